@@ -0,0 +1,225 @@
+#include "benchmark.h"
+
+#include <cstdio>
+#include "mycef.h"
+
+namespace
+{
+
+CefMouseEvent mouse_at(int x, int y, uint32_t modifiers = 0)
+{
+    CefMouseEvent event;
+    event.x = x;
+    event.y = y;
+    event.modifiers = modifiers;
+    return event;
+}
+
+void click(MyApp &app, int x, int y)
+{
+    app.inject_mouse_motion(mouse_at(x, y));
+    app.inject_mouse_up_down(mouse_at(x, y, EVENTFLAG_LEFT_MOUSE_BUTTON), MBT_LEFT, false, 1);
+    app.inject_mouse_up_down(mouse_at(x, y), MBT_LEFT, true, 1);
+}
+
+// Key down, char, key up, like a key press from the view
+void press_key(MyApp &app, int windows_key_code, char16_t character)
+{
+    CefKeyEvent event;
+    event.windows_key_code = windows_key_code;
+    event.character = character;
+    event.unmodified_character = character;
+
+    event.type = KEYEVENT_RAWKEYDOWN;
+    app.inject_key_event(event);
+    if (character)
+    {
+        event.type = KEYEVENT_CHAR;
+        event.windows_key_code = character;
+        app.inject_key_event(event);
+        event.windows_key_code = windows_key_code;
+    }
+    event.type = KEYEVENT_KEYUP;
+    app.inject_key_event(event);
+}
+
+void type_character(MyApp &app, char c)
+{
+    if (c == '\n')
+    {
+        press_key(app, 0x0D, '\r'); // VKEY_RETURN
+        return;
+    }
+    // Letters use their upper case as key code, the rest is close enough
+    int key_code = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+    press_key(app, key_code, static_cast<char16_t>(c));
+}
+
+// Mouse wheel down, then back up, over the middle of the page
+void step_scroll(MyApp &app, int frame)
+{
+    const int kFramesPerDirection = 150;
+    if (frame == 0)
+    {
+        app.inject_mouse_motion(mouse_at(400, 300));
+    }
+    int delta = (frame / kFramesPerDirection) % 2 == 0 ? -120 : 120;
+    app.inject_mouse_wheel(mouse_at(400, 300), 0, delta);
+}
+
+// Steadily down a very long page, a notch every other frame
+void step_long_scroll(MyApp &app, int frame)
+{
+    if (frame == 0)
+    {
+        app.inject_mouse_motion(mouse_at(400, 300));
+    }
+    if (frame % 2 == 0)
+    {
+        app.inject_mouse_wheel(mouse_at(400, 300), 0, -120);
+    }
+}
+
+// Opens the <select> popup, hovers down its options and closes it again
+void step_select_popup(MyApp &app, int frame)
+{
+    const int kCycle = 60;
+    int phase = frame % kCycle;
+    if (phase == 0)
+    {
+        click(app, 160, 56);
+    }
+    else if (phase >= 5 && phase < 50)
+    {
+        // The list opens below the select
+        app.inject_mouse_motion(mouse_at(160, 80 + (phase - 5) * 8));
+    }
+    else if (phase == 50)
+    {
+        press_key(app, 0x1B, 0); // VKEY_ESCAPE
+    }
+}
+
+// A character per frame into the textarea, with an IME composition now and
+// then
+void step_textarea(MyApp &app, int frame)
+{
+    static const char kText[] = "the quick brown fox jumps over the lazy dog\n";
+    static const char *kComposition[] = {"k", "ka", "kan", "kanj", "kanji"};
+    const int kCompositionLength = sizeof(kComposition) / sizeof(kComposition[0]);
+
+    if (frame == 0)
+    {
+        click(app, 200, 100);
+        return;
+    }
+
+    int phase = frame % 100;
+    if (phase >= 80 && phase < 80 + kCompositionLength)
+    {
+        std::string text = kComposition[phase - 80];
+        CefCompositionUnderline underline;
+        underline.range = CefRange(0, static_cast<uint32_t>(text.size()));
+        underline.color = 0xFF000000;
+        underline.background_color = 0;
+        underline.thick = 0;
+        underline.style = CEF_CUS_SOLID;
+        CefRange caret(static_cast<uint32_t>(text.size()), static_cast<uint32_t>(text.size()));
+        app.inject_ime_set_composition(text, {underline}, CefRange::InvalidRange(), caret);
+        return;
+    }
+    if (phase == 80 + kCompositionLength)
+    {
+        app.inject_ime_commit_text("kanji", CefRange::InvalidRange(), 0);
+        return;
+    }
+    type_character(app, kText[frame % (sizeof(kText) - 1)]);
+}
+
+void append_json_string(std::string &out, const std::string &value)
+{
+    out += '"';
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+std::vector<BenchmarkScenario> benchmark_scenarios()
+{
+    std::vector<BenchmarkScenario> scenarios;
+    scenarios.push_back(BenchmarkScenario{"scroll", "scroll.html", 30, 600, step_scroll});
+    scenarios.push_back(BenchmarkScenario{"long_scroll", "long_page.html", 30, 900, step_long_scroll});
+    scenarios.push_back(BenchmarkScenario{"select_popup", "select.html", 30, 300, step_select_popup, true});
+    scenarios.push_back(BenchmarkScenario{"textarea", "textarea.html", 30, 400, step_textarea});
+    // No input, the page animates by itself
+    scenarios.push_back(BenchmarkScenario{"css_animation", "animation.html", 30, 300, nullptr});
+    scenarios.push_back(BenchmarkScenario{"canvas", "canvas.html", 30, 300, nullptr});
+    return scenarios;
+}
+
+std::string benchmark_report_json(const BenchmarkEnvironment &environment, const std::vector<BenchmarkResult> &results)
+{
+    std::string out = "{\n\"version\":" + std::to_string(kBenchmarkReportVersion) + ",\n\"label\":";
+    append_json_string(out, environment.label);
+    out += ",\n\"backend\":";
+    append_json_string(out, environment.backend);
+    out += ",\n\"width\":" + std::to_string(environment.width) +
+           ",\n\"height\":" + std::to_string(environment.height) +
+           ",\n\"target_fps\":" + std::to_string(environment.fps) +
+           ",\n\"scenarios\":[";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult &result = results[i];
+        double seconds = result.duration_us > 0 ? result.duration_us / 1e6 : 0.0;
+        double fps = seconds > 0 ? result.presented_frames / seconds : 0.0;
+        double pixels_per_second = seconds > 0 ? result.painted_pixels / seconds : 0.0;
+
+        out += i ? ",\n{\"name\":" : "\n{\"name\":";
+        append_json_string(out, result.name);
+        out += ",\"fixture\":";
+        append_json_string(out, result.fixture);
+
+        char summary[1024];
+        snprintf(summary, sizeof(summary),
+                 ",\"frames\":%d,\"duration_us\":%lld,\"presented_frames\":%llu,\"fps\":%.1f,"
+                 "\"paints\":%llu,\"popup_paints\":%llu,\"dirty_rects\":%llu,\"dirty_rects_per_paint\":%.2f,"
+                 "\"painted_pixels\":%llu,\"painted_pixels_per_second\":%.0f,"
+                 "\"dirty_bytes\":%llu,\"uploaded_bytes\":%llu,\"upload_ratio\":%.3f,"
+                 "\"scroll_shifts\":%llu,\"scroll_rejected\":%llu,\"moved_bytes\":%llu,"
+                 "\"memory_baseline_bytes\":%llu,\"memory_peak_bytes\":%llu,\"memory_end_bytes\":%llu,\"timing\":",
+                 result.frames, (long long)result.duration_us, (unsigned long long)result.presented_frames, fps,
+                 (unsigned long long)result.paints, (unsigned long long)result.popup_paints,
+                 (unsigned long long)result.dirty_rects,
+                 result.paints + result.popup_paints ? (double)result.dirty_rects / (result.paints + result.popup_paints) : 0.0,
+                 (unsigned long long)result.painted_pixels, pixels_per_second,
+                 (unsigned long long)result.dirty_bytes, (unsigned long long)result.uploaded_bytes,
+                 result.dirty_bytes ? (double)result.uploaded_bytes / result.dirty_bytes : 0.0,
+                 (unsigned long long)result.scroll_shifts, (unsigned long long)result.scroll_rejected,
+                 (unsigned long long)result.moved_bytes, (unsigned long long)result.memory_baseline_bytes,
+                 (unsigned long long)result.memory_peak_bytes, (unsigned long long)result.memory_end_bytes);
+        out += summary;
+        out += result.timing_json.empty() ? std::string("null") : result.timing_json;
+        out += "}";
+    }
+    out += "\n]\n}\n";
+    return out;
+}
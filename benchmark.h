@@ -0,0 +1,69 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class MyApp;
+
+// One scripted run against a page in fixtures/. step() is called at the start
+// of every measured frame, before input is drained, and injects input through
+// MyApp the way the view does.
+struct BenchmarkScenario
+{
+    std::string name;
+    std::string fixture;
+    int warmup_frames = 30;
+    int frames = 300;
+    std::function<void(MyApp &app, int frame)> step; // may be empty
+    // Closes whatever it opens: afterwards the memory ledger has to come
+    // back down to where it was before the first step.
+    bool returns_to_memory_baseline = false;
+};
+
+// Every scenario, in the order they run and are reported in.
+std::vector<BenchmarkScenario> benchmark_scenarios();
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::string fixture;
+    int frames = 0;               // frames ticked
+    int64_t duration_us = 0;
+    uint64_t presented_frames = 0; // frames that showed a new paint
+    uint64_t paints = 0;
+    uint64_t popup_paints = 0;
+    uint64_t dirty_rects = 0;
+    uint64_t painted_pixels = 0;
+    // View uploads: reported dirty vs sent after skipping unchanged tiles
+    uint64_t dirty_bytes = 0;
+    uint64_t uploaded_bytes = 0;
+    // Scrolls handled by moving the view surface (ScrollDetector)
+    uint64_t scroll_shifts = 0;
+    uint64_t scroll_rejected = 0;
+    uint64_t moved_bytes = 0;
+    // MemoryLedger totals after the warmup, at the highest, and at the end
+    size_t memory_baseline_bytes = 0;
+    size_t memory_peak_bytes = 0;
+    size_t memory_end_bytes = 0;
+    std::string timing_json; // FrameTimingRecorder::to_json()
+};
+
+struct BenchmarkEnvironment
+{
+    std::string label; // e.g. the commit, given on the command line
+    std::string backend;
+    int width = 0;
+    int height = 0;
+    int fps = 0;
+};
+
+// Keys and scenarios always come in the same order and rates are rounded,
+// so reports of two commits can be diffed as they are. Bump
+// kBenchmarkReportVersion when the layout changes.
+constexpr int kBenchmarkReportVersion = 4;
+std::string benchmark_report_json(const BenchmarkEnvironment &environment, const std::vector<BenchmarkResult> &results);
+
+#endif // BENCHMARK_H
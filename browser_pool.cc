@@ -0,0 +1,221 @@
+#include "browser_pool.h"
+
+#include <algorithm>
+#include "mycef.h"
+
+BrowserPool::BrowserPool(const BrowserPoolConfig &config)
+    : m_config(config), m_foreground_frame_rate(config.foreground_frame_rate)
+{
+}
+
+BrowserPool::~BrowserPool() = default;
+
+int BrowserPool::add_tab(CefRefPtr<MyClient> client, const std::string &url, bool activate)
+{
+    bool visible = m_tabs.empty() || activate;
+
+    // Until OnAfterCreated the browser can't be told it is hidden; the
+    // handler drops its paints meanwhile.
+    client->m_render_handler->m_visible = visible;
+    client->m_window_hidden = m_window_hidden;
+    client->m_window_frame_rate = m_foreground_frame_rate;
+
+    CefWindowInfo window_info;
+    window_info.SetAsWindowless(nullptr);
+    window_info.external_begin_frame_enabled = true;
+    window_info.shared_texture_enabled = client->m_render_handler->m_accelerated_rendering;
+    window_info.runtime_style = CEF_RUNTIME_STYLE_CHROME;
+
+    CefBrowserSettings browser_settings;
+    browser_settings.windowless_frame_rate = visible ? m_foreground_frame_rate : m_config.background_frame_rate;
+
+    CefBrowserHost::CreateBrowser(window_info, client, url, browser_settings, nullptr, nullptr);
+
+    int tab_id = m_next_id++;
+    m_tabs.push_back(Tab{tab_id, client});
+    if (visible)
+    {
+        if (Tab *previous = find(m_active_id))
+        {
+            hide(*previous);
+        }
+        m_active_id = tab_id;
+    }
+    return tab_id;
+}
+
+bool BrowserPool::activate(int tab_id)
+{
+    Tab *tab = find(tab_id);
+    if (!tab || tab_id == m_active_id)
+        return false;
+
+    if (Tab *previous = find(m_active_id))
+    {
+        hide(*previous);
+    }
+    show(*tab);
+    m_active_id = tab_id;
+    return true;
+}
+
+bool BrowserPool::close_tab(int tab_id)
+{
+    auto it = std::find_if(m_tabs.begin(), m_tabs.end(), [tab_id](const Tab &tab)
+                           { return tab.id == tab_id; });
+    if (it == m_tabs.end() || m_tabs.size() <= 1)
+        return false;
+
+    m_closing.erase(std::remove_if(m_closing.begin(), m_closing.end(), [](const CefRefPtr<MyClient> &client)
+                                   { return client->m_closed; }),
+                    m_closing.end());
+
+    it->client->m_render_handler->m_visible = false;
+    it->client->close_browser(true);
+    m_closing.push_back(it->client);
+
+    size_t index = static_cast<size_t>(it - m_tabs.begin());
+    m_tabs.erase(it);
+    if (tab_id != m_active_id)
+        return false;
+
+    // Like most browsers: the tab to the right, or the new last one
+    Tab &next = m_tabs[std::min(index, m_tabs.size() - 1)];
+    show(next);
+    m_active_id = next.id;
+    return true;
+}
+
+void BrowserPool::close_all(bool force_close)
+{
+    for (Tab &tab : m_tabs)
+    {
+        tab.client->close_browser(force_close);
+        m_closing.push_back(tab.client);
+    }
+    m_tabs.clear();
+    m_active_id = 0;
+}
+
+bool BrowserPool::all_closed() const
+{
+    for (const Tab &tab : m_tabs)
+    {
+        if (!tab.client->m_closed)
+            return false;
+    }
+    for (const CefRefPtr<MyClient> &client : m_closing)
+    {
+        if (!client->m_closed)
+            return false;
+    }
+    return true;
+}
+
+CefRefPtr<MyClient> BrowserPool::active_client() const
+{
+    for (const Tab &tab : m_tabs)
+    {
+        if (tab.id == m_active_id)
+            return tab.client;
+    }
+    return nullptr;
+}
+
+std::vector<BrowserTabInfo> BrowserPool::tabs() const
+{
+    std::vector<BrowserTabInfo> tabs;
+    tabs.reserve(m_tabs.size());
+    for (const Tab &tab : m_tabs)
+    {
+        BrowserTabInfo info;
+        info.id = tab.id;
+        info.title = tab.client->m_title.empty() ? "New Tab" : tab.client->m_title;
+        info.active = tab.id == m_active_id;
+        tabs.push_back(info);
+    }
+    return tabs;
+}
+
+void BrowserPool::update_dimensions(int width, int height, float device_scale_factor)
+{
+    for (Tab &tab : m_tabs)
+    {
+        tab.client->m_render_handler->UpdateDimensions(width, height, device_scale_factor);
+    }
+}
+
+void BrowserPool::set_window_visibility(bool hidden, int frame_rate)
+{
+    bool was_hidden = m_window_hidden;
+    m_window_hidden = hidden;
+    m_foreground_frame_rate = frame_rate;
+    for (Tab &tab : m_tabs)
+    {
+        // For one whose browser is still being created
+        tab.client->m_window_hidden = hidden;
+        tab.client->m_window_frame_rate = frame_rate;
+    }
+
+    Tab *tab = find(m_active_id);
+    CefRefPtr<CefBrowser> browser = tab ? tab->client->get_browser() : nullptr;
+    if (!browser || !browser->IsValid())
+        return;
+
+    CefRefPtr<CefBrowserHost> host = browser->GetHost();
+    host->SetWindowlessFrameRate(frame_rate);
+    if (hidden == was_hidden)
+        return;
+    // The page sees visibilitychange and stops its timers and animations,
+    // like a background tab.
+    host->WasHidden(hidden);
+    if (!hidden)
+    {
+        // A hidden page drops its frames; ask for a whole one
+        host->Invalidate(PET_VIEW);
+    }
+}
+
+void BrowserPool::show(Tab &tab)
+{
+    tab.client->m_render_handler->m_visible = true;
+
+    CefRefPtr<CefBrowser> browser = tab.client->get_browser();
+    if (browser && browser->IsValid())
+    {
+        CefRefPtr<CefBrowserHost> host = browser->GetHost();
+        host->WasHidden(m_window_hidden);
+        host->SetWindowlessFrameRate(m_foreground_frame_rate);
+        // The window may have been resized (or the scale changed) while this
+        // tab was hidden, and the shared surfaces hold another tab's pixels.
+        host->NotifyScreenInfoChanged();
+        host->WasResized();
+        host->Invalidate(PET_VIEW);
+        host->SetFocus(true);
+    }
+}
+
+void BrowserPool::hide(Tab &tab)
+{
+    tab.client->m_render_handler->m_visible = false;
+    tab.client->m_show_context_menu = false;
+
+    CefRefPtr<CefBrowser> browser = tab.client->get_browser();
+    if (browser && browser->IsValid())
+    {
+        CefRefPtr<CefBrowserHost> host = browser->GetHost();
+        host->SetFocus(false);
+        host->WasHidden(true);
+        host->SetWindowlessFrameRate(m_config.background_frame_rate);
+    }
+}
+
+BrowserPool::Tab *BrowserPool::find(int tab_id)
+{
+    for (Tab &tab : m_tabs)
+    {
+        if (tab.id == tab_id)
+            return &tab;
+    }
+    return nullptr;
+}
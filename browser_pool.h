@@ -0,0 +1,84 @@
+#ifndef BROWSER_POOL_H
+#define BROWSER_POOL_H
+
+#include <string>
+#include <vector>
+#include "include/cef_base.h"
+
+class MyClient;
+
+struct BrowserPoolConfig
+{
+    // windowless_frame_rate of the tab on screen and of all the others.
+    // Hidden tabs barely paint at all; the low rate covers the moments
+    // around a switch and anything CEF still schedules for them.
+    int foreground_frame_rate = 60;
+    int background_frame_rate = 1;
+};
+
+struct BrowserTabInfo
+{
+    int id = 0;
+    std::string title;
+    bool active = false;
+};
+
+// The browsers (tabs) of one window. They all share the CEF context and the
+// host's single set of view/popup/composite surfaces: only the active tab is
+// shown, so only its paints are taken. The others are WasHidden() and
+// throttled, and get repainted when they are activated again.
+class BrowserPool
+{
+public:
+    explicit BrowserPool(const BrowserPoolConfig &config = BrowserPoolConfig());
+    ~BrowserPool();
+
+    // Creates the browser for |client| and returns the tab id. The first tab
+    // is always active.
+    int add_tab(CefRefPtr<MyClient> client, const std::string &url, bool activate);
+
+    // Both return true when the active tab changed.
+    bool activate(int tab_id);
+    // The last open tab can only go through close_all().
+    bool close_tab(int tab_id);
+
+    void close_all(bool force_close);
+    bool all_closed() const;
+
+    CefRefPtr<MyClient> active_client() const;
+    int active_tab() const { return m_active_id; }
+    size_t size() const { return m_tabs.size(); }
+    std::vector<BrowserTabInfo> tabs() const;
+
+    // The view size applies to every tab; inactive ones pick it up
+    // (WasResized) when they are shown.
+    void update_dimensions(int width, int height, float device_scale_factor);
+
+    // For the window as a whole: whether the active tab's view can be seen
+    // at all, and the rate it runs at when it can. Tabs activated later
+    // pick it up too.
+    void set_window_visibility(bool hidden, int frame_rate);
+
+private:
+    struct Tab
+    {
+        int id;
+        CefRefPtr<MyClient> client;
+    };
+
+    void show(Tab &tab);
+    void hide(Tab &tab);
+    Tab *find(int tab_id);
+
+    BrowserPoolConfig m_config;
+    std::vector<Tab> m_tabs;
+    // Closed tabs until CEF confirms, so shutdown can wait for them
+    std::vector<CefRefPtr<MyClient>> m_closing;
+    int m_active_id = 0;
+    int m_next_id = 1;
+    // Of the window, see set_window_visibility()
+    bool m_window_hidden = false;
+    int m_foreground_frame_rate;
+};
+
+#endif // BROWSER_POOL_H
@@ -29,22 +29,3 @@ fragment float4 cefFragmentShader(VertexOutput in [[stage_in]],
     float3 texel = tex.sample( s, in.uv ).rgb;
     return float4(texel.x, texel.y, texel.z, 1.0f);
 }
-
-// Popup shader with projection matrix
-vertex VertexOutput
-cefPopupVertexShader(uint vertexID [[vertex_id]],
-                     constant float4 *position [[buffer(0)]],
-                     constant float2 &offset [[buffer(2)]],
-                     constant float4x4 &projection [[buffer(3)]])
-{
-    VertexOutput out;
-
-    // Apply offset to position (position is in pixel coordinates)
-    float2 pixel_pos = float2(position[vertexID][0], position[vertexID][1]) + offset;
-
-    // Transform to NDC using projection matrix
-    out.clip_position = projection * float4(pixel_pos, 0.0, 1.0);
-
-    out.uv = float2(position[vertexID][2], position[vertexID][3]);
-    return out;
-}
\ No newline at end of file
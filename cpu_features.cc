@@ -0,0 +1,63 @@
+#include "cpu_features.h"
+
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHROME_CPU_X86 1
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__arm__))
+#define SHROME_CPU_NEON 1
+#endif
+
+const char *cpu_isa_name(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::Scalar:
+        return "scalar";
+    case CpuIsa::SSE2:
+        return "sse2";
+    case CpuIsa::AVX2:
+        return "avx2";
+    case CpuIsa::NEON:
+        return "neon";
+    }
+    return "unknown";
+}
+
+bool cpu_isa_supported(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::Scalar:
+        return true;
+#if SHROME_CPU_X86
+    case CpuIsa::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case CpuIsa::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#if SHROME_CPU_NEON
+    case CpuIsa::NEON:
+        // Part of the baseline on every ARM target we build for.
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+CpuIsa best_cpu_isa()
+{
+    static const CpuIsa best = []
+    {
+        for (CpuIsa isa : {CpuIsa::AVX2, CpuIsa::NEON, CpuIsa::SSE2})
+        {
+            if (cpu_isa_supported(isa))
+                return isa;
+        }
+        return CpuIsa::Scalar;
+    }();
+    return best;
+}
@@ -0,0 +1,23 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Instruction sets the SIMD row kernels (tile_hash.cc, downscale.cc) come
+// in. Each of those has a variant per ISA and picks the best supported one
+// once, on first use.
+enum class CpuIsa
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON
+};
+
+const char *cpu_isa_name(CpuIsa isa);
+
+// Whether |isa| was compiled in and the CPU we're running on supports it.
+bool cpu_isa_supported(CpuIsa isa);
+
+// The fastest supported ISA, detected once on first use.
+CpuIsa best_cpu_isa();
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,155 @@
+#include "cpu_render_backend.h"
+
+#include <cstring>
+#include <new>
+#include "scroll_detector.h"
+
+CpuRenderBackend::CpuRenderBackend(const SurfacePoolConfig &pool_config)
+    : m_pool(*this, pool_config)
+{
+}
+
+CpuRenderBackend::~CpuRenderBackend()
+{
+    for (auto &entry : m_surfaces)
+    {
+        release(entry.second.lease.allocation, entry.second.lease.key);
+    }
+}
+
+void *CpuRenderBackend::allocate(const SurfaceKey &key)
+{
+    return new (std::nothrow) uint8_t[key.bytes()]();
+}
+
+void CpuRenderBackend::release(void *allocation, const SurfaceKey &)
+{
+    delete[] static_cast<uint8_t *>(allocation);
+}
+
+SurfaceId CpuRenderBackend::create_surface(uint32_t width, uint32_t height, bool render_target)
+{
+    if (width == 0 || height == 0)
+        return kInvalidSurface;
+
+    SurfacePool::Lease lease = m_pool.acquire(render_target ? 1 : 0, width, height);
+    if (!lease.allocation)
+        return kInvalidSurface;
+
+    SurfaceId id = m_next_id++;
+    CpuSurface &surface = m_surfaces[id];
+    surface.width = width;
+    surface.height = height;
+    surface.render_target = render_target;
+    surface.lease = lease;
+    surface.pixels = static_cast<uint8_t *>(lease.allocation);
+    return id;
+}
+
+SurfaceId CpuRenderBackend::import_shared_surface(void *)
+{
+    // Shared GPU surfaces only exist with accelerated paint.
+    return kInvalidSurface;
+}
+
+void CpuRenderBackend::destroy_surface(SurfaceId surface)
+{
+    auto it = m_surfaces.find(surface);
+    if (it == m_surfaces.end())
+        return;
+
+    m_pool.recycle(it->second.lease);
+    m_surfaces.erase(it);
+    if (m_presented == surface)
+    {
+        m_presented = kInvalidSurface;
+    }
+}
+
+bool CpuRenderBackend::get_surface_size(SurfaceId surface, uint32_t &width, uint32_t &height) const
+{
+    const CpuSurface *s = this->surface(surface);
+    if (!s)
+        return false;
+    width = s->width;
+    height = s->height;
+    return true;
+}
+
+void CpuRenderBackend::surface_uv_extent(SurfaceId surface, float &u, float &v) const
+{
+    const CpuSurface *s = this->surface(surface);
+    u = s ? static_cast<float>(s->width) / s->lease.key.width : 1.0f;
+    v = s ? static_cast<float>(s->height) / s->lease.key.height : 1.0f;
+}
+
+size_t CpuRenderBackend::surface_bytes(SurfaceId surface) const
+{
+    const CpuSurface *s = this->surface(surface);
+    return s ? s->lease.key.bytes() : 0;
+}
+
+void CpuRenderBackend::upload_region(SurfaceId surface, const PixelRect &rect, const void *pixels, size_t bytes_per_row)
+{
+    CpuSurface *s = find(surface);
+    if (!s)
+        return;
+
+    PixelRect bounds{0, 0, static_cast<int>(s->width), static_cast<int>(s->height)};
+    PixelRect clipped = intersect_rects(rect, bounds);
+    if (clipped.empty())
+        return;
+
+    const uint8_t *src = static_cast<const uint8_t *>(pixels) +
+                         (clipped.y - rect.y) * bytes_per_row + (clipped.x - rect.x) * 4;
+    size_t row_bytes = static_cast<size_t>(clipped.width) * 4;
+    for (int row = 0; row < clipped.height; ++row)
+    {
+        memcpy(s->pixels + (clipped.y + row) * s->stride() + clipped.x * 4, src + row * bytes_per_row, row_bytes);
+    }
+
+    m_stats.uploads++;
+    m_stats.uploaded_bytes += row_bytes * clipped.height;
+}
+
+bool CpuRenderBackend::move_region(SurfaceId surface, const PixelRect &source, int dx, int dy)
+{
+    CpuSurface *s = find(surface);
+    if (!s)
+        return false;
+
+    // Keep both the source and where it goes inside the surface
+    PixelRect bounds{0, 0, static_cast<int>(s->width), static_cast<int>(s->height)};
+    PixelRect clipped = intersect_rects(intersect_rects(source, bounds),
+                                        PixelRect{bounds.x - dx, bounds.y - dy, bounds.width, bounds.height});
+    if (!clipped.empty())
+    {
+        move_pixels(s->pixels, s->stride(), clipped, ScrollShift{dx, dy});
+        m_stats.moves++;
+        m_stats.moved_bytes += clipped.area() * 4;
+    }
+    return true;
+}
+
+void *CpuRenderBackend::present(SurfaceId surface)
+{
+    CpuSurface *s = find(surface);
+    if (!s)
+        return nullptr;
+
+    m_presented = surface;
+    m_stats.presents++;
+    return s->pixels;
+}
+
+const CpuSurface *CpuRenderBackend::surface(SurfaceId surface) const
+{
+    auto it = m_surfaces.find(surface);
+    return it == m_surfaces.end() ? nullptr : &it->second;
+}
+
+CpuSurface *CpuRenderBackend::find(SurfaceId surface)
+{
+    auto it = m_surfaces.find(surface);
+    return it == m_surfaces.end() ? nullptr : &it->second;
+}
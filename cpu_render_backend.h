@@ -0,0 +1,72 @@
+#ifndef CPU_RENDER_BACKEND_H
+#define CPU_RENDER_BACKEND_H
+
+#include <unordered_map>
+#include "render_backend.h"
+
+struct CpuSurface
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool render_target = false;
+    SurfacePool::Lease lease; // at least width x height
+    uint8_t *pixels = nullptr; // BGRA8, stride() bytes per row
+
+    size_t stride() const { return static_cast<size_t>(lease.key.width) * 4; }
+};
+
+struct CpuRenderStats
+{
+    uint64_t uploads = 0;
+    uint64_t uploaded_bytes = 0;
+    uint64_t moves = 0;
+    uint64_t moved_bytes = 0;
+    uint64_t presents = 0;
+};
+
+// Software implementation of RenderBackend. present() hands out the surface's
+// pixel memory, stride() bytes per row.
+//
+// Surface memory comes from a SurfacePool, so repeated resizes reuse buffers.
+class CpuRenderBackend : public RenderBackend, private SurfaceAllocator
+{
+public:
+    explicit CpuRenderBackend(const SurfacePoolConfig &pool_config = SurfacePoolConfig());
+    ~CpuRenderBackend() override;
+
+    const char *name() const override { return "cpu"; }
+
+    SurfaceId create_surface(uint32_t width, uint32_t height, bool render_target) override;
+    SurfaceId import_shared_surface(void *shared_handle) override;
+    void destroy_surface(SurfaceId surface) override;
+    bool get_surface_size(SurfaceId surface, uint32_t &width, uint32_t &height) const override;
+    void surface_uv_extent(SurfaceId surface, float &u, float &v) const override;
+    const SurfacePoolStats *surface_pool_stats() const override { return &m_pool.stats(); }
+    size_t surface_bytes(SurfaceId surface) const override;
+    void release_idle_memory() override { m_pool.trim(m_pool.stats().in_use_bytes); }
+
+    void upload_region(SurfaceId surface, const PixelRect &rect, const void *pixels, size_t bytes_per_row) override;
+    bool move_region(SurfaceId surface, const PixelRect &source, int dx, int dy) override;
+
+    void *present(SurfaceId surface) override;
+
+    // Read access for benchmarks and comparisons.
+    const CpuSurface *surface(SurfaceId surface) const;
+    SurfaceId presented_surface() const { return m_presented; }
+    const CpuRenderStats &stats() const { return m_stats; }
+
+private:
+    CpuSurface *find(SurfaceId surface);
+
+    // SurfaceAllocator
+    void *allocate(const SurfaceKey &key) override;
+    void release(void *allocation, const SurfaceKey &key) override;
+
+    SurfacePool m_pool;
+    std::unordered_map<SurfaceId, CpuSurface> m_surfaces;
+    SurfaceId m_next_id = 1;
+    SurfaceId m_presented = kInvalidSurface;
+    CpuRenderStats m_stats;
+};
+
+#endif // CPU_RENDER_BACKEND_H
@@ -0,0 +1,329 @@
+#include "dirty_region.h"
+
+#include <algorithm>
+
+PixelRect intersect_rects(const PixelRect &a, const PixelRect &b)
+{
+    int left = std::max(a.x, b.x);
+    int top = std::max(a.y, b.y);
+    int right = std::min(a.right(), b.right());
+    int bottom = std::min(a.bottom(), b.bottom());
+    if (right <= left || bottom <= top)
+    {
+        return PixelRect();
+    }
+    return PixelRect{left, top, right - left, bottom - top};
+}
+
+PixelRect bounding_rect(const PixelRect &a, const PixelRect &b)
+{
+    if (a.empty())
+        return b;
+    if (b.empty())
+        return a;
+
+    int left = std::min(a.x, b.x);
+    int top = std::min(a.y, b.y);
+    int right = std::max(a.right(), b.right());
+    int bottom = std::max(a.bottom(), b.bottom());
+    return PixelRect{left, top, right - left, bottom - top};
+}
+
+void DirtyRegion::add(const PixelRect &rect)
+{
+    if (rect.empty())
+        return;
+
+    m_rects.push_back(rect);
+    m_normalized = m_rects.size() == 1;
+}
+
+void DirtyRegion::add(const DirtyRegion &region)
+{
+    for (const auto &rect : region.rects())
+    {
+        add(rect);
+    }
+}
+
+void DirtyRegion::clip(const PixelRect &bounds)
+{
+    std::vector<PixelRect> clipped;
+    clipped.reserve(m_rects.size());
+    for (const auto &rect : m_rects)
+    {
+        PixelRect r = intersect_rects(rect, bounds);
+        if (!r.empty())
+        {
+            clipped.push_back(r);
+        }
+    }
+    m_rects.swap(clipped);
+    m_normalized = m_rects.size() <= 1;
+}
+
+void DirtyRegion::clear()
+{
+    m_rects.clear();
+    m_normalized = true;
+}
+
+bool DirtyRegion::empty() const
+{
+    return m_rects.empty();
+}
+
+const std::vector<PixelRect> &DirtyRegion::rects() const
+{
+    normalize();
+    return m_rects;
+}
+
+PixelRect DirtyRegion::bounds() const
+{
+    PixelRect result;
+    for (const auto &rect : m_rects)
+    {
+        result = bounding_rect(result, rect);
+    }
+    return result;
+}
+
+int64_t DirtyRegion::area() const
+{
+    int64_t total = 0;
+    for (const auto &rect : rects())
+    {
+        total += rect.area();
+    }
+    return total;
+}
+
+void DirtyRegion::normalize() const
+{
+    if (m_normalized)
+        return;
+    m_normalized = true;
+
+    // Every distinct top/bottom edge starts a new band.
+    std::vector<int> edges;
+    edges.reserve(m_rects.size() * 2);
+    for (const auto &rect : m_rects)
+    {
+        edges.push_back(rect.y);
+        edges.push_back(rect.bottom());
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::vector<PixelRect> result;
+    std::vector<std::pair<int, int>> spans;
+    std::vector<std::pair<int, int>> merged;
+    size_t previous_band_begin = 0;
+    size_t previous_band_end = 0;
+
+    for (size_t i = 0; i + 1 < edges.size(); ++i)
+    {
+        int band_top = edges[i];
+        int band_bottom = edges[i + 1];
+
+        spans.clear();
+        for (const auto &rect : m_rects)
+        {
+            if (rect.y <= band_top && rect.bottom() >= band_bottom)
+            {
+                spans.push_back({rect.x, rect.right()});
+            }
+        }
+        if (spans.empty())
+            continue;
+
+        // Union the spans of this band, joining touching ones as well.
+        std::sort(spans.begin(), spans.end());
+        merged.clear();
+        for (const auto &span : spans)
+        {
+            if (!merged.empty() && span.first <= merged.back().second)
+            {
+                merged.back().second = std::max(merged.back().second, span.second);
+            }
+            else
+            {
+                merged.push_back(span);
+            }
+        }
+
+        // If the band directly above has exactly the same spans, grow it
+        // downwards instead of starting a new band.
+        bool same_as_previous = previous_band_end > previous_band_begin &&
+                                result[previous_band_begin].bottom() == band_top &&
+                                previous_band_end - previous_band_begin == merged.size();
+        for (size_t k = 0; same_as_previous && k < merged.size(); ++k)
+        {
+            const PixelRect &above = result[previous_band_begin + k];
+            same_as_previous = above.x == merged[k].first && above.right() == merged[k].second;
+        }
+
+        if (same_as_previous)
+        {
+            for (size_t k = previous_band_begin; k < previous_band_end; ++k)
+            {
+                result[k].height = band_bottom - result[k].y;
+            }
+        }
+        else
+        {
+            previous_band_begin = result.size();
+            for (const auto &span : merged)
+            {
+                result.push_back(PixelRect{span.first, band_top, span.second - span.first, band_bottom - band_top});
+            }
+            previous_band_end = result.size();
+        }
+    }
+
+    m_rects.swap(result);
+}
+
+const char *upload_strategy_name(UploadStrategy strategy)
+{
+    switch (strategy)
+    {
+    case UploadStrategy::None:
+        return "none";
+    case UploadStrategy::Rects:
+        return "rects";
+    case UploadStrategy::BoundingBox:
+        return "bounding_box";
+    case UploadStrategy::FullFrame:
+        return "full_frame";
+    }
+    return "unknown";
+}
+
+int64_t upload_cost(const PixelRect &rect, int surface_width, const UploadCostModel &model)
+{
+    if (rect.empty())
+        return 0;
+
+    // A rect spanning the full width is one contiguous copy.
+    int64_t rows = rect.width >= surface_width ? 1 : rect.height;
+    return model.per_upload_overhead_bytes +
+           rows * model.per_row_overhead_bytes +
+           rect.area() * model.bytes_per_pixel;
+}
+
+// Above this many rects, plan_upload() folds neighbours before merging
+// pairwise.
+static constexpr size_t kMaxGreedyRects = 32;
+
+static bool cheaper_joined(const PixelRect &a, const PixelRect &b, int surface_width, const UploadCostModel &model)
+{
+    return upload_cost(bounding_rect(a, b), surface_width, model) <=
+           upload_cost(a, surface_width, model) + upload_cost(b, surface_width, model);
+}
+
+UploadPlan plan_upload(const DirtyRegion &region, int surface_width, int surface_height,
+                       const UploadCostModel &model)
+{
+    UploadPlan plan;
+    PixelRect surface{0, 0, surface_width, surface_height};
+
+    DirtyRegion clipped = region;
+    clipped.clip(surface);
+    plan.input_rects = clipped.rects().size();
+    if (clipped.empty())
+    {
+        return plan;
+    }
+
+    // Greedily merge pairs of rects while uploading their bounding box is
+    // cheaper than uploading both. This is what folds rows of tiny rects
+    // (tickers, blinking carets next to each other) into single uploads.
+    // Pairwise merging is quadratic per pass, so the rects are first merged
+    // with their left neighbour in the same band, which is where most merges
+    // happen, and what is still left past kMaxGreedyRects is folded in y
+    // order.
+    std::vector<PixelRect> rects;
+    rects.reserve(clipped.rects().size());
+    for (const PixelRect &rect : clipped.rects())
+    {
+        if (!rects.empty() && rects.back().y == rect.y && rects.back().height == rect.height &&
+            cheaper_joined(rects.back(), rect, surface_width, model))
+        {
+            rects.back() = bounding_rect(rects.back(), rect);
+        }
+        else
+        {
+            rects.push_back(rect);
+        }
+    }
+    while (rects.size() > kMaxGreedyRects)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < rects.size(); i += 2)
+        {
+            rects[kept++] = i + 1 < rects.size() ? bounding_rect(rects[i], rects[i + 1]) : rects[i];
+        }
+        rects.resize(kept);
+    }
+
+    // Rects that grew can merge with ones they were checked against before,
+    // so passes repeat until nothing changes.
+    bool merged_any = true;
+    while (merged_any && rects.size() > 1)
+    {
+        merged_any = false;
+        for (size_t i = 0; i < rects.size(); ++i)
+        {
+            for (size_t j = i + 1; j < rects.size();)
+            {
+                if (cheaper_joined(rects[i], rects[j], surface_width, model))
+                {
+                    rects[i] = bounding_rect(rects[i], rects[j]);
+                    rects.erase(rects.begin() + j);
+                    merged_any = true;
+                }
+                else
+                {
+                    ++j;
+                }
+            }
+        }
+    }
+
+    int64_t rects_cost = 0;
+    int64_t rects_bytes = 0;
+    for (const auto &rect : rects)
+    {
+        rects_cost += upload_cost(rect, surface_width, model);
+        rects_bytes += rect.area() * model.bytes_per_pixel;
+    }
+
+    PixelRect box = clipped.bounds();
+    int64_t box_cost = upload_cost(box, surface_width, model);
+    int64_t full_cost = upload_cost(surface, surface_width, model);
+
+    if (full_cost <= box_cost && full_cost <= rects_cost)
+    {
+        plan.strategy = UploadStrategy::FullFrame;
+        plan.rects.push_back(surface);
+        plan.cost = full_cost;
+        plan.bytes = surface.area() * model.bytes_per_pixel;
+    }
+    else if (box_cost <= rects_cost)
+    {
+        plan.strategy = UploadStrategy::BoundingBox;
+        plan.rects.push_back(box);
+        plan.cost = box_cost;
+        plan.bytes = box.area() * model.bytes_per_pixel;
+    }
+    else
+    {
+        plan.strategy = UploadStrategy::Rects;
+        plan.rects = std::move(rects);
+        plan.cost = rects_cost;
+        plan.bytes = rects_bytes;
+    }
+    return plan;
+}
@@ -0,0 +1,96 @@
+#ifndef DIRTY_REGION_H
+#define DIRTY_REGION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Plain pixel rectangle. Kept free of CEF/Metal types so the region code can be
+// used (and profiled) anywhere.
+struct PixelRect
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+    int right() const { return x + width; }
+    int bottom() const { return y + height; }
+    int64_t area() const { return empty() ? 0 : static_cast<int64_t>(width) * height; }
+    bool contains(int px, int py) const { return px >= x && px < right() && py >= y && py < bottom(); }
+
+    bool operator==(const PixelRect &other) const
+    {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+    bool operator!=(const PixelRect &other) const { return !(*this == other); }
+};
+
+PixelRect intersect_rects(const PixelRect &a, const PixelRect &b);
+PixelRect bounding_rect(const PixelRect &a, const PixelRect &b);
+
+// A set of pixels described as non-overlapping rectangles.
+// Rects are added in any order (overlapping, adjacent, duplicated) and are
+// normalized lazily into y-x bands: every returned rect belongs to a band
+// sharing the same top/bottom, bands are sorted top to bottom and rects inside
+// a band left to right. Vertically adjacent bands with identical spans are
+// merged, so a plain rectangle always comes back as a single rect.
+class DirtyRegion
+{
+public:
+    void add(const PixelRect &rect);
+    void add(const DirtyRegion &region);
+    void clip(const PixelRect &bounds);
+    void clear();
+
+    bool empty() const;
+    const std::vector<PixelRect> &rects() const;
+    PixelRect bounds() const;
+    int64_t area() const;
+
+private:
+    void normalize() const;
+
+    mutable std::vector<PixelRect> m_rects;
+    mutable bool m_normalized = true;
+};
+
+enum class UploadStrategy
+{
+    None,        // nothing to upload
+    Rects,       // one upload per (possibly merged) rect
+    BoundingBox, // a single upload covering the bounds of the damage
+    FullFrame    // the whole surface in one contiguous upload
+};
+
+const char *upload_strategy_name(UploadStrategy strategy);
+
+// Rough cost of an upload, in "bytes equivalent". Every upload call pays a
+// fixed overhead, every row that is not contiguous with the next one pays a
+// smaller one (replaceRegion has to do a copy per row unless the rect spans
+// the full width), plus the bytes themselves.
+struct UploadCostModel
+{
+    int64_t per_upload_overhead_bytes = 32 * 1024;
+    int64_t per_row_overhead_bytes = 64;
+    int bytes_per_pixel = 4;
+};
+
+struct UploadPlan
+{
+    UploadStrategy strategy = UploadStrategy::None;
+    std::vector<PixelRect> rects;
+    int64_t cost = 0;
+    int64_t bytes = 0;
+    size_t input_rects = 0;
+};
+
+int64_t upload_cost(const PixelRect &rect, int surface_width, const UploadCostModel &model);
+
+// Picks between uploading the (greedily merged) rects of |region|, its
+// bounding box, or the full |surface_width| x |surface_height| frame.
+UploadPlan plan_upload(const DirtyRegion &region, int surface_width, int surface_height,
+                       const UploadCostModel &model = UploadCostModel());
+
+#endif // DIRTY_REGION_H
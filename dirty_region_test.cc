@@ -0,0 +1,295 @@
+#include <cstdio>
+#include <ostream>
+#include <random>
+#include "dirty_region.h"
+#include "unit_test.h"
+
+std::ostream &operator<<(std::ostream &out, const PixelRect &rect)
+{
+    return out << "{" << rect.x << "," << rect.y << " " << rect.width << "x" << rect.height << "}";
+}
+
+namespace
+{
+
+const int kSurface = 1000;
+
+int64_t cost(const PixelRect &rect)
+{
+    return upload_cost(rect, kSurface, UploadCostModel());
+}
+
+} // namespace
+
+TEST(region_plain_rect_stays_one)
+{
+    DirtyRegion region;
+    region.add(PixelRect{10, 20, 30, 40});
+    region.add(PixelRect{10, 20, 30, 40});
+    region.add(PixelRect{15, 25, 5, 5});
+    EXPECT_EQ(region.rects().size(), 1u);
+    EXPECT_EQ(region.rects()[0], (PixelRect{10, 20, 30, 40}));
+}
+
+TEST(region_splits_overlaps_into_bands)
+{
+    // Two squares overlapping at a corner: above the overlap, through it,
+    // below it.
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 20, 20});
+    region.add(PixelRect{10, 10, 20, 20});
+    const std::vector<PixelRect> &rects = region.rects();
+    EXPECT_EQ(rects.size(), 3u);
+    if (rects.size() == 3)
+    {
+        EXPECT_EQ(rects[0], (PixelRect{0, 0, 20, 10}));
+        EXPECT_EQ(rects[1], (PixelRect{0, 10, 30, 10}));
+        EXPECT_EQ(rects[2], (PixelRect{10, 20, 20, 10}));
+    }
+    EXPECT_EQ(region.area(), 700);
+    EXPECT_EQ(region.bounds(), (PixelRect{0, 0, 30, 30}));
+}
+
+TEST(region_bands_are_sorted_and_disjoint)
+{
+    DirtyRegion region;
+    region.add(PixelRect{50, 40, 10, 10});
+    region.add(PixelRect{0, 40, 10, 10});
+    region.add(PixelRect{20, 0, 10, 10});
+    const std::vector<PixelRect> &rects = region.rects();
+    EXPECT_EQ(rects.size(), 3u);
+    if (rects.size() == 3)
+    {
+        EXPECT_EQ(rects[0], (PixelRect{20, 0, 10, 10}));
+        EXPECT_EQ(rects[1], (PixelRect{0, 40, 10, 10}));
+        EXPECT_EQ(rects[2], (PixelRect{50, 40, 10, 10}));
+    }
+}
+
+TEST(region_joins_touching_rects)
+{
+    // Side by side in one band, then stacked with the same span
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 10, 10});
+    region.add(PixelRect{10, 0, 10, 10});
+    region.add(PixelRect{0, 10, 20, 10});
+    EXPECT_EQ(region.rects().size(), 1u);
+    EXPECT_EQ(region.rects()[0], (PixelRect{0, 0, 20, 20}));
+}
+
+TEST(region_ignores_empty_rects)
+{
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 0, 10});
+    region.add(PixelRect{0, 0, 10, -1});
+    EXPECT(region.empty());
+    EXPECT_EQ(region.area(), 0);
+}
+
+TEST(region_clip)
+{
+    DirtyRegion region;
+    region.add(PixelRect{-10, -10, 30, 30});
+    region.add(PixelRect{90, 90, 20, 20});
+    region.add(PixelRect{200, 200, 10, 10});
+    region.clip(PixelRect{0, 0, 100, 100});
+    const std::vector<PixelRect> &rects = region.rects();
+    EXPECT_EQ(rects.size(), 2u);
+    if (rects.size() == 2)
+    {
+        EXPECT_EQ(rects[0], (PixelRect{0, 0, 20, 20}));
+        EXPECT_EQ(rects[1], (PixelRect{90, 90, 10, 10}));
+    }
+    EXPECT_EQ(region.area(), 500);
+
+    region.clip(PixelRect{300, 300, 10, 10});
+    EXPECT(region.empty());
+}
+
+TEST(region_area_counts_overlaps_once)
+{
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 10, 10});
+    region.add(PixelRect{5, 0, 10, 10});
+    region.add(PixelRect{0, 0, 10, 10});
+    EXPECT_EQ(region.area(), 150);
+
+    DirtyRegion other;
+    other.add(PixelRect{100, 100, 1, 1});
+    region.add(other);
+    EXPECT_EQ(region.area(), 151);
+}
+
+TEST(plan_upload_nothing)
+{
+    DirtyRegion region;
+    EXPECT(plan_upload(region, kSurface, kSurface).strategy == UploadStrategy::None);
+
+    region.add(PixelRect{kSurface, 0, 10, 10});
+    UploadPlan plan = plan_upload(region, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::None);
+    EXPECT(plan.rects.empty());
+}
+
+TEST(plan_upload_merges_close_pair)
+{
+    // The two carets next to each other are cheaper as one upload; the far
+    // one stays apart.
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 10, 10});
+    region.add(PixelRect{20, 0, 10, 10});
+    region.add(PixelRect{900, 900, 10, 10});
+    UploadPlan plan = plan_upload(region, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::Rects);
+    EXPECT_EQ(plan.input_rects, 3u);
+    EXPECT_EQ(plan.rects.size(), 2u);
+    if (plan.rects.size() == 2)
+    {
+        EXPECT_EQ(plan.rects[0], (PixelRect{0, 0, 30, 10}));
+        EXPECT_EQ(plan.rects[1], (PixelRect{900, 900, 10, 10}));
+    }
+    EXPECT_EQ(plan.cost, cost(PixelRect{0, 0, 30, 10}) + cost(PixelRect{900, 900, 10, 10}));
+    EXPECT_EQ(plan.bytes, (300 + 100) * 4);
+}
+
+TEST(plan_upload_keeps_distant_rects_apart)
+{
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 10, 10});
+    region.add(PixelRect{900, 900, 10, 10});
+    UploadPlan plan = plan_upload(region, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::Rects);
+    EXPECT_EQ(plan.rects.size(), 2u);
+    EXPECT_EQ(plan.cost, 2 * cost(PixelRect{0, 0, 10, 10}));
+}
+
+TEST(plan_upload_bounding_box)
+{
+    // A checkerboard of small squares: the gaps cost less than the upload
+    // overhead of each square.
+    DirtyRegion region;
+    region.add(PixelRect{100, 100, 40, 40});
+    region.add(PixelRect{180, 100, 40, 40});
+    region.add(PixelRect{100, 180, 40, 40});
+    region.add(PixelRect{180, 180, 40, 40});
+    UploadPlan plan = plan_upload(region, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::BoundingBox);
+    EXPECT_EQ(plan.input_rects, 4u);
+    EXPECT_EQ(plan.rects.size(), 1u);
+    if (plan.rects.size() == 1)
+        EXPECT_EQ(plan.rects[0], (PixelRect{100, 100, 120, 120}));
+    EXPECT(plan.cost < 4 * cost(PixelRect{100, 100, 40, 40}));
+}
+
+TEST(plan_upload_full_frame_threshold)
+{
+    // Full width rows are one contiguous copy. A rect almost as wide as the
+    // surface pays a row overhead per row and loses to the whole frame once
+    // that overhead outweighs the bytes it saves: 64 bytes a row against 4
+    // a missing pixel puts the break-even at 16 pixels short of the width.
+    DirtyRegion wide;
+    wide.add(PixelRect{0, 0, kSurface - 10, kSurface});
+    UploadPlan plan = plan_upload(wide, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::FullFrame);
+    if (plan.rects.size() == 1)
+        EXPECT_EQ(plan.rects[0], (PixelRect{0, 0, kSurface, kSurface}));
+    EXPECT_EQ(plan.bytes, static_cast<int64_t>(kSurface) * kSurface * 4);
+
+    DirtyRegion narrower;
+    narrower.add(PixelRect{0, 0, kSurface - 20, kSurface});
+    plan = plan_upload(narrower, kSurface, kSurface);
+    EXPECT(plan.strategy == UploadStrategy::BoundingBox);
+    EXPECT_EQ(plan.cost, cost(PixelRect{0, 0, kSurface - 20, kSurface}));
+
+    // Right at the break-even
+    DirtyRegion last_box;
+    last_box.add(PixelRect{0, 0, kSurface - 16, kSurface});
+    EXPECT(plan_upload(last_box, kSurface, kSurface).strategy == UploadStrategy::BoundingBox);
+    DirtyRegion first_full;
+    first_full.add(PixelRect{0, 0, kSurface - 15, kSurface});
+    EXPECT(plan_upload(first_full, kSurface, kSurface).strategy == UploadStrategy::FullFrame);
+}
+
+TEST(plan_upload_respects_cost_model)
+{
+    // Without per-upload overhead nothing is worth merging.
+    UploadCostModel model;
+    model.per_upload_overhead_bytes = 0;
+    model.per_row_overhead_bytes = 0;
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, 10, 10});
+    region.add(PixelRect{20, 0, 10, 10});
+    UploadPlan plan = plan_upload(region, kSurface, kSurface, model);
+    EXPECT(plan.strategy == UploadStrategy::Rects);
+    EXPECT_EQ(plan.rects.size(), 2u);
+}
+
+TEST(plan_upload_caps_many_rects)
+{
+    // A diagonal of squares, each in a band of its own and not worth merging
+    // with the cost model, still comes out as a bounded number of uploads
+    // that cover all of them.
+    UploadCostModel model;
+    model.per_upload_overhead_bytes = 0;
+    model.per_row_overhead_bytes = 0;
+    DirtyRegion region;
+    for (int i = 0; i < 200; ++i)
+    {
+        region.add(PixelRect{i * 5, i * 5, 2, 2});
+    }
+    UploadPlan plan = plan_upload(region, kSurface, kSurface, model);
+    EXPECT_EQ(plan.input_rects, 200u);
+    EXPECT(!plan.rects.empty());
+    EXPECT(plan.rects.size() <= 32);
+    bool covered = true;
+    for (const PixelRect &rect : region.rects())
+    {
+        bool inside = false;
+        for (const PixelRect &upload : plan.rects)
+        {
+            inside = inside || (rect.x >= upload.x && rect.y >= upload.y && rect.right() <= upload.right() &&
+                                rect.bottom() <= upload.bottom());
+        }
+        covered = covered && inside;
+    }
+    EXPECT(covered);
+}
+
+BENCHMARK(region)
+{
+    // Typical damage of a busy page: a few dozen small rects, some
+    // overlapping, planned against a 2560x1440 surface.
+    std::mt19937 rng(1);
+    const int frames = 500;
+    std::vector<std::vector<PixelRect>> inputs(frames);
+    for (auto &rects : inputs)
+    {
+        int count = 8 + static_cast<int>(rng() % 40);
+        for (int i = 0; i < count; ++i)
+        {
+            rects.push_back(PixelRect{static_cast<int>(rng() % 2400), static_cast<int>(rng() % 1300),
+                                      8 + static_cast<int>(rng() % 150), 8 + static_cast<int>(rng() % 100)});
+        }
+    }
+
+    int64_t normalize_ns = 0;
+    int64_t plan_ns = 0;
+    size_t planned_rects = 0;
+    for (const auto &rects : inputs)
+    {
+        int64_t start = unit_test_now_ns();
+        DirtyRegion region;
+        for (const PixelRect &rect : rects)
+        {
+            region.add(rect);
+        }
+        planned_rects += region.rects().size();
+        int64_t normalized = unit_test_now_ns();
+        UploadPlan plan = plan_upload(region, 2560, 1440);
+        planned_rects += plan.rects.size();
+        plan_ns += unit_test_now_ns() - normalized;
+        normalize_ns += normalized - start;
+    }
+    printf("region: normalize %.1f us, plan_upload %.1f us per frame (%d frames, %zu rects)\n",
+           normalize_ns / 1000.0 / frames, plan_ns / 1000.0 / frames, frames, planned_rects);
+}
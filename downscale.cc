@@ -0,0 +1,209 @@
+#include "downscale.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHROME_MIP_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__arm__))
+#define SHROME_MIP_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Sums of four 8 bit values plus the rounding term stay below 1023, so the
+// vector variants can add in 16 bit lanes.
+
+void mip_row_scalar(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t dst_pixels)
+{
+    for (size_t i = 0; i < dst_pixels; ++i, dst += 4, row0 += 8, row1 += 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            dst[c] = static_cast<uint8_t>((row0[c] + row0[c + 4] + row1[c] + row1[c + 4] + 2) >> 2);
+        }
+    }
+}
+
+#if SHROME_MIP_X86
+
+// Four source pixels of each row (16 bit lanes, vertical sums already
+// taken in |s01| and |s23|) to two destination pixels.
+static inline __m128i mip_2px_sse2(__m128i s01, __m128i s23)
+{
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+static void mip_row_sse2(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t dst_pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= dst_pixels; i += 4)
+    {
+        const uint8_t *a = row0 + i * 8;
+        const uint8_t *b = row1 + i * 8;
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 16));
+
+        __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                         _mm_packus_epi16(mip_2px_sse2(s01, s23), mip_2px_sse2(s45, s67)));
+    }
+
+    mip_row_scalar(dst + i * 4, row0 + i * 8, row1 + i * 8, dst_pixels - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i mip_4px_avx2(__m256i s_lo, __m256i s_hi)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(s_lo, s_hi), _mm256_unpackhi_epi64(s_lo, s_hi));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+__attribute__((target("avx2"))) static void mip_row_avx2(uint8_t *dst, const uint8_t *row0, const uint8_t *row1,
+                                                         size_t dst_pixels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= dst_pixels; i += 8)
+    {
+        const uint8_t *a = row0 + i * 8;
+        const uint8_t *b = row1 + i * 8;
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + 32));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 32));
+
+        // Unpacking stays inside 128 bit lanes, so each result holds
+        // destination pixels 0, 1 | 2, 3 of its 8 source pixels
+        __m256i d03 = mip_4px_avx2(_mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero)),
+                                   _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero)));
+        __m256i d47 = mip_4px_avx2(_mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero)),
+                                   _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero)));
+
+        // Packing interleaves the lanes to 0 1 4 5 | 2 3 6 7
+        __m256i packed = _mm256_packus_epi16(d03, d47);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                            _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    mip_row_sse2(dst + i * 4, row0 + i * 8, row1 + i * 8, dst_pixels - i);
+}
+
+#endif // SHROME_MIP_X86
+
+#if SHROME_MIP_NEON
+
+static void mip_row_neon(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t dst_pixels)
+{
+    size_t i = 0;
+    for (; i + 4 <= dst_pixels; i += 4)
+    {
+        // Even and odd source pixels apart
+        uint32x4x2_t a = vld2q_u32(reinterpret_cast<const uint32_t *>(row0 + i * 8));
+        uint32x4x2_t b = vld2q_u32(reinterpret_cast<const uint32_t *>(row1 + i * 8));
+        uint8x16_t a_even = vreinterpretq_u8_u32(a.val[0]);
+        uint8x16_t a_odd = vreinterpretq_u8_u32(a.val[1]);
+        uint8x16_t b_even = vreinterpretq_u8_u32(b.val[0]);
+        uint8x16_t b_odd = vreinterpretq_u8_u32(b.val[1]);
+
+        uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a_even), vget_low_u8(a_odd)),
+                                  vaddl_u8(vget_low_u8(b_even), vget_low_u8(b_odd)));
+        uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a_even), vget_high_u8(a_odd)),
+                                  vaddl_u8(vget_high_u8(b_even), vget_high_u8(b_odd)));
+        // Rounding shift: (x + 2) >> 2
+        vst1q_u8(dst + i * 4, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+
+    mip_row_scalar(dst + i * 4, row0 + i * 8, row1 + i * 8, dst_pixels - i);
+}
+
+#endif // SHROME_MIP_NEON
+
+MipRowFn mip_row_function(CpuIsa isa)
+{
+    if (!cpu_isa_supported(isa))
+        return nullptr;
+
+    switch (isa)
+    {
+#if SHROME_MIP_X86
+    case CpuIsa::SSE2:
+        return mip_row_sse2;
+    case CpuIsa::AVX2:
+        return mip_row_avx2;
+#endif
+#if SHROME_MIP_NEON
+    case CpuIsa::NEON:
+        return mip_row_neon;
+#endif
+    default:
+        return mip_row_scalar;
+    }
+}
+
+MipRowFn mip_row()
+{
+    static const MipRowFn fn = mip_row_function(best_cpu_isa());
+    return fn;
+}
+
+void downscale_rect(const uint8_t *src, size_t src_stride, int width, int height, int levels,
+                    uint8_t *dst, size_t dst_stride, std::vector<uint8_t> &scratch, MipRowFn fn)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (levels <= 0)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            memcpy(dst + y * dst_stride, src + y * src_stride, static_cast<size_t>(width) * 4);
+        }
+        return;
+    }
+
+    // Levels in between alternate between the two halves of |scratch|:
+    // the first holds level 1, the second (a quarter of it) level 2, and so
+    // on; the last level goes straight to |dst|.
+    size_t first = static_cast<size_t>(width / 2) * (height / 2) * 4;
+    if (levels > 1 && scratch.size() < first + first / 4)
+        scratch.resize(first + first / 4);
+
+    const uint8_t *level_src = src;
+    size_t level_stride = src_stride;
+    for (int level = 1; level <= levels; ++level)
+    {
+        int out_width = width >> level;
+        int out_height = height >> level;
+        uint8_t *out;
+        size_t out_stride;
+        if (level == levels)
+        {
+            out = dst;
+            out_stride = dst_stride;
+        }
+        else
+        {
+            out = scratch.data() + (level % 2 ? 0 : first);
+            out_stride = static_cast<size_t>(out_width) * 4;
+        }
+
+        for (int y = 0; y < out_height; ++y)
+        {
+            const uint8_t *row0 = level_src + (2 * y) * level_stride;
+            fn(out + y * out_stride, row0, row0 + level_stride, static_cast<size_t>(out_width));
+        }
+        level_src = out;
+        level_stride = out_stride;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cpu_features.h"
+
+// Row kernels for halving BGRA8 pixels in both directions (one mip level):
+// every |dst| pixel is the average of the 2x2 block below it in |row0| and
+// |row1|, per channel and rounded to nearest, (a + b + c + d + 2) / 4. All
+// variants give bit-identical results. The rows hold 2 * |dst_pixels|
+// pixels.
+using MipRowFn = void (*)(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t dst_pixels);
+
+// The reference implementation, always available.
+void mip_row_scalar(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t dst_pixels);
+
+// Kernel for |isa|, or nullptr when it isn't supported.
+MipRowFn mip_row_function(CpuIsa isa);
+
+// The fastest supported kernel, detected once on first use.
+MipRowFn mip_row();
+
+// Box filters |width| x |height| pixels of |src| down by 2^|levels| through
+// repeated halving and writes the result, (width >> levels) x
+// (height >> levels) pixels, to |dst|. |width| and |height| must be
+// multiples of 2^|levels|. |scratch| holds the levels in between.
+void downscale_rect(const uint8_t *src, size_t src_stride, int width, int height, int levels,
+                    uint8_t *dst, size_t dst_stride, std::vector<uint8_t> &scratch, MipRowFn fn = mip_row());
+
+#endif // DOWNSCALE_H
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "downscale.h"
+#include "unit_test.h"
+
+// Every mip kernel the CPU runs has to match mip_row_scalar() bit for bit,
+// and downscale_rect() has to give what halving level by level gives.
+
+namespace
+{
+
+const CpuIsa kIsas[] = {CpuIsa::SSE2, CpuIsa::AVX2, CpuIsa::NEON};
+
+// Runs |isa| and the scalar kernel into copies of |dst| and reports the
+// first differing byte; the source rows start |offset| pixels in.
+bool matches_scalar(CpuIsa isa, const std::vector<uint8_t> &dst, const std::vector<uint8_t> &row0,
+                    const std::vector<uint8_t> &row1, size_t offset, size_t dst_pixels)
+{
+    std::vector<uint8_t> expected = dst;
+    std::vector<uint8_t> actual = dst;
+    mip_row_scalar(expected.data() + offset * 4, row0.data() + offset * 4, row1.data() + offset * 4, dst_pixels);
+    mip_row_function(isa)(actual.data() + offset * 4, row0.data() + offset * 4, row1.data() + offset * 4, dst_pixels);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        if (expected[i] != actual[i])
+        {
+            unit_test_fail(__FILE__, __LINE__,
+                           std::string(cpu_isa_name(isa)) + " to match scalar at byte " + std::to_string(i) +
+                               " of " + std::to_string(dst_pixels) + " pixels at " + std::to_string(offset) + " (" +
+                               std::to_string(actual[i]) + " vs " + std::to_string(expected[i]) + ")");
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint8_t> random_bytes(std::mt19937 &rng, size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t &byte : bytes)
+    {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return bytes;
+}
+
+// One level at a time, straight from the definition
+std::vector<uint8_t> halve(const std::vector<uint8_t> &image, int width, int height)
+{
+    std::vector<uint8_t> half(static_cast<size_t>(width / 2) * (height / 2) * 4);
+    for (int y = 0; y < height / 2; ++y)
+    {
+        for (int x = 0; x < width / 2; ++x)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                auto at = [&](int px, int py)
+                { return image[(static_cast<size_t>(py) * width + px) * 4 + c]; };
+                int sum = at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1);
+                half[(static_cast<size_t>(y) * (width / 2) + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return half;
+}
+
+} // namespace
+
+TEST(mip_scalar_rounds_to_nearest)
+{
+    const uint8_t row0[8] = {0, 255, 1, 10, 0, 255, 1, 11};
+    const uint8_t row1[8] = {0, 255, 0, 10, 1, 255, 0, 11};
+    uint8_t dst[4] = {};
+    mip_row_scalar(dst, row0, row1, 1);
+    EXPECT_EQ(dst[0], 0);   // 1 / 4
+    EXPECT_EQ(dst[1], 255);
+    EXPECT_EQ(dst[2], 1);   // 2 / 4 rounds up
+    EXPECT_EQ(dst[3], 11);  // 42 / 4
+}
+
+TEST(mip_kernels_match_scalar)
+{
+    std::mt19937 rng(5);
+    int checked = 0;
+    for (CpuIsa isa : kIsas)
+    {
+        if (!cpu_isa_supported(isa))
+            continue;
+        checked++;
+        EXPECT(mip_row_function(isa) != nullptr);
+
+        // Random rows of every output width up to three AVX2 blocks, at an
+        // odd start, so each main loop meets every tail length
+        for (size_t pixels = 0; pixels <= 40; ++pixels)
+        {
+            std::vector<uint8_t> dst = random_bytes(rng, (pixels + 2) * 4);
+            std::vector<uint8_t> row0 = random_bytes(rng, (2 * pixels + 2) * 4);
+            std::vector<uint8_t> row1 = random_bytes(rng, (2 * pixels + 2) * 4);
+            if (!matches_scalar(isa, dst, row0, row1, 1, pixels))
+                break;
+        }
+
+        // Long rows of extremes, where a sum that doesn't fit would show
+        std::vector<uint8_t> dst(2049 * 4, 0);
+        std::vector<uint8_t> row0 = random_bytes(rng, 2 * 2049 * 4);
+        std::vector<uint8_t> row1 = random_bytes(rng, 2 * 2049 * 4);
+        for (size_t i = 0; i < row0.size(); ++i)
+        {
+            uint32_t pick = rng() % 3;
+            if (pick == 0)
+            {
+                row0[i] = 255;
+                row1[i] = 255;
+            }
+            else if (pick == 1)
+            {
+                row0[i] = 0;
+            }
+        }
+        matches_scalar(isa, dst, row0, row1, 0, 2049);
+    }
+    EXPECT(mip_row_function(CpuIsa::Scalar) != nullptr);
+    EXPECT(cpu_isa_supported(best_cpu_isa()));
+    EXPECT(mip_row() == mip_row_function(best_cpu_isa()));
+#if defined(__x86_64__) || defined(__aarch64__)
+    // SSE2 and NEON are baseline on these
+    EXPECT(checked > 0);
+#endif
+}
+
+TEST(downscale_rect_levels)
+{
+    std::mt19937 rng(7);
+    // Reused across calls the way the thumbnail worker does, and never
+    // cleared: whatever is left in it mustn't matter
+    std::vector<uint8_t> scratch = random_bytes(rng, 64);
+
+    // Levels in between take turns in the two halves of |scratch|; at four
+    // levels the third one overwrites the first while reading the second.
+    for (int levels = 0; levels <= 4; ++levels)
+    {
+        // An odd number of output pixels in each direction, from rows with
+        // padding at the end
+        const int block = 1 << levels;
+        const int width = 37 * block;
+        const int height = 3 * block;
+        const size_t src_stride = static_cast<size_t>(width) * 4 + 12;
+        std::vector<uint8_t> src = random_bytes(rng, src_stride * height);
+        std::vector<uint8_t> image(static_cast<size_t>(width) * height * 4);
+        for (int y = 0; y < height; ++y)
+        {
+            std::copy_n(src.begin() + y * src_stride, width * 4, image.begin() + static_cast<size_t>(y) * width * 4);
+        }
+        std::vector<uint8_t> expected = image;
+        for (int level = 0; level < levels; ++level)
+        {
+            expected = halve(expected, width >> level, height >> level);
+        }
+
+        for (CpuIsa isa : {CpuIsa::Scalar, best_cpu_isa()})
+        {
+            const int out_width = width >> levels;
+            const int out_height = height >> levels;
+            const size_t dst_stride = static_cast<size_t>(out_width) * 4 + 8;
+            std::vector<uint8_t> dst(dst_stride * out_height, 0xcd);
+            downscale_rect(src.data(), src_stride, width, height, levels, dst.data(), dst_stride, scratch,
+                           mip_row_function(isa));
+
+            bool same = true;
+            bool padding_kept = true;
+            for (int y = 0; y < out_height; ++y)
+            {
+                const uint8_t *row = dst.data() + y * dst_stride;
+                same = same && std::equal(row, row + out_width * 4, expected.begin() + y * out_width * 4);
+                padding_kept = padding_kept && std::all_of(row + out_width * 4, row + dst_stride, [](uint8_t byte)
+                                                           { return byte == 0xcd; });
+            }
+            if (!same)
+                unit_test_fail(__FILE__, __LINE__, "level " + std::to_string(levels) + " with " + cpu_isa_name(isa) +
+                                                       " to match halving level by level");
+            EXPECT(padding_kept);
+        }
+    }
+}
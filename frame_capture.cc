@@ -0,0 +1,411 @@
+#include "frame_capture.h"
+
+#include <cstring>
+#include <zlib.h>
+
+namespace
+{
+
+constexpr uint8_t kMagic[4] = {'S', 'H', 'R', 'C'};
+constexpr uint8_t kKeyframe = 1;
+constexpr uint8_t kDelta = 2;
+
+// Both targets are little endian, so fields are written as they are in memory.
+template <typename T>
+void append(std::vector<uint8_t> &out, T value)
+{
+    size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+bool read(FILE *file, T &value)
+{
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+struct ByteReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+
+    template <typename T>
+    bool read(T &value)
+    {
+        if (static_cast<size_t>(end - p) < sizeof(T))
+            return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+} // namespace
+
+FrameCapture::FrameCapture(const FrameCaptureConfig &config)
+    : m_config(config)
+{
+    if (m_config.max_pending < 1)
+        m_config.max_pending = 1;
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+bool FrameCapture::start(const std::string &path)
+{
+    stop();
+
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file)
+        return false;
+    fwrite(kMagic, 1, sizeof(kMagic), m_file);
+    uint32_t version = kFrameCaptureVersion;
+    fwrite(&version, sizeof(version), 1, m_file);
+
+    m_paint_index = 0;
+    m_deltas_since_keyframe = 0;
+    m_need_keyframe = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+        m_stats = FrameCaptureStats();
+    }
+    m_worker = std::thread([this]()
+                           { run_worker(); });
+    return true;
+}
+
+void FrameCapture::stop()
+{
+    if (!m_file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+
+    fclose(m_file);
+    m_file = nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free_buffers.clear();
+    m_free_buffers.shrink_to_fit();
+    m_encoded = std::vector<uint8_t>();
+    m_encoded_bytes = 0;
+    m_stats.buffer_bytes = 0;
+}
+
+bool FrameCapture::capture(const DirtyRegion &dirty, const void *buffer, int width, int height, int64_t time_us)
+{
+    if (!m_file || width <= 0 || height <= 0)
+        return false;
+
+    uint32_t paint_index = m_paint_index++;
+    if (width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_need_keyframe = true;
+    }
+    bool keyframe = m_need_keyframe || m_deltas_since_keyframe >= m_config.keyframe_interval;
+
+    DirtyRegion region;
+    if (keyframe)
+    {
+        region.add(PixelRect{0, 0, width, height});
+    }
+    else
+    {
+        region = dirty;
+        region.clip(PixelRect{0, 0, width, height});
+        if (region.empty())
+            return true;
+    }
+
+    std::vector<uint8_t> pixels;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.size() >= m_config.max_pending)
+        {
+            // The worker is behind; the deltas after this would be relative
+            // to a frame the stream doesn't have.
+            m_stats.dropped++;
+            m_need_keyframe = true;
+            return false;
+        }
+        if (!m_free_buffers.empty())
+        {
+            pixels = std::move(m_free_buffers.back());
+            m_free_buffers.pop_back();
+        }
+    }
+
+    // Only the dirty rects are copied, rows packed back to back
+    pixels.resize(static_cast<size_t>(region.area()) * 4);
+    uint8_t *out = pixels.data();
+    const uint8_t *source = static_cast<const uint8_t *>(buffer);
+    size_t source_stride = static_cast<size_t>(width) * 4;
+    for (const PixelRect &rect : region.rects())
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            memcpy(out, source + y * source_stride + rect.x * 4, row_bytes);
+            out += row_bytes;
+        }
+    }
+
+    Job job;
+    job.keyframe = keyframe;
+    job.time_us = time_us;
+    job.paint_index = paint_index;
+    job.width = width;
+    job.height = height;
+    job.rects = region.rects();
+    job.pixels = std::move(pixels);
+
+    m_need_keyframe = false;
+    m_deltas_since_keyframe = keyframe ? 0 : m_deltas_since_keyframe + 1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(job));
+        update_buffer_bytes();
+        m_stats.captured++;
+        m_stats.keyframes += keyframe ? 1 : 0;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+FrameCaptureStats FrameCapture::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void FrameCapture::run_worker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this]()
+                    { return m_stopping || !m_pending.empty(); });
+        if (m_pending.empty())
+            return; // stopping, and everything was written
+
+        Job job = std::move(m_pending.front());
+        m_pending.pop_front();
+        lock.unlock();
+
+        write_job(job);
+
+        lock.lock();
+        m_stats.raw_bytes += job.pixels.size();
+        m_stats.encoded_bytes += m_encoded.size();
+        m_free_buffers.push_back(std::move(job.pixels));
+        m_encoded_bytes = m_encoded.capacity();
+        update_buffer_bytes();
+    }
+}
+
+void FrameCapture::update_buffer_bytes()
+{
+    size_t bytes = m_encoded_bytes;
+    for (const std::vector<uint8_t> &buffer : m_free_buffers)
+    {
+        bytes += buffer.capacity();
+    }
+    for (const Job &job : m_pending)
+    {
+        bytes += job.pixels.capacity();
+    }
+    m_stats.buffer_bytes = bytes;
+}
+
+void FrameCapture::write_job(const Job &job)
+{
+    FrameRecordInfo info;
+    info.keyframe = job.keyframe;
+    info.time_us = job.time_us;
+    info.paint_index = job.paint_index;
+    info.width = job.width;
+    info.height = job.height;
+    m_encoded.clear();
+    append_frame_record(m_encoded, info, job.rects, job.pixels.data(), job.pixels.size(), m_config.compression_level);
+    fwrite(m_encoded.data(), 1, m_encoded.size(), m_file);
+}
+
+void append_frame_record(std::vector<uint8_t> &out, const FrameRecordInfo &info, const std::vector<PixelRect> &rects,
+                         const uint8_t *pixels, size_t pixel_bytes, int compression_level)
+{
+    append<uint8_t>(out, info.keyframe ? kKeyframe : kDelta);
+    append<int64_t>(out, info.time_us);
+    append<uint32_t>(out, info.paint_index);
+    append<uint32_t>(out, static_cast<uint32_t>(info.width));
+    append<uint32_t>(out, static_cast<uint32_t>(info.height));
+    append<uint32_t>(out, static_cast<uint32_t>(rects.size()));
+    for (const PixelRect &rect : rects)
+    {
+        append<uint32_t>(out, static_cast<uint32_t>(rect.x));
+        append<uint32_t>(out, static_cast<uint32_t>(rect.y));
+        append<uint32_t>(out, static_cast<uint32_t>(rect.width));
+        append<uint32_t>(out, static_cast<uint32_t>(rect.height));
+    }
+    append<uint32_t>(out, static_cast<uint32_t>(pixel_bytes));
+
+    uLongf encoded_size = compressBound(static_cast<uLong>(pixel_bytes));
+    size_t size_offset = out.size();
+    append<uint32_t>(out, 0);
+    size_t data_offset = out.size();
+    out.resize(data_offset + encoded_size);
+    if (compress2(out.data() + data_offset, &encoded_size, pixels, static_cast<uLong>(pixel_bytes),
+                  compression_level) != Z_OK)
+    {
+        encoded_size = 0;
+    }
+    out.resize(data_offset + encoded_size);
+    uint32_t stored_size = static_cast<uint32_t>(encoded_size);
+    memcpy(out.data() + size_offset, &stored_size, sizeof(stored_size));
+}
+
+bool apply_frame_record(const uint8_t *record, size_t size, DecodedFrame &frame, std::vector<uint8_t> &scratch)
+{
+    ByteReader in{record, record + size};
+    uint8_t type = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rect_count = 0;
+    int64_t time_us = 0;
+    uint32_t paint_index = 0;
+    if (!in.read(type) || !in.read(time_us) || !in.read(paint_index) || !in.read(width) || !in.read(height) ||
+        !in.read(rect_count))
+    {
+        return false;
+    }
+    if ((type != kKeyframe && type != kDelta) || width == 0 || height == 0 || width > 16384 || height > 16384)
+        return false;
+
+    bool keyframe = type == kKeyframe;
+    if (!keyframe && (frame.pixels.empty() || static_cast<int>(width) != frame.width ||
+                      static_cast<int>(height) != frame.height))
+    {
+        return false;
+    }
+
+    std::vector<PixelRect> rects;
+    uint64_t expected_raw = 0;
+    for (uint32_t i = 0; i < rect_count; ++i)
+    {
+        uint32_t x, y, w, h;
+        if (!in.read(x) || !in.read(y) || !in.read(w) || !in.read(h))
+            return false;
+        if (x + static_cast<uint64_t>(w) > width || y + static_cast<uint64_t>(h) > height)
+            return false;
+        rects.push_back(PixelRect{static_cast<int>(x), static_cast<int>(y), static_cast<int>(w), static_cast<int>(h)});
+        expected_raw += static_cast<uint64_t>(w) * h * 4;
+    }
+
+    uint32_t raw_size = 0;
+    uint32_t encoded_size = 0;
+    if (!in.read(raw_size) || !in.read(encoded_size) || raw_size != expected_raw ||
+        static_cast<size_t>(in.end - in.p) != encoded_size)
+    {
+        return false;
+    }
+    scratch.resize(raw_size);
+    uLongf decoded_size = raw_size;
+    if (raw_size && (uncompress(scratch.data(), &decoded_size, in.p, encoded_size) != Z_OK ||
+                     decoded_size != raw_size))
+    {
+        return false;
+    }
+
+    if (keyframe)
+    {
+        frame.width = static_cast<int>(width);
+        frame.height = static_cast<int>(height);
+        frame.pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+    }
+    frame.keyframe = keyframe;
+    frame.time_us = time_us;
+    frame.paint_index = paint_index;
+    frame.rects = std::move(rects);
+
+    const uint8_t *pixels = scratch.data();
+    size_t stride = static_cast<size_t>(width) * 4;
+    for (const PixelRect &rect : frame.rects)
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            memcpy(frame.pixels.data() + y * stride + rect.x * 4, pixels, row_bytes);
+            pixels += row_bytes;
+        }
+    }
+    return true;
+}
+
+FrameStreamReader::~FrameStreamReader()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+bool FrameStreamReader::open(const std::string &path)
+{
+    m_file = fopen(path.c_str(), "rb");
+    if (!m_file)
+        return fail();
+
+    uint8_t magic[4];
+    uint32_t version = 0;
+    if (fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !read(m_file, version) || version != kFrameCaptureVersion)
+    {
+        return fail();
+    }
+    return true;
+}
+
+bool FrameStreamReader::next(DecodedFrame &frame)
+{
+    if (!m_file || m_error)
+        return false;
+
+    // type, time, paint index, width, height, rect count
+    constexpr size_t kFixedBytes = 1 + 8 + 4 + 4 + 4 + 4;
+    m_record.resize(kFixedBytes);
+    size_t got = fread(m_record.data(), 1, kFixedBytes, m_file);
+    if (got == 0 && feof(m_file))
+        return false; // clean end of stream
+    if (got != kFixedBytes)
+        return fail();
+
+    uint32_t rect_count = 0;
+    memcpy(&rect_count, m_record.data() + kFixedBytes - 4, sizeof(rect_count));
+    if (rect_count > 1u << 20)
+        return fail();
+    size_t rects_bytes = static_cast<size_t>(rect_count) * 16 + 8; // rects, raw and encoded size
+    m_record.resize(kFixedBytes + rects_bytes);
+    if (fread(m_record.data() + kFixedBytes, 1, rects_bytes, m_file) != rects_bytes)
+        return fail();
+
+    uint32_t encoded_size = 0;
+    memcpy(&encoded_size, m_record.data() + m_record.size() - 4, sizeof(encoded_size));
+    size_t offset = m_record.size();
+    m_record.resize(offset + encoded_size);
+    if (encoded_size && fread(m_record.data() + offset, 1, encoded_size, m_file) != encoded_size)
+        return fail();
+
+    if (!apply_frame_record(m_record.data(), m_record.size(), m_frame, m_raw))
+        return fail();
+    frame = m_frame;
+    return true;
+}
@@ -0,0 +1,167 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dirty_region.h"
+
+// Capture stream layout, all integers little endian:
+//   header: "SHRC", u32 version
+//   record: u8 type (1 keyframe, 2 delta), i64 time_us, u32 paint index,
+//           u32 width, u32 height, u32 rect count, rect count x
+//           (u32 x, y, w, h), u32 raw size, u32 encoded size, then the
+//           zlib-compressed pixels of every rect in order, rows packed.
+// A keyframe has a single rect covering the frame. Paint indices count every
+// paint offered to the capture, so gaps show where frames were dropped.
+constexpr uint32_t kFrameCaptureVersion = 1;
+
+struct FrameCaptureConfig
+{
+    // Deltas between keyframes. A stream can only be decoded from a
+    // keyframe on.
+    int keyframe_interval = 120;
+    // Paints copied but not yet encoded. Past this, paints are dropped
+    // instead of making OnPaint wait for the encoder; the next paint that
+    // is captured is a keyframe.
+    size_t max_pending = 3;
+    // zlib level; 1 is the fastest.
+    int compression_level = 1;
+};
+
+struct FrameCaptureStats
+{
+    uint64_t captured = 0;
+    uint64_t dropped = 0;
+    uint64_t keyframes = 0;
+    uint64_t raw_bytes = 0;     // pixels handed to the encoder
+    uint64_t encoded_bytes = 0; // what was written for them
+    uint64_t buffer_bytes = 0;  // pooled pixel buffers and the encoder's output
+};
+
+// Dumps paints to a file without encoding on the paint thread: capture()
+// copies the dirty pixels into a pooled buffer and a worker thread
+// compresses and writes them.
+class FrameCapture
+{
+public:
+    explicit FrameCapture(const FrameCaptureConfig &config = FrameCaptureConfig());
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    bool start(const std::string &path);
+    // Writes what is still pending and closes the file.
+    void stop();
+    bool active() const { return m_file != nullptr; }
+
+    // |buffer| is a BGRA frame of |width| x |height| as OnPaint gets it.
+    // Returns false if the paint was dropped.
+    bool capture(const DirtyRegion &dirty, const void *buffer, int width, int height, int64_t time_us);
+
+    FrameCaptureStats stats() const;
+
+private:
+    struct Job
+    {
+        bool keyframe = false;
+        int64_t time_us = 0;
+        uint32_t paint_index = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<PixelRect> rects;
+        std::vector<uint8_t> pixels; // from m_free_buffers
+    };
+
+    void run_worker();
+    void write_job(const Job &job);
+    // Under m_mutex
+    void update_buffer_bytes();
+
+    FrameCaptureConfig m_config;
+    FILE *m_file = nullptr;
+    std::thread m_worker;
+
+    // Paint thread only
+    uint32_t m_paint_index = 0;
+    int m_deltas_since_keyframe = 0;
+    bool m_need_keyframe = true;
+    int m_width = 0;
+    int m_height = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_pending;
+    std::vector<std::vector<uint8_t>> m_free_buffers;
+    bool m_stopping = false;
+    size_t m_encoded_bytes = 0; // m_encoded's capacity
+    FrameCaptureStats m_stats;
+
+    // Worker only
+    std::vector<uint8_t> m_encoded;
+};
+
+struct DecodedFrame
+{
+    bool keyframe = false;
+    int64_t time_us = 0;
+    uint32_t paint_index = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<PixelRect> rects;  // what changed
+    std::vector<uint8_t> pixels;   // the whole frame, BGRA
+};
+
+// A single record. The capture file is a header and a sequence of these;
+// the frame stream (frame_stream.h) sends them as they are.
+struct FrameRecordInfo
+{
+    bool keyframe = false;
+    int64_t time_us = 0;
+    uint32_t paint_index = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// |pixels| are the rects' pixels, rows packed back to back.
+void append_frame_record(std::vector<uint8_t> &out, const FrameRecordInfo &info, const std::vector<PixelRect> &rects,
+                         const uint8_t *pixels, size_t pixel_bytes, int compression_level);
+// Applies the record in |record| (exactly |size| bytes) to |frame|, which
+// holds the frame before it. False if the record is corrupt, or a delta
+// |frame| has no keyframe for; |frame| is then unchanged.
+bool apply_frame_record(const uint8_t *record, size_t size, DecodedFrame &frame, std::vector<uint8_t> &scratch);
+
+// Reads a capture back into full frames.
+class FrameStreamReader
+{
+public:
+    ~FrameStreamReader();
+
+    bool open(const std::string &path);
+    // The next frame with its deltas applied. False at the end of the
+    // stream or on a corrupt record; error() tells them apart.
+    bool next(DecodedFrame &frame);
+    bool error() const { return m_error; }
+
+private:
+    bool fail()
+    {
+        m_error = true;
+        return false;
+    }
+
+    FILE *m_file = nullptr;
+    bool m_error = false;
+    DecodedFrame m_frame;
+    std::vector<uint8_t> m_record;
+    std::vector<uint8_t> m_raw;
+};
+
+#endif // FRAME_CAPTURE_H
@@ -0,0 +1,219 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+#include "frame_capture.h"
+#include "unit_test.h"
+
+// Paints captured to a file and read back the way shrome_frame_dump reads
+// them: every frame has to come out as it was painted.
+
+namespace
+{
+
+struct Painter
+{
+    std::mt19937 rng{21};
+    int width = 64;
+    int height = 48;
+    std::vector<uint8_t> frame;
+
+    void resize(int new_width, int new_height)
+    {
+        width = new_width;
+        height = new_height;
+        frame.assign(static_cast<size_t>(width) * height * 4, 0);
+        DirtyRegion all;
+        all.add(PixelRect{0, 0, width, height});
+        paint(all);
+    }
+
+    // Fills |region| with noise, which zlib can't shrink away
+    void paint(const DirtyRegion &region)
+    {
+        for (const PixelRect &rect : region.rects())
+        {
+            for (int y = rect.y; y < rect.bottom(); ++y)
+            {
+                for (int x = rect.x; x < rect.right(); ++x)
+                {
+                    uint32_t pixel = rng() | 0xff000000u;
+                    memcpy(&frame[(static_cast<size_t>(y) * width + x) * 4], &pixel, 4);
+                }
+            }
+        }
+    }
+
+    DirtyRegion random_damage()
+    {
+        DirtyRegion damage;
+        int count = 1 + static_cast<int>(rng() % 3);
+        for (int i = 0; i < count; ++i)
+        {
+            int x = static_cast<int>(rng() % width);
+            int y = static_cast<int>(rng() % height);
+            damage.add(PixelRect{x, y, 1 + static_cast<int>(rng() % 20), 1 + static_cast<int>(rng() % 20)});
+        }
+        damage.clip(PixelRect{0, 0, width, height});
+        paint(damage);
+        return damage;
+    }
+};
+
+std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+} // namespace
+
+TEST(capture_round_trips_through_the_reader)
+{
+    const std::string path = unit_test_temp_path("capture.shrc");
+    FrameCaptureConfig config;
+    config.keyframe_interval = 3;
+    config.max_pending = 1000; // nothing dropped
+    FrameCapture capture(config);
+    EXPECT(capture.start(path));
+    EXPECT(capture.active());
+
+    // What each captured paint should decode to, and whether it's a keyframe
+    std::map<uint32_t, std::vector<uint8_t>> expected;
+    std::map<uint32_t, bool> keyframes;
+    Painter painter;
+    painter.resize(64, 48);
+    uint32_t paint_index = 0;
+    auto paint = [&](const DirtyRegion &damage, bool keyframe)
+    {
+        EXPECT(capture.capture(damage, painter.frame.data(), painter.width, painter.height, paint_index * 1000));
+        expected[paint_index] = painter.frame;
+        keyframes[paint_index] = keyframe;
+        paint_index++;
+    };
+
+    DirtyRegion all;
+    all.add(PixelRect{0, 0, 64, 48});
+    paint(all, true);
+    paint(painter.random_damage(), false);
+
+    // Damage outside the frame is nothing to write, but still counts
+    DirtyRegion outside;
+    outside.add(PixelRect{64, 0, 10, 10});
+    EXPECT(capture.capture(outside, painter.frame.data(), 64, 48, 0));
+    paint_index++;
+
+    // Three deltas, then a keyframe again
+    paint(painter.random_damage(), false);
+    paint(painter.random_damage(), false);
+    for (int i = 0; i < 4; ++i)
+    {
+        paint(painter.random_damage(), i == 0);
+    }
+
+    // A new size starts with a keyframe whatever the damage
+    painter.resize(40, 30);
+    DirtyRegion small;
+    small.add(PixelRect{0, 0, 1, 1});
+    paint(small, true);
+    paint(painter.random_damage(), false);
+    capture.stop();
+    EXPECT(!capture.active());
+
+    FrameCaptureStats stats = capture.stats();
+    EXPECT_EQ(stats.captured, 10u);
+    EXPECT_EQ(stats.keyframes, 3u);
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT(stats.encoded_bytes > 0);
+    EXPECT_EQ(stats.buffer_bytes, 0u);
+
+    FrameStreamReader reader;
+    EXPECT(reader.open(path));
+    DecodedFrame frame;
+    size_t decoded = 0;
+    while (reader.next(frame))
+    {
+        decoded++;
+        auto it = expected.find(frame.paint_index);
+        if (it == expected.end())
+        {
+            unit_test_fail(__FILE__, __LINE__, "a paint that was captured, got " + std::to_string(frame.paint_index));
+            continue;
+        }
+        EXPECT_EQ(frame.keyframe, keyframes[frame.paint_index]);
+        EXPECT_EQ(frame.time_us, static_cast<int64_t>(frame.paint_index) * 1000);
+        EXPECT_EQ(frame.width * frame.height * 4, static_cast<int>(it->second.size()));
+        if (frame.pixels != it->second)
+            unit_test_fail(__FILE__, __LINE__, "paint " + std::to_string(frame.paint_index) + " to decode as painted");
+    }
+    EXPECT(!reader.error());
+    EXPECT_EQ(decoded, expected.size());
+    std::remove(path.c_str());
+}
+
+TEST(capture_reader_rejects_damage)
+{
+    const std::string path = unit_test_temp_path("damaged.shrc");
+    {
+        FrameCapture capture;
+        EXPECT(capture.start(path));
+        Painter painter;
+        painter.resize(32, 32);
+        DirtyRegion all;
+        all.add(PixelRect{0, 0, 32, 32});
+        capture.capture(all, painter.frame.data(), 32, 32, 0);
+        capture.capture(painter.random_damage(), painter.frame.data(), 32, 32, 1);
+    }
+    const std::vector<uint8_t> bytes = read_file(path);
+
+    // Cut inside the second record: the first still reads, then an error
+    std::vector<uint8_t> cut(bytes.begin(), bytes.end() - 3);
+    write_file(path, cut);
+    FrameStreamReader truncated;
+    EXPECT(truncated.open(path));
+    DecodedFrame frame;
+    EXPECT(truncated.next(frame));
+    EXPECT(frame.keyframe);
+    EXPECT(!truncated.next(frame));
+    EXPECT(truncated.error());
+
+    // Not a capture
+    std::vector<uint8_t> other = bytes;
+    other[0] = 'X';
+    write_file(path, other);
+    FrameStreamReader wrong_magic;
+    EXPECT(!wrong_magic.open(path));
+    EXPECT(wrong_magic.error());
+    std::remove(path.c_str());
+    FrameStreamReader missing;
+    EXPECT(!missing.open(path));
+
+    // A delta needs the frame before it, and a flipped byte in the pixels
+    // leaves the frame as it was
+    const size_t header = 8;
+    const uint8_t *first = bytes.data() + header;
+    size_t first_size = 1 + 8 + 4 * 4 + 16 + 8;
+    uint32_t encoded_size = 0;
+    memcpy(&encoded_size, first + first_size - 4, 4);
+    first_size += encoded_size;
+    std::vector<uint8_t> delta(bytes.begin() + header + first_size, bytes.end());
+    DecodedFrame decoded;
+    std::vector<uint8_t> scratch;
+    EXPECT(!apply_frame_record(delta.data(), delta.size(), decoded, scratch));
+    EXPECT(apply_frame_record(first, first_size, decoded, scratch));
+    DecodedFrame before = decoded;
+    delta[delta.size() / 2 + 20] ^= 0x55;
+    delta.back() ^= 0x55;
+    EXPECT(!apply_frame_record(delta.data(), delta.size(), decoded, scratch));
+    EXPECT(decoded.pixels == before.pixels);
+    EXPECT_EQ(decoded.paint_index, before.paint_index);
+}
@@ -0,0 +1,266 @@
+// Turns a frame capture (see frame_capture.h) into PNGs, or compares two.
+//
+//   shrome_frame_dump <capture> <out dir> [--every=N]
+//     writes frame_<paint index>.png for every Nth frame
+//   shrome_frame_dump --diff <a> <b> <out dir>
+//     compares the frames of two captures in order, writes
+//     diff_<n>.png (differences in red over a dimmed a) for those that
+//     differ and exits with 1 if any did
+//   shrome_frame_dump --stream=ADDRESS <out dir> [--every=N] [--frames=N] [--shm]
+//     connects to a running shrome's frame stream (frame_stream.h) and
+//     writes every Nth frame it gets until it got N or the stream ends
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "frame_capture.h"
+#include "frame_stream.h"
+
+namespace
+{
+
+void append_u32_be(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void append_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+    append_u32_be(out, static_cast<uint32_t>(data.size()));
+    size_t type_offset = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    uLong crc = crc32(0, out.data() + type_offset, static_cast<uInt>(out.size() - type_offset));
+    append_u32_be(out, static_cast<uint32_t>(crc));
+}
+
+// 8-bit RGBA PNG from BGRA pixels.
+bool write_png(const std::string &path, int width, int height, const uint8_t *bgra)
+{
+    std::vector<uint8_t> raw;
+    raw.reserve(static_cast<size_t>(height) * (width * 4 + 1));
+    for (int y = 0; y < height; ++y)
+    {
+        raw.push_back(0); // no filter
+        const uint8_t *row = bgra + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; ++x)
+        {
+            raw.push_back(row[x * 4 + 2]);
+            raw.push_back(row[x * 4 + 1]);
+            raw.push_back(row[x * 4 + 0]);
+            raw.push_back(row[x * 4 + 3]);
+        }
+    }
+
+    uLongf compressed_size = compressBound(static_cast<uLong>(raw.size()));
+    std::vector<uint8_t> compressed(compressed_size);
+    if (compress2(compressed.data(), &compressed_size, raw.data(), static_cast<uLong>(raw.size()), 6) != Z_OK)
+        return false;
+    compressed.resize(compressed_size);
+
+    std::vector<uint8_t> header;
+    append_u32_be(header, static_cast<uint32_t>(width));
+    append_u32_be(header, static_cast<uint32_t>(height));
+    header.push_back(8); // bit depth
+    header.push_back(6); // RGBA
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> png(kSignature, kSignature + 8);
+    append_chunk(png, "IHDR", header);
+    append_chunk(png, "IDAT", compressed);
+    append_chunk(png, "IEND", {});
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(png.data(), 1, png.size(), file) == png.size();
+    return fclose(file) == 0 && ok;
+}
+
+std::string frame_path(const std::string &dir, const char *prefix, uint32_t index)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/%s_%06u.png", prefix, index);
+    return dir + name;
+}
+
+int dump(const std::string &capture, const std::string &out_dir, int every)
+{
+    FrameStreamReader reader;
+    if (!reader.open(capture))
+    {
+        fprintf(stderr, "%s is not a frame capture\n", capture.c_str());
+        return 2;
+    }
+
+    DecodedFrame frame;
+    int frames = 0;
+    int written = 0;
+    while (reader.next(frame))
+    {
+        if (frames++ % every != 0)
+            continue;
+        std::string path = frame_path(out_dir, "frame", frame.paint_index);
+        if (!write_png(path, frame.width, frame.height, frame.pixels.data()))
+        {
+            fprintf(stderr, "could not write %s\n", path.c_str());
+            return 2;
+        }
+        written++;
+    }
+    printf("%d frames, %d written\n", frames, written);
+    if (reader.error())
+    {
+        fprintf(stderr, "%s: corrupt record after %d frames\n", capture.c_str(), frames);
+        return 2;
+    }
+    return 0;
+}
+
+int stream(const std::string &address, const std::string &out_dir, int every, int max_frames, bool shared_memory)
+{
+    FrameStreamClient client;
+    if (!client.connect(address, shared_memory))
+    {
+        fprintf(stderr, "could not connect to %s\n", address.c_str());
+        return 2;
+    }
+
+    DecodedFrame frame;
+    int frames = 0;
+    int written = 0;
+    bool used_shared_memory = false;
+    while ((max_frames == 0 || frames < max_frames) && client.next_frame(frame, -1))
+    {
+        used_shared_memory |= client.using_shared_memory();
+        if (frames++ % every != 0)
+            continue;
+        std::string path = frame_path(out_dir, "frame", frame.paint_index);
+        if (!write_png(path, frame.width, frame.height, frame.pixels.data()))
+        {
+            fprintf(stderr, "could not write %s\n", path.c_str());
+            return 2;
+        }
+        written++;
+    }
+    printf("%d frames%s, %d written\n", frames, used_shared_memory ? " (shared memory)" : "", written);
+    return 0;
+}
+
+int diff(const std::string &a_path, const std::string &b_path, const std::string &out_dir)
+{
+    FrameStreamReader a;
+    FrameStreamReader b;
+    if (!a.open(a_path) || !b.open(b_path))
+    {
+        fprintf(stderr, "could not open both captures\n");
+        return 2;
+    }
+
+    DecodedFrame frame_a;
+    DecodedFrame frame_b;
+    uint32_t index = 0;
+    int differing = 0;
+    std::vector<uint8_t> image;
+    for (; a.next(frame_a) && b.next(frame_b); ++index)
+    {
+        if (frame_a.width != frame_b.width || frame_a.height != frame_b.height)
+        {
+            printf("frame %u: size %dx%d vs %dx%d\n", index, frame_a.width, frame_a.height, frame_b.width, frame_b.height);
+            differing++;
+            continue;
+        }
+
+        size_t pixels = static_cast<size_t>(frame_a.width) * frame_a.height;
+        image.resize(pixels * 4);
+        uint64_t changed = 0;
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            const uint8_t *pa = &frame_a.pixels[i * 4];
+            const uint8_t *pb = &frame_b.pixels[i * 4];
+            uint8_t *out = &image[i * 4];
+            if (memcmp(pa, pb, 4) != 0)
+            {
+                changed++;
+                out[0] = 0;
+                out[1] = 0;
+                out[2] = 255;
+            }
+            else
+            {
+                out[0] = pa[0] / 4 + 191;
+                out[1] = pa[1] / 4 + 191;
+                out[2] = pa[2] / 4 + 191;
+            }
+            out[3] = 255;
+        }
+        if (changed)
+        {
+            printf("frame %u: %llu pixels differ\n", index, (unsigned long long)changed);
+            write_png(frame_path(out_dir, "diff", index), frame_a.width, frame_a.height, image.data());
+            differing++;
+        }
+    }
+    printf("%u frames compared, %d differ\n", index, differing);
+    return differing ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc == 5 && strcmp(argv[1], "--diff") == 0)
+    {
+        return diff(argv[2], argv[3], argv[4]);
+    }
+
+    int every = 1;
+    int max_frames = 0;
+    bool shared_memory = false;
+    std::string address;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--every=", 8) == 0)
+        {
+            every = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+        {
+            max_frames = atoi(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--stream=", 9) == 0)
+        {
+            address = argv[i] + 9;
+        }
+        else if (strcmp(argv[i], "--shm") == 0)
+        {
+            shared_memory = true;
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != (address.empty() ? 2u : 1u) || every < 1 || max_frames < 0)
+    {
+        fprintf(stderr, "usage: %s <capture> <out dir> [--every=N]\n"
+                        "       %s --diff <a> <b> <out dir>\n"
+                        "       %s --stream=ADDRESS <out dir> [--every=N] [--frames=N] [--shm]\n",
+                argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    if (!address.empty())
+    {
+        return stream(address, paths[0], every, max_frames, shared_memory);
+    }
+    return dump(paths[0], paths[1], every);
+}
@@ -0,0 +1,185 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+int64_t SteadyFrameClock::now_us() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+const char *frame_invalidation_name(FrameInvalidation source)
+{
+    switch (source)
+    {
+    case FrameInvalidation::Input:
+        return "input";
+    case FrameInvalidation::Paint:
+        return "paint";
+    case FrameInvalidation::PumpWork:
+        return "pump";
+    case FrameInvalidation::Resize:
+        return "resize";
+    case FrameInvalidation::Visibility:
+        return "visibility";
+    default:
+        return "unknown";
+    }
+}
+
+FrameScheduler::FrameScheduler(const FrameClock &clock, const FrameSchedulerConfig &config)
+    : m_clock(clock),
+      m_config(config),
+      m_period_us(config.default_period_us),
+      m_latency_us(config.default_period_us / 2)
+{
+    m_stats.period_us = m_period_us;
+    m_stats.paint_latency_us = m_latency_us;
+}
+
+void FrameScheduler::invalidate(FrameInvalidation source)
+{
+    m_stats.invalidations[static_cast<int>(source)]++;
+    int frames = source == FrameInvalidation::Paint ? 1 : m_config.settle_frames;
+    m_frames_requested = std::max(m_frames_requested, frames);
+}
+
+void FrameScheduler::on_paint()
+{
+    m_stats.paints++;
+    invalidate(FrameInvalidation::Paint);
+
+    if (m_awaiting_paint)
+    {
+        int64_t sample = m_clock.now_us() - m_last_begin_frame_us;
+        m_latency_us = (m_latency_us * 3 + sample) / 4;
+        m_stats.paint_latency_us = m_latency_us;
+        m_awaiting_paint = false;
+        m_paint_streak++;
+        m_empty_frames = 0;
+        m_stats.animating = animating();
+    }
+}
+
+void FrameScheduler::on_vsync()
+{
+    int64_t now = m_clock.now_us();
+    m_stats.ticks++;
+
+    if (m_last_vsync_us >= 0 && now > m_last_vsync_us)
+    {
+        // Missed ticks show up as multiples of the period; ignore long stalls.
+        int64_t interval = now - m_last_vsync_us;
+        int64_t periods = std::max<int64_t>(1, (interval + m_period_us / 2) / m_period_us);
+        if (periods <= 4)
+        {
+            m_period_us = (m_period_us * 7 + interval / periods) / 8;
+            m_stats.period_us = m_period_us;
+        }
+    }
+    m_last_vsync_us = now;
+
+    // A BeginFrame that hasn't painted within two periods had nothing to draw.
+    if (m_awaiting_paint && now - m_last_begin_frame_us > 2 * m_period_us)
+    {
+        on_empty_frame();
+    }
+
+    if (!wants_frame(now))
+    {
+        m_stats.idle_ticks++;
+    }
+}
+
+void FrameScheduler::on_empty_frame()
+{
+    m_awaiting_paint = false;
+    m_empty_frames++;
+    if (!animating() || m_empty_frames > m_config.animation_grace)
+    {
+        m_paint_streak = 0;
+    }
+    m_stats.animating = animating();
+}
+
+bool FrameScheduler::wants_frame(int64_t now) const
+{
+    if (m_frames_requested > 0 || animating())
+        return true;
+
+    return m_last_begin_frame_us < 0 || now - m_last_begin_frame_us >= m_config.keepalive_us;
+}
+
+bool FrameScheduler::should_begin_frame()
+{
+    int64_t now = m_clock.now_us();
+    if (!wants_frame(now))
+        return false;
+
+    if (m_last_vsync_us < 0)
+        return true;
+
+    // One BeginFrame per display period
+    if (m_begin_frame_vsync_us == m_last_vsync_us)
+        return false;
+
+    // Half a period of slack, or vsync jitter would skip a whole period
+    if (m_min_interval_us > m_period_us && m_last_begin_frame_us >= 0 &&
+        now - m_last_begin_frame_us < m_min_interval_us - m_period_us / 2)
+    {
+        m_stats.throttled_requests++;
+        return false;
+    }
+
+    // Right at the tick is always fine; later in the period only if the paint
+    // is expected to land before the next vsync.
+    int64_t deadline = std::max(begin_frame_deadline_us(), m_last_vsync_us + m_period_us / 8);
+    if (now > deadline)
+    {
+        m_stats.late_requests++;
+        return false;
+    }
+    return true;
+}
+
+void FrameScheduler::on_begin_frame_sent()
+{
+    int64_t now = m_clock.now_us();
+    if (m_awaiting_paint)
+    {
+        // The previous frame never painted
+        on_empty_frame();
+    }
+
+    m_stats.begin_frames++;
+    if (m_frames_requested > 0)
+    {
+        m_frames_requested--;
+    }
+    else if (!animating())
+    {
+        m_stats.keepalive_frames++;
+    }
+
+    m_last_begin_frame_us = now;
+    m_begin_frame_vsync_us = m_last_vsync_us;
+    m_awaiting_paint = true;
+}
+
+int64_t FrameScheduler::next_vsync_us() const
+{
+    int64_t now = m_clock.now_us();
+    if (m_last_vsync_us < 0)
+        return now;
+
+    int64_t periods = std::max<int64_t>(0, (now - m_last_vsync_us) / m_period_us) + 1;
+    return m_last_vsync_us + periods * m_period_us;
+}
+
+int64_t FrameScheduler::begin_frame_deadline_us() const
+{
+    int64_t next = next_vsync_us();
+    return next - std::min(m_latency_us, m_period_us);
+}
@@ -0,0 +1,136 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <cstdint>
+
+// Time source for FrameScheduler, in microseconds.
+class FrameClock
+{
+public:
+    virtual ~FrameClock() = default;
+    virtual int64_t now_us() const = 0;
+};
+
+class SteadyFrameClock : public FrameClock
+{
+public:
+    int64_t now_us() const override;
+};
+
+// Clock that only moves when told to, for driving the scheduler headlessly.
+class VirtualFrameClock : public FrameClock
+{
+public:
+    int64_t now_us() const override { return m_now_us; }
+    void set_us(int64_t now_us) { m_now_us = now_us; }
+    void advance_us(int64_t delta_us) { m_now_us += delta_us; }
+
+private:
+    int64_t m_now_us = 0;
+};
+
+// Things that can make the browser produce a new frame.
+enum class FrameInvalidation
+{
+    Input,      // mouse, keyboard, IME or wheel event injected
+    Paint,      // CEF painted (a paint is often followed by another)
+    PumpWork,   // CEF asked for immediate message loop work
+    Resize,     // view size or pixel density changed
+    Visibility, // another tab was brought to the front, or the window shown again
+    Count
+};
+
+const char *frame_invalidation_name(FrameInvalidation source);
+
+struct FrameSchedulerConfig
+{
+    int64_t default_period_us = 16667;
+    // BeginFrames granted per invalidation: the paint for an input event
+    // usually shows up one frame after the event is handled.
+    int settle_frames = 2;
+    // Consecutive BeginFrames that produced a paint before we call the page
+    // animating, and how many empty frames an animation may have before we
+    // stop driving it.
+    int animation_streak = 3;
+    int animation_grace = 3;
+    // One BeginFrame at least this often even when nothing asked for it, in
+    // case something changed that we have no signal for.
+    int64_t keepalive_us = 1000000;
+};
+
+struct FrameSchedulerStats
+{
+    uint64_t ticks = 0;
+    uint64_t begin_frames = 0;
+    uint64_t idle_ticks = 0;        // display ticks where no BeginFrame was needed
+    uint64_t late_requests = 0;     // wanted a frame, but past this period's deadline
+    uint64_t keepalive_frames = 0;
+    uint64_t throttled_requests = 0; // wanted a frame, but too soon after the last one
+    uint64_t paints = 0;
+    uint64_t invalidations[static_cast<int>(FrameInvalidation::Count)] = {};
+    bool animating = false;
+    int64_t period_us = 0;
+    int64_t paint_latency_us = 0;   // BeginFrame -> OnPaint, smoothed
+};
+
+// Decides when to send CEF an external BeginFrame. Instead of one per
+// display refresh, frames are only issued while something is invalidated or
+// the page is animating, at most one per display period.
+//
+// The host calls on_vsync() from its display callback and asks
+// should_begin_frame(). Between ticks it can ask again (e.g. right after an
+// input event): that only says yes if the frame is predicted to be painted
+// before the next vsync, using the measured BeginFrame -> paint latency;
+// otherwise the request waits for the next tick.
+//
+// Single threaded; all calls must come from the thread that renders.
+class FrameScheduler
+{
+public:
+    explicit FrameScheduler(const FrameClock &clock, const FrameSchedulerConfig &config = FrameSchedulerConfig());
+
+    void invalidate(FrameInvalidation source);
+    void on_paint();
+
+    // A display refresh happened at now().
+    void on_vsync();
+
+    bool should_begin_frame();
+    void on_begin_frame_sent();
+
+    // BeginFrames at least this far apart, for a browser running below the
+    // display rate (an unfocused or hidden window). 0 for every period.
+    void set_min_interval_us(int64_t interval_us) { m_min_interval_us = interval_us; }
+    int64_t min_interval_us() const { return m_min_interval_us; }
+
+    // When the next vsync is expected, and the last moment a BeginFrame can be
+    // sent for its paint to make it.
+    int64_t next_vsync_us() const;
+    int64_t begin_frame_deadline_us() const;
+
+    bool animating() const { return m_paint_streak >= m_config.animation_streak; }
+    const FrameSchedulerStats &stats() const { return m_stats; }
+
+private:
+    bool wants_frame(int64_t now) const;
+    void on_empty_frame();
+
+    const FrameClock &m_clock;
+    FrameSchedulerConfig m_config;
+    FrameSchedulerStats m_stats;
+
+    int64_t m_period_us;
+    int64_t m_last_vsync_us = -1;
+    int64_t m_latency_us;
+    int64_t m_min_interval_us = 0;
+
+    int m_frames_requested = 0;
+    int m_paint_streak = 0;
+    int m_empty_frames = 0;
+
+    int64_t m_last_begin_frame_us = -1;
+    int64_t m_begin_frame_vsync_us = -1; // vsync the last BeginFrame belongs to
+    bool m_awaiting_paint = false;
+};
+
+#endif // FRAME_SCHEDULER_H
@@ -0,0 +1,217 @@
+#include "frame_scheduler.h"
+#include "unit_test.h"
+
+// FrameScheduler on a VirtualFrameClock with a 60 Hz display.
+
+namespace
+{
+
+const int64_t kPeriod = 16667;
+
+// The render loop: a vsync, a BeginFrame if the scheduler wants one, and
+// the page's paint |paint_latency_us| later when it has something to draw.
+struct Host
+{
+    VirtualFrameClock clock;
+    FrameScheduler scheduler{clock};
+    int64_t vsync_us = 0;
+    int64_t paint_latency_us = -1; // < 0: the page doesn't paint
+
+    bool tick()
+    {
+        vsync_us += kPeriod;
+        clock.set_us(vsync_us);
+        scheduler.on_vsync();
+        if (!scheduler.should_begin_frame())
+            return false;
+        scheduler.on_begin_frame_sent();
+        if (paint_latency_us >= 0)
+        {
+            clock.set_us(vsync_us + paint_latency_us);
+            scheduler.on_paint();
+        }
+        return true;
+    }
+
+    // BeginFrames sent over |count| ticks
+    int ticks(int count)
+    {
+        int sent = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            sent += tick() ? 1 : 0;
+        }
+        return sent;
+    }
+
+    // Runs until the scheduler has been idle for a few ticks
+    void settle()
+    {
+        paint_latency_us = -1;
+        int idle = 0;
+        while (idle < 4)
+        {
+            idle = tick() ? 0 : idle + 1;
+        }
+    }
+};
+
+} // namespace
+
+TEST(scheduler_invalidations_grant_frames)
+{
+    Host host;
+    // The very first tick always gets a frame
+    EXPECT(host.tick());
+    host.settle();
+    EXPECT_EQ(host.ticks(10), 0);
+
+    // Every source other than a paint is good for settle_frames frames
+    const FrameInvalidation sources[] = {FrameInvalidation::Input, FrameInvalidation::PumpWork,
+                                         FrameInvalidation::Resize, FrameInvalidation::Visibility};
+    for (FrameInvalidation source : sources)
+    {
+        host.scheduler.invalidate(source);
+        host.scheduler.invalidate(source);
+        EXPECT_EQ(host.ticks(5), FrameSchedulerConfig().settle_frames);
+        EXPECT_EQ(host.scheduler.stats().invalidations[static_cast<int>(source)], 2u);
+    }
+
+    // A paint asks for one more frame, in case another follows
+    host.scheduler.on_paint();
+    EXPECT_EQ(host.ticks(5), 1);
+    EXPECT_EQ(host.scheduler.stats().invalidations[static_cast<int>(FrameInvalidation::Paint)], 1u);
+    EXPECT_EQ(host.scheduler.stats().paints, 1u);
+    EXPECT(host.scheduler.stats().idle_ticks > 0);
+}
+
+TEST(scheduler_animation_streak)
+{
+    Host host;
+    host.settle();
+    host.paint_latency_us = 4000;
+    host.scheduler.invalidate(FrameInvalidation::Input);
+
+    // Painted BeginFrames keep coming; after animation_streak of them the
+    // page counts as animating
+    const int streak = FrameSchedulerConfig().animation_streak;
+    for (int i = 0; i < streak - 1; ++i)
+    {
+        EXPECT(host.tick());
+    }
+    EXPECT(!host.scheduler.animating());
+    EXPECT(host.tick());
+    EXPECT(host.scheduler.animating());
+    EXPECT(host.scheduler.stats().animating);
+    EXPECT_EQ(host.ticks(30), 30);
+
+    // Once the paints stop, the frame the last paint asked for and
+    // animation_grace + 1 empty ones go out before it stops driving the page
+    host.paint_latency_us = -1;
+    EXPECT_EQ(host.ticks(20), 1 + FrameSchedulerConfig().animation_grace + 1);
+    EXPECT(!host.scheduler.animating());
+    EXPECT(!host.scheduler.stats().animating);
+}
+
+TEST(scheduler_keepalive)
+{
+    Host host;
+    host.settle();
+    uint64_t keepalives = host.scheduler.stats().keepalive_frames;
+
+    // Nothing invalidated: one BeginFrame a second, no more
+    const int per_second = static_cast<int>((1000000 + kPeriod - 1) / kPeriod);
+    int64_t last_frame_us = -1;
+    int sent = 0;
+    for (int i = 0; i < 3 * per_second + 1; ++i)
+    {
+        if (host.tick())
+        {
+            if (last_frame_us >= 0)
+            {
+                EXPECT(host.vsync_us - last_frame_us >= FrameSchedulerConfig().keepalive_us);
+                EXPECT(host.vsync_us - last_frame_us < FrameSchedulerConfig().keepalive_us + kPeriod);
+            }
+            last_frame_us = host.vsync_us;
+            sent++;
+        }
+    }
+    EXPECT_EQ(sent, 3);
+    EXPECT_EQ(host.scheduler.stats().keepalive_frames, keepalives + 3);
+}
+
+TEST(scheduler_deadline_follows_paint_latency)
+{
+    // With the default latency estimate of half a period, a request 6 ms
+    // into the period still makes it
+    Host fresh;
+    fresh.settle();
+    fresh.tick();
+    fresh.clock.set_us(fresh.vsync_us + 6000);
+    fresh.scheduler.invalidate(FrameInvalidation::Input);
+    EXPECT(fresh.scheduler.should_begin_frame());
+
+    // A page that takes 12 ms to paint pulls the deadline earlier
+    Host host;
+    host.paint_latency_us = 12000;
+    host.scheduler.invalidate(FrameInvalidation::Input);
+    host.ticks(40);
+    host.settle();
+    int64_t latency = host.scheduler.stats().paint_latency_us;
+    EXPECT(latency > 11500 && latency <= 12000);
+
+    host.tick();
+    EXPECT_EQ(host.scheduler.next_vsync_us(), host.vsync_us + kPeriod);
+    EXPECT_EQ(host.scheduler.begin_frame_deadline_us(), host.vsync_us + kPeriod - latency);
+
+    // Past the deadline the request waits for the next tick
+    host.clock.set_us(host.vsync_us + 6000);
+    host.scheduler.invalidate(FrameInvalidation::Input);
+    uint64_t late = host.scheduler.stats().late_requests;
+    EXPECT(!host.scheduler.should_begin_frame());
+    EXPECT_EQ(host.scheduler.stats().late_requests, late + 1);
+
+    // Before it, it goes out right away
+    host.vsync_us += kPeriod;
+    host.clock.set_us(host.vsync_us);
+    host.scheduler.on_vsync();
+    host.clock.set_us(host.vsync_us + 3000);
+    EXPECT(host.scheduler.should_begin_frame());
+
+    // However slow the page, the first eighth of the period stays open
+    Host slow;
+    slow.paint_latency_us = 15000;
+    slow.scheduler.invalidate(FrameInvalidation::Input);
+    slow.ticks(40);
+    slow.settle();
+    slow.tick();
+    slow.clock.set_us(slow.vsync_us + 1000);
+    slow.scheduler.invalidate(FrameInvalidation::Input);
+    EXPECT(slow.scheduler.should_begin_frame());
+    slow.clock.set_us(slow.vsync_us + 3000);
+    EXPECT(!slow.scheduler.should_begin_frame());
+}
+
+TEST(scheduler_min_interval)
+{
+    Host host;
+    host.paint_latency_us = 4000;
+    host.scheduler.invalidate(FrameInvalidation::Input);
+    EXPECT_EQ(host.ticks(60), 60);
+
+    // 30 fps on a 60 Hz display: every other tick
+    host.scheduler.set_min_interval_us(1000000 / 30);
+    uint64_t throttled = host.scheduler.stats().throttled_requests;
+    EXPECT_EQ(host.ticks(60), 30);
+    EXPECT_EQ(host.scheduler.stats().throttled_requests, throttled + 30);
+
+    // Hidden: once a second, animating or not
+    host.scheduler.set_min_interval_us(1000000);
+    EXPECT_EQ(host.ticks(180), 3);
+
+    // And back to every period
+    host.scheduler.set_min_interval_us(0);
+    EXPECT_EQ(host.scheduler.min_interval_us(), 0);
+    host.tick();
+    EXPECT_EQ(host.ticks(30), 30);
+}
@@ -0,0 +1,939 @@
+#include "frame_stream.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Client messages are hellos, acks and input; nothing legitimate comes close
+constexpr uint32_t kMaxClientMessage = 1u << 20;
+constexpr uint32_t kMaxServerMessage = 256u << 20;
+constexpr uint8_t kHelloSharedMemory = 1;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+template <typename T>
+void append(std::vector<uint8_t> &out, T value)
+{
+    size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+bool read(const uint8_t *&p, const uint8_t *end, T &value)
+{
+    if (static_cast<size_t>(end - p) < sizeof(T))
+        return false;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+// Starts a message in |out|; end_message() fills in its length.
+size_t begin_message(std::vector<uint8_t> &out, FrameStreamMessage type)
+{
+    size_t offset = out.size();
+    append<uint32_t>(out, 0);
+    append<uint8_t>(out, static_cast<uint8_t>(type));
+    return offset;
+}
+
+void end_message(std::vector<uint8_t> &out, size_t offset)
+{
+    uint32_t length = static_cast<uint32_t>(out.size() - offset - 4);
+    memcpy(out.data() + offset, &length, sizeof(length));
+}
+
+void no_sigpipe(int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+struct SocketAddress
+{
+    sockaddr_storage storage = {};
+    socklen_t length = 0;
+    std::string path; // for Unix sockets
+};
+
+bool parse_address(const std::string &address, SocketAddress &out)
+{
+    if (address.compare(0, 4, "tcp:") == 0)
+    {
+        char *end = nullptr;
+        long port = strtol(address.c_str() + 4, &end, 10);
+        if (address.size() == 4 || *end != '\0' || port <= 0 || port > 65535)
+            return false;
+        // Loopback only: the stream is the user's screen and takes input
+        sockaddr_in *in = reinterpret_cast<sockaddr_in *>(&out.storage);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<uint16_t>(port));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        out.length = sizeof(sockaddr_in);
+        return true;
+    }
+
+    out.path = address.compare(0, 5, "unix:") == 0 ? address.substr(5) : address;
+    sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&out.storage);
+    if (out.path.empty() || out.path.size() >= sizeof(un->sun_path))
+        return false;
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, out.path.c_str(), out.path.size() + 1);
+    out.length = sizeof(sockaddr_un);
+    return true;
+}
+
+bool read_exact(int fd, uint8_t *data, size_t size)
+{
+    while (size)
+    {
+        ssize_t got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool write_exact(int fd, const uint8_t *data, size_t size)
+{
+    while (size)
+    {
+        ssize_t sent = send(fd, data, size, kSendFlags);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+} // namespace
+
+struct FrameStreamServer::Client
+{
+    int fd = -1;
+    uint32_t id = 0;
+    bool dead = false;
+
+    // Worker only
+    bool hello = false;
+    bool wants_shared_memory = false;
+    bool in_flight = false;
+    uint32_t seq = 0;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t out_offset = 0;
+
+    // Shared memory; the name is unlinked once the client acked the frame
+    // after the attach, by when it has mapped it.
+    bool shared_failed = false;
+    std::string shared_name;
+    uint32_t shared_generation = 0;
+    bool shared_linked = false;
+    uint8_t *shared = nullptr;
+    int shared_width = 0;
+    int shared_height = 0;
+
+    // Guarded by m_mutex: what changed since its last frame
+    DirtyRegion damage;
+    bool keyframe = true;
+};
+
+FrameStreamServer::~FrameStreamServer()
+{
+    stop();
+}
+
+bool FrameStreamServer::start(const std::string &address)
+{
+    stop();
+
+    SocketAddress parsed;
+    if (!parse_address(address, parsed))
+        return false;
+
+    int fd = socket(parsed.storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    if (parsed.storage.ss_family == AF_INET)
+    {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    else
+    {
+        // A socket file left behind by a previous run
+        unlink(parsed.path.c_str());
+    }
+    if (bind(fd, reinterpret_cast<const sockaddr *>(&parsed.storage), parsed.length) != 0 ||
+        (!parsed.path.empty() && chmod(parsed.path.c_str(), 0600) != 0) || listen(fd, 4) != 0 ||
+        !set_nonblocking(fd) || pipe(m_wake_fds) != 0)
+    {
+        ::close(fd);
+        if (!parsed.path.empty())
+            unlink(parsed.path.c_str());
+        return false;
+    }
+    set_nonblocking(m_wake_fds[0]);
+    set_nonblocking(m_wake_fds[1]);
+    m_listen_fd = fd;
+    m_socket_path = parsed.path;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+        m_width = 0;
+        m_height = 0;
+        m_frame.clear();
+        m_inputs.clear();
+        m_stats = FrameStreamStats();
+    }
+    m_worker = std::thread([this]()
+                           { run_worker(); });
+    return true;
+}
+
+void FrameStreamServer::stop()
+{
+    if (!m_worker.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    uint8_t wake = 0;
+    (void)!write(m_wake_fds[1], &wake, 1);
+    m_worker.join();
+
+    std::vector<Client *> clients;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        clients.swap(m_clients);
+        m_stats.clients = 0;
+    }
+    for (Client *client : clients)
+    {
+        close_client(*client);
+        delete client;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frame = std::vector<uint8_t>();
+        m_stats.buffer_bytes = 0;
+    }
+    m_pixels = std::vector<uint8_t>();
+    m_pixels_bytes = 0;
+    ::close(m_listen_fd);
+    ::close(m_wake_fds[0]);
+    ::close(m_wake_fds[1]);
+    m_listen_fd = -1;
+    m_wake_fds[0] = m_wake_fds[1] = -1;
+    if (!m_socket_path.empty())
+        unlink(m_socket_path.c_str());
+    m_socket_path.clear();
+}
+
+void FrameStreamServer::publish(const DirtyRegion &dirty, const void *buffer, int width, int height, int64_t time_us)
+{
+    if (!active() || width <= 0 || height <= 0)
+        return;
+
+    const PixelRect bounds{0, 0, width, height};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.frames_published++;
+        m_paint_index++;
+        m_time_us = time_us;
+
+        bool resized = width != m_width || height != m_height;
+        DirtyRegion region;
+        if (resized)
+        {
+            m_width = width;
+            m_height = height;
+            m_frame.resize(static_cast<size_t>(width) * height * 4);
+            m_stats.buffer_bytes = m_frame.capacity() + m_pixels_bytes;
+            region.add(bounds);
+        }
+        else
+        {
+            region = dirty;
+            region.clip(bounds);
+            if (region.empty())
+                return;
+        }
+
+        const uint8_t *source = static_cast<const uint8_t *>(buffer);
+        const size_t stride = static_cast<size_t>(width) * 4;
+        for (const PixelRect &rect : region.rects())
+        {
+            size_t offset = rect.y * stride + static_cast<size_t>(rect.x) * 4;
+            for (int y = 0; y < rect.height; ++y)
+            {
+                memcpy(m_frame.data() + offset + y * stride, source + offset + y * stride,
+                       static_cast<size_t>(rect.width) * 4);
+            }
+        }
+
+        for (Client *client : m_clients)
+        {
+            if (resized)
+            {
+                client->keyframe = true;
+                client->damage.clear();
+            }
+            if (client->keyframe)
+                continue;
+            // Not sent yet: this paint and the one before go out as one frame
+            if (!client->damage.empty())
+                m_stats.frames_skipped++;
+            client->damage.add(region);
+        }
+    }
+
+    uint8_t wake = 0;
+    (void)!write(m_wake_fds[1], &wake, 1);
+}
+
+void FrameStreamServer::take_input(std::vector<RecordedInput> &inputs)
+{
+    inputs.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    inputs.swap(m_inputs);
+}
+
+FrameStreamStats FrameStreamServer::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void FrameStreamServer::run_worker()
+{
+    std::vector<pollfd> fds;
+    for (;;)
+    {
+        fds.clear();
+        fds.push_back(pollfd{m_listen_fd, POLLIN, 0});
+        fds.push_back(pollfd{m_wake_fds[0], POLLIN, 0});
+        for (Client *client : m_clients)
+        {
+            short events = POLLIN;
+            if (client->out_offset < client->out.size())
+                events |= POLLOUT;
+            fds.push_back(pollfd{client->fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+                return;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint8_t drain[64];
+            while (read(m_wake_fds[0], drain, sizeof(drain)) > 0)
+            {
+            }
+        }
+
+        // Clients accepted now come after the ones polled
+        size_t polled = fds.size() - 2;
+        for (size_t i = 0; i < polled; ++i)
+        {
+            if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+                m_clients[i]->dead = !read_client(*m_clients[i]);
+        }
+        if (fds[0].revents & POLLIN)
+            accept_client();
+
+        for (Client *client : m_clients)
+        {
+            if (client->dead)
+                continue;
+            if (client->hello && !client->in_flight)
+                send_frame(*client);
+            if (client->out_offset < client->out.size())
+                client->dead = !flush_client(*client);
+        }
+
+        for (size_t i = 0; i < m_clients.size();)
+        {
+            Client *client = m_clients[i];
+            if (!client->dead)
+            {
+                ++i;
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_clients.erase(m_clients.begin() + i);
+                m_stats.clients = m_clients.size();
+            }
+            close_client(*client);
+            delete client;
+        }
+    }
+}
+
+void FrameStreamServer::accept_client()
+{
+    for (;;)
+    {
+        int fd = accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        if (!set_nonblocking(fd))
+        {
+            ::close(fd);
+            continue;
+        }
+        no_sigpipe(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+
+        Client *client = new Client();
+        client->fd = fd;
+        client->id = m_next_client_id++;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clients.push_back(client);
+        m_stats.clients = m_clients.size();
+    }
+}
+
+bool FrameStreamServer::read_client(Client &client)
+{
+    uint8_t buffer[16384];
+    for (;;)
+    {
+        ssize_t got = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (got == 0)
+            return false;
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        client.in.insert(client.in.end(), buffer, buffer + got);
+    }
+
+    size_t offset = 0;
+    while (client.in.size() - offset >= 5)
+    {
+        uint32_t length = 0;
+        memcpy(&length, client.in.data() + offset, sizeof(length));
+        if (length == 0 || length > kMaxClientMessage)
+            return false;
+        if (client.in.size() - offset - 4 < length)
+            break;
+        const uint8_t *message = client.in.data() + offset + 4;
+        if (!handle_message(client, static_cast<FrameStreamMessage>(message[0]), message + 1, length - 1))
+            return false;
+        offset += 4 + length;
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + offset);
+    return true;
+}
+
+bool FrameStreamServer::handle_message(Client &client, FrameStreamMessage type, const uint8_t *payload, size_t size)
+{
+    const uint8_t *end = payload + size;
+    switch (type)
+    {
+    case FrameStreamMessage::Hello:
+    {
+        uint32_t version = 0;
+        uint8_t flags = 0;
+        if (client.hello || !read(payload, end, version) || !read(payload, end, flags) ||
+            version != kFrameStreamVersion)
+        {
+            return false;
+        }
+        client.hello = true;
+        client.wants_shared_memory = (flags & kHelloSharedMemory) != 0;
+        size_t offset = begin_message(client.out, FrameStreamMessage::Welcome);
+        append<uint32_t>(client.out, kFrameStreamVersion);
+        end_message(client.out, offset);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        client.keyframe = true;
+        client.damage.clear();
+        return true;
+    }
+    case FrameStreamMessage::Ack:
+    {
+        uint32_t seq = 0;
+        if (!read(payload, end, seq))
+            return false;
+        if (client.in_flight && seq == client.seq)
+        {
+            client.in_flight = false;
+            // Attaches only happen between frames, so this client mapped
+            // the current one before acking.
+            if (client.shared_linked)
+            {
+                shm_unlink(client.shared_name.c_str());
+                client.shared_linked = false;
+            }
+        }
+        return true;
+    }
+    case FrameStreamMessage::Input:
+    {
+        std::vector<RecordedInput> inputs;
+        if (!decode_input_log(payload, size, inputs))
+            return false;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (RecordedInput &input : inputs)
+        {
+            if (input.kind == RecordedInput::Kind::Frame)
+                continue;
+            m_inputs.push_back(std::move(input));
+            m_stats.inputs_received++;
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool FrameStreamServer::map_shared_frame(Client &client, int width, int height)
+{
+    if (client.shared && client.shared_width == width && client.shared_height == height)
+        return true;
+
+    if (client.shared)
+    {
+        munmap(client.shared, static_cast<size_t>(client.shared_width) * client.shared_height * 4);
+        client.shared = nullptr;
+    }
+    if (client.shared_linked)
+    {
+        shm_unlink(client.shared_name.c_str());
+        client.shared_linked = false;
+    }
+
+    // macOS allows 31 characters
+    char name[32];
+    snprintf(name, sizeof(name), "/shrome.%d.%u.%u", static_cast<int>(getpid()), client.id,
+             client.shared_generation++);
+    size_t size = static_cast<size_t>(width) * height * 4;
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return false;
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+
+    client.shared = static_cast<uint8_t *>(mapping);
+    client.shared_width = width;
+    client.shared_height = height;
+    client.shared_name = name;
+    client.shared_linked = true;
+
+    size_t offset = begin_message(client.out, FrameStreamMessage::ShmAttach);
+    append<uint32_t>(client.out, static_cast<uint32_t>(width));
+    append<uint32_t>(client.out, static_cast<uint32_t>(height));
+    client.out.insert(client.out.end(), client.shared_name.begin(), client.shared_name.end());
+    end_message(client.out, offset);
+    return true;
+}
+
+void FrameStreamServer::send_frame(Client &client)
+{
+    FrameRecordInfo info;
+    DirtyRegion region;
+    bool shared = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_width == 0 || (!client.keyframe && client.damage.empty()))
+            return;
+
+        info.keyframe = client.keyframe;
+        info.time_us = m_time_us;
+        info.paint_index = m_paint_index;
+        info.width = m_width;
+        info.height = m_height;
+        if (client.wants_shared_memory && !client.shared_failed)
+        {
+            bool mapped = client.shared && client.shared_width == m_width && client.shared_height == m_height;
+            if (!mapped)
+            {
+                client.shared_failed = !map_shared_frame(client, m_width, m_height);
+                // A new mapping starts out empty
+                info.keyframe = true;
+            }
+            shared = !client.shared_failed;
+        }
+        if (info.keyframe)
+            region.add(PixelRect{0, 0, m_width, m_height});
+        else
+            region = client.damage;
+        client.keyframe = false;
+        client.damage.clear();
+
+        // Only the changed rows are copied under the lock; encoding happens
+        // after it so OnPaint never waits for zlib.
+        const size_t stride = static_cast<size_t>(m_width) * 4;
+        if (!shared)
+            m_pixels.resize(static_cast<size_t>(region.area()) * 4);
+        uint8_t *packed = m_pixels.data();
+        for (const PixelRect &rect : region.rects())
+        {
+            size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+            for (int y = rect.y; y < rect.bottom(); ++y)
+            {
+                const uint8_t *source = m_frame.data() + y * stride + static_cast<size_t>(rect.x) * 4;
+                if (shared)
+                {
+                    memcpy(client.shared + (source - m_frame.data()), source, row_bytes);
+                }
+                else
+                {
+                    memcpy(packed, source, row_bytes);
+                    packed += row_bytes;
+                }
+            }
+        }
+    }
+
+    client.seq++;
+    client.in_flight = true;
+    if (shared)
+    {
+        size_t offset = begin_message(client.out, FrameStreamMessage::ShmFrame);
+        append<uint32_t>(client.out, client.seq);
+        append<int64_t>(client.out, info.time_us);
+        append<uint32_t>(client.out, info.paint_index);
+        append<uint32_t>(client.out, static_cast<uint32_t>(info.width));
+        append<uint32_t>(client.out, static_cast<uint32_t>(info.height));
+        append<uint32_t>(client.out, static_cast<uint32_t>(region.rects().size()));
+        for (const PixelRect &rect : region.rects())
+        {
+            append<uint32_t>(client.out, static_cast<uint32_t>(rect.x));
+            append<uint32_t>(client.out, static_cast<uint32_t>(rect.y));
+            append<uint32_t>(client.out, static_cast<uint32_t>(rect.width));
+            append<uint32_t>(client.out, static_cast<uint32_t>(rect.height));
+        }
+        end_message(client.out, offset);
+    }
+    else
+    {
+        size_t offset = begin_message(client.out, FrameStreamMessage::Frame);
+        append<uint32_t>(client.out, client.seq);
+        append_frame_record(client.out, info, region.rects(), m_pixels.data(), static_cast<size_t>(region.area()) * 4, 1);
+        end_message(client.out, offset);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.frames_sent++;
+    m_stats.shm_frames += shared ? 1 : 0;
+    m_pixels_bytes = m_pixels.capacity();
+    m_stats.buffer_bytes = m_frame.capacity() + m_pixels_bytes;
+}
+
+bool FrameStreamServer::flush_client(Client &client)
+{
+    size_t sent_total = 0;
+    while (client.out_offset < client.out.size())
+    {
+        ssize_t sent = send(client.fd, client.out.data() + client.out_offset, client.out.size() - client.out_offset,
+                            kSendFlags);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        client.out_offset += sent;
+        sent_total += sent;
+    }
+    if (client.out_offset == client.out.size())
+    {
+        client.out.clear();
+        client.out_offset = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.bytes_sent += sent_total;
+    return true;
+}
+
+void FrameStreamServer::close_client(Client &client)
+{
+    ::close(client.fd);
+    if (client.shared)
+        munmap(client.shared, static_cast<size_t>(client.shared_width) * client.shared_height * 4);
+    if (client.shared_linked)
+        shm_unlink(client.shared_name.c_str());
+}
+
+FrameStreamClient::~FrameStreamClient()
+{
+    close();
+}
+
+bool FrameStreamClient::connect(const std::string &address, bool shared_memory)
+{
+    close();
+
+    SocketAddress parsed;
+    if (!parse_address(address, parsed))
+        return false;
+    m_fd = socket(parsed.storage.ss_family, SOCK_STREAM, 0);
+    if (m_fd < 0)
+        return false;
+    no_sigpipe(m_fd);
+    if (::connect(m_fd, reinterpret_cast<const sockaddr *>(&parsed.storage), parsed.length) != 0)
+    {
+        close();
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::vector<uint8_t> hello;
+    append<uint32_t>(hello, kFrameStreamVersion);
+    append<uint8_t>(hello, shared_memory ? kHelloSharedMemory : 0);
+    FrameStreamMessage type;
+    uint32_t version = 0;
+    if (!send_message(FrameStreamMessage::Hello, hello) || !read_message(type, m_payload) ||
+        type != FrameStreamMessage::Welcome || m_payload.size() < sizeof(version) ||
+        (memcpy(&version, m_payload.data(), sizeof(version)), version != kFrameStreamVersion))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void FrameStreamClient::close()
+{
+    detach();
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+bool FrameStreamClient::next_frame(DecodedFrame &frame, int timeout_ms)
+{
+    while (m_fd >= 0)
+    {
+        pollfd fd{m_fd, POLLIN, 0};
+        int ready = poll(&fd, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready == 0)
+            return false;
+
+        FrameStreamMessage type;
+        if (ready < 0 || !read_message(type, m_payload))
+            break;
+        const uint8_t *payload = m_payload.data();
+        size_t size = m_payload.size();
+        uint32_t seq = 0;
+        bool applied = false;
+        switch (type)
+        {
+        case FrameStreamMessage::ShmAttach:
+            if (!attach(payload, size))
+            {
+                close();
+                return false;
+            }
+            continue;
+        case FrameStreamMessage::Frame:
+            applied = size >= 4 && apply_frame_record(payload + 4, size - 4, frame, m_scratch);
+            break;
+        case FrameStreamMessage::ShmFrame:
+            applied = apply_shared_frame(payload, size, frame);
+            break;
+        default:
+            break;
+        }
+        if (!applied)
+            break;
+
+        memcpy(&seq, payload, sizeof(seq));
+        std::vector<uint8_t> ack;
+        append<uint32_t>(ack, seq);
+        if (!send_message(FrameStreamMessage::Ack, ack))
+            break;
+        return true;
+    }
+    close();
+    return false;
+}
+
+bool FrameStreamClient::send_input(const std::vector<RecordedInput> &inputs)
+{
+    std::vector<uint8_t> log;
+    encode_input_log(inputs, log);
+    return m_fd >= 0 && send_message(FrameStreamMessage::Input, log);
+}
+
+bool FrameStreamClient::send_message(FrameStreamMessage type, const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> message;
+    size_t offset = begin_message(message, type);
+    message.insert(message.end(), payload.begin(), payload.end());
+    end_message(message, offset);
+    return write_exact(m_fd, message.data(), message.size());
+}
+
+bool FrameStreamClient::read_message(FrameStreamMessage &type, std::vector<uint8_t> &payload)
+{
+    uint8_t header[5];
+    if (!read_exact(m_fd, header, sizeof(header)))
+        return false;
+    uint32_t length = 0;
+    memcpy(&length, header, sizeof(length));
+    if (length == 0 || length > kMaxServerMessage)
+        return false;
+    type = static_cast<FrameStreamMessage>(header[4]);
+    payload.resize(length - 1);
+    return read_exact(m_fd, payload.data(), payload.size());
+}
+
+bool FrameStreamClient::attach(const uint8_t *payload, size_t size)
+{
+    const uint8_t *end = payload + size;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!read(payload, end, width) || !read(payload, end, height) || width == 0 || height == 0 ||
+        width > 16384 || height > 16384)
+    {
+        return false;
+    }
+    std::string name(reinterpret_cast<const char *>(payload), end - payload);
+
+    detach();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    void *mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    m_shared = static_cast<uint8_t *>(mapping);
+    m_shared_width = static_cast<int>(width);
+    m_shared_height = static_cast<int>(height);
+    return true;
+}
+
+bool FrameStreamClient::apply_shared_frame(const uint8_t *payload, size_t size, DecodedFrame &frame)
+{
+    const uint8_t *p = payload;
+    const uint8_t *end = payload + size;
+    uint32_t seq = 0;
+    int64_t time_us = 0;
+    uint32_t paint_index = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rect_count = 0;
+    if (!m_shared || !read(p, end, seq) || !read(p, end, time_us) || !read(p, end, paint_index) ||
+        !read(p, end, width) || !read(p, end, height) || !read(p, end, rect_count) ||
+        static_cast<int>(width) != m_shared_width || static_cast<int>(height) != m_shared_height ||
+        static_cast<size_t>(end - p) != static_cast<size_t>(rect_count) * 16)
+    {
+        return false;
+    }
+
+    std::vector<PixelRect> rects(rect_count);
+    for (PixelRect &rect : rects)
+    {
+        uint32_t x = 0, y = 0, w = 0, h = 0;
+        if (!read(p, end, x) || !read(p, end, y) || !read(p, end, w) || !read(p, end, h) ||
+            x + static_cast<uint64_t>(w) > width || y + static_cast<uint64_t>(h) > height)
+        {
+            return false;
+        }
+        rect = PixelRect{static_cast<int>(x), static_cast<int>(y), static_cast<int>(w), static_cast<int>(h)};
+    }
+
+    // The server starts every mapping with a frame covering all of it
+    frame.keyframe = rect_count == 1 && rects[0] == PixelRect{0, 0, m_shared_width, m_shared_height};
+    if (frame.keyframe)
+    {
+        frame.width = m_shared_width;
+        frame.height = m_shared_height;
+        frame.pixels.resize(static_cast<size_t>(width) * height * 4);
+    }
+    else if (frame.width != m_shared_width || frame.height != m_shared_height || frame.pixels.empty())
+    {
+        return false;
+    }
+    frame.time_us = time_us;
+    frame.paint_index = paint_index;
+    frame.rects = std::move(rects);
+
+    const size_t stride = static_cast<size_t>(width) * 4;
+    for (const PixelRect &rect : frame.rects)
+    {
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            size_t offset = y * stride + static_cast<size_t>(rect.x) * 4;
+            memcpy(frame.pixels.data() + offset, m_shared + offset, static_cast<size_t>(rect.width) * 4);
+        }
+    }
+    return true;
+}
+
+void FrameStreamClient::detach()
+{
+    if (m_shared)
+        munmap(m_shared, static_cast<size_t>(m_shared_width) * m_shared_height * 4);
+    m_shared = nullptr;
+    m_shared_width = 0;
+    m_shared_height = 0;
+}
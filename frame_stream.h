@@ -0,0 +1,157 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dirty_region.h"
+#include "frame_capture.h"
+#include "input_recorder.h"
+
+// Streams the view's software paints to local clients (a viewer, a test
+// harness) and takes their input back.
+//
+// Addresses are "unix:PATH" (or just a path) for a Unix socket, or
+// "tcp:PORT", which only listens on 127.0.0.1. Every message is a u32
+// length (of what follows), a u8 type and the payload, little endian:
+//   client -> server
+//     Hello      u32 version, u8 flags (1: wants shared memory)
+//     Ack        u32 seq; the client is done with that frame
+//     Input      an input log (encode_input_log()) for MyApp::inject_*
+//   server -> client
+//     Welcome    u32 version
+//     Frame      u32 seq, then a frame capture record (frame_capture.h)
+//     ShmAttach  u32 width, u32 height, then the shm_open() name of a
+//                width * height * 4 byte BGRA frame
+//     ShmFrame   u32 seq, i64 time_us, u32 paint index, u32 width,
+//                u32 height, u32 rect count, rect count x (u32 x, y, w, h);
+//                the rects were written to the shared frame
+//
+// A client has at most one frame in flight. Paints that arrive before it
+// acks are merged into the damage of its next frame, so a slow client gets
+// fewer, bigger frames and never holds up OnPaint or the other clients.
+constexpr uint32_t kFrameStreamVersion = 1;
+
+enum class FrameStreamMessage : uint8_t
+{
+    Hello = 1,
+    Ack = 2,
+    Input = 3,
+    Welcome = 16,
+    Frame = 17,
+    ShmAttach = 18,
+    ShmFrame = 19
+};
+
+struct FrameStreamStats
+{
+    uint64_t clients = 0;          // connected now
+    uint64_t frames_published = 0; // paints handed to publish()
+    uint64_t frames_sent = 0;
+    uint64_t frames_skipped = 0;   // merged into a later frame of a busy client
+    uint64_t shm_frames = 0;       // of frames_sent, through shared memory
+    uint64_t bytes_sent = 0;
+    uint64_t inputs_received = 0;
+    uint64_t buffer_bytes = 0;     // the frame copy and the packing buffer
+};
+
+class FrameStreamServer
+{
+public:
+    FrameStreamServer() = default;
+    ~FrameStreamServer();
+
+    FrameStreamServer(const FrameStreamServer &) = delete;
+    FrameStreamServer &operator=(const FrameStreamServer &) = delete;
+
+    bool start(const std::string &address);
+    void stop();
+    bool active() const { return m_worker.joinable(); }
+
+    // |buffer| is a BGRA frame of |width| x |height| as OnPaint gets it.
+    // Copies the dirty pixels; encoding and sending happen on the worker.
+    void publish(const DirtyRegion &dirty, const void *buffer, int width, int height, int64_t time_us);
+
+    // Moves the input received since the last call to |inputs|.
+    void take_input(std::vector<RecordedInput> &inputs);
+
+    FrameStreamStats stats() const;
+
+private:
+    struct Client;
+
+    void run_worker();
+    void accept_client();
+    bool read_client(Client &client);
+    bool handle_message(Client &client, FrameStreamMessage type, const uint8_t *payload, size_t size);
+    void send_frame(Client &client);
+    bool map_shared_frame(Client &client, int width, int height);
+    bool flush_client(Client &client);
+    void close_client(Client &client);
+
+    std::string m_socket_path; // unlinked on stop()
+    int m_listen_fd = -1;
+    int m_wake_fds[2] = {-1, -1};
+    std::thread m_worker;
+
+    // Worker only
+    uint32_t m_next_client_id = 0;
+    std::vector<uint8_t> m_pixels;
+    size_t m_pixels_bytes = 0; // its capacity, for the stats (under m_mutex)
+
+    // Shared with the paint thread
+    mutable std::mutex m_mutex;
+    bool m_stopping = false;
+    std::vector<Client *> m_clients; // added and removed by the worker
+    std::vector<uint8_t> m_frame; // the latest paint, whole
+    int m_width = 0;
+    int m_height = 0;
+    int64_t m_time_us = 0;
+    uint32_t m_paint_index = 0;
+    std::vector<RecordedInput> m_inputs;
+    FrameStreamStats m_stats;
+};
+
+// The other end, for tools and tests. Blocking.
+class FrameStreamClient
+{
+public:
+    FrameStreamClient() = default;
+    ~FrameStreamClient();
+
+    FrameStreamClient(const FrameStreamClient &) = delete;
+    FrameStreamClient &operator=(const FrameStreamClient &) = delete;
+
+    // |shared_memory| asks for frames through shared memory; the server may
+    // still send them over the socket.
+    bool connect(const std::string &address, bool shared_memory);
+    void close();
+    bool connected() const { return m_fd >= 0; }
+    bool using_shared_memory() const { return m_shared != nullptr; }
+
+    // Waits up to |timeout_ms| (-1: forever) for the next frame, applies it
+    // to |frame| and acks it. False on timeout or when the connection broke;
+    // connected() tells them apart.
+    bool next_frame(DecodedFrame &frame, int timeout_ms);
+
+    bool send_input(const std::vector<RecordedInput> &inputs);
+
+private:
+    bool send_message(FrameStreamMessage type, const std::vector<uint8_t> &payload);
+    bool read_message(FrameStreamMessage &type, std::vector<uint8_t> &payload);
+    bool attach(const uint8_t *payload, size_t size);
+    bool apply_shared_frame(const uint8_t *payload, size_t size, DecodedFrame &frame);
+    void detach();
+
+    int m_fd = -1;
+    uint8_t *m_shared = nullptr;
+    int m_shared_width = 0;
+    int m_shared_height = 0;
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_scratch;
+};
+
+#endif // FRAME_STREAM_H
@@ -0,0 +1,208 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "frame_stream.h"
+#include "unit_test.h"
+
+// A FrameStreamServer on a Unix socket in the temp directory and a
+// FrameStreamClient in the same process, the way shrome_frame_dump
+// --stream talks to shrome.
+
+namespace
+{
+
+struct Painter
+{
+    std::mt19937 rng{31};
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> frame;
+
+    // Fills |rect| with noise and returns it as damage
+    DirtyRegion paint(const PixelRect &rect)
+    {
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            for (int x = rect.x; x < rect.right(); ++x)
+            {
+                uint32_t pixel = rng() | 0xff000000u;
+                memcpy(&frame[(static_cast<size_t>(y) * width + x) * 4], &pixel, 4);
+            }
+        }
+        DirtyRegion damage;
+        damage.add(rect);
+        return damage;
+    }
+
+    DirtyRegion resize(int new_width, int new_height)
+    {
+        width = new_width;
+        height = new_height;
+        frame.assign(static_cast<size_t>(width) * height * 4, 0);
+        return paint(PixelRect{0, 0, width, height});
+    }
+};
+
+// Polls |done| for up to two seconds
+template <typename Fn>
+bool eventually(Fn done)
+{
+    for (int i = 0; i < 2000; ++i)
+    {
+        if (done())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+struct Stream
+{
+    std::string path = unit_test_temp_path("stream.sock");
+    FrameStreamServer server;
+    Painter painter;
+    int64_t time_us = 0;
+
+    Stream() { server.start("unix:" + path); }
+
+    void publish(const DirtyRegion &damage)
+    {
+        time_us += 16667;
+        server.publish(damage, painter.frame.data(), painter.width, painter.height, time_us);
+    }
+
+    bool sent(uint64_t frames)
+    {
+        return eventually([&]
+                          { return server.stats().frames_sent >= frames; });
+    }
+};
+
+} // namespace
+
+TEST(stream_sends_keyframes_and_deltas)
+{
+    Stream stream;
+    EXPECT(stream.server.active());
+    FrameStreamClient client;
+    EXPECT(client.connect("unix:" + stream.path, false));
+    EXPECT(eventually([&]
+                      { return stream.server.stats().clients == 1; }));
+
+    // The first frame a client gets is whole
+    DecodedFrame frame;
+    EXPECT(!client.next_frame(frame, 10));
+    EXPECT(client.connected());
+    stream.publish(stream.painter.resize(64, 48));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(frame.keyframe);
+    EXPECT_EQ(frame.width, 64);
+    EXPECT_EQ(frame.paint_index, 1u);
+    EXPECT_EQ(frame.time_us, stream.time_us);
+    EXPECT(frame.pixels == stream.painter.frame);
+    EXPECT(!client.using_shared_memory());
+
+    // Then only what changed
+    const PixelRect caret{10, 20, 2, 12};
+    stream.publish(stream.painter.paint(caret));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(!frame.keyframe);
+    EXPECT(frame.rects == std::vector<PixelRect>(1, caret));
+    EXPECT(frame.pixels == stream.painter.frame);
+
+    // Paints while a frame is in flight go out together once it's acked
+    stream.publish(stream.painter.paint(PixelRect{0, 0, 8, 8}));
+    EXPECT(stream.sent(3));
+    stream.publish(stream.painter.paint(PixelRect{30, 30, 4, 4}));
+    stream.publish(stream.painter.paint(PixelRect{50, 10, 6, 6}));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT_EQ(frame.paint_index, 3u);
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT_EQ(frame.paint_index, 5u);
+    EXPECT_EQ(frame.rects.size(), 2u);
+    EXPECT(frame.pixels == stream.painter.frame);
+    FrameStreamStats stats = stream.server.stats();
+    EXPECT_EQ(stats.frames_published, 5u);
+    EXPECT_EQ(stats.frames_sent, 4u);
+    EXPECT_EQ(stats.frames_skipped, 1u);
+    EXPECT_EQ(stats.shm_frames, 0u);
+
+    // A new size is a keyframe again
+    stream.publish(stream.painter.resize(40, 30));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(frame.keyframe);
+    EXPECT_EQ(frame.width, 40);
+    EXPECT(frame.pixels == stream.painter.frame);
+
+    // Input comes back, without the frame markers
+    std::vector<RecordedInput> inputs(2);
+    inputs[1].kind = RecordedInput::Kind::Key;
+    inputs[1].event.type = InputEvent::Type::Key;
+    inputs[1].event.windows_key_code = 0x20;
+    EXPECT(client.send_input(inputs));
+    std::vector<RecordedInput> received;
+    EXPECT(eventually([&]
+                      {
+                          std::vector<RecordedInput> more;
+                          stream.server.take_input(more);
+                          received.insert(received.end(), more.begin(), more.end());
+                          return !received.empty();
+                      }));
+    EXPECT_EQ(received.size(), 1u);
+    if (!received.empty())
+        EXPECT_EQ(received[0].event.windows_key_code, 0x20);
+
+    // Stopping ends the connection and removes the socket
+    stream.server.stop();
+    EXPECT(!client.next_frame(frame, 2000));
+    EXPECT(!client.connected());
+    EXPECT(access(stream.path.c_str(), F_OK) != 0);
+}
+
+TEST(stream_attaches_shared_memory)
+{
+    Stream stream;
+    stream.publish(stream.painter.resize(64, 48));
+    FrameStreamClient client;
+    EXPECT(client.connect("unix:" + stream.path, true));
+
+    // Attached on the first frame, which covers the whole mapping
+    DecodedFrame frame;
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(client.using_shared_memory());
+    EXPECT(frame.keyframe);
+    EXPECT(frame.pixels == stream.painter.frame);
+
+    const PixelRect link{5, 40, 30, 3};
+    stream.publish(stream.painter.paint(link));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(!frame.keyframe);
+    EXPECT(frame.rects == std::vector<PixelRect>(1, link));
+    EXPECT(frame.pixels == stream.painter.frame);
+
+    // A new size needs a new mapping
+    stream.publish(stream.painter.resize(80, 20));
+    EXPECT(client.next_frame(frame, 2000));
+    EXPECT(client.using_shared_memory());
+    EXPECT(frame.keyframe);
+    EXPECT_EQ(frame.width, 80);
+    EXPECT(frame.pixels == stream.painter.frame);
+    EXPECT_EQ(stream.server.stats().shm_frames, 3u);
+
+    // A second client on the socket gets the current frame as is
+    FrameStreamClient plain;
+    EXPECT(plain.connect("unix:" + stream.path, false));
+    DecodedFrame other;
+    EXPECT(plain.next_frame(other, 2000));
+    EXPECT(other.pixels == stream.painter.frame);
+    EXPECT(!plain.using_shared_memory());
+
+    // Gone clients are dropped
+    client.close();
+    plain.close();
+    EXPECT(eventually([&]
+                      { return stream.server.stats().clients == 0; }));
+}
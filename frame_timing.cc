@@ -0,0 +1,227 @@
+#include "frame_timing.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+int LogLinearHistogram::bucket_index(uint64_t value)
+{
+    value = std::min(value, kMaxValue);
+    if (value < 2 * kSubBuckets)
+        return static_cast<int>(value);
+
+    int shift = static_cast<int>(std::bit_width(value)) - 1 - kSubBucketBits;
+    return shift * kSubBuckets + static_cast<int>(value >> shift);
+}
+
+uint64_t LogLinearHistogram::bucket_lower_bound(int index)
+{
+    if (index < 2 * kSubBuckets)
+        return static_cast<uint64_t>(index);
+
+    int shift = index / kSubBuckets - 1;
+    uint64_t sub_bucket = static_cast<uint64_t>(index - shift * kSubBuckets);
+    return sub_bucket << shift;
+}
+
+void LogLinearHistogram::record(uint64_t value)
+{
+    m_buckets[bucket_index(value)]++;
+    m_min = m_count ? std::min(m_min, value) : value;
+    m_max = std::max(m_max, value);
+    m_sum += value;
+    m_count++;
+}
+
+void LogLinearHistogram::reset()
+{
+    *this = LogLinearHistogram();
+}
+
+uint64_t LogLinearHistogram::percentile(double quantile) const
+{
+    if (!m_count)
+        return 0;
+
+    quantile = std::clamp(quantile, 0.0, 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * m_count)));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = i + 1 < kBucketCount ? bucket_lower_bound(i + 1) - 1 : kMaxValue;
+            return std::clamp(upper, min(), m_max);
+        }
+    }
+    return m_max;
+}
+
+const char *frame_stage_name(FrameStage stage)
+{
+    switch (stage)
+    {
+    case FrameStage::PaintToUpload:
+        return "paint_to_upload";
+    case FrameStage::Composite:
+        return "composite";
+    case FrameStage::ImGuiRender:
+        return "imgui_render";
+    case FrameStage::Present:
+        return "present";
+    case FrameStage::PaintToPresent:
+        return "paint_to_present";
+    case FrameStage::FrameInterval:
+        return "frame_interval";
+    default:
+        return "unknown";
+    }
+}
+
+void FrameTimingRecorder::mark(FramePoint point)
+{
+    int64_t now_us = m_clock.now_us();
+    int index = static_cast<int>(point);
+
+    if (point == FramePoint::Paint)
+    {
+        // Several paints can land between two frames; latency is measured
+        // from the oldest one that isn't on screen yet.
+        if (!m_marked[index])
+        {
+            m_points_us[index] = now_us;
+            m_marked[index] = true;
+        }
+        return;
+    }
+
+    if (point == FramePoint::Present)
+    {
+        end_frame(now_us);
+        return;
+    }
+
+    m_points_us[index] = now_us;
+    m_marked[index] = true;
+
+    if (point == FramePoint::Upload && m_marked[static_cast<int>(FramePoint::Paint)])
+    {
+        record(FrameStage::PaintToUpload, now_us - m_points_us[static_cast<int>(FramePoint::Paint)]);
+    }
+}
+
+void FrameTimingRecorder::record(FrameStage stage, int64_t duration_us)
+{
+    m_histograms[static_cast<int>(stage)].record(static_cast<uint64_t>(std::max<int64_t>(0, duration_us)));
+}
+
+void FrameTimingRecorder::end_frame(int64_t present_us)
+{
+    constexpr int kStart = static_cast<int>(FramePoint::FrameStart);
+    constexpr int kPaint = static_cast<int>(FramePoint::Paint);
+    constexpr int kUpload = static_cast<int>(FramePoint::Upload);
+    constexpr int kComposite = static_cast<int>(FramePoint::Composite);
+    constexpr int kImGui = static_cast<int>(FramePoint::ImGuiRender);
+
+    // Latest in-frame point marked before |point|. An accelerated paint is
+    // uploaded before the frame starts, hence max() rather than order.
+    auto since_previous = [this](int point) -> int64_t
+    {
+        int64_t from = -1;
+        for (int earlier : {kStart, kUpload, kComposite, kImGui})
+        {
+            if (earlier != point && m_marked[earlier] && m_points_us[earlier] <= m_points_us[point])
+                from = std::max(from, m_points_us[earlier]);
+        }
+        return from < 0 ? -1 : m_points_us[point] - from;
+    };
+
+    if (m_marked[kStart])
+    {
+        if (m_last_frame_start_us >= 0)
+            record(FrameStage::FrameInterval, m_points_us[kStart] - m_last_frame_start_us);
+        m_last_frame_start_us = m_points_us[kStart];
+    }
+
+    if (m_marked[kComposite])
+    {
+        int64_t duration = since_previous(kComposite);
+        if (duration >= 0)
+            record(FrameStage::Composite, duration);
+    }
+    if (m_marked[kImGui])
+    {
+        int64_t duration = since_previous(kImGui);
+        if (duration >= 0)
+            record(FrameStage::ImGuiRender, duration);
+        record(FrameStage::Present, present_us - m_points_us[kImGui]);
+    }
+
+    // A paint only reaches the screen once it was uploaded; one that
+    // arrived after this frame's upload waits for the next frame.
+    bool paint_presented = m_marked[kPaint] && m_marked[kUpload] && m_points_us[kPaint] <= m_points_us[kUpload];
+    if (paint_presented)
+    {
+        record(FrameStage::PaintToPresent, present_us - m_points_us[kPaint]);
+    }
+
+    bool keep_paint = m_marked[kPaint] && !paint_presented;
+    for (bool &marked : m_marked)
+        marked = false;
+    m_marked[kPaint] = keep_paint;
+    m_frames++;
+}
+
+void FrameTimingRecorder::reset()
+{
+    for (LogLinearHistogram &histogram : m_histograms)
+        histogram.reset();
+    for (bool &marked : m_marked)
+        marked = false;
+    m_last_frame_start_us = -1;
+    m_frames = 0;
+}
+
+std::string FrameTimingRecorder::to_json() const
+{
+    std::string out = "{\"frames\":" + std::to_string(m_frames) + ",\"unit\":\"us\",\"stages\":[";
+    for (int s = 0; s < static_cast<int>(FrameStage::Count); ++s)
+    {
+        const LogLinearHistogram &histogram = m_histograms[s];
+        char summary[256];
+        snprintf(summary, sizeof(summary),
+                 "%s{\"name\":\"%s\",\"count\":%llu,\"mean\":%.1f,\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu,\"buckets\":[",
+                 s ? "," : "", frame_stage_name(static_cast<FrameStage>(s)),
+                 (unsigned long long)histogram.count(), histogram.mean(), (unsigned long long)histogram.min(),
+                 (unsigned long long)histogram.percentile(0.5), (unsigned long long)histogram.percentile(0.9),
+                 (unsigned long long)histogram.percentile(0.99), (unsigned long long)histogram.max());
+        out += summary;
+
+        // [lower bound, count] of each non-empty bucket
+        bool first = true;
+        for (int i = 0; i < LogLinearHistogram::kBucketCount; ++i)
+        {
+            if (!histogram.bucket_count(i))
+                continue;
+            out += first ? "[" : ",[";
+            out += std::to_string(LogLinearHistogram::bucket_lower_bound(i)) + "," + std::to_string(histogram.bucket_count(i)) + "]";
+            first = false;
+        }
+        out += "]}";
+    }
+    out += "]}\n";
+    return out;
+}
+
+bool FrameTimingRecorder::write_json(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << to_json();
+    return static_cast<bool>(file);
+}
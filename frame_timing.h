@@ -0,0 +1,103 @@
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+
+#include <cstdint>
+#include <string>
+#include "frame_scheduler.h"
+
+// Histogram of microsecond values in fixed memory. Values below
+// 2 * kSubBuckets get a bucket each; above that every power of two is split
+// into kSubBuckets linear buckets, so a reported percentile is within
+// 1/kSubBuckets of the real value. record() never allocates.
+class LogLinearHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr uint64_t kMaxValue = (uint64_t(1) << 32) - 1; // ~71 minutes
+    static constexpr int kBucketCount = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t count() const { return m_count; }
+    uint64_t min() const { return m_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+
+    // |quantile| in [0, 1]. Returns the upper edge of the bucket holding it,
+    // clamped to the recorded max.
+    uint64_t percentile(double quantile) const;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_lower_bound(int index);
+    uint32_t bucket_count(int index) const { return m_buckets[index]; }
+
+private:
+    uint32_t m_buckets[kBucketCount] = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = 0;
+    uint64_t m_max = 0;
+};
+
+// Points in a display frame where a timestamp is taken.
+enum class FramePoint
+{
+    FrameStart,  // display callback entered
+    Paint,       // OnPaint / OnAcceleratedPaint arrived
+    Upload,      // paint is in a backend surface
+    Composite,   // layer quads rebuilt for new damage
+    ImGuiRender, // ImGui draw data encoded
+    Present,     // drawable presented and committed, closes the frame
+    Count
+};
+
+// What the histograms measure. Each in-frame stage runs from the latest
+// earlier point marked in the same frame, so a frame without composite still
+// attributes its time correctly.
+enum class FrameStage
+{
+    PaintToUpload,  // paint arrival until it is uploaded
+    Composite,      // until the layer quads are built
+    ImGuiRender,    // UI build and draw data encode
+    Present,        // present and commit
+    PaintToPresent, // paint arrival until the frame showing it is committed
+    FrameInterval,  // FrameStart to FrameStart
+    Count
+};
+
+const char *frame_stage_name(FrameStage stage);
+
+// Collects the points of each frame and feeds the stage histograms when the
+// frame is presented. Single threaded: everything is marked from the thread
+// that runs both the CEF message loop and the display callback.
+class FrameTimingRecorder
+{
+public:
+    explicit FrameTimingRecorder(const FrameClock &clock) : m_clock(clock) {}
+
+    void mark(FramePoint point);
+    void reset();
+
+    const LogLinearHistogram &histogram(FrameStage stage) const { return m_histograms[static_cast<int>(stage)]; }
+    uint64_t frames() const { return m_frames; }
+
+    // Percentiles and non-empty buckets of every stage; allocates, for dumps.
+    std::string to_json() const;
+    bool write_json(const std::string &path) const;
+
+private:
+    void end_frame(int64_t present_us);
+    void record(FrameStage stage, int64_t duration_us);
+
+    const FrameClock &m_clock;
+    int64_t m_points_us[static_cast<int>(FramePoint::Count)] = {};
+    bool m_marked[static_cast<int>(FramePoint::Count)] = {};
+    int64_t m_last_frame_start_us = -1;
+
+    LogLinearHistogram m_histograms[static_cast<int>(FrameStage::Count)];
+    uint64_t m_frames = 0;
+};
+
+#endif // FRAME_TIMING_H
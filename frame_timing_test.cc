@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "frame_timing.h"
+#include "unit_test.h"
+
+// LogLinearHistogram's buckets and the percentiles read back from them.
+
+TEST(histogram_bucket_edges)
+{
+    using H = LogLinearHistogram;
+    // Exact below 32, then 16 buckets per power of two
+    EXPECT_EQ(H::bucket_index(0), 0);
+    EXPECT_EQ(H::bucket_index(31), 31);
+    EXPECT_EQ(H::bucket_index(32), 32);
+    EXPECT_EQ(H::bucket_index(33), 32);
+    EXPECT_EQ(H::bucket_index(34), 33);
+    EXPECT_EQ(H::bucket_index(63), 47);
+    EXPECT_EQ(H::bucket_index(64), 48);
+    EXPECT_EQ(H::bucket_index(1000), 111);
+    EXPECT_EQ(H::bucket_lower_bound(111), 992u);
+    EXPECT_EQ(H::bucket_index(H::kMaxValue), H::kBucketCount - 1);
+    EXPECT_EQ(H::bucket_index(uint64_t(1) << 40), H::kBucketCount - 1);
+
+    // Every bucket starts where the one before ends, and is at most a
+    // sixteenth of its values wide
+    bool contiguous = true;
+    bool narrow = true;
+    for (int i = 1; i < H::kBucketCount; ++i)
+    {
+        uint64_t lower = H::bucket_lower_bound(i);
+        contiguous = contiguous && H::bucket_index(lower) == i && H::bucket_index(lower - 1) == i - 1;
+        uint64_t width = (i + 1 < H::kBucketCount ? H::bucket_lower_bound(i + 1) : H::kMaxValue + 1) - lower;
+        narrow = narrow && (width == 1 || width * H::kSubBuckets <= lower);
+    }
+    EXPECT(contiguous);
+    EXPECT(narrow);
+}
+
+TEST(histogram_exact_for_small_values)
+{
+    LogLinearHistogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5), 0u);
+    for (uint64_t value = 1; value <= 20; ++value)
+    {
+        histogram.record(value);
+    }
+    EXPECT_EQ(histogram.count(), 20u);
+    EXPECT_EQ(histogram.min(), 1u);
+    EXPECT_EQ(histogram.max(), 20u);
+    EXPECT_EQ(histogram.mean(), 10.5);
+    EXPECT_EQ(histogram.percentile(0.0), 1u);
+    EXPECT_EQ(histogram.percentile(0.5), 10u);
+    EXPECT_EQ(histogram.percentile(0.95), 19u);
+    EXPECT_EQ(histogram.percentile(1.0), 20u);
+    EXPECT_EQ(histogram.percentile(2.0), 20u);
+    EXPECT_EQ(histogram.bucket_count(7), 1u);
+
+    histogram.reset();
+    EXPECT_EQ(histogram.count(), 0u);
+    EXPECT_EQ(histogram.max(), 0u);
+    EXPECT_EQ(histogram.bucket_count(7), 0u);
+}
+
+TEST(histogram_percentiles_of_known_distributions)
+{
+    // Uniform 1..10000: within a sixteenth above the real value
+    LogLinearHistogram uniform;
+    for (uint64_t value = 1; value <= 10000; ++value)
+    {
+        uniform.record(value);
+    }
+    for (double quantile : {0.1, 0.5, 0.9, 0.99, 0.999})
+    {
+        uint64_t real = static_cast<uint64_t>(quantile * 10000 + 0.5);
+        uint64_t reported = uniform.percentile(quantile);
+        EXPECT(reported >= real);
+        EXPECT(reported <= real + real / LogLinearHistogram::kSubBuckets);
+    }
+    EXPECT_EQ(uniform.percentile(1.0), 10000u);
+
+    // Mostly 1 ms frames with a tenth of 50 ms hitches: p90 is the top of
+    // the 1 ms bucket, anything above lands on the hitches, clamped to the max
+    LogLinearHistogram hitches;
+    for (int i = 0; i < 900; ++i)
+    {
+        hitches.record(1000);
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        hitches.record(50000);
+    }
+    EXPECT_EQ(hitches.percentile(0.9), 1023u);
+    EXPECT_EQ(hitches.percentile(0.901), 50000u);
+    EXPECT_EQ(hitches.mean(), 5900.0);
+
+    // A single value is reported as itself, not as its bucket's edge
+    LogLinearHistogram single;
+    single.record(1000);
+    EXPECT_EQ(single.percentile(0.0), 1000u);
+    EXPECT_EQ(single.percentile(0.5), 1000u);
+
+    // Random values: the reported percentile's bucket holds the real one
+    std::mt19937 rng(3);
+    std::exponential_distribution<double> frame_times(1.0 / 8000.0);
+    std::vector<uint64_t> values;
+    LogLinearHistogram random;
+    for (int i = 0; i < 5000; ++i)
+    {
+        values.push_back(static_cast<uint64_t>(frame_times(rng)));
+        random.record(values.back());
+    }
+    std::sort(values.begin(), values.end());
+    for (double quantile : {0.5, 0.9, 0.99})
+    {
+        uint64_t real = values[static_cast<size_t>(std::ceil(quantile * values.size())) - 1];
+        EXPECT_EQ(LogLinearHistogram::bucket_index(random.percentile(quantile)), LogLinearHistogram::bucket_index(real));
+    }
+}
@@ -0,0 +1,551 @@
+// Headless runner for Linux benchmark hosts: one windowless browser with
+// software rendering, painting through MyRenderHandler::OnPaint into a
+// CpuRenderBackend surface. Needs no display or GPU.
+//
+//   shrome [options] <url or fixture path>
+//     --width=N --height=N   view size in logical pixels (1280x720)
+//     --density=N            device pixels per logical one, like a Retina
+//                            screen's 2 (1)
+//     --adaptive-quality     lowers the device scale while the page moves,
+//                            see render_scale.h
+//     --thumbnails           keeps a tab thumbnail current from the paints,
+//                            see thumbnail_cache.h
+//     --memory-budget=MB     releases reclaimable surfaces and staging above
+//                            it, see memory_ledger.h (none)
+//     --occlude-after=N      the window counts as covered after N of the
+//                            --frames, see visibility.h
+//     --fps=N                BeginFrame rate (60)
+//     --frames=N             frames to run after the first paint (600)
+//     --timing=PATH          where to write the frame timing JSON (stdout)
+//     --trace=PATH           also write a Chrome trace
+//     --replay=PATH          replays an input log after the first paint and
+//                            runs until it ends (then --frames more)
+//     --replay-fast          one recorded frame of input per frame instead
+//                            of the recorded timing
+//     --capture=PATH         dumps the view's paints while measuring, for
+//                            shrome_frame_dump
+//     --stream=ADDRESS       serves the view's paints to local clients and
+//                            takes their input (frame_stream.h), e.g.
+//                            unix:/tmp/shrome.sock or tcp:9300
+//
+//   shrome --bench[=name,...] [options]
+//     runs the scenarios in benchmark.cc (all of them by default)
+//     --fixtures=DIR         the pages they load (fixtures/ next to the binary)
+//     --report=PATH          where to write the report JSON (stdout)
+//     --label=TEXT           stored in the report, e.g. the commit
+//     exits with 1 if a scenario didn't give back the memory it took
+//
+// Everything runs on the main thread: the message pump and the frame ticks
+// share one epoll wait, like the render loop does on macOS.
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "benchmark.h"
+#include "cpu_render_backend.h"
+#include "mycef.h"
+
+namespace
+{
+
+struct HeadlessOptions
+{
+    int width = 1280;
+    int height = 720;
+    int fps = 60;
+    int frames = 600;
+    int density = 1;
+    bool adaptive_quality = false;
+    bool thumbnails = false;
+    int memory_budget_mb = 0;
+    int occlude_after = -1;
+    std::string url;
+    std::string timing_path;
+    std::string trace_path;
+    std::string replay_path;
+    bool replay_fast = false;
+    std::string capture_path;
+    std::string stream_address;
+
+    bool bench = false;
+    std::string bench_filter; // comma separated scenario names, empty = all
+    std::string fixtures_dir;
+    std::string report_path;
+    std::string label;
+};
+
+bool parse_int_option(const char *arg, const char *name, int &value)
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+        return false;
+    value = atoi(arg + length + 1);
+    return true;
+}
+
+bool parse_string_option(const char *arg, const char *name, std::string &value)
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+        return false;
+    value = arg + length + 1;
+    return true;
+}
+
+// Local fixtures can be given as plain paths.
+std::string to_url(const std::string &target)
+{
+    if (target.find("://") != std::string::npos)
+        return target;
+
+    char resolved[PATH_MAX];
+    if (!realpath(target.c_str(), resolved))
+        return target;
+    return std::string("file://") + resolved;
+}
+
+std::string executable_dir()
+{
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return ".";
+    path[length] = '\0';
+    std::string dir(path);
+    size_t slash = dir.rfind('/');
+    return slash == std::string::npos ? "." : dir.substr(0, slash);
+}
+
+HeadlessOptions parse_options(int argc, char *argv[])
+{
+    HeadlessOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--bench") == 0 || parse_string_option(arg, "--bench", options.bench_filter))
+        {
+            options.bench = true;
+            continue;
+        }
+        if (strcmp(arg, "--replay-fast") == 0)
+        {
+            options.replay_fast = true;
+            continue;
+        }
+        if (strcmp(arg, "--adaptive-quality") == 0)
+        {
+            options.adaptive_quality = true;
+            continue;
+        }
+        if (strcmp(arg, "--thumbnails") == 0)
+        {
+            options.thumbnails = true;
+            continue;
+        }
+        if (parse_int_option(arg, "--width", options.width) ||
+            parse_int_option(arg, "--height", options.height) ||
+            parse_int_option(arg, "--fps", options.fps) ||
+            parse_int_option(arg, "--frames", options.frames) ||
+            parse_int_option(arg, "--density", options.density) ||
+            parse_int_option(arg, "--memory-budget", options.memory_budget_mb) ||
+            parse_int_option(arg, "--occlude-after", options.occlude_after) ||
+            parse_string_option(arg, "--timing", options.timing_path) ||
+            parse_string_option(arg, "--trace", options.trace_path) ||
+            parse_string_option(arg, "--replay", options.replay_path) ||
+            parse_string_option(arg, "--capture", options.capture_path) ||
+            parse_string_option(arg, "--stream", options.stream_address) ||
+            parse_string_option(arg, "--fixtures", options.fixtures_dir) ||
+            parse_string_option(arg, "--report", options.report_path) ||
+            parse_string_option(arg, "--label", options.label))
+        {
+            continue;
+        }
+        // Anything else starting with - is for CEF
+        if (arg[0] != '-')
+        {
+            options.url = to_url(arg);
+        }
+    }
+    options.fps = options.fps > 0 ? options.fps : 60;
+    options.density = options.density > 0 ? options.density : 1;
+    if (options.fixtures_dir.empty())
+    {
+        options.fixtures_dir = executable_dir() + "/fixtures";
+    }
+    return options;
+}
+
+std::string cache_dir()
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache)
+        return std::string(cache) + "/shrome_headless";
+    const char *home = getenv("HOME");
+    if (!home)
+        return "/tmp/shrome_headless";
+    return std::string(home) + "/.cache/shrome_headless";
+}
+
+// Display frames at a fixed rate, with the message pump served in between.
+class HeadlessLoop
+{
+public:
+    HeadlessLoop(MyApp &app, int fps)
+        : m_app(app),
+          // create_platform_pump_timer() makes an FdPumpTimer on Linux
+          m_pump_timer(static_cast<FdPumpTimer *>(app.m_pump_timer.get())),
+          m_frame_interval_us(1000000 / fps),
+          m_next_frame_us(app.m_frame_clock.now_us())
+    {
+    }
+
+    const FrameClock &clock() const { return m_app.m_frame_clock; }
+
+    // Pumps until the next frame is due, then runs it.
+    void tick()
+    {
+        for (int64_t wait_us = m_next_frame_us - clock().now_us(); wait_us > 0;
+             wait_us = m_next_frame_us - clock().now_us())
+        {
+            m_pump_timer->wait_and_dispatch(static_cast<int>((wait_us + 999) / 1000));
+        }
+        m_next_frame_us += m_frame_interval_us;
+        if (m_next_frame_us < clock().now_us())
+        {
+            // Fell behind, e.g. on a slow load; don't burst to catch up
+            m_next_frame_us = clock().now_us() + m_frame_interval_us;
+        }
+
+        // Same order as drawInMTKView, minus the UI
+        m_app.mark_frame_point(FramePoint::FrameStart);
+        m_app.deliver_frame_input();
+        m_app.request_new_frame();
+        m_app.prepare_for_render();
+        FramePlacement placement;
+        if (m_app.display_layers(placement, m_quads))
+        {
+            m_app.mark_frame_point(FramePoint::Present);
+        }
+    }
+
+    // Ticks until |done| or |timeout_us| passed. Returns whether |done|.
+    template <typename Done>
+    bool tick_until(Done done, int64_t timeout_us)
+    {
+        int64_t deadline_us = clock().now_us() + timeout_us;
+        while (!done())
+        {
+            if (clock().now_us() > deadline_us)
+                return false;
+            tick();
+        }
+        return true;
+    }
+
+private:
+    MyApp &m_app;
+    std::vector<DisplayQuad> m_quads;
+    FdPumpTimer *m_pump_timer;
+    int64_t m_frame_interval_us;
+    int64_t m_next_frame_us;
+};
+
+constexpr int64_t kLoadTimeoutUs = 30000000;
+
+bool selected(const std::string &filter, const std::string &name)
+{
+    if (filter.empty())
+        return true;
+    std::string padded = "," + filter + ",";
+    return padded.find("," + name + ",") != std::string::npos;
+}
+
+BenchmarkResult run_scenario(MyApp &app, HeadlessLoop &loop, const BenchmarkScenario &scenario, const std::string &fixtures_dir)
+{
+    BenchmarkResult result;
+    result.name = scenario.name;
+    result.fixture = scenario.fixture;
+
+    // Measure from the first paint of the loaded page
+    app.reset_paint_stats();
+    app.load_url(to_url(fixtures_dir + "/" + scenario.fixture));
+    if (!loop.tick_until([&app]()
+                         { return !app.is_loading() && app.paint_stats().paints > 0; },
+                         kLoadTimeoutUs))
+    {
+        std::cerr << "benchmark " << scenario.name << ": " << scenario.fixture << " did not load" << std::endl;
+        return result;
+    }
+    for (int frame = 0; frame < scenario.warmup_frames; ++frame)
+    {
+        loop.tick();
+    }
+
+    app.reset_frame_timing();
+    app.reset_paint_stats();
+    app.reset_tile_upload_stats();
+    app.reset_scroll_stats();
+    app.reset_memory_stats();
+    size_t baseline_bytes = app.memory_ledger().total();
+    int64_t start_us = loop.clock().now_us();
+    for (int frame = 0; frame < scenario.frames; ++frame)
+    {
+        if (scenario.step)
+        {
+            scenario.step(app, frame);
+        }
+        loop.tick();
+    }
+
+    const PaintStats &paints = app.paint_stats();
+    result.frames = scenario.frames;
+    result.duration_us = loop.clock().now_us() - start_us;
+    result.presented_frames = app.frame_timing().histogram(FrameStage::PaintToPresent).count();
+    result.paints = paints.paints;
+    result.popup_paints = paints.popup_paints;
+    result.dirty_rects = paints.dirty_rects;
+    result.painted_pixels = paints.painted_pixels;
+    result.dirty_bytes = app.tile_upload_stats().dirty_bytes;
+    result.uploaded_bytes = app.tile_upload_stats().uploaded_bytes;
+    result.scroll_shifts = app.scroll_stats().shifted;
+    result.scroll_rejected = app.scroll_stats().rejected;
+    result.moved_bytes = app.scroll_stats().moved_bytes;
+    result.timing_json = app.frame_timing().to_json();
+
+    // What the scenario left behind once what it opened was closed again
+    result.memory_baseline_bytes = baseline_bytes;
+    result.memory_peak_bytes = app.memory_ledger().stats().peak_bytes;
+    if (scenario.returns_to_memory_baseline)
+    {
+        loop.tick_until([&app, baseline_bytes]()
+                        { return app.memory_ledger().total() <= baseline_bytes; },
+                        2 * app.memory_ledger().config().hidden_popup_release_us);
+    }
+    result.memory_end_bytes = app.memory_ledger().total();
+    if (scenario.returns_to_memory_baseline && result.memory_end_bytes > baseline_bytes)
+    {
+        std::cerr << "benchmark " << scenario.name << ": memory did not return to its baseline, "
+                  << result.memory_end_bytes << " bytes after, " << baseline_bytes << " before" << std::endl;
+    }
+    return result;
+}
+
+bool write_file(const std::string &path, const std::string &contents)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file << contents;
+    return static_cast<bool>(file);
+}
+
+// False when a scenario that should give its memory back didn't.
+bool run_benchmarks(MyApp &app, HeadlessLoop &loop, const HeadlessOptions &options)
+{
+    BenchmarkEnvironment environment;
+    environment.label = options.label;
+    environment.backend = app.backend()->name();
+    environment.width = options.width;
+    environment.height = options.height;
+    environment.fps = options.fps;
+
+    std::vector<BenchmarkResult> results;
+    bool passed = true;
+    for (const BenchmarkScenario &scenario : benchmark_scenarios())
+    {
+        if (!selected(options.bench_filter, scenario.name))
+            continue;
+        std::cerr << "benchmark " << scenario.name << std::endl;
+        results.push_back(run_scenario(app, loop, scenario, options.fixtures_dir));
+        if (scenario.returns_to_memory_baseline && results.back().memory_end_bytes > results.back().memory_baseline_bytes)
+            passed = false;
+    }
+
+    std::string report = benchmark_report_json(environment, results);
+    if (options.report_path.empty())
+    {
+        std::cout << report;
+    }
+    else if (!write_file(options.report_path, report))
+    {
+        std::cerr << "could not write " << options.report_path << std::endl;
+    }
+    return passed;
+}
+
+void run_page(MyApp &app, HeadlessLoop &loop, const HeadlessOptions &options)
+{
+    // Timing starts with the first paint; loading isn't what's measured
+    if (!loop.tick_until([&app]()
+                         { return app.paint_stats().paints > 0; },
+                         kLoadTimeoutUs))
+    {
+        std::cerr << options.url << " did not paint" << std::endl;
+        return;
+    }
+    app.reset_frame_timing();
+    if (!options.capture_path.empty() && !app.start_frame_capture(options.capture_path))
+    {
+        std::cerr << "could not write " << options.capture_path << std::endl;
+        return;
+    }
+    if (!options.stream_address.empty() && !app.start_frame_stream(options.stream_address))
+    {
+        std::cerr << "could not listen on " << options.stream_address << std::endl;
+        app.stop_frame_capture();
+        return;
+    }
+    if (!options.replay_path.empty())
+    {
+        if (!app.start_input_replay(options.replay_path, options.replay_fast ? ReplayPace::Frames : ReplayPace::Recorded))
+        {
+            std::cerr << "could not load " << options.replay_path << std::endl;
+            app.stop_frame_capture();
+            app.stop_frame_stream();
+            return;
+        }
+        while (app.input_replaying())
+        {
+            loop.tick();
+        }
+    }
+    for (int frame = 0; frame < options.frames; ++frame)
+    {
+        if (frame == options.occlude_after)
+        {
+            app.set_window_occluded(true);
+        }
+        loop.tick();
+    }
+    if (app.frame_capturing())
+    {
+        app.stop_frame_capture();
+        FrameCaptureStats capture = app.frame_capture_stats();
+        std::cerr << "captured " << capture.captured << " frames (" << capture.dropped << " dropped) to "
+                  << options.capture_path << std::endl;
+    }
+    if (app.frame_streaming())
+    {
+        FrameStreamStats stream = app.frame_stream_stats();
+        app.stop_frame_stream();
+        std::cerr << "streamed " << stream.frames_sent << " frames (" << stream.frames_skipped << " skipped, "
+                  << stream.shm_frames << " through shared memory), " << stream.inputs_received << " inputs"
+                  << std::endl;
+    }
+    if (app.adaptive_quality())
+    {
+        const RenderScaleStats &scale = app.render_scale_stats();
+        std::cerr << "render scale: " << scale.scale_downs << " steps down, " << scale.restores << " restores, "
+                  << scale.reduced_frames << " of " << scale.frames << " frames reduced" << std::endl;
+    }
+    {
+        const MemoryLedger &memory = app.memory_ledger();
+        std::cerr << "memory: " << memory.total() << " bytes, peak " << memory.stats().peak_bytes << ", "
+                  << memory.stats().popup_releases << " popup releases, " << memory.stats().budget_releases
+                  << " over budget, " << memory.stats().released_bytes << " bytes released" << std::endl;
+    }
+    if (options.occlude_after >= 0)
+    {
+        const VisibilityStats &visibility = app.visibility().stats();
+        std::cerr << "visibility: " << view_visibility_name(app.visibility().state()) << ", " << visibility.paused_frames
+                  << " of " << visibility.frames << " frames paused, " << app.frame_scheduler_stats().throttled_requests
+                  << " BeginFrames throttled, " << app.paint_stats().paints << " paints" << std::endl;
+    }
+    if (app.thumbnails_enabled())
+    {
+        ThumbnailCacheStats thumbs = app.thumbnail_stats();
+        std::cerr << "thumbnails: " << thumbs.refreshes << " refreshes of " << thumbs.paints << " paints, "
+                  << thumbs.downscaled_pixels << " pixels filtered, " << thumbs.thumbnail_bytes << " bytes cached"
+                  << std::endl;
+    }
+
+    if (options.timing_path.empty())
+    {
+        std::cout << app.frame_timing().to_json() << std::endl;
+    }
+    else if (!app.frame_timing().write_json(options.timing_path))
+    {
+        std::cerr << "could not write " << options.timing_path << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Sub-processes are this same executable
+    CefMainArgs main_args(argc, argv);
+    int exit_code = CefExecuteProcess(main_args, nullptr, nullptr);
+    if (exit_code >= 0)
+    {
+        return exit_code;
+    }
+
+    HeadlessOptions options = parse_options(argc, argv);
+    if (options.url.empty() && !options.bench)
+    {
+        std::cerr << "usage: " << argv[0] << " [--width=N --height=N --density=N --adaptive-quality --thumbnails --memory-budget=MB --occlude-after=N --fps=N --frames=N --timing=PATH --trace=PATH --replay=PATH --capture=PATH --stream=ADDRESS] <url or file>\n"
+                  << "       " << argv[0] << " --bench[=name,...] [--fixtures=DIR --report=PATH --label=TEXT]" << std::endl;
+        return 1;
+    }
+
+    CefRefPtr<MyApp> app = new MyApp(std::make_unique<CpuRenderBackend>(), options.width, options.height, options.density);
+    // Scenarios navigate the tab themselves
+    app->m_start_url = options.bench ? "about:blank" : options.url;
+    app->init(options.width, options.height);
+
+    CefSettings settings;
+    settings.windowless_rendering_enabled = true;
+    settings.external_message_pump = true;
+    settings.no_sandbox = true;
+    CefString(&settings.root_cache_path) = cache_dir();
+
+    if (!CefInitialize(main_args, settings, app.get(), nullptr))
+    {
+        return CefGetExitCode();
+    }
+
+    HeadlessLoop loop(*app, options.fps);
+    int exit_code = 0;
+    // OnContextInitialized opens the tab once the pump gets going
+    if (loop.tick_until([&app]()
+                        { return app->get_browser() && app->get_browser()->IsValid(); },
+                        kLoadTimeoutUs))
+    {
+        // The size never changes here, once is enough
+        app->update_view_size(options.width, options.height, options.density);
+        app->set_adaptive_quality(options.adaptive_quality);
+        app->set_thumbnails_enabled(options.thumbnails);
+        app->set_memory_budget(static_cast<size_t>(std::max(0, options.memory_budget_mb)) << 20);
+        if (options.bench)
+        {
+            if (!run_benchmarks(*app, loop, options))
+                exit_code = 1;
+        }
+        else
+        {
+            run_page(*app, loop, options);
+        }
+    }
+    else
+    {
+        std::cerr << "browser was not created" << std::endl;
+    }
+
+    if (!options.trace_path.empty())
+    {
+        trace_write_chrome_json(options.trace_path);
+    }
+
+    app->close(true);
+    loop.tick_until([&app]()
+                    { return app->is_browser_closed(); },
+                    kLoadTimeoutUs);
+    CefShutdown();
+    return exit_code;
+}
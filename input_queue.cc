@@ -0,0 +1,76 @@
+#include "input_queue.h"
+
+#include <cmath>
+
+InputQueue::InputQueue()
+{
+    m_batch.reserve(kCapacity);
+}
+
+bool InputQueue::push(const InputEvent &event)
+{
+    // queued/dropped are only touched by the producer.
+    if (!m_queue.try_push(event))
+    {
+        m_stats.dropped++;
+        return false;
+    }
+    m_stats.queued++;
+    return true;
+}
+
+void InputQueue::drain(const std::function<void(const InputEvent &)> &deliver)
+{
+    m_stats.drains++;
+
+    m_batch.clear();
+    InputEvent event;
+    while (m_batch.size() < kCapacity && m_queue.try_pop(event))
+    {
+        m_batch.push_back(event);
+    }
+
+    for (size_t i = 0; i < m_batch.size(); ++i)
+    {
+        const InputEvent &current = m_batch[i];
+        const InputEvent *next = i + 1 < m_batch.size() ? &m_batch[i + 1] : nullptr;
+        bool same_run = next && next->type == current.type && next->modifiers == current.modifiers;
+
+        if (current.type == InputEvent::Type::MouseMove)
+        {
+            if (same_run)
+            {
+                m_stats.moves_coalesced++;
+                continue;
+            }
+        }
+        else if (current.type == InputEvent::Type::MouseWheel)
+        {
+            m_wheel_carry_x += current.wheel_dx;
+            m_wheel_carry_y += current.wheel_dy;
+            if (same_run)
+            {
+                m_stats.wheels_coalesced++;
+                continue;
+            }
+
+            // Deliver the whole pixels, keep the fraction for next time.
+            double whole_x = std::trunc(m_wheel_carry_x);
+            double whole_y = std::trunc(m_wheel_carry_y);
+            m_wheel_carry_x -= whole_x;
+            m_wheel_carry_y -= whole_y;
+            if (whole_x == 0.0 && whole_y == 0.0)
+                continue;
+
+            InputEvent wheel = current;
+            wheel.wheel_dx = whole_x;
+            wheel.wheel_dy = whole_y;
+            deliver(wheel);
+            m_stats.delivered++;
+            continue;
+        }
+
+        deliver(current);
+        m_stats.delivered++;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "spsc_queue.h"
+
+// Browser input in a CEF-independent form; MyApp converts to CefMouseEvent /
+// CefKeyEvent on delivery.
+struct InputEvent
+{
+    enum class Type : uint8_t
+    {
+        MouseMove,
+        MouseButton,
+        MouseWheel,
+        Key
+    };
+
+    Type type = Type::MouseMove;
+    int x = 0;
+    int y = 0;
+    uint32_t modifiers = 0; // EVENTFLAG_*, includes the pressed mouse buttons
+
+    // MouseButton
+    int button = 0; // cef_mouse_button_type_t
+    bool mouse_up = false;
+    int click_count = 1;
+
+    // MouseWheel. Fractional when queued, whole pixels when delivered.
+    double wheel_dx = 0.0;
+    double wheel_dy = 0.0;
+
+    // Key
+    int key_type = 0; // cef_key_event_type_t
+    int windows_key_code = 0;
+    int native_key_code = 0;
+    bool is_system_key = false;
+    uint16_t character = 0;
+    uint16_t unmodified_character = 0;
+    bool focus_on_editable_field = false;
+};
+
+struct InputQueueStats
+{
+    uint64_t queued = 0;
+    uint64_t dropped = 0;         // queue was full
+    uint64_t delivered = 0;
+    uint64_t moves_coalesced = 0;
+    uint64_t wheels_coalesced = 0;
+    uint64_t drains = 0;
+};
+
+// Collects input from the UI thread and hands it to the browser once per
+// frame. Within a drain, runs of mouse moves with the same modifiers collapse
+// to the last one, and runs of wheel events are summed. Wheel deltas are
+// accumulated in floating point and delivered as whole pixels, the remainder
+// carries over to the next wheel event. Everything else, and the relative
+// order of all delivered events, is kept as queued.
+//
+// push() is for one producer thread, drain() for one consumer thread.
+class InputQueue
+{
+public:
+    static constexpr size_t kCapacity = 4096;
+
+    InputQueue();
+
+    // Returns false (and counts a drop) when the queue is full.
+    bool push(const InputEvent &event);
+
+    void drain(const std::function<void(const InputEvent &)> &deliver);
+
+    const InputQueueStats &stats() const { return m_stats; }
+
+private:
+    SpscQueue<InputEvent, kCapacity> m_queue;
+
+    // Consumer side
+    std::vector<InputEvent> m_batch;
+    double m_wheel_carry_x = 0.0;
+    double m_wheel_carry_y = 0.0;
+
+    InputQueueStats m_stats;
+};
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,178 @@
+#include <vector>
+#include "input_queue.h"
+#include "unit_test.h"
+
+// InputQueue drained once per frame, the way MyApp does before BeginFrame.
+
+namespace
+{
+
+const uint32_t kShift = 1 << 1; // EVENTFLAG_SHIFT_DOWN
+
+InputEvent move(int x, int y, uint32_t modifiers = 0)
+{
+    InputEvent event;
+    event.type = InputEvent::Type::MouseMove;
+    event.x = x;
+    event.y = y;
+    event.modifiers = modifiers;
+    return event;
+}
+
+InputEvent wheel(double dx, double dy, uint32_t modifiers = 0)
+{
+    InputEvent event;
+    event.type = InputEvent::Type::MouseWheel;
+    event.wheel_dx = dx;
+    event.wheel_dy = dy;
+    event.modifiers = modifiers;
+    return event;
+}
+
+InputEvent key(int code)
+{
+    InputEvent event;
+    event.type = InputEvent::Type::Key;
+    event.windows_key_code = code;
+    return event;
+}
+
+std::vector<InputEvent> drain(InputQueue &queue)
+{
+    std::vector<InputEvent> delivered;
+    queue.drain([&](const InputEvent &event)
+                { delivered.push_back(event); });
+    return delivered;
+}
+
+} // namespace
+
+TEST(input_moves_collapse_to_the_last)
+{
+    InputQueue queue;
+    for (int i = 1; i <= 4; ++i)
+    {
+        queue.push(move(i, 10 * i));
+    }
+    // Shift pressed mid-drag starts a new run
+    queue.push(move(5, 50, kShift));
+    queue.push(move(6, 60, kShift));
+    InputEvent press;
+    press.type = InputEvent::Type::MouseButton;
+    press.x = 6;
+    press.y = 60;
+    press.modifiers = kShift;
+    queue.push(press);
+    queue.push(move(7, 70, kShift));
+
+    std::vector<InputEvent> delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), 4u);
+    EXPECT(delivered[0].type == InputEvent::Type::MouseMove);
+    EXPECT_EQ(delivered[0].x, 4);
+    EXPECT_EQ(delivered[0].y, 40);
+    EXPECT_EQ(delivered[0].modifiers, 0u);
+    EXPECT_EQ(delivered[1].x, 6);
+    EXPECT_EQ(delivered[1].modifiers, kShift);
+    // Moves never jump over a click
+    EXPECT(delivered[2].type == InputEvent::Type::MouseButton);
+    EXPECT(delivered[3].type == InputEvent::Type::MouseMove);
+    EXPECT_EQ(delivered[3].x, 7);
+    EXPECT_EQ(queue.stats().moves_coalesced, 4u);
+    EXPECT_EQ(queue.stats().delivered, 4u);
+    EXPECT_EQ(queue.stats().queued, 8u);
+
+    // A run only lasts for one drain
+    queue.push(move(8, 80));
+    EXPECT_EQ(drain(queue).size(), 1u);
+    queue.push(move(9, 90));
+    queue.push(key(65));
+    queue.push(move(10, 100));
+    EXPECT_EQ(drain(queue).size(), 3u);
+    EXPECT_EQ(queue.stats().drains, 3u);
+}
+
+TEST(input_wheel_runs_are_summed)
+{
+    InputQueue queue;
+    InputEvent first = wheel(0, -10);
+    first.x = 5;
+    queue.push(first);
+    InputEvent last = wheel(2, -20);
+    last.x = 8;
+    queue.push(last);
+    queue.push(wheel(0, 4, kShift));
+    queue.push(wheel(0, 6, kShift));
+    queue.push(key(13));
+    queue.push(wheel(-3, 0));
+
+    std::vector<InputEvent> delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), 4u);
+    // At the position of the last one
+    EXPECT_EQ(delivered[0].x, 8);
+    EXPECT_EQ(delivered[0].wheel_dx, 2.0);
+    EXPECT_EQ(delivered[0].wheel_dy, -30.0);
+    EXPECT_EQ(delivered[1].modifiers, kShift);
+    EXPECT_EQ(delivered[1].wheel_dy, 10.0);
+    EXPECT(delivered[2].type == InputEvent::Type::Key);
+    EXPECT_EQ(delivered[3].wheel_dx, -3.0);
+    EXPECT_EQ(queue.stats().wheels_coalesced, 2u);
+}
+
+TEST(input_wheel_fractions_carry_over)
+{
+    // A trackpad's small deltas add up over frames instead of being lost
+    InputQueue queue;
+    const double steps[] = {0.75, 0.75, 0.75, 0.75};
+    const double expected[] = {0.0, 1.0, 1.0, 1.0};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        queue.push(wheel(0, steps[i]));
+        std::vector<InputEvent> delivered = drain(queue);
+        EXPECT_EQ(delivered.size(), expected[i] != 0.0 ? 1u : 0u);
+        if (!delivered.empty())
+            EXPECT_EQ(delivered[0].wheel_dy, expected[i]);
+    }
+    // All of the 3.0 delivered, nothing left over
+    queue.push(wheel(0, 0.5));
+    queue.push(wheel(0, 0.5));
+    std::vector<InputEvent> delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0].wheel_dy, 1.0);
+
+    // Back the other way: truncated towards zero, each axis on its own
+    queue.push(wheel(1.5, -0.25));
+    EXPECT_EQ(drain(queue)[0].wheel_dx, 1.0);
+    queue.push(wheel(-1.75, -0.5));
+    delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0].wheel_dx, -1.0);
+    EXPECT_EQ(delivered[0].wheel_dy, 0.0);
+    queue.push(wheel(0, -0.25));
+    delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0].wheel_dy, -1.0);
+}
+
+TEST(input_full_queue_drops)
+{
+    InputQueue queue;
+    size_t pushed = 0;
+    for (size_t i = 0; i < InputQueue::kCapacity + 10; ++i)
+    {
+        pushed += queue.push(key(static_cast<int>(i))) ? 1 : 0;
+    }
+    EXPECT(pushed < InputQueue::kCapacity + 10);
+    EXPECT_EQ(queue.stats().queued, pushed);
+    EXPECT_EQ(queue.stats().dropped, InputQueue::kCapacity + 10 - pushed);
+
+    // What got in comes out in order
+    std::vector<InputEvent> delivered = drain(queue);
+    EXPECT_EQ(delivered.size(), pushed);
+    bool in_order = true;
+    for (size_t i = 0; i < delivered.size(); ++i)
+    {
+        in_order = in_order && delivered[i].windows_key_code == static_cast<int>(i);
+    }
+    EXPECT(in_order);
+    EXPECT(queue.push(key(0)));
+}
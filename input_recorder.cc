@@ -0,0 +1,390 @@
+#include "input_recorder.h"
+
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+
+constexpr uint8_t kMagic[4] = {'S', 'H', 'R', 'I'};
+constexpr uint64_t kVersion = 1;
+
+class Writer
+{
+public:
+    explicit Writer(std::vector<uint8_t> &out) : m_out(out) {}
+
+    void byte(uint8_t value) { m_out.push_back(value); }
+
+    void varint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            m_out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        m_out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void signed_varint(int64_t value)
+    {
+        varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    void string(const std::string &value)
+    {
+        varint(value.size());
+        m_out.insert(m_out.end(), value.begin(), value.end());
+    }
+
+private:
+    std::vector<uint8_t> &m_out;
+};
+
+// Reads past the end fail once and then keep returning 0.
+class Reader
+{
+public:
+    Reader(const uint8_t *bytes, size_t size) : m_bytes(bytes), m_size(size) {}
+
+    bool ok() const { return m_ok; }
+    bool at_end() const { return m_pos >= m_size; }
+
+    uint8_t byte()
+    {
+        if (m_pos >= m_size)
+        {
+            m_ok = false;
+            return 0;
+        }
+        return m_bytes[m_pos++];
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    int64_t signed_varint()
+    {
+        uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    std::string string()
+    {
+        uint64_t length = varint();
+        if (!m_ok || length > m_size - m_pos)
+        {
+            m_ok = false;
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char *>(m_bytes + m_pos), length);
+        m_pos += length;
+        return value;
+    }
+
+private:
+    const uint8_t *m_bytes;
+    size_t m_size;
+    size_t m_pos = 0;
+    bool m_ok = true;
+};
+
+void encode_input(Writer &writer, const RecordedInput &input)
+{
+    const InputEvent &event = input.event;
+    switch (input.kind)
+    {
+    case RecordedInput::Kind::Frame:
+    case RecordedInput::Kind::ImeCancelComposition:
+        break;
+    case RecordedInput::Kind::Mouse:
+        writer.byte(static_cast<uint8_t>(event.type));
+        writer.signed_varint(event.x);
+        writer.signed_varint(event.y);
+        writer.varint(event.modifiers);
+        if (event.type == InputEvent::Type::MouseButton)
+        {
+            writer.varint(event.button);
+            writer.byte(event.mouse_up);
+            writer.varint(event.click_count);
+        }
+        else if (event.type == InputEvent::Type::MouseWheel)
+        {
+            // Delivered wheel deltas are whole pixels
+            writer.signed_varint(static_cast<int64_t>(event.wheel_dx));
+            writer.signed_varint(static_cast<int64_t>(event.wheel_dy));
+        }
+        break;
+    case RecordedInput::Kind::Key:
+        writer.varint(event.key_type);
+        writer.varint(event.modifiers);
+        writer.signed_varint(event.windows_key_code);
+        writer.signed_varint(event.native_key_code);
+        writer.byte((event.is_system_key ? 1 : 0) | (event.focus_on_editable_field ? 2 : 0));
+        writer.varint(event.character);
+        writer.varint(event.unmodified_character);
+        break;
+    case RecordedInput::Kind::ImeSetComposition:
+        writer.string(input.text);
+        writer.varint(input.underlines.size());
+        for (const ImeUnderline &underline : input.underlines)
+        {
+            writer.varint(underline.from);
+            writer.varint(underline.to);
+            writer.varint(underline.color);
+            writer.varint(underline.background_color);
+            writer.signed_varint(underline.thick);
+            writer.signed_varint(underline.style);
+        }
+        writer.varint(input.replacement_from);
+        writer.varint(input.replacement_to);
+        writer.varint(input.selection_from);
+        writer.varint(input.selection_to);
+        break;
+    case RecordedInput::Kind::ImeCommitText:
+        writer.string(input.text);
+        writer.varint(input.replacement_from);
+        writer.varint(input.replacement_to);
+        writer.signed_varint(input.relative_cursor_pos);
+        break;
+    case RecordedInput::Kind::ImeFinishComposingText:
+        writer.byte(input.keep_selection);
+        break;
+    }
+}
+
+bool decode_input(Reader &reader, RecordedInput &input)
+{
+    InputEvent &event = input.event;
+    switch (input.kind)
+    {
+    case RecordedInput::Kind::Frame:
+    case RecordedInput::Kind::ImeCancelComposition:
+        break;
+    case RecordedInput::Kind::Mouse:
+        event.type = static_cast<InputEvent::Type>(reader.byte());
+        event.x = static_cast<int>(reader.signed_varint());
+        event.y = static_cast<int>(reader.signed_varint());
+        event.modifiers = static_cast<uint32_t>(reader.varint());
+        if (event.type == InputEvent::Type::MouseButton)
+        {
+            event.button = static_cast<int>(reader.varint());
+            event.mouse_up = reader.byte() != 0;
+            event.click_count = static_cast<int>(reader.varint());
+        }
+        else if (event.type == InputEvent::Type::MouseWheel)
+        {
+            event.wheel_dx = static_cast<double>(reader.signed_varint());
+            event.wheel_dy = static_cast<double>(reader.signed_varint());
+        }
+        else if (event.type != InputEvent::Type::MouseMove)
+        {
+            return false;
+        }
+        break;
+    case RecordedInput::Kind::Key:
+    {
+        event.type = InputEvent::Type::Key;
+        event.key_type = static_cast<int>(reader.varint());
+        event.modifiers = static_cast<uint32_t>(reader.varint());
+        event.windows_key_code = static_cast<int>(reader.signed_varint());
+        event.native_key_code = static_cast<int>(reader.signed_varint());
+        uint8_t flags = reader.byte();
+        event.is_system_key = (flags & 1) != 0;
+        event.focus_on_editable_field = (flags & 2) != 0;
+        event.character = static_cast<uint16_t>(reader.varint());
+        event.unmodified_character = static_cast<uint16_t>(reader.varint());
+        break;
+    }
+    case RecordedInput::Kind::ImeSetComposition:
+    {
+        input.text = reader.string();
+        uint64_t count = reader.varint();
+        for (uint64_t i = 0; i < count && reader.ok(); ++i)
+        {
+            ImeUnderline underline;
+            underline.from = static_cast<uint32_t>(reader.varint());
+            underline.to = static_cast<uint32_t>(reader.varint());
+            underline.color = static_cast<uint32_t>(reader.varint());
+            underline.background_color = static_cast<uint32_t>(reader.varint());
+            underline.thick = static_cast<int>(reader.signed_varint());
+            underline.style = static_cast<int>(reader.signed_varint());
+            input.underlines.push_back(underline);
+        }
+        input.replacement_from = static_cast<uint32_t>(reader.varint());
+        input.replacement_to = static_cast<uint32_t>(reader.varint());
+        input.selection_from = static_cast<uint32_t>(reader.varint());
+        input.selection_to = static_cast<uint32_t>(reader.varint());
+        break;
+    }
+    case RecordedInput::Kind::ImeCommitText:
+        input.text = reader.string();
+        input.replacement_from = static_cast<uint32_t>(reader.varint());
+        input.replacement_to = static_cast<uint32_t>(reader.varint());
+        input.relative_cursor_pos = static_cast<int>(reader.signed_varint());
+        break;
+    case RecordedInput::Kind::ImeFinishComposingText:
+        input.keep_selection = reader.byte() != 0;
+        break;
+    default:
+        return false;
+    }
+    return reader.ok();
+}
+
+} // namespace
+
+void encode_input_log(const std::vector<RecordedInput> &inputs, std::vector<uint8_t> &out)
+{
+    Writer writer(out);
+    for (uint8_t b : kMagic)
+        writer.byte(b);
+    writer.varint(kVersion);
+
+    int64_t previous_us = 0;
+    for (const RecordedInput &input : inputs)
+    {
+        writer.byte(static_cast<uint8_t>(input.kind));
+        writer.signed_varint(input.time_us - previous_us);
+        previous_us = input.time_us;
+        encode_input(writer, input);
+    }
+}
+
+bool decode_input_log(const uint8_t *bytes, size_t size, std::vector<RecordedInput> &inputs)
+{
+    inputs.clear();
+    Reader reader(bytes, size);
+    for (uint8_t b : kMagic)
+    {
+        if (reader.byte() != b)
+            return false;
+    }
+    if (reader.varint() != kVersion)
+        return false;
+
+    int64_t time_us = 0;
+    while (!reader.at_end())
+    {
+        RecordedInput input;
+        input.kind = static_cast<RecordedInput::Kind>(reader.byte());
+        time_us += reader.signed_varint();
+        input.time_us = time_us;
+        if (!decode_input(reader, input))
+            return false;
+        inputs.push_back(std::move(input));
+    }
+    return reader.ok();
+}
+
+bool save_input_log(const std::string &path, const std::vector<RecordedInput> &inputs)
+{
+    std::vector<uint8_t> bytes;
+    encode_input_log(inputs, bytes);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(file);
+}
+
+bool load_input_log(const std::string &path, std::vector<RecordedInput> &inputs)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return decode_input_log(bytes.data(), bytes.size(), inputs);
+}
+
+void InputRecorder::start()
+{
+    m_inputs.clear();
+    m_start_us = m_clock.now_us();
+    m_recording = true;
+}
+
+void InputRecorder::record(RecordedInput input)
+{
+    if (!m_recording)
+        return;
+    input.time_us = m_clock.now_us() - m_start_us;
+    m_inputs.push_back(std::move(input));
+}
+
+void InputRecorder::record_frame()
+{
+    if (!m_recording)
+        return;
+    RecordedInput input;
+    input.kind = RecordedInput::Kind::Frame;
+    record(std::move(input));
+}
+
+bool InputReplayer::load(const std::string &path)
+{
+    std::vector<RecordedInput> inputs;
+    if (!load_input_log(path, inputs))
+        return false;
+    set_inputs(std::move(inputs));
+    return true;
+}
+
+void InputReplayer::set_inputs(std::vector<RecordedInput> inputs)
+{
+    m_inputs = std::move(inputs);
+    m_next = 0;
+    m_replaying = false;
+}
+
+void InputReplayer::start(ReplayPace pace)
+{
+    m_pace = pace;
+    m_next = 0;
+    m_start_us = m_clock.now_us();
+    m_replaying = !m_inputs.empty();
+}
+
+size_t InputReplayer::deliver_due(const std::function<void(const RecordedInput &)> &deliver)
+{
+    if (!m_replaying)
+        return 0;
+
+    size_t delivered = 0;
+    int64_t elapsed_us = m_clock.now_us() - m_start_us;
+    while (m_next < m_inputs.size())
+    {
+        const RecordedInput &input = m_inputs[m_next];
+        if (m_pace == ReplayPace::Recorded && input.time_us > elapsed_us)
+            break;
+        m_next++;
+
+        if (input.kind == RecordedInput::Kind::Frame)
+        {
+            // The recorded frame's input is everything up to the next marker
+            if (m_pace == ReplayPace::Frames && delivered > 0)
+                break;
+            continue;
+        }
+        deliver(input);
+        delivered++;
+    }
+
+    if (m_next >= m_inputs.size())
+    {
+        m_replaying = false;
+    }
+    return delivered;
+}
@@ -0,0 +1,123 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "frame_scheduler.h"
+#include "input_queue.h"
+
+// CefCompositionUnderline without CEF.
+struct ImeUnderline
+{
+    uint32_t from = 0;
+    uint32_t to = 0;
+    uint32_t color = 0;
+    uint32_t background_color = 0;
+    int thick = 0;
+    int style = 0;
+};
+
+// One call across the MyApp::inject_* boundary, or the start of a frame.
+struct RecordedInput
+{
+    enum class Kind : uint8_t
+    {
+        Frame, // MyApp::deliver_frame_input(), once per display frame
+        Mouse, // |event|: MouseMove, MouseButton or MouseWheel
+        Key,   // |event|: Key
+        ImeSetComposition,
+        ImeCommitText,
+        ImeFinishComposingText,
+        ImeCancelComposition
+    };
+
+    Kind kind = Kind::Frame;
+    int64_t time_us = 0; // since the recording started
+
+    InputEvent event;
+
+    // IME; ranges are [from, to), UINT32_MAX for CefRange::InvalidRange()
+    std::string text;
+    std::vector<ImeUnderline> underlines;
+    uint32_t replacement_from = UINT32_MAX;
+    uint32_t replacement_to = UINT32_MAX;
+    uint32_t selection_from = UINT32_MAX;
+    uint32_t selection_to = UINT32_MAX;
+    int relative_cursor_pos = 0;
+    bool keep_selection = false;
+};
+
+// The log is a small header followed by one record per input. Times are
+// deltas and every integer is a varint (zigzag for signed), so a mouse move
+// takes about 6 bytes.
+void encode_input_log(const std::vector<RecordedInput> &inputs, std::vector<uint8_t> &out);
+// False if |bytes| isn't a log of this version or is truncated; |inputs|
+// then holds what could be read.
+bool decode_input_log(const uint8_t *bytes, size_t size, std::vector<RecordedInput> &inputs);
+
+bool save_input_log(const std::string &path, const std::vector<RecordedInput> &inputs);
+bool load_input_log(const std::string &path, std::vector<RecordedInput> &inputs);
+
+// Collects what MyApp hands to the browser, timestamped with |clock|.
+class InputRecorder
+{
+public:
+    explicit InputRecorder(const FrameClock &clock) : m_clock(clock) {}
+
+    void start();
+    void stop() { m_recording = false; }
+    bool recording() const { return m_recording; }
+
+    // Stamps |input| and keeps it; a no-op unless recording.
+    void record(RecordedInput input);
+    void record_frame();
+
+    const std::vector<RecordedInput> &inputs() const { return m_inputs; }
+    bool save(const std::string &path) const { return save_input_log(path, m_inputs); }
+
+private:
+    const FrameClock &m_clock;
+    bool m_recording = false;
+    int64_t m_start_us = 0;
+    std::vector<RecordedInput> m_inputs;
+};
+
+enum class ReplayPace
+{
+    Recorded, // each input at its recorded time after start()
+    Frames    // as fast as possible: one recorded frame per call
+};
+
+// Feeds a log back through the same boundary it was recorded at.
+class InputReplayer
+{
+public:
+    explicit InputReplayer(const FrameClock &clock) : m_clock(clock) {}
+
+    bool load(const std::string &path);
+    void set_inputs(std::vector<RecordedInput> inputs);
+
+    void start(ReplayPace pace);
+    void stop() { m_replaying = false; }
+    bool replaying() const { return m_replaying; }
+
+    // Call once per display frame. Hands the due inputs to |deliver| (Frame
+    // markers are skipped) and returns how many; stops at the end of the log.
+    size_t deliver_due(const std::function<void(const RecordedInput &)> &deliver);
+
+    size_t position() const { return m_next; }
+    size_t size() const { return m_inputs.size(); }
+
+private:
+    const FrameClock &m_clock;
+    std::vector<RecordedInput> m_inputs;
+    ReplayPace m_pace = ReplayPace::Recorded;
+    bool m_replaying = false;
+    int64_t m_start_us = 0;
+    size_t m_next = 0;
+};
+
+#endif // INPUT_RECORDER_H
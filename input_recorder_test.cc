@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "input_recorder.h"
+#include "unit_test.h"
+
+// A session recorded at the inject boundary, saved, loaded and replayed.
+
+namespace
+{
+
+RecordedInput mouse(InputEvent::Type type, int x, int y)
+{
+    RecordedInput input;
+    input.kind = RecordedInput::Kind::Mouse;
+    input.event.type = type;
+    input.event.x = x;
+    input.event.y = y;
+    return input;
+}
+
+// Records a few frames of everything MyApp can inject, 16 ms apart.
+std::vector<RecordedInput> record_session(VirtualFrameClock &clock)
+{
+    InputRecorder recorder(clock);
+    RecordedInput ignored = mouse(InputEvent::Type::MouseMove, 1, 1);
+    recorder.record(ignored);
+    clock.advance_us(5000);
+    recorder.start();
+
+    recorder.record_frame();
+    recorder.record(mouse(InputEvent::Type::MouseMove, 10, -3));
+    RecordedInput click = mouse(InputEvent::Type::MouseButton, 10, 20);
+    click.event.modifiers = 1 << 4; // EVENTFLAG_LEFT_MOUSE_BUTTON
+    click.event.button = 0;
+    click.event.click_count = 2;
+    recorder.record(click);
+    click.event.mouse_up = true;
+    clock.advance_us(300);
+    recorder.record(click);
+
+    clock.advance_us(16000);
+    recorder.record_frame();
+    RecordedInput scroll = mouse(InputEvent::Type::MouseWheel, 40, 50);
+    scroll.event.wheel_dx = -3;
+    scroll.event.wheel_dy = 120;
+    recorder.record(scroll);
+    RecordedInput key;
+    key.kind = RecordedInput::Kind::Key;
+    key.event.type = InputEvent::Type::Key;
+    key.event.key_type = 3; // KEYEVENT_CHAR
+    key.event.modifiers = 1 << 1;
+    key.event.windows_key_code = 0x41;
+    key.event.native_key_code = -1;
+    key.event.is_system_key = true;
+    key.event.focus_on_editable_field = true;
+    key.event.character = 0x3a9; // Ω, past a single varint byte
+    key.event.unmodified_character = 'a';
+    recorder.record(key);
+
+    clock.advance_us(16000);
+    recorder.record_frame();
+    RecordedInput compose;
+    compose.kind = RecordedInput::Kind::ImeSetComposition;
+    compose.text = "\xe3\x81\x8b\xe3\x81\xaa";
+    compose.underlines.push_back(ImeUnderline{0, 1, 0xff000000u, 0, 1, 0});
+    compose.underlines.push_back(ImeUnderline{1, 2, 0xff0000ffu, 0xffffff00u, 0, 2});
+    compose.selection_from = 2;
+    compose.selection_to = 2;
+    recorder.record(compose);
+    RecordedInput commit;
+    commit.kind = RecordedInput::Kind::ImeCommitText;
+    commit.text = "\xe5\x8f\xaf";
+    commit.replacement_from = 0;
+    commit.replacement_to = 2;
+    commit.relative_cursor_pos = -1;
+    recorder.record(commit);
+    RecordedInput finish;
+    finish.kind = RecordedInput::Kind::ImeFinishComposingText;
+    finish.keep_selection = true;
+    recorder.record(finish);
+    RecordedInput cancel;
+    cancel.kind = RecordedInput::Kind::ImeCancelComposition;
+    recorder.record(cancel);
+
+    recorder.stop();
+    recorder.record(ignored);
+    recorder.record_frame();
+    return recorder.inputs();
+}
+
+bool same_input(const RecordedInput &a, const RecordedInput &b)
+{
+    const InputEvent &x = a.event;
+    const InputEvent &y = b.event;
+    bool same_event = x.type == y.type && x.x == y.x && x.y == y.y && x.modifiers == y.modifiers &&
+                      x.button == y.button && x.mouse_up == y.mouse_up && x.click_count == y.click_count &&
+                      x.wheel_dx == y.wheel_dx && x.wheel_dy == y.wheel_dy && x.key_type == y.key_type &&
+                      x.windows_key_code == y.windows_key_code && x.native_key_code == y.native_key_code &&
+                      x.is_system_key == y.is_system_key && x.character == y.character &&
+                      x.unmodified_character == y.unmodified_character &&
+                      x.focus_on_editable_field == y.focus_on_editable_field;
+    bool same_underlines = a.underlines.size() == b.underlines.size();
+    for (size_t i = 0; same_underlines && i < a.underlines.size(); ++i)
+    {
+        const ImeUnderline &u = a.underlines[i];
+        const ImeUnderline &v = b.underlines[i];
+        same_underlines = u.from == v.from && u.to == v.to && u.color == v.color &&
+                          u.background_color == v.background_color && u.thick == v.thick && u.style == v.style;
+    }
+    return a.kind == b.kind && a.time_us == b.time_us && same_event && same_underlines && a.text == b.text &&
+           a.replacement_from == b.replacement_from && a.replacement_to == b.replacement_to &&
+           a.selection_from == b.selection_from && a.selection_to == b.selection_to &&
+           a.relative_cursor_pos == b.relative_cursor_pos && a.keep_selection == b.keep_selection;
+}
+
+bool same_inputs(const std::vector<RecordedInput> &a, const std::vector<RecordedInput> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (!same_input(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(recorder_keeps_inputs_while_recording)
+{
+    VirtualFrameClock clock;
+    std::vector<RecordedInput> inputs = record_session(clock);
+    EXPECT_EQ(inputs.size(), 12u);
+    EXPECT(inputs.front().kind == RecordedInput::Kind::Frame);
+    EXPECT_EQ(inputs.front().time_us, 0);
+    EXPECT_EQ(inputs[3].time_us, 300);
+    EXPECT_EQ(inputs.back().time_us, 32300);
+}
+
+TEST(recorder_log_round_trips)
+{
+    VirtualFrameClock clock;
+    std::vector<RecordedInput> inputs = record_session(clock);
+
+    std::string path = unit_test_temp_path("input.log");
+    EXPECT(save_input_log(path, inputs));
+    std::vector<RecordedInput> loaded;
+    EXPECT(load_input_log(path, loaded));
+    EXPECT(same_inputs(loaded, inputs));
+    std::remove(path.c_str());
+
+    // Cut anywhere, the log reads as broken rather than as a shorter one,
+    // except right after the header or a whole record
+    std::vector<size_t> whole_records;
+    for (size_t count = 0; count <= inputs.size(); ++count)
+    {
+        std::vector<uint8_t> encoded;
+        encode_input_log(std::vector<RecordedInput>(inputs.begin(), inputs.begin() + count), encoded);
+        whole_records.push_back(encoded.size());
+    }
+    std::vector<uint8_t> bytes;
+    encode_input_log(inputs, bytes);
+    EXPECT_EQ(bytes.size(), whole_records.back());
+    int mismatches = 0;
+    for (size_t size = 0; size <= bytes.size(); ++size)
+    {
+        bool expected = std::find(whole_records.begin(), whole_records.end(), size) != whole_records.end();
+        if (decode_input_log(bytes.data(), size, loaded) != expected)
+            mismatches++;
+    }
+    EXPECT_EQ(mismatches, 0);
+    EXPECT(same_inputs(loaded, inputs));
+
+    // Not a log of this version
+    std::vector<uint8_t> other = bytes;
+    other[4] = 2;
+    EXPECT(!decode_input_log(other.data(), other.size(), loaded));
+    other = bytes;
+    other[0] = 'X';
+    EXPECT(!decode_input_log(other.data(), other.size(), loaded));
+    EXPECT(!load_input_log(unit_test_temp_path("missing.log"), loaded));
+}
+
+TEST(replayer_delivers_at_recorded_times)
+{
+    VirtualFrameClock clock;
+    std::vector<RecordedInput> inputs = record_session(clock);
+
+    std::string path = unit_test_temp_path("replay.log");
+    EXPECT(save_input_log(path, inputs));
+    InputReplayer replayer(clock);
+    EXPECT(replayer.load(path));
+    std::remove(path.c_str());
+    EXPECT_EQ(replayer.size(), inputs.size());
+
+    std::vector<RecordedInput> delivered;
+    auto deliver = [&](const RecordedInput &input)
+    { delivered.push_back(input); };
+    replayer.start(ReplayPace::Recorded);
+    EXPECT_EQ(replayer.deliver_due(deliver), 2u);
+    clock.advance_us(300);
+    EXPECT_EQ(replayer.deliver_due(deliver), 1u);
+    clock.advance_us(15999);
+    EXPECT_EQ(replayer.deliver_due(deliver), 0u);
+    clock.advance_us(1);
+    EXPECT_EQ(replayer.deliver_due(deliver), 2u);
+    clock.advance_us(1000000);
+    EXPECT_EQ(replayer.deliver_due(deliver), 4u);
+    EXPECT(!replayer.replaying());
+    EXPECT_EQ(replayer.deliver_due(deliver), 0u);
+
+    // Everything but the frame markers, as recorded
+    std::vector<RecordedInput> expected;
+    for (const RecordedInput &input : inputs)
+    {
+        if (input.kind != RecordedInput::Kind::Frame)
+            expected.push_back(input);
+    }
+    EXPECT(same_inputs(delivered, expected));
+}
+
+TEST(replayer_delivers_a_frame_per_call)
+{
+    VirtualFrameClock clock;
+    InputReplayer replayer(clock);
+    replayer.set_inputs(record_session(clock));
+    replayer.start(ReplayPace::Frames);
+    auto ignore = [](const RecordedInput &) {};
+    EXPECT_EQ(replayer.deliver_due(ignore), 3u);
+    EXPECT_EQ(replayer.deliver_due(ignore), 2u);
+    EXPECT_EQ(replayer.deliver_due(ignore), 4u);
+    EXPECT(!replayer.replaying());
+
+    // Nothing to replay
+    replayer.set_inputs({});
+    replayer.start(ReplayPace::Frames);
+    EXPECT(!replayer.replaying());
+}
@@ -0,0 +1,222 @@
+#include "layer_tree.h"
+
+#include <algorithm>
+
+void subtract_rect(const PixelRect &rect, const PixelRect &hole, std::vector<PixelRect> &out)
+{
+    PixelRect overlap = intersect_rects(rect, hole);
+    if (overlap.empty())
+    {
+        out.push_back(rect);
+        return;
+    }
+
+    // Full-width bands above and below, then what is left and right of the
+    // hole in between
+    if (overlap.y > rect.y)
+        out.push_back(PixelRect{rect.x, rect.y, rect.width, overlap.y - rect.y});
+    if (overlap.bottom() < rect.bottom())
+        out.push_back(PixelRect{rect.x, overlap.bottom(), rect.width, rect.bottom() - overlap.bottom()});
+    if (overlap.x > rect.x)
+        out.push_back(PixelRect{rect.x, overlap.y, overlap.x - rect.x, overlap.height});
+    if (overlap.right() < rect.right())
+        out.push_back(PixelRect{overlap.right(), overlap.y, rect.right() - overlap.right(), overlap.height});
+}
+
+LayerId LayerTree::add_layer(int z)
+{
+    Layer layer;
+    layer.id = m_next_id++;
+    layer.z = z;
+    auto position = std::upper_bound(m_layers.begin(), m_layers.end(), z,
+                                     [](int value, const Layer &other)
+                                     { return value < other.z; });
+    m_layers.insert(position, layer);
+    return layer.id;
+}
+
+void LayerTree::remove_layer(LayerId id)
+{
+    auto it = std::find_if(m_layers.begin(), m_layers.end(), [id](const Layer &layer)
+                           { return layer.id == id; });
+    if (it == m_layers.end())
+        return;
+    damage_bounds(*it);
+    m_layers.erase(it);
+}
+
+const Layer *LayerTree::find(LayerId id) const
+{
+    for (const Layer &layer : m_layers)
+    {
+        if (layer.id == id)
+            return &layer;
+    }
+    return nullptr;
+}
+
+Layer *LayerTree::layer(LayerId id)
+{
+    return const_cast<Layer *>(find(id));
+}
+
+void LayerTree::damage_bounds(const Layer &layer)
+{
+    if (layer.visible && layer.surface != kInvalidSurface)
+        m_damage.add(layer.bounds);
+}
+
+void LayerTree::set_surface(LayerId id, SurfaceId surface)
+{
+    Layer *l = layer(id);
+    if (!l || l->surface == surface)
+        return;
+    damage_bounds(*l);
+    l->surface = surface;
+    damage_bounds(*l);
+}
+
+void LayerTree::set_bounds(LayerId id, const PixelRect &bounds)
+{
+    Layer *l = layer(id);
+    if (!l || l->bounds == bounds)
+        return;
+    // Uncover the old place, draw at the new one
+    damage_bounds(*l);
+    l->bounds = bounds;
+    damage_bounds(*l);
+}
+
+void LayerTree::set_visible(LayerId id, bool visible)
+{
+    Layer *l = layer(id);
+    if (!l || l->visible == visible)
+        return;
+    l->visible = true;
+    damage_bounds(*l);
+    l->visible = visible;
+}
+
+void LayerTree::set_opacity(LayerId id, float opacity)
+{
+    Layer *l = layer(id);
+    if (!l || l->opacity == opacity)
+        return;
+    l->opacity = opacity;
+    damage_bounds(*l);
+}
+
+void LayerTree::set_opaque(LayerId id, bool opaque)
+{
+    Layer *l = layer(id);
+    if (!l || l->opaque == opaque)
+        return;
+    l->opaque = opaque;
+    damage_bounds(*l);
+}
+
+void LayerTree::set_hit_testable(LayerId id, bool hit_testable)
+{
+    if (Layer *l = layer(id))
+        l->hit_testable = hit_testable;
+}
+
+void LayerTree::set_input_offset(LayerId id, int dx, int dy)
+{
+    if (Layer *l = layer(id))
+    {
+        l->input_dx = dx;
+        l->input_dy = dy;
+    }
+}
+
+void LayerTree::damage(LayerId id, const PixelRect &rect)
+{
+    const Layer *l = find(id);
+    if (!l || !l->visible || l->surface == kInvalidSurface)
+        return;
+    PixelRect clipped = intersect_rects(rect, l->bounds);
+    if (!clipped.empty())
+        m_damage.add(clipped);
+}
+
+void LayerTree::damage(LayerId id)
+{
+    if (const Layer *l = find(id))
+        damage_bounds(*l);
+}
+
+LayerId LayerTree::hit_test(int x, int y) const
+{
+    for (auto it = m_layers.rbegin(); it != m_layers.rend(); ++it)
+    {
+        if (it->visible && it->hit_testable && it->surface != kInvalidSurface && it->bounds.contains(x, y))
+            return it->id;
+    }
+    return kInvalidLayer;
+}
+
+bool LayerTree::build_frame(const PixelRect &target, std::vector<LayerQuad> &quads, DirtyRegion &damage)
+{
+    quads.clear();
+    damage = m_damage;
+    damage.clip(target);
+    m_damage.clear();
+
+    m_stats.frames++;
+    bool changed = !damage.empty();
+    if (!changed)
+        m_stats.frames_unchanged++;
+    m_stats.damaged_pixels += damage.area();
+
+    // Front to back, so every layer knows what is covered in front of it;
+    // the quads are reversed at the end.
+    m_covered.clear();
+    for (auto it = m_layers.rbegin(); it != m_layers.rend(); ++it)
+    {
+        const Layer &layer = *it;
+        if (!layer.visible || layer.surface == kInvalidSurface || layer.opacity <= 0.0f)
+            continue;
+        PixelRect visible = intersect_rects(layer.bounds, target);
+        if (visible.empty())
+            continue;
+
+        m_pieces.assign(1, visible);
+        for (const PixelRect &hole : m_covered)
+        {
+            m_split.clear();
+            for (const PixelRect &piece : m_pieces)
+            {
+                subtract_rect(piece, hole, m_split);
+            }
+            m_pieces.swap(m_split);
+            if (m_pieces.empty())
+                break;
+        }
+
+        // Pushed in reverse so the final reverse keeps them top to bottom
+        int64_t drawn = 0;
+        for (auto piece = m_pieces.rbegin(); piece != m_pieces.rend(); ++piece)
+        {
+            LayerQuad quad;
+            quad.layer = layer.id;
+            quad.surface = layer.surface;
+            quad.dest = *piece;
+            quad.u0 = static_cast<float>(piece->x - layer.bounds.x) / layer.bounds.width;
+            quad.v0 = static_cast<float>(piece->y - layer.bounds.y) / layer.bounds.height;
+            quad.u1 = static_cast<float>(piece->right() - layer.bounds.x) / layer.bounds.width;
+            quad.v1 = static_cast<float>(piece->bottom() - layer.bounds.y) / layer.bounds.height;
+            quad.opacity = layer.opacity;
+            quads.push_back(quad);
+            drawn += piece->area();
+        }
+        m_stats.drawn_pixels += drawn;
+        m_stats.occluded_pixels += visible.area() - drawn;
+
+        if (layer.opaque && layer.opacity >= 1.0f)
+            m_covered.push_back(visible);
+    }
+    std::reverse(quads.begin(), quads.end());
+    m_stats.quads += quads.size();
+    return changed;
+}
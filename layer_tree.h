@@ -0,0 +1,111 @@
+#ifndef LAYER_TREE_H
+#define LAYER_TREE_H
+
+#include <cstdint>
+#include <vector>
+#include "dirty_region.h"
+#include "render_backend.h"
+
+using LayerId = uint32_t;
+constexpr LayerId kInvalidLayer = 0;
+
+// Something drawn into the frame: the browser view, its popup, later the
+// context menu, a find bar or devtools. Coordinates are target pixels.
+struct Layer
+{
+    LayerId id = kInvalidLayer;
+    SurfaceId surface = kInvalidSurface;
+    PixelRect bounds; // the surface is stretched into this
+    int z = 0;        // higher is in front; equal z in order of creation
+    float opacity = 1.0f;
+    bool opaque = false; // every pixel of the content covers what is below
+    bool visible = false;
+    bool hit_testable = true;
+    // Added to input coordinates that land on the layer, e.g. for a popup
+    // that was moved to fit into the view.
+    int input_dx = 0;
+    int input_dy = 0;
+};
+
+// One piece of a layer to draw, back to front. |u0|..|v1| is the part of the
+// layer's content it shows, 0..1 across the whole layer.
+struct LayerQuad
+{
+    LayerId layer = kInvalidLayer;
+    SurfaceId surface = kInvalidSurface;
+    PixelRect dest;
+    float u0 = 0.0f;
+    float v0 = 0.0f;
+    float u1 = 1.0f;
+    float v1 = 1.0f;
+    float opacity = 1.0f;
+};
+
+struct LayerTreeStats
+{
+    uint64_t frames = 0;
+    uint64_t frames_unchanged = 0; // nothing damaged since the frame before
+    uint64_t quads = 0;
+    uint64_t drawn_pixels = 0;
+    uint64_t occluded_pixels = 0; // of visible layers, under opaque ones
+    uint64_t damaged_pixels = 0;
+};
+
+// The layers of the frame in z order. It is drawn straight into the final
+// target each frame, there is no intermediate composite: only the parts of
+// each layer that no opaque layer in front of it covers become quads.
+//
+// Damage is what changed in the target since the last build_frame(): layers
+// damage what they cover when they move, show, hide or are repainted.
+class LayerTree
+{
+public:
+    LayerId add_layer(int z);
+    void remove_layer(LayerId id);
+    const Layer *find(LayerId id) const;
+
+    void set_surface(LayerId id, SurfaceId surface);
+    void set_bounds(LayerId id, const PixelRect &bounds);
+    void set_visible(LayerId id, bool visible);
+    void set_opacity(LayerId id, float opacity);
+    void set_opaque(LayerId id, bool opaque);
+    void set_hit_testable(LayerId id, bool hit_testable);
+    void set_input_offset(LayerId id, int dx, int dy);
+
+    // |rect| of the layer's content changed, in target pixels.
+    void damage(LayerId id, const PixelRect &rect);
+    // All of the layer's bounds.
+    void damage(LayerId id);
+    void damage_target(const PixelRect &rect) { m_damage.add(rect); }
+
+    // The front-most visible, hit testable layer at |x|, |y|, or
+    // kInvalidLayer.
+    LayerId hit_test(int x, int y) const;
+
+    // The quads that draw |target|, back to front, with occluded parts of
+    // layers left out. |damage| gets what changed since the last call.
+    // Returns whether anything did.
+    bool build_frame(const PixelRect &target, std::vector<LayerQuad> &quads, DirtyRegion &damage);
+
+    const LayerTreeStats &stats() const { return m_stats; }
+    void reset_stats() { m_stats = LayerTreeStats(); }
+
+private:
+    Layer *layer(LayerId id);
+    void damage_bounds(const Layer &layer);
+
+    std::vector<Layer> m_layers; // sorted by z, stable
+    LayerId m_next_id = 1;
+    DirtyRegion m_damage;
+    LayerTreeStats m_stats;
+
+    // Scratch for build_frame()
+    std::vector<PixelRect> m_covered;
+    std::vector<PixelRect> m_pieces;
+    std::vector<PixelRect> m_split;
+};
+
+// |rect| minus |hole|, as up to four rects appended to |out|.
+void subtract_rect(const PixelRect &rect, const PixelRect &hole, std::vector<PixelRect> &out);
+
+#endif // LAYER_TREE_H
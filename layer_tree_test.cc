@@ -0,0 +1,223 @@
+#include <vector>
+#include "layer_tree.h"
+#include "unit_test.h"
+
+// LayerTree with a view and a popup over it, the way MyApp sets them up.
+
+namespace
+{
+
+const PixelRect kTarget{0, 0, 100, 80};
+const PixelRect kPopup{10, 20, 30, 40};
+
+struct Tree
+{
+    LayerTree layers;
+    LayerId view;
+    LayerId popup;
+    std::vector<LayerQuad> quads;
+    DirtyRegion damage;
+
+    Tree()
+    {
+        view = layers.add_layer(0);
+        layers.set_surface(view, 1);
+        layers.set_bounds(view, kTarget);
+        layers.set_opaque(view, true);
+        layers.set_visible(view, true);
+        popup = layers.add_layer(1);
+        layers.set_surface(popup, 2);
+        layers.set_bounds(popup, kPopup);
+        layers.set_opaque(popup, true);
+        layers.set_visible(popup, true);
+    }
+
+    bool build() { return layers.build_frame(kTarget, quads, damage); }
+
+    int64_t drawn(LayerId id) const
+    {
+        int64_t area = 0;
+        for (const LayerQuad &quad : quads)
+        {
+            if (quad.layer == id)
+                area += quad.dest.area();
+        }
+        return area;
+    }
+};
+
+// The pieces cover |rect| minus |hole| exactly once
+bool covers_exactly(const std::vector<PixelRect> &pieces, const PixelRect &rect, const PixelRect &hole)
+{
+    for (int y = rect.y - 1; y <= rect.bottom(); ++y)
+    {
+        for (int x = rect.x - 1; x <= rect.right(); ++x)
+        {
+            int count = 0;
+            for (const PixelRect &piece : pieces)
+            {
+                count += piece.contains(x, y) ? 1 : 0;
+            }
+            if (count != (rect.contains(x, y) && !hole.contains(x, y) ? 1 : 0))
+                return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(subtract_rect_pieces)
+{
+    const PixelRect rect{10, 10, 20, 16};
+    const PixelRect holes[] = {
+        {40, 40, 5, 5},   // apart
+        {15, 14, 4, 3},   // inside: four pieces
+        {0, 0, 50, 50},   // all of it
+        {5, 12, 10, 100}, // the left edge
+        {25, 5, 2, 10},   // a notch in the top
+    };
+    const size_t expected_pieces[] = {1, 4, 0, 2, 3};
+    for (size_t i = 0; i < sizeof(holes) / sizeof(holes[0]); ++i)
+    {
+        std::vector<PixelRect> out;
+        subtract_rect(rect, holes[i], out);
+        EXPECT_EQ(out.size(), expected_pieces[i]);
+        EXPECT(covers_exactly(out, rect, holes[i]));
+    }
+
+    // Appends rather than replaces
+    std::vector<PixelRect> out(1, PixelRect{0, 0, 1, 1});
+    subtract_rect(rect, holes[1], out);
+    EXPECT_EQ(out.size(), 5u);
+}
+
+TEST(layer_occluded_parts_are_not_drawn)
+{
+    Tree tree;
+    tree.build();
+
+    // The view around the popup, back to front, then the popup
+    EXPECT_EQ(tree.quads.size(), 5u);
+    EXPECT_EQ(tree.quads.back().layer, tree.popup);
+    EXPECT(tree.quads.back().dest == kPopup);
+    EXPECT_EQ(tree.drawn(tree.view), kTarget.area() - kPopup.area());
+    std::vector<PixelRect> pieces;
+    for (size_t i = 0; i + 1 < tree.quads.size(); ++i)
+    {
+        EXPECT_EQ(tree.quads[i].layer, tree.view);
+        pieces.push_back(tree.quads[i].dest);
+    }
+    EXPECT(covers_exactly(pieces, kTarget, kPopup));
+    EXPECT_EQ(tree.layers.stats().occluded_pixels, static_cast<uint64_t>(kPopup.area()));
+    EXPECT_EQ(tree.layers.stats().drawn_pixels, static_cast<uint64_t>(kTarget.area()));
+
+    // Each piece shows its own part of the view's content
+    for (size_t i = 0; i + 1 < tree.quads.size(); ++i)
+    {
+        const LayerQuad &quad = tree.quads[i];
+        EXPECT_EQ(quad.u0, quad.dest.x / 100.0f);
+        EXPECT_EQ(quad.v1, quad.dest.bottom() / 80.0f);
+    }
+
+    // A popup that isn't opaque, or is faded, hides nothing
+    tree.layers.set_opaque(tree.popup, false);
+    tree.build();
+    EXPECT_EQ(tree.quads.size(), 2u);
+    EXPECT(tree.quads[0].dest == kTarget);
+    tree.layers.set_opaque(tree.popup, true);
+    tree.layers.set_opacity(tree.popup, 0.5f);
+    tree.build();
+    EXPECT_EQ(tree.quads.size(), 2u);
+    EXPECT_EQ(tree.quads[1].opacity, 0.5f);
+
+    // A view that is hidden or has no surface isn't drawn at all, and one
+    // fully behind an opaque layer leaves no quads
+    tree.layers.set_opacity(tree.popup, 1.0f);
+    tree.layers.set_bounds(tree.popup, kTarget);
+    tree.build();
+    EXPECT_EQ(tree.quads.size(), 1u);
+    EXPECT_EQ(tree.quads[0].layer, tree.popup);
+    tree.layers.set_visible(tree.popup, false);
+    tree.layers.set_surface(tree.view, kInvalidSurface);
+    tree.build();
+    EXPECT(tree.quads.empty());
+}
+
+TEST(layer_hit_test_order)
+{
+    Tree tree;
+    EXPECT_EQ(tree.layers.hit_test(15, 25), tree.popup);
+    EXPECT_EQ(tree.layers.hit_test(5, 5), tree.view);
+    EXPECT_EQ(tree.layers.hit_test(100, 5), kInvalidLayer);
+
+    // Equal z: the later one is in front; lower z is behind whatever order
+    LayerId menu = tree.layers.add_layer(1);
+    tree.layers.set_surface(menu, 3);
+    tree.layers.set_bounds(menu, PixelRect{0, 0, 20, 30});
+    tree.layers.set_visible(menu, true);
+    LayerId back = tree.layers.add_layer(-1);
+    tree.layers.set_surface(back, 4);
+    tree.layers.set_bounds(back, kTarget);
+    tree.layers.set_visible(back, true);
+    EXPECT_EQ(tree.layers.hit_test(15, 25), menu);
+    EXPECT_EQ(tree.layers.hit_test(15, 35), tree.popup);
+    EXPECT_EQ(tree.layers.hit_test(90, 70), tree.view);
+
+    // Hidden, not hit testable and surfaceless layers let input through
+    tree.layers.set_visible(menu, false);
+    EXPECT_EQ(tree.layers.hit_test(15, 25), tree.popup);
+    tree.layers.set_hit_testable(tree.popup, false);
+    EXPECT_EQ(tree.layers.hit_test(15, 25), tree.view);
+    tree.layers.set_surface(tree.view, kInvalidSurface);
+    EXPECT_EQ(tree.layers.hit_test(15, 25), back);
+    tree.layers.remove_layer(back);
+    EXPECT_EQ(tree.layers.hit_test(15, 25), kInvalidLayer);
+    EXPECT(tree.layers.find(back) == nullptr);
+}
+
+TEST(layer_damage)
+{
+    Tree tree;
+    EXPECT(tree.build());
+    EXPECT(tree.damage.rects() == std::vector<PixelRect>(1, kTarget));
+
+    // Nothing happened since
+    EXPECT(!tree.build());
+    EXPECT(tree.damage.empty());
+    EXPECT_EQ(tree.layers.stats().frames_unchanged, 1u);
+
+    // Moving damages both places, nothing else
+    const PixelRect moved{60, 10, 30, 40};
+    tree.layers.set_bounds(tree.popup, moved);
+    EXPECT(tree.build());
+    EXPECT_EQ(tree.damage.area(), kPopup.area() + moved.area());
+    EXPECT(tree.damage.bounds() == bounding_rect(kPopup, moved));
+
+    // A repaint is clipped to the layer, a layer's damage to the target
+    tree.layers.damage(tree.popup, PixelRect{50, 0, 20, 20});
+    tree.build();
+    EXPECT(tree.damage.rects() == std::vector<PixelRect>(1, PixelRect{60, 10, 10, 10}));
+    tree.layers.set_bounds(tree.popup, PixelRect{90, 70, 30, 40});
+    tree.build();
+    EXPECT_EQ(tree.damage.area(), moved.area() + 10 * 10);
+
+    // Hiding uncovers the layer once; a hidden layer's repaints don't count
+    tree.layers.set_visible(tree.popup, false);
+    EXPECT(tree.build());
+    EXPECT(tree.damage.rects() == std::vector<PixelRect>(1, PixelRect{90, 70, 10, 10}));
+    tree.layers.damage(tree.popup);
+    tree.layers.damage(tree.popup, PixelRect{90, 70, 5, 5});
+    EXPECT(!tree.build());
+
+    // Changing input offsets or hit testing draws nothing new
+    tree.layers.set_input_offset(tree.view, 3, 4);
+    tree.layers.set_hit_testable(tree.view, false);
+    EXPECT(!tree.build());
+
+    // Removing a visible layer uncovers it
+    tree.layers.remove_layer(tree.view);
+    EXPECT(tree.build());
+    EXPECT(tree.damage.rects() == std::vector<PixelRect>(1, kTarget));
+    EXPECT(tree.quads.empty());
+}
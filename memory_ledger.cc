@@ -0,0 +1,78 @@
+#include "memory_ledger.h"
+
+const char *memory_category_name(MemoryCategory category)
+{
+    switch (category)
+    {
+    case MemoryCategory::ViewSurface:
+        return "view surface";
+    case MemoryCategory::PopupSurface:
+        return "popup surface";
+    case MemoryCategory::ThumbnailSurfaces:
+        return "thumbnail surfaces";
+    case MemoryCategory::PooledIdle:
+        return "pooled idle";
+    case MemoryCategory::BackendScratch:
+        return "backend scratch";
+    case MemoryCategory::ViewStaging:
+        return "view staging";
+    case MemoryCategory::PopupStaging:
+        return "popup staging";
+    case MemoryCategory::ScrollShadow:
+        return "scroll shadow";
+    case MemoryCategory::TileHashes:
+        return "tile hashes";
+    case MemoryCategory::Thumbnails:
+        return "thumbnails";
+    case MemoryCategory::FrameStream:
+        return "frame stream";
+    case MemoryCategory::FrameCapture:
+        return "frame capture";
+    case MemoryCategory::Count:
+        break;
+    }
+    return "?";
+}
+
+MemoryLedger::MemoryLedger(const MemoryBudgetConfig &config)
+    : m_config(config)
+{
+}
+
+void MemoryLedger::set(MemoryCategory category, size_t bytes)
+{
+    m_bytes[static_cast<int>(category)] = bytes;
+}
+
+size_t MemoryLedger::total() const
+{
+    size_t total = 0;
+    for (size_t bytes : m_bytes)
+    {
+        total += bytes;
+    }
+    return total;
+}
+
+bool MemoryLedger::end_frame()
+{
+    size_t current = total();
+    if (current > m_stats.peak_bytes)
+        m_stats.peak_bytes = current;
+    if (!over_budget())
+        return false;
+    m_stats.over_budget_frames++;
+    return true;
+}
+
+void MemoryLedger::count_release(size_t before, size_t after)
+{
+    if (before > after)
+        m_stats.released_bytes += before - after;
+}
+
+void MemoryLedger::reset_stats()
+{
+    m_stats = MemoryLedgerStats();
+    m_stats.peak_bytes = total();
+}
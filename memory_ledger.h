@@ -0,0 +1,88 @@
+#ifndef MEMORY_LEDGER_H
+#define MEMORY_LEDGER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// What MyApp keeps memory for. Surfaces are counted at the size of their
+// allocation (pooled ones are rounded up); surfaces CEF shares with us
+// belong to CEF and count nothing.
+enum class MemoryCategory
+{
+    ViewSurface,
+    PopupSurface,
+    ThumbnailSurfaces, // the UI's copies of the thumbnails
+    PooledIdle,        // freed surfaces the backend keeps for reuse
+    BackendScratch,    // e.g. Metal's staging texture for move_region()
+    ViewStaging,       // OnPaint copies waiting for upload
+    PopupStaging,
+    ScrollShadow,      // ScrollDetector's copy of the view surface
+    TileHashes,
+    Thumbnails,        // ThumbnailCache's staging frames and thumbnails
+    FrameStream,
+    FrameCapture,
+    Count
+};
+
+const char *memory_category_name(MemoryCategory category);
+
+// What may be released without losing anything on screen: the popup's
+// surface and staging while it is hidden, idle pooled surfaces, scratch.
+struct MemoryBudgetConfig
+{
+    // Above this total the reclaimable memory is released right away. 0
+    // for no budget.
+    size_t budget_bytes = 0;
+    // A popup hidden this long gives its memory back in any case.
+    int64_t hidden_popup_release_us = 1000000;
+};
+
+enum class MemoryPressure
+{
+    Moderate, // release what is reclaimable
+    Critical, // and what can be rebuilt, like the UI's thumbnail surfaces
+};
+
+struct MemoryLedgerStats
+{
+    size_t peak_bytes = 0;
+    uint64_t over_budget_frames = 0;
+    uint64_t popup_releases = 0;     // hidden popups that gave their memory back
+    uint64_t budget_releases = 0;    // releases because of the budget
+    uint64_t pressure_events = 0;
+    uint64_t released_bytes = 0;     // by all of the above
+};
+
+// Bytes per category, refreshed by the owner once per display frame from
+// whatever holds them, and the budget to hold them against. Keeps no
+// pointers into anything, so it never has to be told about frees.
+class MemoryLedger
+{
+public:
+    explicit MemoryLedger(const MemoryBudgetConfig &config = MemoryBudgetConfig());
+
+    void set(MemoryCategory category, size_t bytes);
+    size_t bytes(MemoryCategory category) const { return m_bytes[static_cast<int>(category)]; }
+    size_t total() const;
+
+    // Call after the categories were set for a frame. Returns true when the
+    // total is over the budget.
+    bool end_frame();
+
+    void set_budget(size_t budget_bytes) { m_config.budget_bytes = budget_bytes; }
+    const MemoryBudgetConfig &config() const { return m_config; }
+    bool over_budget() const { return m_config.budget_bytes && total() > m_config.budget_bytes; }
+
+    // |before| and |after| are totals around a release.
+    void count_release(size_t before, size_t after);
+    MemoryLedgerStats &stats() { return m_stats; }
+    const MemoryLedgerStats &stats() const { return m_stats; }
+    void reset_stats();
+
+private:
+    MemoryBudgetConfig m_config;
+    size_t m_bytes[static_cast<int>(MemoryCategory::Count)] = {};
+    MemoryLedgerStats m_stats;
+};
+
+#endif // MEMORY_LEDGER_H
@@ -0,0 +1,145 @@
+#include <vector>
+#include "cpu_render_backend.h"
+#include "memory_ledger.h"
+#include "paint_staging.h"
+#include "unit_test.h"
+
+// The popup's memory accounting as MyApp does it, on the CPU backend: what
+// opening a popup takes has to come back once it is hidden and released.
+
+namespace
+{
+
+// MyApp's view and popup, without CEF
+struct Host
+{
+    CpuRenderBackend backend;
+    MemoryLedger ledger;
+    SurfaceId view = kInvalidSurface;
+    SurfaceId popup = kInvalidSurface;
+    PaintStagingRing view_staging;
+    PaintStagingRing popup_staging;
+    bool popup_shown = false;
+
+    // MyApp::measure_memory(), for what is here
+    void measure()
+    {
+        ledger.set(MemoryCategory::ViewSurface, backend.surface_bytes(view));
+        ledger.set(MemoryCategory::PopupSurface, backend.surface_bytes(popup));
+        ledger.set(MemoryCategory::PooledIdle, backend.surface_pool_stats()->idle_bytes);
+        ledger.set(MemoryCategory::BackendScratch, backend.scratch_bytes());
+        ledger.set(MemoryCategory::ViewStaging, view_staging.memory_bytes());
+        ledger.set(MemoryCategory::PopupStaging, popup_staging.memory_bytes());
+    }
+
+    // A paint staged by the paint thread and uploaded by the render loop
+    void paint(SurfaceId &surface, PaintStagingRing &staging, int width, int height)
+    {
+        std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, 0x80);
+        DirtyRegion dirty;
+        dirty.add(PixelRect{0, 0, width, height});
+        staging.publish(dirty, pixels.data(), width, height);
+        DirtyRegion damage;
+        const StagedFrame *frame = staging.acquire(damage);
+        if (!frame)
+            return;
+        if (surface == kInvalidSurface)
+            surface = backend.create_surface(width, height, false);
+        for (const PixelRect &rect : damage.rects())
+        {
+            backend.upload_region(surface, rect, frame->pixels.data() + rect.y * frame->stride() + rect.x * 4,
+                                  frame->stride());
+        }
+    }
+
+    // MyApp::release_reclaimable_memory()
+    size_t release()
+    {
+        measure();
+        size_t before = ledger.total();
+        if (!popup_shown)
+        {
+            if (popup != kInvalidSurface)
+                backend.destroy_surface(popup);
+            popup = kInvalidSurface;
+            popup_staging.release();
+        }
+        backend.release_idle_memory();
+        measure();
+        size_t after = ledger.total();
+        ledger.count_release(before, after);
+        return before > after ? before - after : 0;
+    }
+};
+
+} // namespace
+
+TEST(memory_popup_returns_to_baseline)
+{
+    Host host;
+    host.paint(host.view, host.view_staging, 640, 480);
+    host.measure();
+    host.ledger.end_frame();
+    const size_t baseline = host.ledger.total();
+    EXPECT(baseline > 0);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        host.popup_shown = true;
+        host.paint(host.popup, host.popup_staging, 200 + round * 50, 300);
+        host.measure();
+        host.ledger.end_frame();
+        EXPECT(host.ledger.total() > baseline);
+        EXPECT(host.ledger.bytes(MemoryCategory::PopupSurface) > 0);
+        EXPECT(host.ledger.bytes(MemoryCategory::PopupStaging) > 0);
+
+        // Hidden, it keeps everything until it is released
+        host.popup_shown = false;
+        host.measure();
+        EXPECT(host.ledger.total() > baseline);
+
+        size_t peak = host.ledger.stats().peak_bytes;
+        EXPECT(host.release() > 0);
+        EXPECT_EQ(host.ledger.total(), baseline);
+        EXPECT_EQ(host.ledger.bytes(MemoryCategory::PopupSurface), 0u);
+        EXPECT_EQ(host.ledger.bytes(MemoryCategory::PopupStaging), 0u);
+        EXPECT_EQ(host.ledger.bytes(MemoryCategory::PooledIdle), 0u);
+        EXPECT(peak > baseline);
+    }
+    EXPECT(host.ledger.stats().released_bytes > 0);
+
+    // A shown popup isn't released
+    host.popup_shown = true;
+    host.paint(host.popup, host.popup_staging, 200, 300);
+    EXPECT_EQ(host.release(), 0u);
+    EXPECT(host.ledger.total() > baseline);
+}
+
+TEST(memory_ledger_budget)
+{
+    MemoryLedger ledger;
+    ledger.set(MemoryCategory::ViewSurface, 1000);
+    ledger.set(MemoryCategory::ViewStaging, 500);
+    ledger.set(MemoryCategory::ViewSurface, 2000);
+    EXPECT_EQ(ledger.total(), 2500u);
+
+    // No budget, never over
+    EXPECT(!ledger.end_frame());
+    EXPECT_EQ(ledger.stats().peak_bytes, 2500u);
+
+    ledger.set_budget(2000);
+    EXPECT(ledger.over_budget());
+    EXPECT(ledger.end_frame());
+    EXPECT_EQ(ledger.stats().over_budget_frames, 1u);
+
+    ledger.set(MemoryCategory::ViewStaging, 0);
+    EXPECT(!ledger.end_frame());
+    ledger.count_release(2500, 2000);
+    ledger.count_release(2000, 2100);
+    EXPECT_EQ(ledger.stats().released_bytes, 500u);
+    EXPECT_EQ(ledger.stats().peak_bytes, 2500u);
+
+    ledger.reset_stats();
+    EXPECT_EQ(ledger.stats().peak_bytes, 2000u);
+    EXPECT_EQ(ledger.stats().over_budget_frames, 0u);
+}
@@ -0,0 +1,304 @@
+#include "message_pump.h"
+
+#include <algorithm>
+
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Timers may fire a little early; that still counts as due.
+static constexpr int64_t kWakeupSlackUs = 1000;
+
+MessagePumpScheduler::MessagePumpScheduler(const FrameClock &clock, std::function<void()> do_work,
+                                           const MessagePumpConfig &config)
+    : m_clock(clock), m_do_work(std::move(do_work)), m_config(config)
+{
+}
+
+void MessagePumpScheduler::schedule(int64_t delay_ms)
+{
+    int64_t delay_us = std::max<int64_t>(0, delay_ms) * 1000;
+    int64_t when = m_clock.now_us() + delay_us;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.requested++;
+        if (delay_ms <= 0)
+        {
+            m_stats.immediate++;
+            m_pending_immediate = true;
+        }
+
+        if (when >= m_pending_us)
+        {
+            // Already covered by the pending wakeup; remember it in case CEF
+            // doesn't ask again after that one ran.
+            m_stats.coalesced++;
+            if (!m_pending_idle)
+            {
+                m_deferred_us = std::min(m_deferred_us, when);
+            }
+            return;
+        }
+
+        if (m_pending_us != kNoWakeup)
+        {
+            m_stats.rearmed++;
+            if (!m_pending_idle)
+            {
+                m_deferred_us = std::min(m_deferred_us, m_pending_us);
+            }
+        }
+        m_pending_us = when;
+        m_pending_idle = false;
+
+        // A slice in progress picks immediate requests up by itself.
+        if (m_running && delay_ms <= 0)
+            return;
+    }
+
+    if (m_timer)
+    {
+        m_timer->arm(delay_us);
+    }
+}
+
+int64_t MessagePumpScheduler::take_next_wakeup(int64_t now)
+{
+    if (m_deferred_us < m_pending_us)
+    {
+        m_pending_us = m_deferred_us;
+        m_pending_idle = false;
+        m_deferred_us = kNoWakeup;
+    }
+
+    if (m_pending_us == kNoWakeup)
+    {
+        m_pending_us = now + m_config.max_idle_us;
+        m_pending_idle = true;
+    }
+    return m_pending_us;
+}
+
+bool MessagePumpScheduler::run()
+{
+    int64_t start = m_clock.now_us();
+    bool idle;
+    bool served_immediate;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.wakeups++;
+        if (m_pending_us != kNoWakeup && m_pending_us > start + kWakeupSlackUs)
+        {
+            // Stale wakeup from a timer that has since been moved.
+            int64_t delay = m_pending_us - start;
+            if (m_timer)
+            {
+                m_timer->arm(delay);
+            }
+            return false;
+        }
+
+        idle = m_pending_idle;
+        served_immediate = m_pending_immediate;
+        m_pending_us = kNoWakeup;
+        m_pending_idle = false;
+        m_pending_immediate = false;
+        m_running = true;
+    }
+
+    int64_t next;
+    int64_t now;
+    for (;;)
+    {
+        m_do_work();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.runs++;
+        if (idle)
+        {
+            m_stats.idle_runs++;
+            idle = false;
+        }
+
+        now = m_clock.now_us();
+        bool more = m_pending_us <= now + kWakeupSlackUs;
+        if (more && now - start < m_config.work_budget_us)
+        {
+            served_immediate |= m_pending_immediate;
+            m_pending_us = kNoWakeup;
+            m_pending_idle = false;
+            m_pending_immediate = false;
+            continue;
+        }
+
+        if (more)
+        {
+            m_stats.over_budget++;
+        }
+        m_running = false;
+        next = take_next_wakeup(now);
+        break;
+    }
+
+    if (m_timer)
+    {
+        m_timer->arm(std::max<int64_t>(0, next - now));
+    }
+    return served_immediate;
+}
+
+MessagePumpStats MessagePumpScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+#ifdef __APPLE__
+
+// One-shot timer source on the main queue.
+class DispatchPumpTimer : public PumpTimer
+{
+public:
+    explicit DispatchPumpTimer(std::function<void()> on_fire)
+        : m_on_fire(std::move(on_fire))
+    {
+        m_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_set_context(m_source, this);
+        dispatch_source_set_event_handler_f(m_source, &DispatchPumpTimer::fire);
+        dispatch_source_set_timer(m_source, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(m_source);
+    }
+
+    ~DispatchPumpTimer() override
+    {
+        // Cancelling stops handlers that haven't started; we're on the main
+        // queue, so none is running.
+        dispatch_source_cancel(m_source);
+        dispatch_release(m_source);
+    }
+
+    void arm(int64_t delay_us) override
+    {
+        dispatch_source_set_timer(m_source, dispatch_time(DISPATCH_TIME_NOW, delay_us * NSEC_PER_USEC),
+                                  DISPATCH_TIME_FOREVER, 500 * NSEC_PER_USEC);
+    }
+
+    void cancel() override
+    {
+        dispatch_source_set_timer(m_source, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    }
+
+private:
+    static void fire(void *context)
+    {
+        DispatchPumpTimer *timer = static_cast<DispatchPumpTimer *>(context);
+        // One-shot: stays quiet until armed again.
+        timer->cancel();
+        timer->m_on_fire();
+    }
+
+    std::function<void()> m_on_fire;
+    dispatch_source_t m_source;
+};
+
+std::unique_ptr<PumpTimer> create_platform_pump_timer(std::function<void()> on_fire)
+{
+    return std::unique_ptr<PumpTimer>(new DispatchPumpTimer(std::move(on_fire)));
+}
+
+#endif // __APPLE__
+
+#ifdef __linux__
+
+FdPumpTimer::FdPumpTimer(std::function<void()> on_fire)
+    : m_on_fire(std::move(on_fire))
+{
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = m_timer_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_timer_fd, &event);
+    event.data.fd = m_wake_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event);
+}
+
+FdPumpTimer::~FdPumpTimer()
+{
+    for (int fd : {m_epoll_fd, m_wake_fd, m_timer_fd})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+void FdPumpTimer::arm(int64_t delay_us)
+{
+    if (delay_us <= 0)
+    {
+        // A zero it_value would disarm the timerfd, so wake through the eventfd.
+        uint64_t one = 1;
+        ssize_t written = write(m_wake_fd, &one, sizeof(one));
+        (void)written;
+        return;
+    }
+
+    itimerspec spec = {};
+    spec.it_value.tv_sec = delay_us / 1000000;
+    spec.it_value.tv_nsec = (delay_us % 1000000) * 1000;
+    timerfd_settime(m_timer_fd, 0, &spec, nullptr);
+}
+
+void FdPumpTimer::cancel()
+{
+    itimerspec spec = {};
+    timerfd_settime(m_timer_fd, 0, &spec, nullptr);
+    uint64_t value;
+    while (read(m_wake_fd, &value, sizeof(value)) > 0)
+    {
+    }
+}
+
+bool FdPumpTimer::wait_and_dispatch(int timeout_ms)
+{
+    epoll_event events[2];
+    int count = epoll_wait(m_epoll_fd, events, 2, timeout_ms);
+    if (count <= 0)
+        return false;
+
+    // Drain both; any of them firing means "run now".
+    uint64_t value;
+    while (read(m_timer_fd, &value, sizeof(value)) > 0)
+    {
+    }
+    while (read(m_wake_fd, &value, sizeof(value)) > 0)
+    {
+    }
+
+    dispatch();
+    return true;
+}
+
+void FdPumpTimer::dispatch()
+{
+    m_on_fire();
+}
+
+std::unique_ptr<PumpTimer> create_platform_pump_timer(std::function<void()> on_fire)
+{
+    return std::unique_ptr<PumpTimer>(new FdPumpTimer(std::move(on_fire)));
+}
+
+#endif // __linux__
@@ -0,0 +1,115 @@
+#ifndef MESSAGE_PUMP_H
+#define MESSAGE_PUMP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "frame_scheduler.h"
+
+// One-shot wakeup on the thread that runs CEF's message loop. arm() may be
+// called from any thread and replaces whatever wakeup was pending.
+class PumpTimer
+{
+public:
+    virtual ~PumpTimer() = default;
+    virtual void arm(int64_t delay_us) = 0;
+    virtual void cancel() = 0;
+};
+
+// Creates the timer for this platform (a dispatch source on the main queue on
+// macOS, timerfd + eventfd on Linux). |on_fire| runs on the loop thread.
+std::unique_ptr<PumpTimer> create_platform_pump_timer(std::function<void()> on_fire);
+
+#ifdef __linux__
+// Linux has no main queue to post to: the host loop waits on fd() and calls
+// dispatch() when it becomes readable.
+class FdPumpTimer : public PumpTimer
+{
+public:
+    explicit FdPumpTimer(std::function<void()> on_fire);
+    ~FdPumpTimer() override;
+
+    void arm(int64_t delay_us) override;
+    void cancel() override;
+
+    int fd() const { return m_epoll_fd; }
+    // Waits up to |timeout_ms| (-1 = forever) and fires if the timer expired.
+    // Returns whether it fired.
+    bool wait_and_dispatch(int timeout_ms);
+    void dispatch();
+
+private:
+    std::function<void()> m_on_fire;
+    int m_timer_fd = -1;
+    int m_wake_fd = -1;  // eventfd for immediate wakeups
+    int m_epoll_fd = -1; // both of the above
+};
+#endif
+
+struct MessagePumpConfig
+{
+    // Upper bound for back-to-back CefDoMessageLoopWork() calls in one slice.
+    // CEF often asks for more work from inside the work; past the budget that
+    // waits for the next wakeup so the render loop gets the thread back.
+    int64_t work_budget_us = 4000;
+    // The loop still runs this often when CEF asks for nothing.
+    int64_t max_idle_us = 33333;
+};
+
+struct MessagePumpStats
+{
+    uint64_t requested = 0;      // OnScheduleMessagePumpWork calls
+    uint64_t immediate = 0;      // ... of which with delay <= 0
+    uint64_t coalesced = 0;      // requests folded into an already pending wakeup
+    uint64_t rearmed = 0;        // requests that moved the pending wakeup earlier
+    uint64_t wakeups = 0;        // timer firings
+    uint64_t runs = 0;           // CefDoMessageLoopWork() calls
+    uint64_t idle_runs = 0;      // runs nobody asked for (max_idle_us)
+    uint64_t over_budget = 0;    // slices cut short by work_budget_us
+};
+
+// Turns CEF's stream of OnScheduleMessagePumpWork(delay) calls into a single
+// pending wakeup at the earliest requested time. Requests that land at or
+// after the pending one are dropped; requests made while the work runs are
+// served in the same slice as long as it stays within the budget.
+class MessagePumpScheduler
+{
+public:
+    MessagePumpScheduler(const FrameClock &clock, std::function<void()> do_work,
+                         const MessagePumpConfig &config = MessagePumpConfig());
+
+    // Must be set before the first schedule() and stay valid while CEF can
+    // still call it.
+    void set_timer(PumpTimer *timer) { m_timer = timer; }
+
+    // Thread safe.
+    void schedule(int64_t delay_ms);
+
+    // Runs the due work; call from the timer's callback on the loop thread.
+    // Returns whether an immediate request was served.
+    bool run();
+
+    MessagePumpStats stats() const;
+
+private:
+    static constexpr int64_t kNoWakeup = INT64_MAX;
+
+    // Picks the next wakeup once the pending one was served. Needs m_mutex.
+    int64_t take_next_wakeup(int64_t now);
+
+    const FrameClock &m_clock;
+    std::function<void()> m_do_work;
+    MessagePumpConfig m_config;
+    PumpTimer *m_timer = nullptr;
+
+    mutable std::mutex m_mutex;
+    int64_t m_pending_us = kNoWakeup;  // the armed wakeup
+    int64_t m_deferred_us = kNoWakeup; // earliest request later than that one
+    bool m_pending_immediate = false;
+    bool m_pending_idle = false;
+    bool m_running = false;
+    MessagePumpStats m_stats;
+};
+
+#endif // MESSAGE_PUMP_H
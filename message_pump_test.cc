@@ -0,0 +1,137 @@
+#include <vector>
+#include "message_pump.h"
+#include "unit_test.h"
+
+// MessagePumpScheduler on a VirtualFrameClock, with a timer that only
+// records what it was armed for; fire() plays the timer going off.
+
+namespace
+{
+
+struct FakeTimer : PumpTimer
+{
+    std::vector<int64_t> arms; // delays, in order
+
+    void arm(int64_t delay_us) override { arms.push_back(delay_us); }
+    void cancel() override {}
+};
+
+struct Pump
+{
+    VirtualFrameClock clock;
+    FakeTimer timer;
+    int work = 0;
+    // What a CefDoMessageLoopWork() call takes and whether it asks for more
+    int64_t work_us = 0;
+    int ask_again = 0;
+    MessagePumpScheduler scheduler{clock, [this] { do_work(); }};
+
+    Pump() { scheduler.set_timer(&timer); }
+
+    void do_work()
+    {
+        work++;
+        clock.advance_us(work_us);
+        if (ask_again > 0)
+        {
+            ask_again--;
+            scheduler.schedule(0);
+        }
+    }
+
+    // The timer goes off when it was last armed for
+    bool fire()
+    {
+        clock.advance_us(timer.arms.back());
+        return scheduler.run();
+    }
+};
+
+} // namespace
+
+TEST(pump_requests_fold_into_one_wakeup)
+{
+    Pump pump;
+    pump.scheduler.schedule(10);
+    pump.scheduler.schedule(20);
+    pump.scheduler.schedule(10);
+    EXPECT(pump.timer.arms == std::vector<int64_t>{10000});
+    EXPECT_EQ(pump.scheduler.stats().coalesced, 2u);
+
+    // An earlier one moves the wakeup
+    pump.scheduler.schedule(4);
+    EXPECT_EQ(pump.timer.arms.back(), 4000);
+    EXPECT_EQ(pump.scheduler.stats().rearmed, 1u);
+
+    // The one it moved is still served after it
+    EXPECT(!pump.fire());
+    EXPECT_EQ(pump.work, 1);
+    EXPECT_EQ(pump.clock.now_us(), 4000);
+    EXPECT_EQ(pump.timer.arms.back(), 6000);
+    pump.fire();
+    EXPECT_EQ(pump.work, 2);
+
+    // With nothing asked for the loop still runs now and then
+    const int64_t idle = MessagePumpConfig().max_idle_us;
+    EXPECT_EQ(pump.timer.arms.back(), idle);
+    pump.fire();
+    EXPECT_EQ(pump.work, 3);
+    EXPECT_EQ(pump.scheduler.stats().idle_runs, 1u);
+
+    // A request later than the idle wakeup is served by it, one before it
+    // replaces it
+    pump.scheduler.schedule(100);
+    EXPECT_EQ(pump.scheduler.stats().coalesced, 3u);
+    pump.scheduler.schedule(0);
+    EXPECT_EQ(pump.timer.arms.back(), 0);
+    EXPECT(pump.fire());
+    EXPECT_EQ(pump.scheduler.stats().idle_runs, 1u);
+    EXPECT_EQ(pump.timer.arms.back(), idle);
+    EXPECT_EQ(pump.scheduler.stats().immediate, 1u);
+}
+
+TEST(pump_work_stays_within_budget)
+{
+    // CEF asks for more from inside every call, each taking 1.5 ms: the
+    // slice stops once 4 ms are used and comes back right away.
+    Pump pump;
+    pump.work_us = 1500;
+    pump.ask_again = 100;
+    pump.scheduler.schedule(0);
+    EXPECT(pump.fire());
+    EXPECT_EQ(pump.work, 3);
+    EXPECT_EQ(pump.clock.now_us(), 4500);
+    EXPECT_EQ(pump.scheduler.stats().over_budget, 1u);
+
+    // Requests made during the slice didn't arm the timer, the end did
+    EXPECT(pump.timer.arms == (std::vector<int64_t>{0, 0}));
+    EXPECT_EQ(pump.scheduler.stats().requested, 4u);
+
+    // Once CEF is done the slice ends on its own
+    pump.ask_again = 1;
+    EXPECT(pump.fire());
+    EXPECT_EQ(pump.work, 5);
+    EXPECT_EQ(pump.scheduler.stats().over_budget, 1u);
+    EXPECT_EQ(pump.scheduler.stats().runs, 5u);
+    EXPECT_EQ(pump.timer.arms.back(), MessagePumpConfig().max_idle_us);
+}
+
+TEST(pump_stale_wakeup_rearms)
+{
+    Pump pump;
+    pump.scheduler.schedule(10);
+
+    // Woken early by a timer armed before: no work, armed for what is left
+    pump.clock.advance_us(3000);
+    EXPECT(!pump.scheduler.run());
+    EXPECT_EQ(pump.work, 0);
+    EXPECT_EQ(pump.timer.arms.back(), 7000);
+    EXPECT_EQ(pump.scheduler.stats().wakeups, 1u);
+
+    // A little early is close enough
+    pump.clock.advance_us(6500);
+    pump.scheduler.run();
+    EXPECT_EQ(pump.work, 1);
+    EXPECT_EQ(pump.scheduler.stats().runs, 1u);
+    EXPECT_EQ(pump.scheduler.stats().wakeups, 2u);
+}
@@ -0,0 +1,114 @@
+#ifndef METAL_RENDER_BACKEND_H
+#define METAL_RENDER_BACKEND_H
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "render_backend.h"
+
+namespace MTL
+{
+    class Device;
+    class Texture;
+    class Buffer;
+    class CommandQueue;
+    class CommandBuffer;
+    class BlitCommandEncoder;
+    class DepthStencilState;
+    class RenderPipelineState;
+    class RenderCommandEncoder;
+};
+
+// RenderBackend on top of metal-cpp, using the shaders from cef.metal.
+// Textures it creates come from a SurfacePool; imported IOSurfaces are
+// wrapped once and the wrappers kept while CEF cycles through them.
+//
+// Moves are blits on |command_queue|, which has to be the queue the view
+// draws the frame with: they are committed by present(), ahead of the
+// frame, so Metal runs them in order without the CPU waiting on any.
+class MetalRenderBackend : public RenderBackend, private SurfaceAllocator
+{
+public:
+    MetalRenderBackend(MTL::Device *metal_device, MTL::CommandQueue *command_queue, uint64_t pixel_format,
+                       const SurfacePoolConfig &pool_config = SurfacePoolConfig());
+    ~MetalRenderBackend() override;
+
+    const char *name() const override { return "metal"; }
+
+    SurfaceId create_surface(uint32_t width, uint32_t height, bool render_target) override;
+    SurfaceId import_shared_surface(void *shared_handle) override;
+    bool can_import_shared_surfaces() const override { return true; }
+    void destroy_surface(SurfaceId surface) override;
+    bool get_surface_size(SurfaceId surface, uint32_t &width, uint32_t &height) const override;
+    void surface_uv_extent(SurfaceId surface, float &u, float &v) const override;
+    const SurfacePoolStats *surface_pool_stats() const override { return &m_pool.stats(); }
+    size_t surface_bytes(SurfaceId surface) const override;
+    size_t scratch_bytes() const override;
+    void release_idle_memory() override;
+
+    void upload_region(SurfaceId surface, const PixelRect &rect, const void *pixels, size_t bytes_per_row) override;
+    bool move_region(SurfaceId surface, const PixelRect &source, int dx, int dy) override;
+
+    void *present(SurfaceId surface) override;
+
+    MTL::Texture *texture(SurfaceId surface) const;
+
+    // Draws |surface| with the display quad into an encoder owned by the view.
+    void encode_render_command(MTL::RenderCommandEncoder *render_command_encoder, SurfaceId surface);
+    void update_geometry(int holeX, int holeY, int holeWidth, int holeHeight, int viewportWidth, int viewportHeight);
+
+private:
+    struct MetalSurface
+    {
+        MTL::Texture *texture = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        SurfacePool::Lease lease; // empty for imported surfaces
+        void *shared_handle = nullptr;
+    };
+
+    // Imported IOSurface wrappers, most recently used last
+    struct ImportedTexture
+    {
+        void *shared_handle;
+        MTL::Texture *texture;
+    };
+    static constexpr size_t kMaxImportedTextures = 8;
+
+    const MetalSurface *find(SurfaceId surface) const;
+    MTL::Texture *wrap_io_surface(void *shared_handle, uint32_t width, uint32_t height);
+
+    // The blit pass of this frame, opened on first use
+    MTL::BlitCommandEncoder *transfer_encoder();
+    void commit_transfers();
+    // True while a blit pass may still write textures; replaceRegion()
+    // would overtake it.
+    bool transfers_pending() const;
+
+    // SurfaceAllocator
+    void *allocate(const SurfaceKey &key) override;
+    void release(void *allocation, const SurfaceKey &key) override;
+
+    MTL::Device *m_metal_device = nullptr;
+    MTL::CommandQueue *m_command_queue = nullptr;
+    MTL::DepthStencilState *m_depth_stencil_state_disabled = nullptr;
+    MTL::RenderPipelineState *m_render_pipeline = nullptr;
+    MTL::Buffer *m_triangle_vertex_buffer = nullptr;
+
+    SurfacePool m_pool;
+    std::unordered_map<SurfaceId, MetalSurface> m_surfaces;
+    // Staging for move_region(), grown as needed
+    MTL::Texture *m_move_scratch = nullptr;
+    MTL::CommandBuffer *m_transfer_commands = nullptr;
+    MTL::BlitCommandEncoder *m_transfer_blit = nullptr;
+    size_t m_transfer_bytes = 0;
+    // Blit passes committed, and finished by the GPU; the latter is shared
+    // with completion handlers that may run after the backend is gone.
+    uint64_t m_committed_serial = 0;
+    std::shared_ptr<std::atomic<uint64_t>> m_completed_serial = std::make_shared<std::atomic<uint64_t>>(0);
+    std::vector<ImportedTexture> m_imported;
+    SurfaceId m_next_id = 1;
+};
+
+#endif // METAL_RENDER_BACKEND_H
@@ -0,0 +1,519 @@
+#define NS_PRIVATE_IMPLEMENTATION
+#define CA_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+#include <QuartzCore/QuartzCore.hpp>
+#include <IOSurface/IOSurface.h>
+#include <simd/simd.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include "metal_render_backend.h"
+#include "trace.h"
+
+namespace
+{
+// Staged uploads a blit pass may hold before it is committed early
+const size_t kMaxTransferBytes = 64u << 20;
+}
+
+MetalRenderBackend::MetalRenderBackend(MTL::Device *metal_device, MTL::CommandQueue *command_queue,
+                                       uint64_t pixel_format, const SurfacePoolConfig &pool_config)
+    : m_metal_device(metal_device), m_command_queue(command_queue), m_pool(*this, pool_config)
+{
+    // The view's queue, so blits and the frame's draw are ordered
+    m_command_queue->retain();
+
+    simd::float4 quad_vertices[] = {
+        {-1.0f, -1.0f, 0.0f, 1.0f},
+        {-1.0f, 1.0f, 0.0f, 0.0f},
+        {1.0f, -1.0f, 1.0f, 1.0f},
+        {1.0f, 1.0f, 1.0f, 0.0f}};
+
+    // The display quad is moved around by update_geometry().
+    m_triangle_vertex_buffer = m_metal_device->newBuffer(&quad_vertices,
+                                                         sizeof(quad_vertices),
+                                                         MTL::ResourceStorageModeShared);
+
+    MTL::DepthStencilDescriptor *ds_desc_disabled = MTL::DepthStencilDescriptor::alloc()->init();
+    ds_desc_disabled->setDepthCompareFunction(MTL::CompareFunctionAlways); // Or whatever your depth test needs
+    ds_desc_disabled->setDepthWriteEnabled(false);                         // Disable depth writes if not needed
+
+    // Set up stencil behavior
+    MTL::StencilDescriptor *front_stencil_disabled = MTL::StencilDescriptor::alloc()->init();
+    front_stencil_disabled->setStencilCompareFunction(MTL::CompareFunctionAlways);   // Like gl.stencilFunc(ALWAYS)
+    front_stencil_disabled->setStencilFailureOperation(MTL::StencilOperationKeep);   // KEEP
+    front_stencil_disabled->setDepthFailureOperation(MTL::StencilOperationKeep);     // KEEP
+    front_stencil_disabled->setDepthStencilPassOperation(MTL::StencilOperationKeep); // REPLACE on depth+stencil pass
+    front_stencil_disabled->setReadMask(0xFF);
+    front_stencil_disabled->setWriteMask(0x00);
+
+    ds_desc_disabled->setFrontFaceStencil(front_stencil_disabled);
+    ds_desc_disabled->setBackFaceStencil(front_stencil_disabled); // Same for back face in this case
+    front_stencil_disabled->release();
+    m_depth_stencil_state_disabled = m_metal_device->newDepthStencilState(ds_desc_disabled);
+    ds_desc_disabled->release();
+
+    MTL::Library *metal_default_library = m_metal_device->newDefaultLibrary();
+    if (!metal_default_library)
+    {
+        std::cerr << "Failed to load default library." << std::endl;
+        std::exit(-1);
+    }
+
+    MTL::Function *vertex_shader = metal_default_library->newFunction(NS::String::string("cefVertexShader", NS::ASCIIStringEncoding));
+    assert(vertex_shader);
+    MTL::Function *fragment_shader = metal_default_library->newFunction(NS::String::string("cefFragmentShader", NS::ASCIIStringEncoding));
+    assert(fragment_shader);
+
+    MTL::RenderPipelineDescriptor *render_pipeline_descriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    render_pipeline_descriptor->setLabel(NS::String::string("Triangle Rendering Pipeline", NS::ASCIIStringEncoding));
+    render_pipeline_descriptor->setVertexFunction(vertex_shader);
+    render_pipeline_descriptor->setFragmentFunction(fragment_shader);
+    assert(render_pipeline_descriptor);
+    render_pipeline_descriptor->colorAttachments()->object(0)->setPixelFormat(static_cast<MTL::PixelFormat>(pixel_format));
+
+    NS::Error *error;
+    m_render_pipeline = m_metal_device->newRenderPipelineState(render_pipeline_descriptor, &error);
+
+    render_pipeline_descriptor->release();
+    vertex_shader->release();
+    fragment_shader->release();
+    metal_default_library->release();
+
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "render_pipeline_created");
+}
+
+MetalRenderBackend::~MetalRenderBackend()
+{
+    // Encoded blits keep what they use alive until they ran
+    commit_transfers();
+    for (auto &entry : m_surfaces)
+    {
+        if (entry.second.lease.allocation)
+        {
+            release(entry.second.lease.allocation, entry.second.lease.key);
+        }
+        else
+        {
+            entry.second.texture->release();
+        }
+    }
+    m_surfaces.clear();
+    for (ImportedTexture &imported : m_imported)
+    {
+        imported.texture->release();
+    }
+    m_imported.clear();
+
+    if (m_depth_stencil_state_disabled)
+    {
+        m_depth_stencil_state_disabled->release();
+        m_depth_stencil_state_disabled = nullptr;
+    }
+
+    if (m_render_pipeline)
+    {
+        m_render_pipeline->release();
+        m_render_pipeline = nullptr;
+    }
+
+    if (m_triangle_vertex_buffer)
+    {
+        m_triangle_vertex_buffer->release();
+        m_triangle_vertex_buffer = nullptr;
+    }
+
+    if (m_move_scratch)
+    {
+        m_move_scratch->release();
+        m_move_scratch = nullptr;
+    }
+
+    if (m_command_queue)
+    {
+        m_command_queue->release();
+        m_command_queue = nullptr;
+    }
+}
+
+SurfaceId MetalRenderBackend::create_surface(uint32_t width, uint32_t height, bool render_target)
+{
+    if (width == 0 || height == 0)
+        return kInvalidSurface;
+
+    SurfacePool::Lease lease = m_pool.acquire(render_target ? 1 : 0, width, height);
+    if (!lease.allocation)
+        return kInvalidSurface;
+
+    SurfaceId id = m_next_id++;
+    MetalSurface &surface = m_surfaces[id];
+    surface.texture = static_cast<MTL::Texture *>(lease.allocation);
+    surface.width = width;
+    surface.height = height;
+    surface.lease = lease;
+    return id;
+}
+
+void *MetalRenderBackend::allocate(const SurfaceKey &key)
+{
+    bool render_target = key.format == 1;
+    MTL::TextureDescriptor *pTextureDesc = MTL::TextureDescriptor::alloc()->init();
+    pTextureDesc->setWidth(key.width);
+    pTextureDesc->setHeight(key.height);
+    pTextureDesc->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    pTextureDesc->setTextureType(MTL::TextureType2D);
+    if (render_target)
+    {
+        pTextureDesc->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead | MTL::TextureUsageRenderTarget);
+        pTextureDesc->setStorageMode(MTL::StorageModePrivate);
+    }
+    else
+    {
+        pTextureDesc->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead);
+        pTextureDesc->setStorageMode(MTL::StorageModeManaged);
+    }
+
+    MTL::Texture *texture = m_metal_device->newTexture(pTextureDesc);
+    pTextureDesc->release();
+    return texture;
+}
+
+void MetalRenderBackend::release(void *allocation, const SurfaceKey &key)
+{
+    static_cast<MTL::Texture *>(allocation)->release();
+}
+
+SurfaceId MetalRenderBackend::import_shared_surface(void *shared_handle)
+{
+    IOSurfaceRef io_surface = static_cast<IOSurfaceRef>(shared_handle);
+    if (!io_surface)
+        return kInvalidSurface;
+
+    uint32_t width = static_cast<uint32_t>(IOSurfaceGetWidth(io_surface));
+    uint32_t height = static_cast<uint32_t>(IOSurfaceGetHeight(io_surface));
+
+    // CEF paints into a few IOSurfaces in turn; wrap each of them once. The
+    // texture retains its IOSurface, so a cached handle can't be recycled
+    // for a different surface behind our back.
+    MTL::Texture *texture = nullptr;
+    for (auto it = m_imported.begin(); it != m_imported.end(); ++it)
+    {
+        if (it->shared_handle == shared_handle)
+        {
+            ImportedTexture imported = *it;
+            m_imported.erase(it);
+            m_imported.push_back(imported);
+            texture = imported.texture;
+            break;
+        }
+    }
+
+    if (!texture)
+    {
+        texture = wrap_io_surface(shared_handle, width, height);
+        if (!texture)
+            return kInvalidSurface;
+
+        // Wrappers of another size are from before a resize, CEF won't
+        // paint into those again.
+        for (auto it = m_imported.begin(); it != m_imported.end();)
+        {
+            if (it->texture->width() != width || it->texture->height() != height)
+            {
+                it->texture->release();
+                it = m_imported.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        m_imported.push_back(ImportedTexture{shared_handle, texture});
+        if (m_imported.size() > kMaxImportedTextures)
+        {
+            m_imported.front().texture->release();
+            m_imported.erase(m_imported.begin());
+        }
+    }
+
+    // One reference for the cache, one for the surface
+    texture->retain();
+    SurfaceId id = m_next_id++;
+    MetalSurface &surface = m_surfaces[id];
+    surface.texture = texture;
+    surface.width = width;
+    surface.height = height;
+    surface.shared_handle = shared_handle;
+    return id;
+}
+
+MTL::Texture *MetalRenderBackend::wrap_io_surface(void *shared_handle, uint32_t width, uint32_t height)
+{
+    IOSurfaceRef io_surface = static_cast<IOSurfaceRef>(shared_handle);
+    MTL::TextureDescriptor *descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+        MTL::PixelFormatBGRA8Unorm,
+        width,
+        height,
+        false // mipmapped
+    );
+
+    // Set the usage and storage mode.
+    descriptor->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead);
+    descriptor->setStorageMode(MTL::StorageModeManaged);
+
+    // The key function: Create the texture directly from the IOSurface.
+    // This creates a Metal texture that aliases the memory of the IOSurface.
+    // descriptor->release(); // no need to release
+    return m_metal_device->newTexture(descriptor, io_surface, 0);
+}
+
+void MetalRenderBackend::destroy_surface(SurfaceId surface)
+{
+    auto it = m_surfaces.find(surface);
+    if (it == m_surfaces.end())
+        return;
+
+    if (it->second.lease.allocation)
+    {
+        m_pool.recycle(it->second.lease);
+    }
+    else
+    {
+        it->second.texture->release();
+    }
+    m_surfaces.erase(it);
+}
+
+bool MetalRenderBackend::get_surface_size(SurfaceId surface, uint32_t &width, uint32_t &height) const
+{
+    const MetalSurface *s = find(surface);
+    if (!s)
+        return false;
+    width = s->width;
+    height = s->height;
+    return true;
+}
+
+void MetalRenderBackend::surface_uv_extent(SurfaceId surface, float &u, float &v) const
+{
+    const MetalSurface *s = find(surface);
+    u = s ? static_cast<float>(s->width) / s->texture->width() : 1.0f;
+    v = s ? static_cast<float>(s->height) / s->texture->height() : 1.0f;
+}
+
+size_t MetalRenderBackend::surface_bytes(SurfaceId surface) const
+{
+    const MetalSurface *s = find(surface);
+    return s ? s->lease.key.bytes() : 0;
+}
+
+size_t MetalRenderBackend::scratch_bytes() const
+{
+    return m_move_scratch ? static_cast<size_t>(m_move_scratch->width()) * m_move_scratch->height() * 4 : 0;
+}
+
+void MetalRenderBackend::release_idle_memory()
+{
+    m_pool.trim(m_pool.stats().in_use_bytes);
+    if (m_move_scratch)
+    {
+        // Blits already encoded keep their own reference
+        m_move_scratch->release();
+        m_move_scratch = nullptr;
+    }
+}
+
+void MetalRenderBackend::upload_region(SurfaceId surface, const PixelRect &rect, const void *pixels, size_t bytes_per_row)
+{
+    MTL::Texture *t = texture(surface);
+    if (!t || rect.empty())
+        return;
+
+    MTL::BlitCommandEncoder *blit = transfers_pending() ? transfer_encoder() : nullptr;
+    MTL::Buffer *staging = nullptr;
+    size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+    if (blit)
+    {
+        staging = m_metal_device->newBuffer(row_bytes * rect.height, MTL::ResourceStorageModeShared);
+    }
+    if (!staging)
+    {
+        MTL::Region region = MTL::Region(rect.x, rect.y, 0, rect.width, rect.height, 1);
+        t->replaceRegion(region, 0, pixels, bytes_per_row);
+        return;
+    }
+
+    // A blit that hasn't run yet may still write this texture; the pixels
+    // go into the same pass so they land after it.
+    uint8_t *dst = static_cast<uint8_t *>(staging->contents());
+    const uint8_t *src = static_cast<const uint8_t *>(pixels);
+    for (int y = 0; y < rect.height; ++y)
+    {
+        memcpy(dst + y * row_bytes, src + y * bytes_per_row, row_bytes);
+    }
+    blit->copyFromBuffer(staging, 0, row_bytes, row_bytes * rect.height, MTL::Size(rect.width, rect.height, 1),
+                         t, 0, 0, MTL::Origin(rect.x, rect.y, 0));
+    blit->synchronizeResource(t);
+    // The command buffer holds on to it until the copy ran
+    staging->release();
+
+    m_transfer_bytes += row_bytes * rect.height;
+    if (m_transfer_bytes > kMaxTransferBytes)
+    {
+        commit_transfers();
+    }
+}
+
+bool MetalRenderBackend::move_region(SurfaceId surface, const PixelRect &source, int dx, int dy)
+{
+    const MetalSurface *s = find(surface);
+    // Never write into an IOSurface CEF shared with us
+    if (!s || s->shared_handle)
+        return false;
+
+    PixelRect bounds{0, 0, static_cast<int>(s->width), static_cast<int>(s->height)};
+    PixelRect clipped = intersect_rects(intersect_rects(source, bounds),
+                                        PixelRect{bounds.x - dx, bounds.y - dy, bounds.width, bounds.height});
+    if (clipped.empty())
+        return true;
+
+    // A blit can't copy a texture onto an overlapping part of itself, so the
+    // pixels take a detour through a scratch texture.
+    if (!m_move_scratch || m_move_scratch->width() < static_cast<NS::UInteger>(clipped.width) ||
+        m_move_scratch->height() < static_cast<NS::UInteger>(clipped.height))
+    {
+        NS::UInteger width = static_cast<NS::UInteger>(clipped.width);
+        NS::UInteger height = static_cast<NS::UInteger>(clipped.height);
+        if (m_move_scratch)
+        {
+            width = std::max(width, m_move_scratch->width());
+            height = std::max(height, m_move_scratch->height());
+            m_move_scratch->release();
+        }
+        MTL::TextureDescriptor *descriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            MTL::PixelFormatBGRA8Unorm, width, height, false);
+        descriptor->setStorageMode(MTL::StorageModePrivate);
+        descriptor->setUsage(MTL::ResourceUsageRead);
+        m_move_scratch = m_metal_device->newTexture(descriptor);
+        if (!m_move_scratch)
+            return false;
+    }
+
+    MTL::BlitCommandEncoder *blit = transfer_encoder();
+    if (!blit)
+        return false;
+
+    MTL::Size size(clipped.width, clipped.height, 1);
+    blit->copyFromTexture(s->texture, 0, 0, MTL::Origin(clipped.x, clipped.y, 0), size,
+                          m_move_scratch, 0, 0, MTL::Origin(0, 0, 0));
+    blit->copyFromTexture(m_move_scratch, 0, 0, MTL::Origin(0, 0, 0), size,
+                          s->texture, 0, 0, MTL::Origin(clipped.x + dx, clipped.y + dy, 0));
+    // The surface is managed: bring its CPU side up to date before a later
+    // replaceRegion() writes next to the moved pixels.
+    blit->synchronizeResource(s->texture);
+    // Nothing waits for it; uploads until it has run are queued behind it.
+    return true;
+}
+
+MTL::BlitCommandEncoder *MetalRenderBackend::transfer_encoder()
+{
+    if (m_transfer_blit)
+        return m_transfer_blit;
+
+    MTL::CommandBuffer *command_buffer = m_command_queue->commandBuffer();
+    MTL::BlitCommandEncoder *blit = command_buffer ? command_buffer->blitCommandEncoder() : nullptr;
+    if (!blit)
+        return nullptr;
+
+    // Both are autoreleased, and the pass stays open until present()
+    m_transfer_commands = command_buffer->retain();
+    m_transfer_blit = blit->retain();
+    return m_transfer_blit;
+}
+
+void MetalRenderBackend::commit_transfers()
+{
+    if (!m_transfer_commands)
+        return;
+
+    m_transfer_blit->endEncoding();
+    m_transfer_blit->release();
+    m_transfer_blit = nullptr;
+
+    uint64_t serial = ++m_committed_serial;
+    std::shared_ptr<std::atomic<uint64_t>> completed = m_completed_serial;
+    MTL::HandlerFunction handler = [completed, serial](MTL::CommandBuffer *)
+    {
+        completed->store(serial, std::memory_order_release);
+    };
+    m_transfer_commands->addCompletedHandler(handler);
+    m_transfer_commands->commit();
+    m_transfer_commands->release();
+    m_transfer_commands = nullptr;
+    m_transfer_bytes = 0;
+}
+
+bool MetalRenderBackend::transfers_pending() const
+{
+    return m_transfer_commands || m_completed_serial->load(std::memory_order_acquire) < m_committed_serial;
+}
+
+void *MetalRenderBackend::present(SurfaceId surface)
+{
+    // The texture is drawn by ImGui as part of the view's own pass, which is
+    // committed to the same queue after this frame's blits.
+    commit_transfers();
+    return texture(surface);
+}
+
+MTL::Texture *MetalRenderBackend::texture(SurfaceId surface) const
+{
+    const MetalSurface *s = find(surface);
+    return s ? s->texture : nullptr;
+}
+
+const MetalRenderBackend::MetalSurface *MetalRenderBackend::find(SurfaceId surface) const
+{
+    auto it = m_surfaces.find(surface);
+    return it == m_surfaces.end() ? nullptr : &it->second;
+}
+
+void MetalRenderBackend::encode_render_command(MTL::RenderCommandEncoder *render_command_encoder, SurfaceId surface)
+{
+    MTL::Texture *texture_to_render = texture(surface);
+    if (!texture_to_render)
+        return;
+
+    render_command_encoder->setRenderPipelineState(m_render_pipeline);
+    render_command_encoder->setDepthStencilState(m_depth_stencil_state_disabled);
+    render_command_encoder->setVertexBuffer(m_triangle_vertex_buffer, 0, 0);
+    render_command_encoder->setCullMode(MTL::CullMode::CullModeNone);
+    render_command_encoder->setFragmentTexture(texture_to_render, /* index */ 0);
+    NS::UInteger vertexStart = 0;
+    NS::UInteger vertexCount = 4;
+    render_command_encoder->drawPrimitives(MTL::PrimitiveTypeTriangleStrip, vertexStart, vertexCount);
+}
+
+void MetalRenderBackend::update_geometry(int holeX, int holeY, int holeWidth, int holeHeight, int viewportWidth, int viewportHeight)
+{
+    if (m_triangle_vertex_buffer)
+    {
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_COMPOSITE, "update_geometry", "hole=(%d,%d %dx%d)", holeX, holeY,
+                    holeWidth, holeHeight);
+        float left = holeX / (float)viewportWidth * 2.0f - 1.0f;
+        float right = (holeX + holeWidth) / (float)viewportWidth * 2.0f - 1.0f;
+        float top = holeY / (float)viewportHeight * 2.0f - 1.0f;
+        float bottom = (holeY + holeHeight) / (float)viewportHeight * 2.0f - 1.0f;
+
+        simd::float4 quad_vertices[] = {
+            {left, top, 0.0f, 1.0f},
+            {left, bottom, 0.0f, 0.0f},
+            {right, top, 1.0f, 1.0f},
+            {right, bottom, 1.0f, 0.0f}};
+
+        memcpy(m_triangle_vertex_buffer->contents(), &quad_vertices, sizeof(quad_vertices));
+    }
+}
@@ -11,7 +11,9 @@
 #include "include/wrapper/cef_library_loader.h"
 #include "include/cef_command_line.h" // Required for CefCommandLine
 #include <simd/simd.h>
+#include <algorithm>
 #include "mycef.h"
+#include "metal_render_backend.h"
 #import <Cocoa/Cocoa.h>
 #import <Carbon/Carbon.h>
 @class CEFManager;
@@ -169,6 +171,11 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
     bool shouldHandleMouseEvents;
     bool shouldHandleKeyEvents;
     bool isDragging; // Track if we're in a drag operation
+    // The system's memory pressure notifications, handed to the app
+    dispatch_source_t _memoryPressureSource;
+    // What the display runs the view at; lowered while the window can't
+    // be seen, see VisibilityPolicy::ui_frame_rate()
+    NSInteger _displayFramesPerSecond;
 }
 
 - (instancetype)initWithFrame:(NSRect)frame device:(id<MTLDevice>)device
@@ -188,6 +195,7 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
         self.paused = NO;
         self.framebufferOnly = NO;
         self.delegate = self;
+        _displayFramesPerSecond = self.preferredFramesPerSecond;
         [self setupMetalWithFrame:frame];
         [self setupTextInput];
         // Force initial display
@@ -221,8 +229,12 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
         int normalWinWidth = frame.size.width;
         int normalWinHeight = frame.size.height;
 
-        _app = new MyApp((__bridge MTL::Device *)self.device, normalWinWidth, normalWinHeight, pixelDensity);
-        _app->init((__bridge MTL::Device *)self.device, MTLPixelFormatBGRA8Unorm, normalWinWidth, normalWinHeight);
+        std::unique_ptr<RenderBackend> backend(new MetalRenderBackend((__bridge MTL::Device *)self.device,
+                                                                      (__bridge MTL::CommandQueue *)_commandQueue,
+                                                                      MTLPixelFormatBGRA8Unorm));
+        _app = new MyApp(std::move(backend), normalWinWidth, normalWinHeight, pixelDensity);
+        _app->init(normalWinWidth, normalWinHeight);
+        [self watchMemoryPressure];
 
         [self setupCEF]; // Initialize CEF
 
@@ -239,6 +251,16 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
                                                      name:NSWindowDidResignKeyNotification
                                                    object:nil];
 
+        // Occlusion and minimizing pause the browser, see VisibilityPolicy
+        for (NSNotificationName name in @[ NSWindowDidChangeOcclusionStateNotification, NSWindowDidMiniaturizeNotification,
+                                           NSWindowDidDeminiaturizeNotification ])
+        {
+            [[NSNotificationCenter defaultCenter] addObserver:self
+                                                     selector:@selector(windowVisibilityDidChange:)
+                                                         name:name
+                                                       object:nil];
+        }
+
         [[NSNotificationCenter defaultCenter] addObserver:self
                                                  selector:@selector(applicationDidBecomeActive:)
                                                      name:NSApplicationDidBecomeActiveNotification
@@ -402,10 +424,33 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
     self.followMouse = NO; // Set to YES to follow mouse, NO to follow text cursor
 }
 
+- (void)watchMemoryPressure
+{
+    _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                   DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                   dispatch_get_main_queue());
+    __weak MainMetalView *weakSelf = self;
+    dispatch_source_set_event_handler(_memoryPressureSource, ^{
+        MainMetalView *strongSelf = weakSelf;
+        if (!strongSelf || !strongSelf->_app)
+            return;
+        unsigned long flags = dispatch_source_get_data(strongSelf->_memoryPressureSource);
+        strongSelf->_app->on_memory_pressure((flags & DISPATCH_MEMORYPRESSURE_CRITICAL) ? MemoryPressure::Critical
+                                                                                       : MemoryPressure::Moderate);
+    });
+    dispatch_resume(_memoryPressureSource);
+}
+
 - (void)cleanup
 {
     NSLog(@"MainMetalView cleanup called");
 
+    if (_memoryPressureSource)
+    {
+        dispatch_source_cancel(_memoryPressureSource);
+        _memoryPressureSource = nil;
+    }
+
     // Remove notification observers
     [[NSNotificationCenter defaultCenter] removeObserver:self];
 
@@ -454,6 +499,11 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
         shouldHandleMouseEvents = true;
         shouldHandleKeyEvents = true;
 
+        if (_app)
+        {
+            _app->set_window_key(true);
+        }
+
         // Notify CEF that we regained focus
         if (_app && _app->get_browser())
         {
@@ -469,6 +519,11 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
     {
         NSLog(@"MainMetalView window resigned key");
 
+        if (_app)
+        {
+            _app->set_window_key(false);
+        }
+
         // Notify CEF that we lost focus
         if (_app && _app->get_browser())
         {
@@ -477,6 +532,31 @@ matrix_float4x4 matrix_ortho(float left, float right, float bottom, float top, f
     }
 }
 
+- (void)windowVisibilityDidChange:(NSNotification *)notification
+{
+    if (notification.object == self.window)
+    {
+        [self updateWindowVisibility];
+    }
+}
+
+- (void)viewDidMoveToWindow
+{
+    [super viewDidMoveToWindow];
+    [self updateWindowVisibility];
+}
+
+- (void)updateWindowVisibility
+{
+    if (!_app || !self.window)
+        return;
+
+    // A minimized window is occluded too; the app tells them apart
+    _app->set_window_miniaturized(self.window.isMiniaturized);
+    _app->set_window_occluded(!(self.window.occlusionState & NSWindowOcclusionStateVisible));
+    _app->set_window_key(self.window.isKeyWindow);
+}
+
 - (void)applicationDidBecomeActive:(NSNotification *)notification
 {
     NSLog(@"Application became active");
@@ -520,11 +600,14 @@ void SetupDockspace(ImGuiID dockspaceID)
 // MTKViewDelegate method - called automatically every frame
 - (void)drawInMTKView:(MTKView *)view
 {
+    _app->mark_frame_point(FramePoint::FrameStart);
     ImGui::SetMouseCursor(_app->get_cursor_type());
-    // Process CEF message loop work
-    CefDoMessageLoopWork();
+    // CEF message loop work is driven by MyApp's pump scheduler
+    // (OnScheduleMessagePumpWork), not by the display loop.
 
-    // Request new frame BEFORE starting Metal rendering
+    // Hand this frame's input to the browser, then request the new frame
+    // BEFORE starting Metal rendering
+    _app->deliver_frame_input();
     _app->request_new_frame();
 
     ImGuiIO &io = ImGui::GetIO();
@@ -640,6 +723,7 @@ void SetupDockspace(ImGuiID dockspaceID)
         // Our state (make them static = more or less global) as a convenience to keep the example terse.
         static bool show_demo_window = true;
         static bool show_another_window = false;
+        static bool show_overview = false;
         // static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
         // 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
@@ -652,6 +736,45 @@ void SetupDockspace(ImGuiID dockspaceID)
 
             ImGui::Begin("Controls");
 
+            // Tab strip. Only the active tab renders, the rest are hidden
+            // and throttled by the app's BrowserPool.
+            if (_app)
+            {
+                std::vector<BrowserTabInfo> tabs = _app->tabs();
+                for (const BrowserTabInfo &tab : tabs)
+                {
+                    ImGui::PushID(tab.id);
+                    std::string label = tab.title.size() > 18 ? tab.title.substr(0, 18) + "..." : tab.title;
+                    if (tab.active)
+                    {
+                        ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive));
+                    }
+                    if (ImGui::Button(label.c_str()))
+                    {
+                        _app->activate_tab(tab.id);
+                    }
+                    if (tab.active)
+                    {
+                        ImGui::PopStyleColor();
+                    }
+                    if (tabs.size() > 1)
+                    {
+                        ImGui::SameLine(0, 2);
+                        if (ImGui::SmallButton("x"))
+                        {
+                            _app->close_tab(tab.id);
+                        }
+                    }
+                    ImGui::PopID();
+                    ImGui::SameLine();
+                }
+                if (ImGui::Button("+"))
+                {
+                    _app->new_tab(url_buffer);
+                }
+                ImGui::Separator();
+            }
+
             // URL input and navigation controls
             ImGui::Text("URL:");
             ImGui::SetNextItemWidth(-150); // Leave space for Go button
@@ -731,10 +854,349 @@ void SetupDockspace(ImGuiID dockspaceID)
 
             ImGui::Separator();
 
+            // Layer counters; a static page with an open dropdown should
+            // settle at 0 damaged frames/s.
+            if (_app && ImGui::CollapsingHeader("Render Stats"))
+            {
+                const LayerTreeStats &stats = _app->layer_stats();
+                static double last_sample_time = 0.0;
+                static uint64_t last_sample_damaged = 0;
+                static double damaged_per_second = 0.0;
+                double now = ImGui::GetTime();
+                uint64_t damaged = stats.frames - stats.frames_unchanged;
+                if (now - last_sample_time >= 1.0)
+                {
+                    damaged_per_second = (damaged - last_sample_damaged) / (now - last_sample_time);
+                    last_sample_time = now;
+                    last_sample_damaged = damaged;
+                }
+
+                ImGui::Text("Backend: %s", _app->backend()->name());
+                const MemoryLedger &memory = _app->memory_ledger();
+                const MemoryLedgerStats &memory_stats = memory.stats();
+                ImGui::Text("Memory: %.1f MB (peak %.1f MB), %llu popup releases, %llu over budget, %.1f MB released",
+                            memory.total() / 1048576.0, memory_stats.peak_bytes / 1048576.0,
+                            (unsigned long long)memory_stats.popup_releases,
+                            (unsigned long long)memory_stats.budget_releases, memory_stats.released_bytes / 1048576.0);
+                static int budget_mb = 0;
+                if (ImGui::InputInt("Memory budget (MB, 0 = none)", &budget_mb))
+                {
+                    budget_mb = std::max(0, budget_mb);
+                    _app->set_memory_budget(static_cast<size_t>(budget_mb) << 20);
+                }
+                if (ImGui::TreeNode("Memory by category"))
+                {
+                    for (int i = 0; i < static_cast<int>(MemoryCategory::Count); ++i)
+                    {
+                        MemoryCategory category = static_cast<MemoryCategory>(i);
+                        ImGui::Text("%-20s %8.2f MB", memory_category_name(category), memory.bytes(category) / 1048576.0);
+                    }
+                    ImGui::TreePop();
+                }
+                if (_app->thumbnails_enabled())
+                {
+                    ThumbnailCacheStats thumbs = _app->thumbnail_stats();
+                    ImGui::Text("Thumbnails: %llu refreshes of %llu paints, %.1f MP filtered, %llu cached (%.1f MB), %llu evicted",
+                                (unsigned long long)thumbs.refreshes, (unsigned long long)thumbs.paints,
+                                thumbs.downscaled_pixels / 1e6, (unsigned long long)thumbs.thumbnails,
+                                thumbs.thumbnail_bytes / 1048576.0, (unsigned long long)thumbs.evictions);
+                }
+                const VisibilityPolicy &visibility = _app->visibility();
+                const VisibilityStats &visibility_stats = visibility.stats();
+                ImGui::Text("Visibility: %s at %d fps, %llu changes (%llu debounced), %llu of %llu frames paused (%.1f s)",
+                            view_visibility_name(visibility.state()), visibility.frame_rate(),
+                            (unsigned long long)visibility_stats.changes, (unsigned long long)visibility_stats.debounced,
+                            (unsigned long long)visibility_stats.paused_frames, (unsigned long long)visibility_stats.frames,
+                            visibility_stats.hidden_us / 1e6);
+                bool adaptive = _app->adaptive_quality();
+                if (ImGui::Checkbox("Adaptive quality", &adaptive))
+                {
+                    _app->set_adaptive_quality(adaptive);
+                }
+                const RenderScaleStats &scale = _app->render_scale_stats();
+                ImGui::Text("Device scale: %.2f (frame %.2f), %llu steps down, %llu restores, %llu of %llu frames reduced",
+                            _app->device_scale_factor(), _app->frame_scale(), (unsigned long long)scale.scale_downs,
+                            (unsigned long long)scale.restores, (unsigned long long)scale.reduced_frames,
+                            (unsigned long long)scale.frames);
+                ImGui::Text("Layer frames: %llu, %llu unchanged (%.1f damaged/s)", (unsigned long long)stats.frames,
+                            (unsigned long long)stats.frames_unchanged, damaged_per_second);
+                ImGui::Text("Layer quads: %llu, %.1f MP drawn, %.1f MP occluded", (unsigned long long)stats.quads,
+                            stats.drawn_pixels / 1e6, stats.occluded_pixels / 1e6);
+                const ResizeStats &resize = _app->resize_stats();
+                ImGui::Text("Resizes: %llu sizes, %llu interim + %llu final sent, %llu relayouts saved, %llu scaled frames",
+                            (unsigned long long)resize.size_changes, (unsigned long long)resize.interim_resizes,
+                            (unsigned long long)resize.final_resizes, (unsigned long long)resize.relayouts_saved,
+                            (unsigned long long)resize.scaled_frames);
+                const TileUploadStats &tiles = _app->tile_upload_stats();
+                ImGui::Text("View uploads: %.1f MB of %.1f MB dirty, %llu of %llu tiles unchanged",
+                            tiles.uploaded_bytes / 1048576.0, tiles.dirty_bytes / 1048576.0,
+                            (unsigned long long)tiles.tiles_unchanged, (unsigned long long)tiles.tiles_hashed);
+                const ScrollDetectorStats &scroll = _app->scroll_stats();
+                ImGui::Text("Scrolls: %llu moved of %llu found (%llu rejected), %.1f MB moved, %.1f MB patched",
+                            (unsigned long long)scroll.shifted, (unsigned long long)scroll.detected,
+                            (unsigned long long)scroll.rejected, scroll.moved_bytes / 1048576.0,
+                            scroll.patched_bytes / 1048576.0);
+                if (const SurfacePoolStats *pool = _app->backend()->surface_pool_stats())
+                {
+                    ImGui::Text("Surface pool: %llu hits, %llu misses, %llu evicted",
+                                (unsigned long long)pool->hits, (unsigned long long)pool->misses,
+                                (unsigned long long)pool->evictions);
+                    ImGui::Text("Surface memory: %.1f MB in use, %.1f MB idle (%zu surfaces)",
+                                pool->in_use_bytes / 1048576.0, pool->idle_bytes / 1048576.0, pool->idle_surfaces);
+                }
+
+                const FrameSchedulerStats &frames = _app->frame_scheduler_stats();
+                ImGui::Text("BeginFrames: %llu of %llu ticks (%llu idle, %llu keepalive)",
+                            (unsigned long long)frames.begin_frames, (unsigned long long)frames.ticks,
+                            (unsigned long long)frames.idle_ticks, (unsigned long long)frames.keepalive_frames);
+                ImGui::Text("Animating: %s, period %.2f ms, paint latency %.2f ms",
+                            frames.animating ? "yes" : "no", frames.period_us / 1000.0, frames.paint_latency_us / 1000.0);
+                for (int i = 0; i < static_cast<int>(FrameInvalidation::Count); ++i)
+                {
+                    ImGui::Text("Invalidated by %s: %llu", frame_invalidation_name(static_cast<FrameInvalidation>(i)),
+                                (unsigned long long)frames.invalidations[i]);
+                }
+
+                const InputQueueStats &input = _app->input_queue_stats();
+                ImGui::Text("Input: %llu queued, %llu delivered, %llu moves / %llu wheels coalesced, %llu dropped",
+                            (unsigned long long)input.queued, (unsigned long long)input.delivered,
+                            (unsigned long long)input.moves_coalesced, (unsigned long long)input.wheels_coalesced,
+                            (unsigned long long)input.dropped);
+                MessagePumpStats pump = _app->message_pump_stats();
+                ImGui::Text("Pumps: %llu requested, %llu run, %llu coalesced",
+                            (unsigned long long)pump.requested, (unsigned long long)pump.runs,
+                            (unsigned long long)pump.coalesced);
+                ImGui::Text("Pump wakeups: %llu (%llu idle runs, %llu over budget)",
+                            (unsigned long long)pump.wakeups, (unsigned long long)pump.idle_runs,
+                            (unsigned long long)pump.over_budget);
+
+                // Open in Perfetto or chrome://tracing.
+                static std::string trace_status;
+                if (ImGui::Button("Save Trace"))
+                {
+                    std::string path = get_macos_cache_dir("shrome") + "/shrome_trace.json";
+                    trace_status = trace_write_chrome_json(path) ? "Saved " + path : "Failed to write " + path;
+                }
+                if (!trace_status.empty())
+                {
+                    ImGui::TextWrapped("%s", trace_status.c_str());
+                }
+
+                // Input as the browser got it; replays here or on the headless build.
+                static std::string input_log_status;
+                std::string input_log_path = get_macos_cache_dir("shrome") + "/shrome_input.bin";
+                if (_app->input_recording())
+                {
+                    if (ImGui::Button("Stop Recording Input"))
+                    {
+                        input_log_status = _app->stop_input_recording(input_log_path) ? "Saved " + input_log_path
+                                                                                       : "Failed to write " + input_log_path;
+                    }
+                }
+                else if (_app->input_replaying())
+                {
+                    if (ImGui::Button("Stop Replay"))
+                    {
+                        _app->stop_input_replay();
+                    }
+                }
+                else
+                {
+                    if (ImGui::Button("Record Input"))
+                    {
+                        _app->start_input_recording();
+                        input_log_status.clear();
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Replay"))
+                    {
+                        input_log_status = _app->start_input_replay(input_log_path, ReplayPace::Recorded) ? "" : "Could not load " + input_log_path;
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Replay Fast"))
+                    {
+                        input_log_status = _app->start_input_replay(input_log_path, ReplayPace::Frames) ? "" : "Could not load " + input_log_path;
+                    }
+                }
+                if (!input_log_status.empty())
+                {
+                    ImGui::TextWrapped("%s", input_log_status.c_str());
+                }
+
+                // Software paints of the view; shrome_frame_dump makes PNGs of them.
+                static std::string capture_status;
+                if (_app->frame_capturing())
+                {
+                    if (ImGui::Button("Stop Capture"))
+                    {
+                        _app->stop_frame_capture();
+                    }
+                }
+                else if (ImGui::Button("Capture Frames"))
+                {
+                    std::string path = get_macos_cache_dir("shrome") + "/shrome_capture.shrc";
+                    capture_status = _app->start_frame_capture(path) ? "Capturing to " + path : "Failed to open " + path;
+                }
+                if (!capture_status.empty())
+                {
+                    ImGui::TextWrapped("%s", capture_status.c_str());
+                }
+                FrameCaptureStats capture = _app->frame_capture_stats();
+                if (capture.captured || capture.dropped)
+                {
+                    ImGui::Text("Captured %llu frames (%llu keyframes, %llu dropped), %.1f MB -> %.1f MB",
+                                (unsigned long long)capture.captured, (unsigned long long)capture.keyframes,
+                                (unsigned long long)capture.dropped, capture.raw_bytes / 1048576.0,
+                                capture.encoded_bytes / 1048576.0);
+                }
+
+                // The same paints, live to local clients (frame_stream.h)
+                static std::string stream_status;
+                if (_app->frame_streaming())
+                {
+                    if (ImGui::Button("Stop Streaming"))
+                    {
+                        _app->stop_frame_stream();
+                        stream_status.clear();
+                    }
+                }
+                else if (ImGui::Button("Start Streaming"))
+                {
+                    std::string address = "unix:" + get_macos_cache_dir("shrome") + "/shrome_stream.sock";
+                    stream_status = _app->start_frame_stream(address) ? "Streaming on " + address : "Could not listen on " + address;
+                }
+                if (!stream_status.empty())
+                {
+                    ImGui::TextWrapped("%s", stream_status.c_str());
+                }
+                if (_app->frame_streaming())
+                {
+                    FrameStreamStats stream = _app->frame_stream_stats();
+                    ImGui::Text("Stream: %llu clients, %llu sent (%llu skipped, %llu shm), %.1f MB, %llu inputs",
+                                (unsigned long long)stream.clients, (unsigned long long)stream.frames_sent,
+                                (unsigned long long)stream.frames_skipped, (unsigned long long)stream.shm_frames,
+                                stream.bytes_sent / 1048576.0, (unsigned long long)stream.inputs_received);
+                }
+            }
+
+            ImGui::Separator();
+
             // Keep the demo window checkbox for testing
             ImGui::Checkbox("Demo Window", &show_demo_window);
             ImGui::Checkbox("Another Window", &show_another_window);
+            if (_app && ImGui::Checkbox("Tab Overview", &show_overview))
+            {
+                // Thumbnails cost a copy of every paint, only keep them
+                // while they are looked at
+                _app->set_thumbnails_enabled(show_overview);
+            }
+
+            ImGui::End();
+        }
+
+        // Live previews of all tabs; a tab shows its last thumbnail from
+        // when it was in front
+        if (_app && show_overview)
+        {
+            ImGui::SetNextWindowSize(ImVec2(700, 420), ImGuiCond_FirstUseEver);
+            if (ImGui::Begin("Tab Overview", &show_overview))
+            {
+                const float cell_width = 200.0f;
+                const float cell_height = 150.0f;
+                int columns = std::max(1, static_cast<int>(ImGui::GetContentRegionAvail().x / (cell_width + 8.0f)));
+                std::vector<BrowserTabInfo> tabs = _app->tabs();
+                for (size_t i = 0; i < tabs.size(); ++i)
+                {
+                    const BrowserTabInfo &tab = tabs[i];
+                    ImGui::PushID(tab.id);
+                    ImGui::BeginGroup();
+                    DisplayQuad thumb;
+                    bool clicked = false;
+                    if (_app->thumbnail_quad(tab.id, thumb))
+                    {
+                        float scale = std::min(cell_width / thumb.width, cell_height / thumb.height);
+                        clicked = ImGui::ImageButton("##thumb", reinterpret_cast<ImTextureID>(thumb.texture),
+                                                     ImVec2(thumb.width * scale, thumb.height * scale),
+                                                     ImVec2(thumb.u0, thumb.v0), ImVec2(thumb.u1, thumb.v1));
+                    }
+                    else
+                    {
+                        clicked = ImGui::Button("No preview yet", ImVec2(cell_width, cell_height));
+                    }
+                    if (clicked)
+                    {
+                        _app->activate_tab(tab.id);
+                    }
+                    std::string label = tab.title.size() > 28 ? tab.title.substr(0, 28) + "..." : tab.title;
+                    ImGui::TextUnformatted(label.c_str());
+                    ImGui::EndGroup();
+                    ImGui::PopID();
+                    if ((i + 1) % columns != 0)
+                    {
+                        ImGui::SameLine();
+                    }
+                }
+            }
+            ImGui::End();
+            if (!show_overview)
+            {
+                _app->set_thumbnails_enabled(false);
+            }
+        }
+
+        // Frame timing histograms, docked next to Controls on first run
+        if (_app)
+        {
+            ImGui::SetNextWindowPos(ImVec2(420, 60), ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize(ImVec2(460, 220), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Frame Timing");
+
+            const FrameTimingRecorder &timing = _app->frame_timing();
+            ImGui::Text("Frames: %llu", (unsigned long long)timing.frames());
+            if (ImGui::BeginTable("##frame_timing", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+            {
+                ImGui::TableSetupColumn("Stage (ms)");
+                ImGui::TableSetupColumn("Count");
+                ImGui::TableSetupColumn("p50");
+                ImGui::TableSetupColumn("p90");
+                ImGui::TableSetupColumn("p99");
+                ImGui::TableSetupColumn("Max");
+                ImGui::TableHeadersRow();
+                for (int i = 0; i < static_cast<int>(FrameStage::Count); ++i)
+                {
+                    FrameStage stage = static_cast<FrameStage>(i);
+                    const LogLinearHistogram &histogram = timing.histogram(stage);
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(frame_stage_name(stage));
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", (unsigned long long)histogram.count());
+                    for (double quantile : {0.5, 0.9, 0.99})
+                    {
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%.2f", histogram.percentile(quantile) / 1000.0);
+                    }
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", histogram.max() / 1000.0);
+                }
+                ImGui::EndTable();
+            }
 
+            static std::string dump_status;
+            if (ImGui::Button("Reset"))
+            {
+                _app->reset_frame_timing();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Dump JSON"))
+            {
+                std::string path = get_macos_cache_dir("shrome") + "/shrome_frame_timing.json";
+                dump_status = timing.write_json(path) ? "Saved " + path : "Failed to write " + path;
+            }
+            if (!dump_status.empty())
+            {
+                ImGui::TextWrapped("%s", dump_status.c_str());
+            }
             ImGui::End();
         }
 
@@ -753,7 +1215,8 @@ void SetupDockspace(ImGuiID dockspaceID)
         ImGuiWindowFlags windowFlags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove;
         windowFlags |= ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoNavFocus | ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground;
 
-        ImGui::Begin("ShromeWindow", nullptr, windowFlags);
+        // False while the panel is collapsed or docked behind another tab
+        bool panelShown = ImGui::Begin("ShromeWindow", nullptr, windowFlags);
         ImGui::PopStyleVar(2);
         if (ImGui::IsWindowHovered())
         {
@@ -795,35 +1258,54 @@ void SetupDockspace(ImGuiID dockspaceID)
         // ... resize framebuffer and render your scene
         holeX = (int)startCursorPos.x + (int)windowPos.x - (int)viewportPos.x;
         holeY = (int)startCursorPos.y + (int)windowPos.y - (int)viewportPos.y;
-        if (contentSize.x != holeWidth || contentSize.y != holeHeight)
+        // Every frame: while the size is changing the app only resizes the
+        // browser now and then, see ResizeController.
         {
             CGFloat pixelDensity = [NSScreen.mainScreen backingScaleFactor];
             pixelDensity = pixelDensity > 0 ? pixelDensity : 1.0;
-            _app->update_render_handler_dimensions((int)contentSize.x, (int)contentSize.y, (int)pixelDensity);
-
-            // Notify CEF about the size change
-            if (_app && _app->get_browser() && _app->get_browser()->IsValid())
-            {
-                _app->get_browser()->GetHost()->WasResized();
-            }
+            _app->update_view_size((int)contentSize.x, (int)contentSize.y, (int)pixelDensity);
             holeWidth = contentSize.x;
             holeHeight = contentSize.y;
         }
 
-        // Prepare rendering (composite if needed)
+        // Upload paints and build the layer quads, unless nothing of the
+        // view can be seen
         if (_app)
         {
+            _app->set_view_panel_visible(panelShown && contentSize.x >= 1.0f && contentSize.y >= 1.0f);
             _app->prepare_for_render();
-        }
 
-        // Display the composite texture (main + popup) or fall back to main texture
-        MTL::Texture *display_texture = (_app && _app->m_should_show_popup && _app->m_popup_texture && _app->m_composite_texture)
-                                        ? _app->m_composite_texture : (_app ? _app->m_texture : nullptr);
+            int uiFrameRate = _app->visibility().ui_frame_rate();
+            NSInteger framesPerSecond = uiFrameRate > 0 ? uiFrameRate : _displayFramesPerSecond;
+            if (self.preferredFramesPerSecond != framesPerSecond)
+            {
+                self.preferredFramesPerSecond = framesPerSecond;
+            }
+        }
 
-        if (display_texture)
+        // The layers (view, popup) are drawn straight into this pass, back
+        // to front. During a resize it is the last frame at its own size.
+        FramePlacement placement;
+        static std::vector<DisplayQuad> quads;
+        if (_app && _app->display_layers(placement, quads))
         {
-            ImTextureID myFramebufferTextureID = reinterpret_cast<ImTextureID>(display_texture);
-            ImGui::Image(myFramebufferTextureID, contentSize, ImVec2(0, 0), ImVec2(1, 1));
+            ImVec2 origin = ImGui::GetCursorScreenPos();
+            ImDrawList *drawList = ImGui::GetWindowDrawList();
+            if (placement.width < contentSize.x || placement.height < contentSize.y)
+            {
+                // Letterbox in the page's usual background until it repaints
+                drawList->AddRectFilled(origin, ImVec2(origin.x + contentSize.x, origin.y + contentSize.y),
+                                        IM_COL32_WHITE);
+            }
+            for (const DisplayQuad &quad : quads)
+            {
+                int alpha = static_cast<int>(quad.opacity * 255.0f + 0.5f);
+                drawList->AddImage(reinterpret_cast<ImTextureID>(quad.texture),
+                                   ImVec2(origin.x + quad.x, origin.y + quad.y),
+                                   ImVec2(origin.x + quad.x + quad.width, origin.y + quad.y + quad.height),
+                                   ImVec2(quad.u0, quad.v0), ImVec2(quad.u1, quad.v1), IM_COL32(255, 255, 255, alpha));
+            }
+            ImGui::Dummy(ImVec2(placement.width, placement.height));
         }
         ImGui::End();
 
@@ -838,7 +1320,8 @@ void SetupDockspace(ImGuiID dockspaceID)
             {
                 context_menu_pos = ImGui::GetMousePos();
                 context_menu_pos_set = true;
-                std::cout << "Showing context menu at: " << context_menu_pos.x << ", " << context_menu_pos.y << std::endl;
+                TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_UI, "context_menu", "x=%.1f y=%.1f", context_menu_pos.x,
+                            context_menu_pos.y);
             }
 
             ImGui::SetNextWindowPos(context_menu_pos);
@@ -906,10 +1389,12 @@ void SetupDockspace(ImGuiID dockspaceID)
         ImGui_ImplMetal_RenderDrawData(draw_data, commandBuffer, renderEncoder);
         [renderEncoder popDebugGroup];
         [renderEncoder endEncoding];
+        _app->mark_frame_point(FramePoint::ImGuiRender);
 
         // Present
         [commandBuffer presentDrawable:view.currentDrawable];
         [commandBuffer commit];
+        _app->mark_frame_point(FramePoint::Present);
 
         // Update and Render additional Platform Windows
         if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
@@ -1045,7 +1530,7 @@ void SetupDockspace(ImGuiID dockspaceID)
         [self getKeyEvent:keyEvent forEvent:event];
         keyEvent.type = KEYEVENT_KEYUP;
 
-        _app->inject_key_event(keyEvent);
+        _app->queue_key_event(keyEvent);
         return;
     }
 
@@ -1079,8 +1564,7 @@ void SetupDockspace(ImGuiID dockspaceID)
 
         int mouseX = static_cast<int>(locationInView.x) - holeX;
         int mouseY = static_cast<int>(self.bounds.size.height - locationInView.y) - holeY;
-        std::cout << "holex " << holeX << " holey " << holeY << std::endl;
-        std::cout << "Mouse down at: (" << mouseX << ", " << mouseY << ")" << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_INPUT, "mouse_down", "x=%d y=%d hole=(%d,%d)", mouseX, mouseY, holeX, holeY);
 
         // Update cursor position to mouse click location
         self.textCursorPosition = locationInView;
@@ -1106,7 +1590,7 @@ void SetupDockspace(ImGuiID dockspaceID)
             buttonType = CefBrowserHost::MouseButtonType::MBT_MIDDLE;
         }
 
-        _app->inject_mouse_up_down(mouseEvent, buttonType, false, [event clickCount]);
+        _app->queue_mouse_up_down(mouseEvent, buttonType, false, [event clickCount]);
 
         // Start drag tracking
         isDragging = true;
@@ -1138,7 +1622,7 @@ void SetupDockspace(ImGuiID dockspaceID)
             buttonType = CefBrowserHost::MouseButtonType::MBT_MIDDLE;
         }
 
-        _app->inject_mouse_up_down(mouseEvent, buttonType, true, [event clickCount]);
+        _app->queue_mouse_up_down(mouseEvent, buttonType, true, [event clickCount]);
 
         // End drag tracking
         isDragging = false;
@@ -1179,10 +1663,11 @@ void SetupDockspace(ImGuiID dockspaceID)
         mouseEvent.y = static_cast<int>(self.bounds.size.height - locationInView.y) - holeY;
         mouseEvent.modifiers = [self convertModifiers:event];
 
-        int deltaX = static_cast<int>([event scrollingDeltaX]);
-        int deltaY = static_cast<int>([event scrollingDeltaY]);
+        // Keep the fractions; the input queue carries them over between events.
+        double deltaX = [event scrollingDeltaX];
+        double deltaY = [event scrollingDeltaY];
 
-        _app->inject_mouse_wheel(mouseEvent, deltaX, deltaY);
+        _app->queue_mouse_wheel(mouseEvent, deltaX, deltaY);
 
         // NSLog(@"mouse scroll at (%.1f, %.1f) with delta (%d, %d)  (%f, %f)",
         //       locationInView.x, locationInView.y, deltaX, deltaY, [event scrollingDeltaX], [event scrollingDeltaY]);
@@ -1371,7 +1856,7 @@ void SetupDockspace(ImGuiID dockspaceID)
     if (!_hasMarkedText && !_oldHasMarkedText && _textToBeInserted.length() <= 1)
     {
         keyEvent.type = KEYEVENT_KEYDOWN;
-        _app->inject_key_event(keyEvent);
+        _app->queue_key_event(keyEvent);
 
         // Don't send a CHAR event for non-char keys like arrows, function keys and clear
         if (keyEvent.modifiers & (EVENTFLAG_IS_KEY_PAD))
@@ -1383,7 +1868,7 @@ void SetupDockspace(ImGuiID dockspaceID)
         }
 
         keyEvent.type = KEYEVENT_CHAR;
-        _app->inject_key_event(keyEvent);
+        _app->queue_key_event(keyEvent);
     }
 
     // If the text to be inserted contains multiple characters then send the text to the browser
@@ -1476,10 +1961,11 @@ void SetupDockspace(ImGuiID dockspaceID)
         // Convert from NSView coordinates (bottom-left origin) to CEF coordinates (top-left origin)
         mouseEvent.x = static_cast<int>(locationInView.x) - holeX;
         mouseEvent.y = static_cast<int>(self.bounds.size.height - locationInView.y) - holeY;
-        std::cout << "mouse motion raw: (" << locationInView.x << ", " << locationInView.y << ") converted: (" << mouseEvent.x << ", " << mouseEvent.y << ") holes: (" << holeX << ", " << holeY << ")" << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_VERBOSE, TRACE_CAT_INPUT, "mouse_moved", "raw=(%.1f,%.1f) x=%d y=%d hole=(%d,%d)",
+                    locationInView.x, locationInView.y, mouseEvent.x, mouseEvent.y, holeX, holeY);
         mouseEvent.modifiers = [self convertModifiers:event];
 
-        _app->inject_mouse_motion(mouseEvent);
+        _app->queue_mouse_motion(mouseEvent);
     }
 }
 
@@ -0,0 +1,1202 @@
+#include "mycef.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <include/cef_id_mappers.h>
+
+// Uploads the dirty parts of a staged software frame into |surface|.
+// CEF hands us overlapping, adjacent and often tiny rects; every upload call
+// has a fixed cost, so the rects are coalesced first and the cost model
+// decides between a few merged uploads, one bounding box or the full frame.
+// Returns the bytes uploaded.
+static int64_t upload_dirty_rects(RenderBackend *backend,
+                               SurfaceId surface,
+                               const DirtyRegion &dirty,
+                               bool full_update,
+                               const void *buffer,
+                               int width,
+                               int height)
+{
+    DirtyRegion region;
+    if (full_update)
+    {
+        region.add(PixelRect{0, 0, width, height});
+    }
+    else
+    {
+        region = dirty;
+    }
+
+    UploadPlan plan = plan_upload(region, width, height);
+
+    // The source stride is always the full width of the OnPaint buffer.
+    size_t bytesPerRow = width * 4; // Assuming 4 bytes per pixel (BGRA format)
+    for (const auto &rect : plan.rects)
+    {
+        const uint8_t *rectBufferStart = static_cast<const uint8_t *>(buffer) +
+                                         (rect.y * bytesPerRow) +
+                                         (rect.x * 4); // 4 bytes per pixel
+        backend->upload_region(surface, rect, rectBufferStart, bytesPerRow);
+    }
+    return plan.bytes;
+}
+
+MyApp::MyApp(std::unique_ptr<RenderBackend> backend, uint32_t window_width, uint32_t window_height, uint32_t pixel_density)
+    : m_backend(std::move(backend)),
+      m_window_width(window_width),
+      m_window_height(window_height),
+      m_pixel_density(pixel_density)
+{
+    trace_set_thread_name("CrBrowserMain");
+    m_pump_timer = create_platform_pump_timer([this]()
+                                              { on_pump_timer(); });
+    m_pump.set_timer(m_pump_timer.get());
+
+    m_frame_scale = static_cast<float>(std::max<uint32_t>(1, m_pixel_density));
+    m_render_scale.set_native_scale(m_frame_scale);
+
+    // Both are opaque: cefFragmentShader always wrote alpha 1, and CEF's
+    // popup widgets paint their whole rect.
+    m_view_layer = m_layers.add_layer(0);
+    m_layers.set_opaque(m_view_layer, true);
+    m_popup_layer = m_layers.add_layer(100);
+    m_layers.set_opaque(m_popup_layer, true);
+
+    m_popup_show_callback = [this](bool show)
+    {
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_UI, "popup_show", "show=%d", show ? 1 : 0);
+        m_should_show_popup = show;
+        m_popup_hidden_us = show ? -1 : m_frame_clock.now_us();
+        if (!show)
+        {
+            m_popup_staging.reset();
+        }
+    };
+
+    m_popup_sized_callback = [this](const CefRect &rect)
+    {
+        // update_layers() damages the old and the new position
+        m_popup_pos = rect;
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_UI, "popup_size", "rect=(%d,%d %dx%d)", rect.x, rect.y, rect.width,
+                    rect.height);
+    };
+
+    m_on_accelerated_texture_ready = [this](CefRenderHandler::PaintElementType type,
+                                            const CefRenderHandler::RectList &dirtyRects,
+                                            void *shared_handle)
+    {
+        m_frame_scheduler.on_paint();
+        m_frame_timing.mark(FramePoint::Paint);
+        count_paint(type, dirtyRects);
+
+        if (type == CefRenderHandler::PaintElementType::PET_VIEW)
+        {
+            if (m_view_surface && m_view_shared_handle != shared_handle)
+            {
+                m_backend->destroy_surface(m_view_surface);
+                m_view_surface = kInvalidSurface;
+            }
+
+            if (!m_view_surface)
+            {
+                m_view_surface = m_backend->import_shared_surface(shared_handle);
+                m_view_shared_handle = shared_handle;
+
+                uint32_t width = 0;
+                uint32_t height = 0;
+                if (m_backend->get_surface_size(m_view_surface, width, height))
+                {
+                    m_window_width = width;
+                    m_window_height = height;
+                }
+            }
+
+            // CEF cycles through several IOSurfaces, so the dirty rects are
+            // relative to a different surface; redraw all of it.
+            m_layers.damage(m_view_layer);
+
+            // Reading the IOSurface back is a whole frame each time, so only
+            // when the thumbnail is due; otherwise it's left for later.
+            m_thumbnail_tap_pending = m_thumbnails.active() && !tap_view_surface_for_thumbnail();
+        }
+        else if (type == CefRenderHandler::PaintElementType::PET_POPUP && m_should_show_popup)
+        {
+            if (m_popup_surface && m_popup_shared_handle != shared_handle)
+            {
+                m_backend->destroy_surface(m_popup_surface);
+                m_popup_surface = kInvalidSurface;
+            }
+
+            if (!m_popup_surface)
+            {
+                m_popup_surface = m_backend->import_shared_surface(shared_handle);
+                m_popup_shared_handle = shared_handle;
+            }
+
+            m_layers.damage(m_popup_layer);
+        }
+
+        // Importing the IOSurface is all the upload there is
+        m_frame_timing.mark(FramePoint::Upload);
+    };
+
+    m_on_texture_ready = [this](CefRenderHandler::PaintElementType type, const CefRenderHandler::RectList &dirtyRects, const void *buffer, int width, int height)
+    {
+        // std::cout << "texture ready " << width << ", " << height << std::endl;
+        // Runs on the CEF UI thread: only stage the changed rows here, the
+        // texture upload happens once per display frame in upload_staged_frames().
+        // With the external message pump that is also the render thread, so
+        // the frame scheduler can be told directly.
+        m_frame_scheduler.on_paint();
+        m_frame_timing.mark(FramePoint::Paint);
+        count_paint(type, dirtyRects);
+        DirtyRegion dirty;
+        for (const auto &rect : dirtyRects)
+        {
+            dirty.add(PixelRect{rect.x, rect.y, rect.width, rect.height});
+        }
+
+        if (type == CefRenderHandler::PaintElementType::PET_VIEW)
+        {
+            m_view_staging.publish(dirty, buffer, width, height);
+            if (m_frame_capture.active())
+            {
+                TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "frame_capture");
+                m_frame_capture.capture(dirty, buffer, width, height, m_frame_clock.now_us());
+            }
+            if (m_frame_stream.active())
+            {
+                TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "frame_stream");
+                m_frame_stream.publish(dirty, buffer, width, height, m_frame_clock.now_us());
+            }
+            if (m_thumbnails.active())
+            {
+                TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "thumbnail");
+                m_thumbnails.submit(m_tabs.active_tab(), dirty, buffer, static_cast<size_t>(width) * 4, width, height,
+                                    m_frame_clock.now_us());
+            }
+        }
+        else if (type == CefRenderHandler::PaintElementType::PET_POPUP && m_should_show_popup)
+        {
+            m_popup_staging.publish(dirty, buffer, width, height);
+        }
+    };
+}
+
+bool MyApp::ensure_surface(SurfaceId &surface, uint32_t width, uint32_t height, bool render_target)
+{
+    uint32_t current_width = 0;
+    uint32_t current_height = 0;
+    if (surface != kInvalidSurface &&
+        m_backend->get_surface_size(surface, current_width, current_height) &&
+        current_width == width && current_height == height)
+    {
+        return false;
+    }
+
+    if (surface != kInvalidSurface)
+    {
+        m_backend->destroy_surface(surface);
+    }
+    surface = m_backend->create_surface(width, height, render_target);
+    return true;
+}
+
+void MyApp::upload_staged_frames()
+{
+    bool uploaded = false;
+    DirtyRegion damage;
+    if (const StagedFrame *frame = m_view_staging.acquire(damage))
+    {
+        uploaded = true;
+        if (m_view_shared_handle)
+        {
+            // Never write into a surface CEF shared with us.
+            m_backend->destroy_surface(m_view_surface);
+            m_view_surface = kInvalidSurface;
+            m_view_shared_handle = nullptr;
+        }
+
+        bool full_update = ensure_surface(m_view_surface, frame->width, frame->height, false);
+        if (full_update)
+        {
+            // std::cout << "recreate texture " << frame->width << ", " << frame->height << std::endl;
+            m_window_width = frame->width;
+            m_window_height = frame->height;
+        }
+
+        if (full_update)
+        {
+            m_view_tiles.reset();
+            damage.clear();
+            damage.add(PixelRect{0, 0, frame->width, frame->height});
+        }
+        m_view_tiles.add_dirty_bytes(damage.area() * 4);
+
+        // A scroll arrives as a (nearly) fully dirty frame that is mostly the
+        // last one moved; move what the surface has and patch the rest.
+        bool scrolled = false;
+        if (!full_update)
+        {
+            TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "detect_scroll");
+            ScrollShift shift;
+            DirtyRegion remaining;
+            if (m_view_scroll.detect(damage, frame->pixels.data(), frame->width, frame->height, shift, remaining) &&
+                m_backend->move_region(m_view_surface, scroll_source_rect(frame->width, frame->height, shift),
+                                       shift.dx, shift.dy))
+            {
+                m_view_scroll.apply_shift(shift);
+                // The tile hashes describe pixels that have moved
+                m_view_tiles.reset();
+                damage = remaining;
+                scrolled = true;
+            }
+        }
+
+        // Only what is in tiles whose pixels changed goes to the GPU; CEF's
+        // damage is often much bigger than that.
+        DirtyRegion changed;
+        {
+            TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "hash_tiles");
+            changed = m_view_tiles.filter(damage, frame->pixels.data(), frame->width, frame->height);
+        }
+        m_view_tiles.add_uploaded_bytes(upload_dirty_rects(m_backend.get(), m_view_surface, changed, false,
+                                                           frame->pixels.data(), frame->width, frame->height));
+        m_view_scroll.update(damage, frame->pixels.data(), frame->width, frame->height);
+
+        // The view layer is drawn 1:1
+        if (full_update || scrolled)
+        {
+            m_layers.damage(m_view_layer);
+        }
+        else
+        {
+            for (const PixelRect &rect : changed.rects())
+            {
+                m_layers.damage(m_view_layer, rect);
+            }
+        }
+    }
+
+    damage.clear();
+    if (const StagedFrame *frame = m_popup_staging.acquire(damage))
+    {
+        uploaded = true;
+        if (m_popup_shared_handle)
+        {
+            m_backend->destroy_surface(m_popup_surface);
+            m_popup_surface = kInvalidSurface;
+            m_popup_shared_handle = nullptr;
+        }
+
+        bool full_update = ensure_surface(m_popup_surface, frame->width, frame->height, false);
+        upload_dirty_rects(m_backend.get(), m_popup_surface, damage, full_update,
+                           frame->pixels.data(), frame->width, frame->height);
+
+        PixelRect popup_rect = popup_layer_rect();
+        if (full_update || popup_rect.width != frame->width || popup_rect.height != frame->height)
+        {
+            // Scaled (or brand new) popup, any texel may move
+            m_layers.damage(m_popup_layer);
+        }
+        else
+        {
+            for (const PixelRect &rect : damage.rects())
+            {
+                m_layers.damage(m_popup_layer, PixelRect{rect.x + popup_rect.x, rect.y + popup_rect.y, rect.width, rect.height});
+            }
+        }
+    }
+
+    if (uploaded)
+    {
+        m_frame_timing.mark(FramePoint::Upload);
+    }
+}
+
+void MyApp::OnBeforeCommandLineProcessing(const CefString &process_type, CefRefPtr<CefCommandLine> command_line)
+{
+    // std::cout << "OnBeforeCommandLineProcessing called for process type: " << process_type.ToString() << std::endl;
+    // Check if it's the browser process (process_type will be empty for browser process)
+    if (process_type.empty())
+    {
+        command_line->AppendSwitch("enable-beginframe-scheduling");
+        command_line->AppendSwitch("use-mock-keychain");
+        if (!m_backend->can_import_shared_surfaces())
+        {
+            // Paints come through OnPaint only; keep the GPU process out of it
+            command_line->AppendSwitch("disable-gpu");
+            command_line->AppendSwitch("disable-gpu-compositing");
+        }
+#ifdef __linux__
+        // The Linux build is the headless runner, there may be no display
+        command_line->AppendSwitchWithValue("ozone-platform", "headless");
+#endif
+        // Add other browser process specific switches here.
+        // For WebGPU/WebGL, remember NOT to use --disable-gpu or --disable-gpu-compositing.
+    }
+    // You can also add switches for specific process types if needed:
+    // else if (process_type == "renderer") {
+    //     // Add renderer process specific switches
+    // }
+}
+
+MyApp::~MyApp()
+{
+    // Clean up resources if necessary
+    if (m_backend)
+    {
+        for (SurfaceId *surface : {&m_view_surface, &m_popup_surface})
+        {
+            if (*surface != kInvalidSurface)
+            {
+                m_backend->destroy_surface(*surface);
+                *surface = kInvalidSurface;
+            }
+        }
+        release_thumbnail_surfaces(0);
+    }
+}
+
+MyRenderHandler::MyRenderHandler(bool accelerated_rendering, int width, int height, float device_scale_factor,
+                                 RenderingCallback rendering_callback,
+                                 AcceleratedRenderingCallback accelerated_rendering_callback,
+                                 PopupShowCallback popup_show_callback,
+                                 PopupSizedCallback popup_sized_callback)
+    : m_accelerated_rendering(accelerated_rendering),
+      m_width(width), m_height(height), m_device_scale_factor(device_scale_factor),
+      m_rendering_callback(rendering_callback),
+      m_accelerated_rendering_callback(accelerated_rendering_callback),
+      m_popup_show_callback(popup_show_callback),
+      m_popup_sized_callback(popup_sized_callback)
+{
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_BROWSER, "render_handler", "size=%dx%d scale=%.2f", m_width, m_height,
+                m_device_scale_factor);
+}
+
+void MyRenderHandler::UpdateDimensions(int width, int height, float device_scale_factor)
+{
+    m_width = width;
+    m_height = height;
+    m_device_scale_factor = device_scale_factor;
+    // std::cout << "MyRenderHandler updated dimensions: " << m_width << ", " << m_height << ", " << m_device_scale_factor << std::endl;
+}
+
+void MyApp::init(uint32_t window_width, uint32_t window_height)
+{
+    m_window_width = window_width;
+    m_window_height = window_height;
+
+    // Initialize the view surface; it is recreated when CEF paints at a different size.
+    if (m_view_surface)
+    {
+        m_backend->destroy_surface(m_view_surface);
+        m_view_surface = kInvalidSurface;
+    }
+    m_view_surface = m_backend->create_surface(m_window_width, m_window_height, false);
+
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "render_backend", "name=%s", m_backend->name());
+}
+
+void MyApp::prepare_for_render()
+{
+    update_visibility();
+    if (m_visibility.paused())
+    {
+        // Nothing of the view can be seen. OnPaint keeps merging into the
+        // staging slots and the layers keep the last frame until it can.
+        update_memory();
+        return;
+    }
+
+    // Pick up whatever OnPaint staged since the last display frame.
+    upload_staged_frames();
+    update_render_scale();
+    update_memory();
+    update_layers();
+    // The last paint of a throttled burst still makes it into the thumbnail
+    if (m_thumbnail_tap_pending)
+    {
+        m_thumbnail_tap_pending = !tap_view_surface_for_thumbnail();
+    }
+    m_thumbnails.tick(m_frame_clock.now_us());
+
+    // The layers are drawn straight into the UI's pass; what a layer in
+    // front covers isn't drawn at all.
+    const Layer *view = m_layers.find(m_view_layer);
+    DirtyRegion damage;
+    bool changed;
+    {
+        TRACE_SCOPE(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "build_layers");
+        changed = m_layers.build_frame(view->bounds, m_layer_quads, damage);
+    }
+    if (changed)
+    {
+        m_frame_timing.mark(FramePoint::Composite);
+    }
+}
+
+void MyApp::update_layers()
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool has_view = m_view_surface != kInvalidSurface && m_backend->get_surface_size(m_view_surface, width, height);
+    m_layers.set_surface(m_view_layer, has_view ? m_view_surface : kInvalidSurface);
+    m_layers.set_bounds(m_view_layer, PixelRect{0, 0, static_cast<int>(width), static_cast<int>(height)});
+    m_layers.set_visible(m_view_layer, has_view);
+
+    // A frame of a new size is the first one painted at a new size or
+    // scale; only once it arrives is the view stretched differently.
+    if (has_view && (static_cast<int>(width) != m_frame_scale_width || static_cast<int>(height) != m_frame_scale_height))
+    {
+        m_frame_scale_width = static_cast<int>(width);
+        m_frame_scale_height = static_cast<int>(height);
+        const ViewSize &size = m_resize.browser_size();
+        float scale = m_render_scale.device_scale();
+        if (std::abs(m_frame_scale_width - static_cast<int>(std::ceil(size.width * scale))) <= 1 &&
+            std::abs(m_frame_scale_height - static_cast<int>(std::ceil(size.height * scale))) <= 1)
+        {
+            m_frame_scale = scale;
+        }
+    }
+
+    PixelRect requested = popup_rect_in_pixels();
+    PixelRect placed = popup_layer_rect();
+    m_layers.set_surface(m_popup_layer, m_popup_surface);
+    m_layers.set_bounds(m_popup_layer, placed);
+    m_layers.set_input_offset(m_popup_layer, requested.x - placed.x, requested.y - placed.y);
+    m_layers.set_visible(m_popup_layer, m_should_show_popup && m_popup_surface != kInvalidSurface);
+}
+
+bool MyApp::display_layers(FramePlacement &placement, std::vector<DisplayQuad> &quads)
+{
+    quads.clear();
+    const Layer *view = m_layers.find(m_view_layer);
+    if (!view->visible)
+        return false;
+
+    // While a resize is pending the frame is shown at its own size, cut
+    // to the view
+    placement = m_resize.place_frame(view->bounds.width, view->bounds.height, m_frame_scale);
+    float density = m_frame_scale;
+    PixelRect shown{0, 0, static_cast<int>(std::lround(placement.width * density)),
+                    static_cast<int>(std::lround(placement.height * density))};
+
+    for (const LayerQuad &quad : m_layer_quads)
+    {
+        PixelRect dest = intersect_rects(quad.dest, shown);
+        void *texture = dest.empty() ? nullptr : m_backend->present(quad.surface);
+        if (!texture)
+            continue;
+
+        // Pooled surfaces can be larger than what is drawn into them
+        float extent_u = 1.0f;
+        float extent_v = 1.0f;
+        m_backend->surface_uv_extent(quad.surface, extent_u, extent_v);
+        float u_per_pixel = (quad.u1 - quad.u0) / quad.dest.width;
+        float v_per_pixel = (quad.v1 - quad.v0) / quad.dest.height;
+
+        DisplayQuad display;
+        display.texture = texture;
+        display.x = dest.x / density;
+        display.y = dest.y / density;
+        display.width = dest.width / density;
+        display.height = dest.height / density;
+        display.u0 = (quad.u0 + (dest.x - quad.dest.x) * u_per_pixel) * extent_u;
+        display.v0 = (quad.v0 + (dest.y - quad.dest.y) * v_per_pixel) * extent_v;
+        display.u1 = (quad.u0 + (dest.right() - quad.dest.x) * u_per_pixel) * extent_u;
+        display.v1 = (quad.v0 + (dest.bottom() - quad.dest.y) * v_per_pixel) * extent_v;
+        display.opacity = quad.opacity;
+        quads.push_back(display);
+    }
+    return !quads.empty();
+}
+
+void MyApp::update_view_size(int width, int height, int pixel_density)
+{
+    if (!m_resize.update(ViewSize{width, height, pixel_density}))
+        return;
+
+    const ViewSize &size = m_resize.browser_size();
+    float scale = m_render_scale.device_scale();
+    m_render_scale.set_native_scale(static_cast<float>(size.pixel_density));
+    update_render_handler_dimensions(size.width, size.height, m_render_scale.device_scale());
+    resize_browser(m_render_scale.device_scale() != scale);
+}
+
+void MyApp::resize_browser(bool screen_info_changed)
+{
+    if (CefRefPtr<CefBrowser> browser = get_browser(); browser && browser->IsValid())
+    {
+        // The scale factor is only read again from GetScreenInfo() when told
+        if (screen_info_changed)
+        {
+            browser->GetHost()->NotifyScreenInfoChanged();
+        }
+        browser->GetHost()->WasResized();
+    }
+}
+
+void MyApp::set_adaptive_quality(bool enabled)
+{
+    float scale = m_render_scale.device_scale();
+    m_render_scale.set_enabled(enabled);
+    if (m_render_scale.device_scale() == scale)
+        return;
+
+    const ViewSize &size = m_resize.browser_size();
+    update_render_handler_dimensions(size.width, size.height, m_render_scale.device_scale());
+    resize_browser(true);
+}
+
+void MyApp::update_visibility()
+{
+    bool was_paused = m_visibility.paused();
+    if (!m_visibility.update())
+        return;
+
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_UI, "visibility", "state=%s frame_rate=%d",
+                view_visibility_name(m_visibility.state()), m_visibility.frame_rate());
+    m_tabs.set_window_visibility(m_visibility.paused(), m_visibility.frame_rate());
+    m_frame_scheduler.set_min_interval_us(m_visibility.begin_frame_interval_us());
+    if (was_paused && !m_visibility.paused())
+    {
+        // The repaint BrowserPool asked for needs BeginFrames right away
+        m_frame_scheduler.invalidate(FrameInvalidation::Visibility);
+    }
+}
+
+void MyApp::update_render_scale()
+{
+    // Any paint counts; scrolls are only detected on software paints, but
+    // they paint every frame either way.
+    const FrameSchedulerStats &scheduler = m_frame_scheduler.stats();
+    bool painted = scheduler.paints != m_render_scale_paints;
+    bool scrolled = m_view_scroll.stats().detected != m_render_scale_scrolls;
+    m_render_scale_paints = scheduler.paints;
+    m_render_scale_scrolls = m_view_scroll.stats().detected;
+    if (!m_render_scale.update(painted, scrolled, scheduler.period_us))
+        return;
+
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_PAINT, "render_scale", "scale=%.2f native=%.2f",
+                m_render_scale.device_scale(), m_render_scale.native_scale());
+    const ViewSize &size = m_resize.browser_size();
+    if (size.empty())
+        return;
+    update_render_handler_dimensions(size.width, size.height, m_render_scale.device_scale());
+    resize_browser(true);
+}
+
+void MyClient::OnAfterCreated(CefRefPtr<CefBrowser> browser)
+{
+    m_browser = browser;
+    if (m_browser->GetHost())
+    {
+        m_browser->GetHost()->WasResized(); // Initial resize notification
+        if (m_render_handler->m_visible)
+        {
+            // BrowserPool::set_window_visibility() had no browser to tell
+            if (m_window_hidden)
+                m_browser->GetHost()->WasHidden(true);
+            m_browser->GetHost()->SetWindowlessFrameRate(m_window_frame_rate);
+            m_browser->GetHost()->SetFocus(true); // Give focus
+        }
+        else
+        {
+            // Opened as a background tab
+            m_browser->GetHost()->WasHidden(true);
+        }
+    }
+}
+
+int MyApp::new_tab(const std::string &url)
+{
+    CefRefPtr<MyRenderHandler> render_handler = new MyRenderHandler(m_backend->can_import_shared_surfaces(),
+                                                                     m_window_width,
+                                                                     m_window_height,
+                                                                     m_render_scale.device_scale(),
+                                                                     m_on_texture_ready,
+                                                                     m_on_accelerated_texture_ready,
+                                                                     m_popup_show_callback, m_popup_sized_callback);
+    if (m_client)
+    {
+        // New tabs open at the current view size, not the initial one
+        render_handler->UpdateDimensions(m_client->m_render_handler->m_width,
+                                         m_client->m_render_handler->m_height,
+                                         m_client->m_render_handler->m_device_scale_factor);
+    }
+
+    // Input queued for the current tab goes to it, not the new one
+    drain_input();
+    int tab_id = m_tabs.add_tab(new MyClient(render_handler), url, true);
+    on_tab_activated();
+    return tab_id;
+}
+
+void MyApp::load_url(const std::string &url)
+{
+    CefRefPtr<CefBrowser> browser = get_browser();
+    if (!browser || !browser->IsValid())
+        return;
+
+    drain_input();
+    // Set here, the load handler only hears about it once the load started
+    m_client->m_loading = true;
+    browser->GetMainFrame()->LoadURL(url);
+}
+
+void MyApp::count_paint(CefRenderHandler::PaintElementType type, const CefRenderHandler::RectList &dirtyRects)
+{
+    if (type == CefRenderHandler::PaintElementType::PET_POPUP)
+    {
+        m_paint_stats.popup_paints++;
+    }
+    else
+    {
+        m_paint_stats.paints++;
+    }
+    m_paint_stats.dirty_rects += dirtyRects.size();
+    for (const auto &rect : dirtyRects)
+    {
+        m_paint_stats.painted_pixels += static_cast<uint64_t>(rect.width) * rect.height;
+    }
+}
+
+void MyApp::activate_tab(int tab_id)
+{
+    drain_input();
+    if (m_tabs.activate(tab_id))
+    {
+        on_tab_activated();
+    }
+}
+
+void MyApp::close_tab(int tab_id)
+{
+    drain_input();
+    m_thumbnails.remove(tab_id);
+    release_thumbnail_surfaces(tab_id);
+    if (m_tabs.close_tab(tab_id))
+    {
+        on_tab_activated();
+    }
+}
+
+void MyApp::set_thumbnails_enabled(bool enabled)
+{
+    if (enabled == m_thumbnails.active())
+        return;
+
+    if (enabled)
+    {
+        m_thumbnails.start();
+        // Software paints only carry what changed; start from a whole frame
+        if (m_client && m_client->get_browser())
+            m_client->get_browser()->GetHost()->Invalidate(PET_VIEW);
+    }
+    else
+    {
+        m_thumbnails.stop();
+        release_thumbnail_surfaces(0);
+    }
+}
+
+bool MyApp::thumbnail_quad(int tab_id, DisplayQuad &quad)
+{
+    auto it = std::find_if(m_thumbnail_surfaces.begin(), m_thumbnail_surfaces.end(),
+                           [tab_id](const ThumbnailSurface &entry)
+                           { return entry.tab_id == tab_id; });
+    if (it == m_thumbnail_surfaces.end())
+    {
+        ThumbnailSurface entry;
+        entry.tab_id = tab_id;
+        it = m_thumbnail_surfaces.insert(m_thumbnail_surfaces.end(), std::move(entry));
+    }
+
+    uint64_t generation = it->thumbnail.generation;
+    if (!m_thumbnails.copy(tab_id, it->thumbnail))
+    {
+        // Evicted or never painted
+        release_thumbnail_surfaces(tab_id);
+        return false;
+    }
+
+    const Thumbnail &thumbnail = it->thumbnail;
+    if (thumbnail.generation != generation || it->surface == kInvalidSurface)
+    {
+        // A few hundred KB at most, and only a few times a second
+        ensure_surface(it->surface, thumbnail.width, thumbnail.height, false);
+        m_backend->upload_region(it->surface, PixelRect{0, 0, thumbnail.width, thumbnail.height},
+                                 thumbnail.pixels.data(), static_cast<size_t>(thumbnail.width) * 4);
+    }
+
+    void *texture = m_backend->present(it->surface);
+    if (!texture)
+        return false;
+
+    quad = DisplayQuad();
+    quad.texture = texture;
+    quad.width = static_cast<float>(thumbnail.width);
+    quad.height = static_cast<float>(thumbnail.height);
+    m_backend->surface_uv_extent(it->surface, quad.u1, quad.v1);
+    return true;
+}
+
+bool MyApp::tap_view_surface_for_thumbnail()
+{
+#ifdef __APPLE__
+    int tab_id = m_tabs.active_tab();
+    int64_t now_us = m_frame_clock.now_us();
+    if (!m_view_shared_handle || !m_thumbnails.refresh_due(tab_id, now_us))
+        return false;
+
+    // CEF may have started on its next frame in this surface since it was
+    // handed over; for a thumbnail that's close enough.
+    TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_PAINT, "thumbnail_tap");
+    IOSurfaceRef surface = static_cast<IOSurfaceRef>(m_view_shared_handle);
+    if (IOSurfaceLock(surface, kIOSurfaceLockReadOnly, nullptr) != kIOReturnSuccess)
+        return false;
+
+    // CEF cycles through several IOSurfaces, so all of it is new
+    int width = static_cast<int>(IOSurfaceGetWidth(surface));
+    int height = static_cast<int>(IOSurfaceGetHeight(surface));
+    DirtyRegion dirty;
+    dirty.add(PixelRect{0, 0, width, height});
+    m_thumbnails.submit(tab_id, dirty, IOSurfaceGetBaseAddress(surface), IOSurfaceGetBytesPerRow(surface), width,
+                        height, now_us);
+    IOSurfaceUnlock(surface, kIOSurfaceLockReadOnly, nullptr);
+    return true;
+#else
+    return true;
+#endif
+}
+
+void MyApp::measure_memory()
+{
+    m_memory.set(MemoryCategory::ViewSurface, m_backend->surface_bytes(m_view_surface));
+    m_memory.set(MemoryCategory::PopupSurface, m_backend->surface_bytes(m_popup_surface));
+    size_t thumbnail_surfaces = 0;
+    for (const ThumbnailSurface &entry : m_thumbnail_surfaces)
+    {
+        thumbnail_surfaces += m_backend->surface_bytes(entry.surface);
+    }
+    m_memory.set(MemoryCategory::ThumbnailSurfaces, thumbnail_surfaces);
+    const SurfacePoolStats *pool = m_backend->surface_pool_stats();
+    m_memory.set(MemoryCategory::PooledIdle, pool ? pool->idle_bytes : 0);
+    m_memory.set(MemoryCategory::BackendScratch, m_backend->scratch_bytes());
+    m_memory.set(MemoryCategory::ViewStaging, m_view_staging.memory_bytes());
+    m_memory.set(MemoryCategory::PopupStaging, m_popup_staging.memory_bytes());
+    m_memory.set(MemoryCategory::ScrollShadow, m_view_scroll.memory_bytes());
+    m_memory.set(MemoryCategory::TileHashes, m_view_tiles.memory_bytes());
+    ThumbnailCacheStats thumbnails = m_thumbnails.stats();
+    m_memory.set(MemoryCategory::Thumbnails, thumbnails.thumbnail_bytes + thumbnails.staging_bytes);
+    m_memory.set(MemoryCategory::FrameStream, m_frame_stream.stats().buffer_bytes);
+    m_memory.set(MemoryCategory::FrameCapture, m_frame_capture.stats().buffer_bytes);
+}
+
+void MyApp::update_memory()
+{
+    measure_memory();
+
+    const MemoryBudgetConfig &config = m_memory.config();
+    bool popup_held = m_memory.bytes(MemoryCategory::PopupSurface) || m_memory.bytes(MemoryCategory::PopupStaging);
+    if (!m_should_show_popup && popup_held && m_popup_hidden_us >= 0 &&
+        m_frame_clock.now_us() - m_popup_hidden_us >= config.hidden_popup_release_us)
+    {
+        TRACE_SCOPE(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "release_hidden_popup");
+        // Its surface went back to the pool, which would only keep it
+        if (release_reclaimable_memory())
+            m_memory.stats().popup_releases++;
+    }
+
+    if (m_memory.end_frame())
+    {
+        TRACE_SCOPE(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "release_over_budget");
+        if (release_reclaimable_memory())
+            m_memory.stats().budget_releases++;
+    }
+}
+
+void MyApp::on_memory_pressure(MemoryPressure level)
+{
+    TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "memory_pressure", "level=%d total=%zu",
+                static_cast<int>(level), m_memory.total());
+    m_memory.stats().pressure_events++;
+    if (level == MemoryPressure::Critical)
+    {
+        // thumbnail_quad() uploads them again when they are drawn
+        release_thumbnail_surfaces(0);
+    }
+    release_reclaimable_memory();
+}
+
+size_t MyApp::release_reclaimable_memory()
+{
+    measure_memory();
+    size_t before = m_memory.total();
+    if (!m_should_show_popup)
+    {
+        release_hidden_popup();
+    }
+    m_backend->release_idle_memory();
+    measure_memory();
+    size_t after = m_memory.total();
+    m_memory.count_release(before, after);
+    return before > after ? before - after : 0;
+}
+
+void MyApp::release_hidden_popup()
+{
+    if (m_popup_surface != kInvalidSurface)
+    {
+        // Painted or imported again when it is shown next
+        m_backend->destroy_surface(m_popup_surface);
+        m_popup_surface = kInvalidSurface;
+        m_popup_shared_handle = nullptr;
+    }
+    m_popup_staging.release();
+    m_popup_hidden_us = -1;
+}
+
+void MyApp::release_thumbnail_surfaces(int tab_id)
+{
+    for (auto it = m_thumbnail_surfaces.begin(); it != m_thumbnail_surfaces.end();)
+    {
+        if (tab_id != 0 && it->tab_id != tab_id)
+        {
+            ++it;
+            continue;
+        }
+        if (it->surface != kInvalidSurface)
+            m_backend->destroy_surface(it->surface);
+        it = m_thumbnail_surfaces.erase(it);
+    }
+}
+
+void MyApp::on_tab_activated()
+{
+    m_client = m_tabs.active_client();
+
+    // The surfaces are shared by all tabs. Keep showing the old tab's pixels
+    // until the new one paints (BrowserPool::show() invalidates it), but its
+    // popup belongs to the old tab.
+    if (m_should_show_popup)
+    {
+        m_should_show_popup = false;
+        m_popup_hidden_us = m_frame_clock.now_us();
+        m_popup_staging.reset();
+    }
+    // The shared IOSurface still holds the old tab until the new one paints
+    m_thumbnail_tap_pending = false;
+    m_frame_scheduler.invalidate(FrameInvalidation::Visibility);
+}
+
+bool MyClient::OnChromeCommand(CefRefPtr<CefBrowser> browser,
+                               int command_id,
+                               cef_window_open_disposition_t disposition)
+{
+
+    CEF_DECLARE_COMMAND_ID(IDC_CUT);
+    CEF_DECLARE_COMMAND_ID(IDC_COPY);
+    CEF_DECLARE_COMMAND_ID(IDC_PASTE);
+
+    static const int kAllowedCommandIds[] = {
+        IDC_CUT,
+        IDC_COPY,
+        IDC_PASTE};
+    for (int kAllowedCommandId : kAllowedCommandIds)
+    {
+        if (command_id == kAllowedCommandId)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string get_macos_cache_dir(const std::string &app_name)
+{
+    const char *home = getenv("HOME");
+    if (!home)
+        return "/tmp/" + app_name; // fallback
+    return std::string(home) + "/Library/Caches/" + app_name;
+}
+
+void MyApp::OnScheduleMessagePumpWork(int64_t delay_ms)
+{
+    // Can be called on any thread. The scheduler keeps a single pending
+    // wakeup at the earliest requested time instead of one block per call.
+    m_pump.schedule(delay_ms);
+}
+
+void MyApp::on_pump_timer()
+{
+    TRACE_SCOPE(TRACE_LEVEL_INFO, TRACE_CAT_PUMP, "message_loop_work");
+    // Immediate work is usually the page reacting to something; delayed
+    // work is timers, which invalidate through their paints if at all.
+    if (m_pump.run())
+    {
+        m_frame_scheduler.invalidate(FrameInvalidation::PumpWork);
+    }
+}
+
+InputEvent to_input_event(const CefMouseEvent &event, InputEvent::Type type)
+{
+    InputEvent input;
+    input.type = type;
+    input.x = event.x;
+    input.y = event.y;
+    input.modifiers = event.modifiers;
+    return input;
+}
+
+InputEvent to_input_event(const CefKeyEvent &event)
+{
+    InputEvent input;
+    input.type = InputEvent::Type::Key;
+    input.modifiers = event.modifiers;
+    input.key_type = event.type;
+    input.windows_key_code = event.windows_key_code;
+    input.native_key_code = event.native_key_code;
+    input.is_system_key = event.is_system_key;
+    input.character = event.character;
+    input.unmodified_character = event.unmodified_character;
+    input.focus_on_editable_field = event.focus_on_editable_field;
+    return input;
+}
+
+CefMouseEvent to_cef_mouse_event(const InputEvent &input)
+{
+    CefMouseEvent mouse_event;
+    mouse_event.x = input.x;
+    mouse_event.y = input.y;
+    mouse_event.modifiers = input.modifiers;
+    return mouse_event;
+}
+
+CefKeyEvent to_cef_key_event(const InputEvent &input)
+{
+    CefKeyEvent key_event;
+    key_event.type = static_cast<cef_key_event_type_t>(input.key_type);
+    key_event.modifiers = input.modifiers;
+    key_event.windows_key_code = input.windows_key_code;
+    key_event.native_key_code = input.native_key_code;
+    key_event.is_system_key = input.is_system_key;
+    key_event.character = input.character;
+    key_event.unmodified_character = input.unmodified_character;
+    key_event.focus_on_editable_field = input.focus_on_editable_field;
+    return key_event;
+}
+
+void MyApp::queue_mouse_motion(const CefMouseEvent &event)
+{
+    m_input_queue.push(to_input_event(event, InputEvent::Type::MouseMove));
+}
+
+void MyApp::queue_mouse_up_down(const CefMouseEvent &event, CefBrowserHost::MouseButtonType type, bool mouseUp, int clickCount)
+{
+    InputEvent input = to_input_event(event, InputEvent::Type::MouseButton);
+    input.button = type;
+    input.mouse_up = mouseUp;
+    input.click_count = clickCount;
+    m_input_queue.push(input);
+}
+
+void MyApp::queue_mouse_wheel(const CefMouseEvent &event, double deltaX, double deltaY)
+{
+    InputEvent input = to_input_event(event, InputEvent::Type::MouseWheel);
+    input.wheel_dx = deltaX;
+    input.wheel_dy = deltaY;
+    m_input_queue.push(input);
+}
+
+void MyApp::queue_key_event(const CefKeyEvent &event)
+{
+    m_input_queue.push(to_input_event(event));
+}
+
+void MyApp::drain_input()
+{
+    TRACE_SCOPE(TRACE_LEVEL_DEBUG, TRACE_CAT_INPUT, "drain_input");
+    m_input_queue.drain([this](const InputEvent &input)
+                        {
+        switch (input.type)
+        {
+        case InputEvent::Type::MouseMove:
+            inject_mouse_motion(to_cef_mouse_event(input));
+            break;
+        case InputEvent::Type::MouseButton:
+            inject_mouse_up_down(to_cef_mouse_event(input), static_cast<CefBrowserHost::MouseButtonType>(input.button),
+                                 input.mouse_up, input.click_count);
+            break;
+        case InputEvent::Type::MouseWheel:
+            inject_mouse_wheel(to_cef_mouse_event(input), static_cast<int>(input.wheel_dx), static_cast<int>(input.wheel_dy));
+            break;
+        case InputEvent::Type::Key:
+            inject_key_event(to_cef_key_event(input));
+            break;
+        } });
+}
+
+void MyApp::deliver_frame_input()
+{
+    m_input_recorder.record_frame();
+    if (m_frame_stream.active())
+    {
+        m_frame_stream.take_input(m_stream_input);
+    }
+    if (!m_input_replayer.replaying())
+    {
+        drain_input();
+        // Stream clients go through the same boundary the replay does
+        for (const RecordedInput &input : m_stream_input)
+        {
+            replay_input(input);
+        }
+        m_stream_input.clear();
+        return;
+    }
+
+    // Stray view and stream input would make the replay diverge
+    m_input_queue.drain([](const InputEvent &) {});
+    m_stream_input.clear();
+    size_t delivered = m_input_replayer.deliver_due([this](const RecordedInput &input)
+                                                    { replay_input(input); });
+    TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_INPUT, "replay", "delivered=%zu position=%zu/%zu",
+                delivered, m_input_replayer.position(), m_input_replayer.size());
+}
+
+bool MyApp::stop_input_recording(const std::string &path)
+{
+    m_input_recorder.stop();
+    return m_input_recorder.save(path);
+}
+
+bool MyApp::start_input_replay(const std::string &path, ReplayPace pace)
+{
+    if (!m_input_replayer.load(path))
+        return false;
+    m_input_replayer.start(pace);
+    return true;
+}
+
+void MyApp::replay_input(const RecordedInput &input)
+{
+    const InputEvent &event = input.event;
+    switch (input.kind)
+    {
+    case RecordedInput::Kind::Frame:
+        break;
+    case RecordedInput::Kind::Mouse:
+        if (event.type == InputEvent::Type::MouseButton)
+        {
+            inject_mouse_up_down(to_cef_mouse_event(event), static_cast<CefBrowserHost::MouseButtonType>(event.button),
+                                 event.mouse_up, event.click_count);
+        }
+        else if (event.type == InputEvent::Type::MouseWheel)
+        {
+            inject_mouse_wheel(to_cef_mouse_event(event), static_cast<int>(event.wheel_dx), static_cast<int>(event.wheel_dy));
+        }
+        else
+        {
+            inject_mouse_motion(to_cef_mouse_event(event));
+        }
+        break;
+    case RecordedInput::Kind::Key:
+        inject_key_event(to_cef_key_event(event));
+        break;
+    case RecordedInput::Kind::ImeSetComposition:
+    {
+        std::vector<CefCompositionUnderline> underlines;
+        for (const ImeUnderline &recorded : input.underlines)
+        {
+            CefCompositionUnderline underline;
+            underline.range = CefRange(recorded.from, recorded.to);
+            underline.color = recorded.color;
+            underline.background_color = recorded.background_color;
+            underline.thick = recorded.thick;
+            underline.style = static_cast<cef_composition_underline_style_t>(recorded.style);
+            underlines.push_back(underline);
+        }
+        inject_ime_set_composition(input.text, underlines,
+                                   CefRange(input.replacement_from, input.replacement_to),
+                                   CefRange(input.selection_from, input.selection_to));
+        break;
+    }
+    case RecordedInput::Kind::ImeCommitText:
+        inject_ime_commit_text(input.text, CefRange(input.replacement_from, input.replacement_to), input.relative_cursor_pos);
+        break;
+    case RecordedInput::Kind::ImeFinishComposingText:
+        inject_ime_finish_composing_text(input.keep_selection);
+        break;
+    case RecordedInput::Kind::ImeCancelComposition:
+        inject_ime_cancel_composition();
+        break;
+    }
+}
+
+void MyApp::record_ime_set_composition(const std::string &text,
+                                       const std::vector<CefCompositionUnderline> &underlines,
+                                       const CefRange &replacement_range,
+                                       const CefRange &selection_range)
+{
+    RecordedInput input;
+    input.kind = RecordedInput::Kind::ImeSetComposition;
+    input.text = text;
+    for (const CefCompositionUnderline &underline : underlines)
+    {
+        input.underlines.push_back(ImeUnderline{underline.range.from, underline.range.to, underline.color,
+                                                underline.background_color, underline.thick,
+                                                static_cast<int>(underline.style)});
+    }
+    input.replacement_from = replacement_range.from;
+    input.replacement_to = replacement_range.to;
+    input.selection_from = selection_range.from;
+    input.selection_to = selection_range.to;
+    record_input(std::move(input));
+}
+
+PixelRect MyApp::popup_rect_in_pixels() const
+{
+    // Scale by the frame's scale (CEF uses logical pixels, we render in physical pixels)
+    return PixelRect{static_cast<int>(std::lround(m_popup_pos.x * m_frame_scale)),
+                     static_cast<int>(std::lround(m_popup_pos.y * m_frame_scale)),
+                     static_cast<int>(std::lround(m_popup_pos.width * m_frame_scale)),
+                     static_cast<int>(std::lround(m_popup_pos.height * m_frame_scale))};
+}
+
+PixelRect MyApp::popup_layer_rect() const
+{
+    // Like cefclient's GetPopupRectInWebView(): a popup that would hang out
+    // of the view is moved back in, and shrunk only if it can't fit.
+    PixelRect rect = popup_rect_in_pixels();
+    const Layer *view = m_layers.find(m_view_layer);
+    if (!view || view->bounds.empty())
+        return rect;
+    const PixelRect &bounds = view->bounds;
+    rect.width = std::min(rect.width, bounds.width);
+    rect.height = std::min(rect.height, bounds.height);
+    rect.x = std::max(bounds.x, std::min(rect.x, bounds.right() - rect.width));
+    rect.y = std::max(bounds.y, std::min(rect.y, bounds.bottom() - rect.height));
+    return rect;
+}
+
+void MyApp::route_mouse_event(CefMouseEvent &event) const
+{
+    // Mouse coordinates are logical pixels, layers are in physical ones
+    float scale = m_frame_scale;
+    LayerId target = m_layers.hit_test(static_cast<int>(event.x * scale), static_cast<int>(event.y * scale));
+    const Layer *layer = m_layers.find(target);
+    if (!layer || (layer->input_dx == 0 && layer->input_dy == 0))
+        return;
+
+    // CEF hit tests against where it asked the popup to be
+    int view_x = event.x;
+    int view_y = event.y;
+    event.x += static_cast<int>(std::lround(layer->input_dx / scale));
+    event.y += static_cast<int>(std::lround(layer->input_dy / scale));
+    TRACE_EVENT(TRACE_LEVEL_VERBOSE, TRACE_CAT_INPUT, "mouse_over_layer", "layer=%u view=(%d,%d) routed=(%d,%d)",
+                target, view_x, view_y, event.x, event.y);
+}
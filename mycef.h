@@ -8,28 +8,47 @@
 #include "include/wrapper/cef_library_loader.h"
 #include "include/cef_focus_handler.h"
 #include "include/cef_command_line.h" // Required for CefCommandLine
+#ifdef __APPLE__
 #include <IOSurface/IOSurface.h>
+#endif
 #include <iostream>
 #include <vector>
 #include <functional>
 #include <cmath>
 #include "imgui.h"
-#include <Metal/Metal.hpp>
+#include <memory>
+#include "browser_pool.h"
+#include "dirty_region.h"
+#include "frame_capture.h"
+#include "frame_stream.h"
+#include "frame_scheduler.h"
+#include "frame_timing.h"
+#include "input_queue.h"
+#include "input_recorder.h"
+#include "layer_tree.h"
+#include "memory_ledger.h"
+#include "message_pump.h"
+#include "paint_staging.h"
+#include "render_backend.h"
+#include "render_scale.h"
+#include "resize_controller.h"
+#include "scroll_detector.h"
+#include "thumbnail_cache.h"
+#include "tile_hash.h"
+#include "trace.h"
+#include "visibility.h"
 
 //--off-screen-rendering-enabled
 
-namespace MTL
-{
-    class Device;
-    class Texture;
-    class Buffer;
-    class DepthStencilState;
-    class RenderPipelineState;
-    class RenderCommandEncoder;
-};
-
 std::string get_macos_cache_dir(const std::string &app_name);
 
+// Between CEF's input structs and InputEvent; |type| says which of the
+// mouse events it is, the button/wheel fields are left to the caller.
+InputEvent to_input_event(const CefMouseEvent &event, InputEvent::Type type);
+InputEvent to_input_event(const CefKeyEvent &event);
+CefMouseEvent to_cef_mouse_event(const InputEvent &input);
+CefKeyEvent to_cef_key_event(const InputEvent &input);
+
 using RenderingCallback = std::function<void(CefRenderHandler::PaintElementType type,
                                              const CefRenderHandler::RectList &dirtyRects,
                                              const void *buffer,
@@ -38,7 +57,7 @@ using RenderingCallback = std::function<void(CefRenderHandler::PaintElementType
 
 using AcceleratedRenderingCallback = std::function<void(CefRenderHandler::PaintElementType type,
                                                         const CefRenderHandler::RectList &dirtyRects,
-                                                        IOSurfaceRef io_surface)>;
+                                                        void *shared_handle)>;
 
 using PopupShowCallback = std::function<void(bool show)>;
 
@@ -51,17 +70,22 @@ public:
     bool m_accelerated_rendering = false;
     int m_width = 0;
     int m_height = 0;
-    int m_pixel_density = 1;
+    // What GetScreenInfo() reports; fractional while RenderScalePolicy
+    // lowers the quality.
+    float m_device_scale_factor = 1.0f;
     std::string m_selected_text; // Track selected text
+    // Cleared while the tab is in the background; its paints and popup
+    // changes are dropped then, the host surfaces belong to the active tab.
+    bool m_visible = true;
 
-    MyRenderHandler(bool accelerated_rendering, int width, int height, int pixel_density,
+    MyRenderHandler(bool accelerated_rendering, int width, int height, float device_scale_factor,
                     RenderingCallback rendering_callback,
                     AcceleratedRenderingCallback accelerated_rendering_callback,
                     PopupShowCallback popup_show_callback,
                     PopupSizedCallback popup_sized_callback);
 
-    // Method to update dimensions and pixel density
-    void UpdateDimensions(int width, int height, int pixel_density);
+    // Method to update dimensions and device scale
+    void UpdateDimensions(int width, int height, float device_scale_factor);
 
     RenderingCallback m_rendering_callback;
     AcceleratedRenderingCallback m_accelerated_rendering_callback;
@@ -79,13 +103,11 @@ public:
     bool GetScreenInfo(CefRefPtr<CefBrowser> browser, CefScreenInfo &screen_info) override
     {
 
-        float dpi_scale_factor = m_pixel_density;
-
-        screen_info.device_scale_factor = dpi_scale_factor;
+        screen_info.device_scale_factor = m_device_scale_factor;
 
         screen_info.rect = CefRect(0, 0, m_width, m_height);           // Full screen in DIPs
         screen_info.available_rect = CefRect(0, 0, m_width, m_height); // Usable screen in DIPs (e.g., excluding taskbars)
-                                                                       // std::cout << "get screen info: " << m_width << ", " << m_height << ", " << dpi_scale_factor << std::endl;
+                                                                       // std::cout << "get screen info: " << m_width << ", " << m_height << ", " << m_device_scale_factor << std::endl;
         return true;                                                   // Indicate that you provided the information
     }
 
@@ -96,12 +118,16 @@ public:
     {
         // Handle accelerated paint events here if needed
         // For now, we can ignore this if not using accelerated painting
-
-        IOSurfaceRef io_surface = (IOSurfaceRef)info.shared_texture_io_surface;
-
-        if (m_accelerated_rendering && m_accelerated_rendering_callback)
+#ifdef __APPLE__
+        void *shared_handle = info.shared_texture_io_surface;
+#else
+        // Only the Metal backend imports shared textures
+        void *shared_handle = nullptr;
+#endif
+
+        if (m_visible && m_accelerated_rendering && m_accelerated_rendering_callback)
         {
-            m_accelerated_rendering_callback(type, dirtyRects, io_surface);
+            m_accelerated_rendering_callback(type, dirtyRects, shared_handle);
         }
     }
 
@@ -116,26 +142,10 @@ public:
         // 'buffer' contains the pixel data (RGBA, 32-bit per pixel).
         // 'width' and 'height' are the dimensions of the buffer.
         // 'dirtyRects' specifies the regions that have changed and need updating. [2]
-        /*std::cout << "Received OnPaint data: " << width << "x" << height << " pixels. Dirty regions: " << dirtyRects.size() << std::endl;
+        // To look at what was painted, MyApp::start_frame_capture() records
+        // the view's paints and shrome_frame_dump turns them into PNGs.
 
-        int result = stbi_write_jpg("debug.jpg", width, height, 4, buffer, 100);
-
-        if (result == 0)
-        {
-            printf("Error writing image\n");
-            return;
-        }
-        else
-        {
-            printf("Image written successfully\n");
-        }*/
-        // In a real application, you would copy this 'buffer' data to your
-        // rendering target (e.g., an OpenGL texture, a Metal texture, or a bitmap)
-        // and then display it.
-        // For simplicity, we're just printing a message here.
-        // Example: memcpy(my_texture_buffer, buffer, width * height * 4); [1]
-
-        if (!m_accelerated_rendering && m_rendering_callback)
+        if (m_visible && !m_accelerated_rendering && m_rendering_callback)
         {
             m_rendering_callback(type, dirtyRects, buffer, width, height);
         }
@@ -146,6 +156,8 @@ public:
 
     void OnPopupShow(CefRefPtr<CefBrowser> browser, bool show) override
     {
+        if (!m_visible)
+            return;
         m_popup_show_callback(show);
     }
 
@@ -156,6 +168,8 @@ public:
     /*--cef()--*/
     void OnPopupSize(CefRefPtr<CefBrowser> browser, const CefRect &rect) override
     {
+        if (!m_visible)
+            return;
         m_popup_sized_callback(rect);
     }
 
@@ -165,7 +179,7 @@ public:
                                const CefRange& selected_range) override
     {
         m_selected_text = selected_text.ToString();
-        std::cout << "Text selection changed: '" << m_selected_text << "'" << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_BROWSER, "text_selection_changed", "length=%zu", m_selected_text.size());
     }
 
 private:
@@ -179,13 +193,20 @@ class MyClient : public CefClient,
                  public CefContextMenuHandler,
                  public CefKeyboardHandler,
                  public CefFocusHandler,
-                 public CefCommandHandler
+                 public CefCommandHandler,
+                 public CefLoadHandler
 {
 public:
     ImGuiMouseCursor m_imgui_cursor_type = ImGuiMouseCursor_Arrow;
     bool m_closed = false;
     bool m_has_focus = false;
+    bool m_loading = false;
     CefRefPtr<MyRenderHandler> m_render_handler;
+    std::string m_title; // for the tab strip
+    // The window's state as BrowserPool last saw it, for a browser that
+    // comes up in the foreground after the window was hidden or throttled.
+    bool m_window_hidden = false;
+    int m_window_frame_rate = 60;
 
     // Context menu state
     bool m_show_context_menu = false;
@@ -220,6 +241,21 @@ public:
         return this; // Return a reference to yourself
     }
 
+    CefRefPtr<CefLoadHandler> GetLoadHandler() override { return this; }
+
+    void OnLoadingStateChange(CefRefPtr<CefBrowser> browser,
+                              bool isLoading,
+                              bool canGoBack,
+                              bool canGoForward) override
+    {
+        m_loading = isLoading;
+    }
+
+    void OnTitleChange(CefRefPtr<CefBrowser> browser, const CefString &title) override
+    {
+        m_title = title.ToString();
+    }
+
     void OnGotFocus(CefRefPtr<CefBrowser> browser) override
     {
         m_has_focus = true;
@@ -237,22 +273,18 @@ public:
     {
         // This is called BEFORE the browser processes the key event.
         // Return true to block default processing.
-        std::cout << "OnPreKeyEvent: Type=" << event.type
-                  << ", VK=" << event.windows_key_code
-                  << ", NK=" << event.native_key_code
-                  << ", Char=" << event.character
-                  << ", Modifiers=" << event.modifiers
-                  << ", unmodified_char " << event.unmodified_character
-                  << ", is_system_key " << event.is_system_key
-                  << ", focus_on_editable_field " << event.focus_on_editable_field
-                  << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_KEY, "pre_key_event",
+                    "type=%d vk=%d nk=%d char=%u mods=0x%x unmod=%u sys=%d editable=%d",
+                    (int)event.type, event.windows_key_code, event.native_key_code, (unsigned)event.character,
+                    event.modifiers, (unsigned)event.unmodified_character, (int)event.is_system_key,
+                    (int)event.focus_on_editable_field);
 
         // Handle keyboard shortcuts
         if (event.type == KEYEVENT_KEYDOWN || event.type == KEYEVENT_RAWKEYDOWN) {
             bool is_cmd = (event.modifiers & EVENTFLAG_COMMAND_DOWN) != 0;
             
             if (is_cmd) {
-                std::cout << "Cmd key detected with character: '" << (char)event.unmodified_character << "' (code: " << (int)event.unmodified_character << ")" << std::endl;
+                TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_KEY, "cmd_key", "code=%d", (int)event.unmodified_character);
                 switch (event.unmodified_character) {
                     case 'z':
                     case 'Z':
@@ -266,7 +298,7 @@ public:
                         
                     case 'x':
                     case 'X':
-                        std::cout << "Cut shortcut detected" << std::endl;
+                        TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_KEY, "shortcut_cut");
                         // Let CEF handle cut, then add our clipboard workaround
                         *is_keyboard_shortcut = true;
                         cut();
@@ -274,7 +306,7 @@ public:
                         
                     case 'c':
                     case 'C':
-                        std::cout << "Copy shortcut detected" << std::endl;
+                        TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_KEY, "shortcut_copy");
                         // Let CEF handle copy, then add our clipboard workaround
                         *is_keyboard_shortcut = true;
                         copy();
@@ -295,7 +327,7 @@ public:
                     case '=':
                     case '+':
                         // Cmd++ or Cmd+= for zoom in
-                        std::cout << "Zoom in shortcut detected" << std::endl;
+                        TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_KEY, "shortcut_zoom_in");
                         if (m_browser && m_browser->IsValid()) {
                             m_browser->GetHost()->Zoom(CEF_ZOOM_COMMAND_IN);
                         }
@@ -304,7 +336,7 @@ public:
 
                     case '-':
                         // Cmd+- for zoom out
-                        std::cout << "Zoom out shortcut detected" << std::endl;
+                        TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_KEY, "shortcut_zoom_out");
                         if (m_browser && m_browser->IsValid()) {
                             m_browser->GetHost()->Zoom(CEF_ZOOM_COMMAND_OUT);
                         }
@@ -313,7 +345,7 @@ public:
 
                     case '0':
                         // Cmd+0 for reset zoom
-                        std::cout << "Zoom reset shortcut detected" << std::endl;
+                        TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_KEY, "shortcut_zoom_reset");
                         if (m_browser && m_browser->IsValid()) {
                             m_browser->GetHost()->Zoom(CEF_ZOOM_COMMAND_RESET);
                         }
@@ -339,15 +371,11 @@ public:
     {
         // This is called AFTER the browser processes the key event.
         // Return true if you handled it and CEF should not do default processing.
-        std::cout << "OnKeyEvent: Type=" << event.type
-                  << ", VK=" << event.windows_key_code
-                  << ", NK=" << event.native_key_code
-                  << ", Char=" << event.character
-                  << ", Modifiers=" << event.modifiers
-                  << ", unmodified_char " << event.unmodified_character
-                  << ", is_system_key " << event.is_system_key
-                  << ", focus_on_editable_field " << event.focus_on_editable_field
-                  << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_KEY, "key_event",
+                    "type=%d vk=%d nk=%d char=%u mods=0x%x unmod=%u sys=%d editable=%d",
+                    (int)event.type, event.windows_key_code, event.native_key_code, (unsigned)event.character,
+                    event.modifiers, (unsigned)event.unmodified_character, (int)event.is_system_key,
+                    (int)event.focus_on_editable_field);
         // I have to return true here, cef will send an NSEvent when this is false, that event triggers menu shortcuts.
         return true;
     }
@@ -409,7 +437,7 @@ public:
                 redo();
                 return true;
             case 1003: // Cut
-                std::cout << "Context menu cut selected" << std::endl;
+                TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_UI, "context_menu_cut");
                 cut();
                 return true;
             case 1004: // Copy
@@ -466,9 +494,8 @@ public:
 
     void copy() {
         if (m_browser && m_browser->IsValid() && m_browser->GetFocusedFrame()) {
-            std::cout << "Executing copy operation..." << std::endl;
+            TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_BROWSER, "copy");
             m_browser->GetFocusedFrame()->Copy();
-            std::cout << "Copy operation completed" << std::endl;
         }
     }
 
@@ -476,9 +503,8 @@ public:
 
     void cut() {
         if (m_browser && m_browser->IsValid() && m_browser->GetFocusedFrame()) {
-            std::cout << "Executing cut operation..." << std::endl;
+            TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_BROWSER, "cut");
             m_browser->GetFocusedFrame()->Cut();
-            std::cout << "Cut operation completed" << std::endl;
         }
     }
 
@@ -699,51 +725,136 @@ private:
     IMPLEMENT_REFCOUNTING(MyClient);
 };
 
+// A LayerQuad for the UI to draw: what RenderBackend::present() returned for
+// its surface, placed in logical pixels from the view's top-left, and the
+// texture coordinates of the part of the surface it shows.
+struct DisplayQuad
+{
+    void *texture = nullptr;
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    float height = 0.0f;
+    float u0 = 0.0f;
+    float v0 = 0.0f;
+    float u1 = 1.0f;
+    float v1 = 1.0f;
+    float opacity = 1.0f;
+};
+
+// What CEF painted, for benchmarks. Accelerated paints count their dirty
+// rects too, even though the whole view layer is damaged.
+struct PaintStats
+{
+    uint64_t paints = 0;
+    uint64_t popup_paints = 0;
+    uint64_t dirty_rects = 0;
+    uint64_t painted_pixels = 0; // summed dirty rect areas, overlaps counted twice
+};
+
 // Implement CefApp and CefBrowserProcessHandler
 class MyApp final : public CefApp,
                     public CefBrowserProcessHandler
 {
 public:
-    MTL::Device *m_metal_device = nullptr;
-    MTL::Texture *m_texture = nullptr;
+    std::unique_ptr<RenderBackend> m_backend;
     bool m_should_show_popup = false;
     CefRect m_popup_pos;
-    MTL::Buffer *m_popup_offset_buffer = nullptr;
-    MTL::Buffer *m_triangle_vertex_buffer = nullptr;
-    MTL::Texture *m_popup_texture = nullptr;
-
-    uint32_t m_texture_width = 0;
-    uint32_t m_texture_height = 0;
-    uint32_t m_popup_texture_width = 0;
-    uint32_t m_popup_texture_height = 0;
 
-    // Framebuffer for compositing main texture + popup
-    MTL::Texture *m_composite_texture = nullptr;
-    uint32_t m_composite_width = 0;
-    uint32_t m_composite_height = 0;
-    MTL::CommandQueue *m_command_queue = nullptr;
+    // Browser view and popup widget
+    SurfaceId m_view_surface = kInvalidSurface;
+    SurfaceId m_popup_surface = kInvalidSurface;
+    // IOSurfaces the view/popup surfaces wrap when CEF paints accelerated
+    void *m_view_shared_handle = nullptr;
+    void *m_popup_shared_handle = nullptr;
+    PaintStats m_paint_stats;
+
+    // What each frame is drawn from, in view pixels: the view at the bottom,
+    // the popup above it. Overlays get layers of their own.
+    LayerTree m_layers;
+    LayerId m_view_layer = kInvalidLayer;
+    LayerId m_popup_layer = kInvalidLayer;
+    std::vector<LayerQuad> m_layer_quads; // of the current frame
+
+    // Decides which display ticks send CEF a BeginFrame
+    SteadyFrameClock m_frame_clock;
+    FrameScheduler m_frame_scheduler{m_frame_clock};
+    // Where each display frame's time goes, from paint to present
+    FrameTimingRecorder m_frame_timing{m_frame_clock};
+    // Rate-limits browser resizes during a live resize
+    ResizeController m_resize{m_frame_clock};
+    // Lowers the device scale while the page moves, see set_adaptive_quality()
+    RenderScalePolicy m_render_scale{m_frame_clock};
+    // Device pixels per logical one of the frame in the view surface; lags
+    // behind the policy until the browser paints at the new scale.
+    float m_frame_scale = 1.0f;
+    int m_frame_scale_width = 0;
+    int m_frame_scale_height = 0;
+    uint64_t m_render_scale_paints = 0;
+    uint64_t m_render_scale_scrolls = 0;
+
+    // Runs CefDoMessageLoopWork() when CEF asks for it. The timer is declared
+    // after m_pump so it goes away before the scheduler it calls into.
+    MessagePumpScheduler m_pump{m_frame_clock, []()
+                                { CefDoMessageLoopWork(); }};
+    std::unique_ptr<PumpTimer> m_pump_timer;
+
+    InputQueue m_input_queue;
+    // Everything passing inject_*, for reproducing perf bugs; and the other
+    // way round.
+    InputRecorder m_input_recorder{m_frame_clock};
+    InputReplayer m_input_replayer{m_frame_clock};
+    // Dumps the view's software paints to disk off the paint thread
+    FrameCapture m_frame_capture;
+    // Sends them to local viewers and takes their input back
+    FrameStreamServer m_frame_stream;
+    std::vector<RecordedInput> m_stream_input;
+    // Small previews of the tabs, kept current from the view's paints
+    ThumbnailCache m_thumbnails;
+    // Their copies on the GPU, for the UI
+    struct ThumbnailSurface
+    {
+        int tab_id = 0;
+        SurfaceId surface = kInvalidSurface;
+        Thumbnail thumbnail;
+    };
+    std::vector<ThumbnailSurface> m_thumbnail_surfaces;
+    // An accelerated paint not read back for its thumbnail yet
+    bool m_thumbnail_tap_pending = false;
+
+    // What the surfaces and buffers above take, see set_memory_budget()
+    MemoryLedger m_memory;
+    int64_t m_popup_hidden_us = -1; // when the popup was last hidden
+    // Whether the view can be seen, and at what rate the browser runs
+    VisibilityPolicy m_visibility{m_frame_clock};
 
     uint32_t m_window_width = 1280;
     uint32_t m_window_height = 720;
     uint32_t m_pixel_density = 1;
+    // What the first tab loads
+    std::string m_start_url = "https://www.geeksforgeeks.org/javascript/how-to-create-a-dropdown-list-with-array-values-using-javascript/";
+    // All open tabs; m_client is the active one, the only one that gets
+    // input and whose paints reach the surfaces above.
+    BrowserPool m_tabs;
     CefRefPtr<MyClient> m_client;
 
-    MTL::DepthStencilState *m_depth_stencil_state_disabled = nullptr;
-    // MTL::Buffer *m_triangle_vertex_buffer = nullptr;
-    MTL::Buffer *m_popup_triangle_vertex_buffer = nullptr;
-    MTL::Buffer *m_popup_projection_buffer = nullptr;
-
-    MTL::RenderPipelineState *m_render_pipeline = nullptr;
-    MTL::RenderPipelineState *m_popup_render_pipeline = nullptr;
+    // CPU copies of the latest software paints, filled by OnPaint and
+    // uploaded from the render loop.
+    PaintStagingRing m_view_staging;
+    PaintStagingRing m_popup_staging;
+    // Hashes of what the view surface holds, to skip unchanged tiles
+    TileHashCache m_view_tiles;
+    // Moves the view surface on scrolls instead of re-uploading it
+    ScrollDetector m_view_scroll;
 
     RenderingCallback m_on_texture_ready;
     AcceleratedRenderingCallback m_on_accelerated_texture_ready;
     PopupShowCallback m_popup_show_callback;
     PopupSizedCallback m_popup_sized_callback;
 
-    MyApp(MTL::Device *metal_device, uint32_t window_width, uint32_t window_height, uint32_t pixel_density);
+    MyApp(std::unique_ptr<RenderBackend> backend, uint32_t window_width, uint32_t window_height, uint32_t pixel_density);
 
-    void init(MTL::Device *metal_device, uint64_t pixel_format, uint32_t window_width, uint32_t window_height);
+    void init(uint32_t window_width, uint32_t window_height);
 
     ~MyApp();
 
@@ -757,39 +868,21 @@ public:
     void OnContextInitialized() override
     {
         // std::cout << "CefApp::OnContextInitialized called" << std::endl;
-        CefBrowserSettings browser_settings;
-        browser_settings.windowless_frame_rate = 60;
-        // Transparent painting is enabled by default in OSR, but can be disabled
-        // by setting background_color to an opaque value. [3]
-        // browser_settings.background_color = 0xFFFFFFFF; // Opaque white background
-
-        CefWindowInfo window_info;
-        // Crucial for OSR: Use SetAsWindowless instead of SetAsOffScreen.
-        // The 'parent' handle can be nullptr if not strictly necessary for dialog parenting or monitor info. [3, 4]
-        window_info.SetAsWindowless(nullptr); // [5, 1]
-        window_info.external_begin_frame_enabled = true;
-        window_info.shared_texture_enabled = true; // Enable shared textures for Metal
-        window_info.runtime_style = CEF_RUNTIME_STYLE_CHROME;
-        CefRefPtr<MyRenderHandler> render_handler = new MyRenderHandler( window_info.shared_texture_enabled,
-            m_window_width, 
-            m_window_height, 
-            m_pixel_density, 
-            m_on_texture_ready, 
-            m_on_accelerated_texture_ready,
-            m_popup_show_callback, m_popup_sized_callback);
-        m_client = new MyClient(render_handler);
-
-        // Create the offscreen browser
-        // You might want to load a specific URL here instead of "about:blank"
-        CefBrowserHost::CreateBrowser(window_info, m_client, "https://www.geeksforgeeks.org/javascript/how-to-create-a-dropdown-list-with-array-values-using-javascript/", browser_settings, nullptr, nullptr); // [1]
+        new_tab(m_start_url);
     }
 
+    // Tabs. The browser is created windowless, with shared textures if the
+    // backend can import them, see BrowserPool::add_tab().
+    int new_tab(const std::string &url);
+    void activate_tab(int tab_id);
+    void close_tab(int tab_id);
+    std::vector<BrowserTabInfo> tabs() const { return m_tabs.tabs(); }
+    // Points m_client at the new active tab and drops the old tab's pixels
+    void on_tab_activated();
+
     void close(bool force_close)
     {
-        if (m_client)
-        {
-            m_client->close_browser(force_close);
-        }
+        m_tabs.close_all(force_close);
     }
 
     bool has_focus()
@@ -803,11 +896,7 @@ public:
 
     bool is_browser_closed()
     {
-        if (m_client)
-        {
-            return m_client->m_closed;
-        }
-        return true;
+        return m_tabs.all_closed();
     }
 
     CefRefPtr<CefBrowser> get_browser()
@@ -819,23 +908,110 @@ public:
         return nullptr;
     }
 
-    void update_render_handler_dimensions(int width, int height, int pixel_density)
+    void update_render_handler_dimensions(int width, int height, float device_scale_factor)
     {
-        if (m_client && m_client->m_render_handler)
-        {
-            m_client->m_render_handler->UpdateDimensions(width, height, pixel_density);
-        }
+        m_tabs.update_dimensions(width, height, device_scale_factor);
+        m_frame_scheduler.invalidate(FrameInvalidation::Resize);
     }
 
+    // Called once per display refresh. Only sends a BeginFrame when something
+    // may have changed or the page is animating, see FrameScheduler.
     void request_new_frame()
     {
-        if (m_client)
+        m_frame_scheduler.on_vsync();
+        begin_frame_if_needed();
+    }
+
+    void begin_frame_if_needed()
+    {
+        if (m_client && m_frame_scheduler.should_begin_frame())
         {
             // std::cout << "request new frame" << std::endl;
             m_client->request_new_frame();
+            m_frame_scheduler.on_begin_frame_sent();
         }
     }
 
+    // Input can be answered within the current display period when there is
+    // still time before the next vsync.
+    void on_input_injected()
+    {
+        m_frame_scheduler.invalidate(FrameInvalidation::Input);
+        begin_frame_if_needed();
+    }
+
+    const FrameSchedulerStats &frame_scheduler_stats() const { return m_frame_scheduler.stats(); }
+
+    // Paint and upload are marked here; the view marks the rest of the frame.
+    void mark_frame_point(FramePoint point) { m_frame_timing.mark(point); }
+    const FrameTimingRecorder &frame_timing() const { return m_frame_timing; }
+    void reset_frame_timing() { m_frame_timing.reset(); }
+
+    // Mouse and key input from the view goes through m_input_queue and is
+    // handed to the browser once per frame by drain_input().
+    void queue_mouse_motion(const CefMouseEvent &event);
+    void queue_mouse_up_down(const CefMouseEvent &event, CefBrowserHost::MouseButtonType type, bool mouseUp, int clickCount);
+    void queue_mouse_wheel(const CefMouseEvent &event, double deltaX, double deltaY);
+    void queue_key_event(const CefKeyEvent &event);
+    void drain_input();
+    const InputQueueStats &input_queue_stats() const { return m_input_queue.stats(); }
+
+    // Once per display frame instead of drain_input(): marks the frame in a
+    // recording and delivers the replayed input that is due, or the input
+    // of frame stream clients. The view's own input is dropped while a
+    // replay runs.
+    void deliver_frame_input();
+
+    void start_input_recording() { m_input_recorder.start(); }
+    bool stop_input_recording(const std::string &path);
+    bool input_recording() const { return m_input_recorder.recording(); }
+    bool start_input_replay(const std::string &path, ReplayPace pace);
+    void stop_input_replay() { m_input_replayer.stop(); }
+    bool input_replaying() const { return m_input_replayer.replaying(); }
+    void record_input(RecordedInput input) { m_input_recorder.record(std::move(input)); }
+    void replay_input(const RecordedInput &input);
+
+    bool start_frame_capture(const std::string &path) { return m_frame_capture.start(path); }
+    void stop_frame_capture() { m_frame_capture.stop(); }
+    bool frame_capturing() const { return m_frame_capture.active(); }
+    FrameCaptureStats frame_capture_stats() const { return m_frame_capture.stats(); }
+
+    // |address| as in frame_stream.h: "unix:PATH" or "tcp:PORT"
+    bool start_frame_stream(const std::string &address) { return m_frame_stream.start(address); }
+    void stop_frame_stream() { m_frame_stream.stop(); }
+    bool frame_streaming() const { return m_frame_stream.active(); }
+    FrameStreamStats frame_stream_stats() const { return m_frame_stream.stats(); }
+
+    // Tab previews for the tab strip and the overview. Off by default.
+    void set_thumbnails_enabled(bool enabled);
+    bool thumbnails_enabled() const { return m_thumbnails.active(); }
+    ThumbnailCacheStats thumbnail_stats() const { return m_thumbnails.stats(); }
+    // The tab's latest thumbnail, uploaded if it changed. |quad| gets the
+    // texture and coordinates and its size in thumbnail pixels; the caller
+    // places it. False while the tab has none.
+    bool thumbnail_quad(int tab_id, DisplayQuad &quad);
+
+    // Memory held for surfaces and staging, by category, as of the last
+    // display frame. Above the budget (0 = none, the default) whatever
+    // isn't needed on screen is released: a hidden popup's surface and
+    // staging, idle pooled surfaces, backend scratch. A hidden popup gives
+    // its memory back after a while in any case.
+    const MemoryLedger &memory_ledger() const { return m_memory; }
+    void set_memory_budget(size_t budget_bytes) { m_memory.set_budget(budget_bytes); }
+    void reset_memory_stats() { m_memory.reset_stats(); }
+    // The system is short of memory; from the app's memory pressure source.
+    void on_memory_pressure(MemoryPressure level);
+
+    // What the window and the UI say about the view, see VisibilityPolicy.
+    // While none of it can be seen the browser is hidden and nothing is
+    // uploaded or composited; unfocused, it runs at a lower rate.
+    void set_window_occluded(bool occluded) { m_visibility.set_window_occluded(occluded); }
+    void set_window_miniaturized(bool miniaturized) { m_visibility.set_miniaturized(miniaturized); }
+    void set_window_key(bool key) { m_visibility.set_key_window(key); }
+    void set_view_panel_visible(bool visible) { m_visibility.set_panel_visible(visible); }
+    const VisibilityPolicy &visibility() const { return m_visibility; }
+    void reset_visibility_stats() { m_visibility.reset_stats(); }
+
     void copy() {
         if (m_client) {
             m_client->copy();
@@ -843,7 +1019,6 @@ public:
     }
 
     void cut() {
-        std::cout << "Cut called from MyApp" << std::endl;
         if (m_client) {
             m_client->cut();
         }
@@ -929,15 +1104,14 @@ public:
 
         bool menu_clicked = false;
         
-        std::cout << "render_context_menu called with " << m_client->m_context_menu_items.size() << " items" << std::endl;
-        std::cout << "Context menu position: " << m_client->m_context_menu_x << ", " << m_client->m_context_menu_y << std::endl;
+        TRACE_EVENT(TRACE_LEVEL_VERBOSE, TRACE_CAT_UI, "render_context_menu", "items=%zu x=%.0f y=%.0f",
+                    m_client->m_context_menu_items.size(), m_client->m_context_menu_x, m_client->m_context_menu_y);
         
         // Note: CEF coordinates are relative to the browser content area
         // We should position the popup relative to the mouse cursor instead
         // ImGui::SetNextWindowPos will be handled by the popup system automatically
         
         if (ImGui::BeginPopup("ContextMenu")) {
-            std::cout << "BeginPopup succeeded, rendering items" << std::endl;
             for (const auto& item : m_client->m_context_menu_items) {
                 if (item.first == -1) {
                     // Separator
@@ -951,7 +1125,7 @@ public:
                             case 1001: undo(); break;
                             case 1002: redo(); break;
                             case 1003: 
-                            std::cout << "Context menu cut selected" << std::endl;
+                            TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_UI, "context_menu_cut");
                             cut(); 
                             break;
                             case 1004: copy(); break;
@@ -976,17 +1150,17 @@ public:
     {
         if (m_client)
         {
-            CefMouseEvent adjusted_motion = motion;
-
-            // Check if mouse is over popup and apply offset
-            if (is_over_popup(adjusted_motion.x, adjusted_motion.y))
+            if (m_input_recorder.recording())
             {
-                std::cout << "Mouse over popup at (" << adjusted_motion.x << ", " << adjusted_motion.y << ")";
-                apply_popup_offset(adjusted_motion.x, adjusted_motion.y);
-                std::cout << " -> adjusted to (" << adjusted_motion.x << ", " << adjusted_motion.y << ")" << std::endl;
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::Mouse;
+                input.event = to_input_event(motion, InputEvent::Type::MouseMove);
+                record_input(std::move(input));
             }
-
+            CefMouseEvent adjusted_motion = motion;
+            route_mouse_event(adjusted_motion);
             m_client->inject_mouse_motion(adjusted_motion);
+            on_input_injected();
         }
     }
 
@@ -1006,8 +1180,21 @@ public:
     {
         if (m_client)
         {
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::Mouse;
+                input.event = to_input_event(event, InputEvent::Type::MouseButton);
+                input.event.button = type;
+                input.event.mouse_up = mouseUp;
+                input.event.click_count = clickCount;
+                record_input(std::move(input));
+            }
             // std::cout << "injected mouse up down 1" << mouseUp << std::endl;
-            m_client->inject_mouse_up_down(event, type, mouseUp, clickCount);
+            CefMouseEvent adjusted_event = event;
+            route_mouse_event(adjusted_event);
+            m_client->inject_mouse_up_down(adjusted_event, type, mouseUp, clickCount);
+            on_input_injected();
         }
     }
 
@@ -1017,7 +1204,19 @@ public:
     {
         if (m_client)
         {
-            m_client->inject_mouse_wheel(event, deltaX, deltaY);
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::Mouse;
+                input.event = to_input_event(event, InputEvent::Type::MouseWheel);
+                input.event.wheel_dx = deltaX;
+                input.event.wheel_dy = deltaY;
+                record_input(std::move(input));
+            }
+            CefMouseEvent adjusted_event = event;
+            route_mouse_event(adjusted_event);
+            m_client->inject_mouse_wheel(adjusted_event, deltaX, deltaY);
+            on_input_injected();
         }
     }
 
@@ -1025,15 +1224,36 @@ public:
     {
         if (m_client)
         {
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::Key;
+                input.event = to_input_event(event);
+                record_input(std::move(input));
+            }
             m_client->inject_key_event(event);
+            on_input_injected();
         }
     }
 
     void inject_ime_commit_text(const std::string &text, const CefRange &range, int relative_cursor_pos)
     {
+        // IME calls go straight to the browser; queued keys come first.
+        drain_input();
         if (m_client && m_client->get_browser() && m_client->get_browser()->IsValid())
         {
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::ImeCommitText;
+                input.text = text;
+                input.replacement_from = range.from;
+                input.replacement_to = range.to;
+                input.relative_cursor_pos = relative_cursor_pos;
+                record_input(std::move(input));
+            }
             m_client->get_browser()->GetHost()->ImeCommitText(text, range, relative_cursor_pos);
+            on_input_injected();
         }
     }
 
@@ -1042,45 +1262,130 @@ public:
                                     const CefRange &replacement_range,
                                     const CefRange &selection_range)
     {
+        // IME calls go straight to the browser; queued keys come first.
+        drain_input();
         if (m_client && m_client->get_browser() && m_client->get_browser()->IsValid())
         {
+            if (m_input_recorder.recording())
+            {
+                record_ime_set_composition(text, underlines, replacement_range, selection_range);
+            }
             m_client->get_browser()->GetHost()->ImeSetComposition(text, underlines, replacement_range, selection_range);
+            on_input_injected();
         }
     }
 
     void inject_ime_finish_composing_text(bool keep_selection)
     {
+        // IME calls go straight to the browser; queued keys come first.
+        drain_input();
         if (m_client && m_client->get_browser() && m_client->get_browser()->IsValid())
         {
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::ImeFinishComposingText;
+                input.keep_selection = keep_selection;
+                record_input(std::move(input));
+            }
             m_client->get_browser()->GetHost()->ImeFinishComposingText(keep_selection);
+            on_input_injected();
         }
     }
 
     void inject_ime_cancel_composition()
     {
+        // IME calls go straight to the browser; queued keys come first.
+        drain_input();
         if (m_client && m_client->get_browser() && m_client->get_browser()->IsValid())
         {
+            if (m_input_recorder.recording())
+            {
+                RecordedInput input;
+                input.kind = RecordedInput::Kind::ImeCancelComposition;
+                record_input(std::move(input));
+            }
             m_client->get_browser()->GetHost()->ImeCancelComposition();
+            on_input_injected();
         }
     }
 
+    void record_ime_set_composition(const std::string &text,
+                                    const std::vector<CefCompositionUnderline> &underlines,
+                                    const CefRange &replacement_range,
+                                    const CefRange &selection_range);
+
     void OnBeforeCommandLineProcessing(const CefString &process_type,
                                        CefRefPtr<CefCommandLine> command_line) override;
 
-    void encode_render_command(MTL::RenderCommandEncoder *render_command_encoder);
-    void create_composite_framebuffer();
-    void composite_textures_to_framebuffer();
+    RenderBackend *backend() { return m_backend.get(); }
+    const LayerTreeStats &layer_stats() const { return m_layers.stats(); }
+    void reset_layer_stats() { m_layers.reset_stats(); }
+    const TileUploadStats &tile_upload_stats() const { return m_view_tiles.stats(); }
+    void reset_tile_upload_stats() { m_view_tiles.reset_stats(); }
+    const ScrollDetectorStats &scroll_stats() const { return m_view_scroll.stats(); }
+    void reset_scroll_stats() { m_view_scroll.reset_stats(); }
+    const PaintStats &paint_stats() const { return m_paint_stats; }
+    void reset_paint_stats() { m_paint_stats = PaintStats(); }
+    void count_paint(CefRenderHandler::PaintElementType type, const CefRenderHandler::RectList &dirtyRects);
+    // Hands the IOSurface the view shows to the thumbnails if they want a
+    // refresh. False if they didn't take it.
+    bool tap_view_surface_for_thumbnail();
+    // Frees the GPU copy of the tab's thumbnail, or of all with 0.
+    void release_thumbnail_surfaces(int tab_id);
+    // Refreshes the ledger and releases what the budget asks for; once per
+    // display frame, before the layers pick up the surfaces.
+    void update_memory();
+    void measure_memory();
+    // Feeds the visibility policy once per display frame and applies it.
+    void update_visibility();
+    // Frees what isn't needed on screen. Returns the bytes released.
+    size_t release_reclaimable_memory();
+    void release_hidden_popup();
+
+    // Navigates the active tab; is_loading() until the page has loaded.
+    void load_url(const std::string &url);
+    bool is_loading() const { return m_client && m_client->m_loading; }
+
+    bool ensure_surface(SurfaceId &surface, uint32_t width, uint32_t height, bool render_target);
+    void upload_staged_frames();
+    // Brings the layers up to date with the surfaces and the popup.
+    void update_layers();
     void prepare_for_render();
+    // What the UI should draw this frame, back to front, and how big the
+    // frame is. Only differs from the view size while a resize is pending.
+    bool display_layers(FramePlacement &placement, std::vector<DisplayQuad> &quads);
+
+    // Called every display frame with the size available to the browser.
+    void update_view_size(int width, int height, int pixel_density);
+    const ResizeStats &resize_stats() const { return m_resize.stats(); }
+
+    // Adaptive quality: a lower, possibly fractional, device scale while
+    // the page scrolls or animates, the native one at rest. Off by default.
+    void set_adaptive_quality(bool enabled);
+    bool adaptive_quality() const { return m_render_scale.enabled(); }
+    float device_scale_factor() const { return m_render_scale.device_scale(); }
+    float frame_scale() const { return m_frame_scale; }
+    const RenderScaleStats &render_scale_stats() const { return m_render_scale.stats(); }
+    void reset_render_scale_stats() { m_render_scale.reset_stats(); }
+    // Feeds the policy once per display frame and applies its decisions.
+    void update_render_scale();
+    // Tells the active browser about a new size or scale.
+    void resize_browser(bool screen_info_changed);
 
     // This is the magic hook provided by CEF, with the correct name.
     void OnScheduleMessagePumpWork(int64_t delay_ms) override;
+    void on_pump_timer();
+    MessagePumpStats message_pump_stats() const { return m_pump.stats(); }
 
-    void update_geometry(int holeX, int holeY, int holeWidth, int holeHeight, int viewportWidth, int viewportHeight);
-    void update_popup_projection_matrix();
+    // Where CEF wants the popup, and where it is drawn: moved to fit
+    // into the view if it doesn't.
+    PixelRect popup_rect_in_pixels() const;
+    PixelRect popup_layer_rect() const;
 
-    // Helper methods for popup mouse event handling
-    bool is_over_popup(int x, int y) const;
-    void apply_popup_offset(int& x, int& y) const;
+    // Mouse events go to the browser in view coordinates; over a layer that
+    // was moved (a popup that didn't fit) they are moved back.
+    void route_mouse_event(CefMouseEvent &event) const;
 
 private:
     IMPLEMENT_REFCOUNTING(MyApp);
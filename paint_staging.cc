@@ -0,0 +1,157 @@
+#include "paint_staging.h"
+
+#include <cstring>
+#include <utility>
+
+PaintStagingRing::PaintStagingRing() = default;
+
+void PaintStagingRing::publish(const DirtyRegion &dirty, const void *buffer, int width, int height)
+{
+    if (!buffer || width <= 0 || height <= 0)
+        return;
+
+    PixelRect full{0, 0, width, height};
+    DirtyRegion clipped = dirty;
+    clipped.clip(full);
+
+    int write_index;
+    bool force_full;
+    DirtyRegion to_copy;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        write_index = m_write_index;
+        to_copy = std::move(m_slots[write_index].stale);
+        m_slots[write_index].stale.clear();
+        force_full = m_force_full;
+        m_force_full = false;
+        m_writing = true;
+    }
+
+    // The write slot belongs to the producer, so the copy happens unlocked.
+    StagedFrame &frame = m_slots[write_index].frame;
+    bool resized = force_full || frame.width != width || frame.height != height;
+    if (resized)
+    {
+        frame.width = width;
+        frame.height = height;
+        frame.pixels.resize(frame.stride() * height);
+        to_copy.clear();
+        to_copy.add(full);
+    }
+    else
+    {
+        to_copy.add(clipped);
+        to_copy.clip(full);
+    }
+
+    const uint8_t *src = static_cast<const uint8_t *>(buffer);
+    size_t stride = frame.stride();
+    uint64_t bytes_copied = 0;
+    for (const auto &rect : to_copy.rects())
+    {
+        size_t offset = rect.y * stride + static_cast<size_t>(rect.x) * 4;
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        if (rect.x == 0 && rect.width == width)
+        {
+            memcpy(frame.pixels.data() + offset, src + offset, row_bytes * rect.height);
+        }
+        else
+        {
+            for (int row = 0; row < rect.height; ++row)
+            {
+                memcpy(frame.pixels.data() + offset + row * stride, src + offset + row * stride, row_bytes);
+            }
+        }
+        bytes_copied += row_bytes * rect.height;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writing = false;
+    m_slot_bytes[write_index] = frame.pixels.capacity();
+    frame.sequence = ++m_sequence;
+
+    // A reset() or release() while copying dropped what the consumer had;
+    // this slot is complete, so it goes out as the full frame it asked for.
+    if (m_force_full && !resized)
+    {
+        m_force_full = false;
+        to_copy.clear();
+        to_copy.add(full);
+        resized = true;
+    }
+
+    const DirtyRegion &published_damage = resized ? to_copy : clipped;
+    for (int i = 0; i < kSlotCount; ++i)
+    {
+        if (i != write_index)
+        {
+            m_slots[i].stale.add(published_damage);
+        }
+    }
+    m_pending_damage.add(published_damage);
+
+    if (m_ready_fresh)
+    {
+        m_stats.merged++;
+    }
+    std::swap(m_write_index, m_ready_index);
+    m_ready_fresh = true;
+    m_stats.published++;
+    m_stats.bytes_copied += bytes_copied;
+}
+
+const StagedFrame *PaintStagingRing::acquire(DirtyRegion &damage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_ready_fresh)
+        return nullptr;
+
+    std::swap(m_read_index, m_ready_index);
+    m_ready_fresh = false;
+    damage = std::move(m_pending_damage);
+    m_pending_damage.clear();
+    m_stats.acquired++;
+    return &m_slots[m_read_index].frame;
+}
+
+void PaintStagingRing::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ready_fresh = false;
+    m_pending_damage.clear();
+    m_force_full = true;
+}
+
+void PaintStagingRing::release()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ready_fresh = false;
+    m_pending_damage.clear();
+    m_force_full = true;
+    for (int i = 0; i < kSlotCount; ++i)
+    {
+        if (i == m_write_index && m_writing)
+            continue;
+        // Written in full next time, as a resize would be
+        m_slots[i].frame = StagedFrame();
+        m_slots[i].stale.clear();
+        m_slot_bytes[i] = 0;
+    }
+}
+
+size_t PaintStagingRing::memory_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for (size_t slot_bytes : m_slot_bytes)
+    {
+        bytes += slot_bytes;
+    }
+    return bytes;
+}
+
+PaintStagingStats PaintStagingRing::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,90 @@
+#ifndef PAINT_STAGING_H
+#define PAINT_STAGING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "dirty_region.h"
+
+// One complete CPU copy of a paint element (BGRA, tightly packed rows).
+struct StagedFrame
+{
+    std::vector<uint8_t> pixels;
+    int width = 0;
+    int height = 0;
+    uint64_t sequence = 0;
+
+    size_t stride() const { return static_cast<size_t>(width) * 4; }
+};
+
+struct PaintStagingStats
+{
+    uint64_t published = 0;      // frames handed over by OnPaint
+    uint64_t acquired = 0;       // frames picked up by the render loop
+    uint64_t merged = 0;         // frames superseded before the render loop saw them
+    uint64_t bytes_copied = 0;   // bytes copied out of CEF's buffers
+};
+
+// Triple-buffered staging between CEF's OnPaint (producer) and the render
+// loop (consumer), which may run on different threads.
+//
+// The producer owns one slot and only copies the rows that changed into it:
+// the new dirty rects plus whatever was published since that slot was last
+// written. Publishing swaps the slot with the "ready" one; the consumer swaps
+// "ready" with the slot it reads from. The consumer therefore always sees the
+// newest complete frame and never a half written one, and paints that arrive
+// faster than the consumer polls are merged: their damage is accumulated and
+// uploaded once.
+class PaintStagingRing
+{
+public:
+    static constexpr int kSlotCount = 3;
+
+    PaintStagingRing();
+
+    // Producer side. |buffer| is the complete frame CEF passed to OnPaint,
+    // |width| * 4 bytes per row.
+    void publish(const DirtyRegion &dirty, const void *buffer, int width, int height);
+
+    // Consumer side. Returns the newest published frame, or nullptr if
+    // nothing was published since the previous call. |damage| receives the
+    // union of everything that changed since the previously acquired frame.
+    // The returned frame stays valid until the next call to acquire().
+    const StagedFrame *acquire(DirtyRegion &damage);
+
+    // Drops pending damage and frames, e.g. when the popup is hidden. The next
+    // published frame is copied and reported as damaged in full.
+    void reset();
+    // reset(), and frees the frames as well; the next publish allocates
+    // again. A slot the producer is writing right now is kept. Invalidates
+    // what acquire() returned.
+    void release();
+
+    // Bytes held by the slots' frames.
+    size_t memory_bytes() const;
+
+    PaintStagingStats stats() const;
+
+private:
+    struct Slot
+    {
+        StagedFrame frame;
+        DirtyRegion stale; // published since this slot was last written
+    };
+
+    mutable std::mutex m_mutex;
+    Slot m_slots[kSlotCount];
+    int m_write_index = 0;
+    int m_ready_index = 1;
+    int m_read_index = 2;
+    bool m_ready_fresh = false;
+    bool m_force_full = false;
+    bool m_writing = false; // the producer is copying into its slot
+    size_t m_slot_bytes[kSlotCount] = {};
+    uint64_t m_sequence = 0;
+    DirtyRegion m_pending_damage;
+    PaintStagingStats m_stats;
+};
+
+#endif // PAINT_STAGING_H
@@ -0,0 +1,209 @@
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include "paint_staging.h"
+#include "unit_test.h"
+
+// Built into shrome_tsan_tests as well, with -fsanitize=thread: the
+// threaded cases are the point there.
+
+namespace
+{
+
+const int kWidth = 96;
+const int kHeight = 64;
+
+// What CEF's buffer would be: every paint fills its rect with a new value.
+struct FakeView
+{
+    std::vector<uint8_t> pixels = std::vector<uint8_t>(static_cast<size_t>(kWidth) * kHeight * 4);
+    uint8_t value = 0;
+
+    DirtyRegion paint(const PixelRect &rect)
+    {
+        value++;
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            memset(pixels.data() + (static_cast<size_t>(y) * kWidth + rect.x) * 4, value,
+                   static_cast<size_t>(rect.width) * 4);
+        }
+        DirtyRegion dirty;
+        dirty.add(rect);
+        return dirty;
+    }
+};
+
+// The render loop's texture: only the damage of each acquired frame is
+// copied into it, so it matches the frame only if no damage was lost.
+struct Mirror
+{
+    std::vector<uint8_t> pixels;
+    int width = 0;
+    int height = 0;
+
+    // False if the damage doesn't bring the mirror up to date.
+    bool apply(const StagedFrame &frame, const DirtyRegion &damage)
+    {
+        if (frame.width != width || frame.height != height)
+        {
+            // A new texture; only a full damage can fill it
+            width = frame.width;
+            height = frame.height;
+            pixels.assign(frame.pixels.size(), 0xee);
+        }
+        for (const PixelRect &rect : damage.rects())
+        {
+            for (int y = rect.y; y < rect.bottom(); ++y)
+            {
+                size_t offset = static_cast<size_t>(y) * frame.stride() + static_cast<size_t>(rect.x) * 4;
+                memcpy(pixels.data() + offset, frame.pixels.data() + offset, static_cast<size_t>(rect.width) * 4);
+            }
+        }
+        return pixels == frame.pixels;
+    }
+
+    void drop()
+    {
+        pixels.clear();
+        width = 0;
+        height = 0;
+    }
+};
+
+} // namespace
+
+TEST(staging_first_publish_is_full)
+{
+    PaintStagingRing ring;
+    FakeView view;
+    ring.publish(view.paint(PixelRect{0, 0, 8, 8}), view.pixels.data(), kWidth, kHeight);
+
+    DirtyRegion damage;
+    const StagedFrame *frame = ring.acquire(damage);
+    EXPECT(frame != nullptr);
+    if (!frame)
+        return;
+    EXPECT_EQ(damage.area(), static_cast<int64_t>(kWidth) * kHeight);
+    EXPECT(frame->pixels == view.pixels);
+    EXPECT(ring.acquire(damage) == nullptr);
+}
+
+TEST(staging_merges_skipped_frames)
+{
+    PaintStagingRing ring;
+    FakeView view;
+    Mirror mirror;
+    DirtyRegion damage;
+    // Until every slot has been written once, each publish is a full one
+    for (int i = 0; i < PaintStagingRing::kSlotCount; ++i)
+    {
+        ring.publish(view.paint(PixelRect{0, 0, 1, 1}), view.pixels.data(), kWidth, kHeight);
+        mirror.apply(*ring.acquire(damage), damage);
+    }
+    EXPECT(mirror.pixels == view.pixels);
+
+    // Three paints before the render loop looks again: one frame, the union
+    // of their damage, and every slot's stale rows caught up.
+    ring.publish(view.paint(PixelRect{0, 0, 10, 10}), view.pixels.data(), kWidth, kHeight);
+    ring.publish(view.paint(PixelRect{50, 20, 10, 10}), view.pixels.data(), kWidth, kHeight);
+    ring.publish(view.paint(PixelRect{5, 5, 10, 10}), view.pixels.data(), kWidth, kHeight);
+    const StagedFrame *frame = ring.acquire(damage);
+    EXPECT(frame != nullptr);
+    if (!frame)
+        return;
+    EXPECT_EQ(damage.area(), 100 + 100 + 100 - 25);
+    EXPECT(mirror.apply(*frame, damage));
+    EXPECT(frame->pixels == view.pixels);
+    EXPECT_EQ(ring.stats().merged, 2u);
+    EXPECT_EQ(ring.stats().acquired, 4u);
+
+    // A slot that sat out those paints copies them before the next one
+    ring.publish(view.paint(PixelRect{90, 60, 6, 4}), view.pixels.data(), kWidth, kHeight);
+    frame = ring.acquire(damage);
+    EXPECT_EQ(damage.area(), 24);
+    EXPECT(mirror.apply(*frame, damage));
+}
+
+TEST(staging_reset_and_release_force_full)
+{
+    PaintStagingRing ring;
+    FakeView view;
+    DirtyRegion damage;
+    ring.publish(view.paint(PixelRect{0, 0, kWidth, kHeight}), view.pixels.data(), kWidth, kHeight);
+    ring.acquire(damage);
+
+    ring.publish(view.paint(PixelRect{0, 0, 4, 4}), view.pixels.data(), kWidth, kHeight);
+    ring.reset();
+    EXPECT(ring.acquire(damage) == nullptr);
+    ring.publish(view.paint(PixelRect{0, 0, 4, 4}), view.pixels.data(), kWidth, kHeight);
+    const StagedFrame *frame = ring.acquire(damage);
+    EXPECT_EQ(damage.area(), static_cast<int64_t>(kWidth) * kHeight);
+    EXPECT(frame && frame->pixels == view.pixels);
+
+    ring.release();
+    EXPECT_EQ(ring.memory_bytes(), 0u);
+    ring.publish(view.paint(PixelRect{0, 0, 4, 4}), view.pixels.data(), kWidth, kHeight);
+    frame = ring.acquire(damage);
+    EXPECT_EQ(damage.area(), static_cast<int64_t>(kWidth) * kHeight);
+    EXPECT(frame && frame->pixels == view.pixels);
+}
+
+TEST(staging_threaded_bursts)
+{
+    // The producer bursts paints while the consumer acquires at its own
+    // pace and now and then releases everything, as a hidden popup does.
+    // Whatever interleaving happens, the damage of the acquired frames has
+    // to bring the consumer's copy up to date, including right after a
+    // release() that raced a publish().
+    PaintStagingRing ring;
+    std::atomic<bool> done{false};
+    std::thread producer([&ring, &done]()
+                         {
+        FakeView view;
+        std::mt19937 rng(7);
+        for (int i = 0; i < 20000; ++i)
+        {
+            PixelRect rect{static_cast<int>(rng() % kWidth), static_cast<int>(rng() % kHeight),
+                           1 + static_cast<int>(rng() % 32), 1 + static_cast<int>(rng() % 32)};
+            rect = intersect_rects(rect, PixelRect{0, 0, kWidth, kHeight});
+            ring.publish(view.paint(rect), view.pixels.data(), kWidth, kHeight);
+            if (rng() % 64 == 0)
+                std::this_thread::yield();
+        }
+        done = true; });
+
+    Mirror mirror;
+    std::mt19937 rng(11);
+    uint64_t acquired = 0;
+    uint64_t mismatches = 0;
+    uint64_t releases = 0;
+    while (!done)
+    {
+        DirtyRegion damage;
+        if (const StagedFrame *frame = ring.acquire(damage))
+        {
+            acquired++;
+            if (!mirror.apply(*frame, damage))
+            {
+                mismatches++;
+                // Count each loss once
+                mirror.pixels = frame->pixels;
+            }
+        }
+        if (rng() % 16 == 0)
+        {
+            ring.release();
+            mirror.drop();
+            releases++;
+        }
+    }
+    producer.join();
+
+    EXPECT(acquired > 0);
+    EXPECT(releases > 0);
+    EXPECT_EQ(mismatches, 0u);
+    PaintStagingStats stats = ring.stats();
+    EXPECT_EQ(stats.published, 20000u);
+    EXPECT(stats.acquired + stats.merged <= stats.published);
+}
@@ -0,0 +1,85 @@
+#ifndef RENDER_BACKEND_H
+#define RENDER_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include "dirty_region.h"
+#include "surface_pool.h"
+
+// Handle to a BGRA8 surface owned by a RenderBackend. 0 is never a valid id.
+using SurfaceId = uint32_t;
+constexpr SurfaceId kInvalidSurface = 0;
+
+// The small set of operations MyApp needs to get CEF paints on screen.
+// MetalRenderBackend is what the app uses; CpuRenderBackend reproduces the
+// same results on plain memory so the paint -> present path can run (and be
+// compared) without a GPU. Layers are drawn by the UI from what present()
+// returns, see LayerTree.
+class RenderBackend
+{
+public:
+    virtual ~RenderBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    // Creates a surface. |render_target| surfaces can be drawn into by the
+    // GPU as well as uploaded to.
+    // The memory behind it may come from a SurfacePool: it can be larger
+    // than asked for (see surface_uv_extent()) and its pixels are undefined.
+    virtual SurfaceId create_surface(uint32_t width, uint32_t height, bool render_target) = 0;
+
+    // Wraps a surface CEF shares with us (an IOSurfaceRef on macOS) without
+    // copying it. Returns kInvalidSurface when the backend can't do that.
+    virtual SurfaceId import_shared_surface(void *shared_handle) = 0;
+    // Whether the above can work at all; decides if CEF paints accelerated.
+    virtual bool can_import_shared_surfaces() const { return false; }
+
+    virtual void destroy_surface(SurfaceId surface) = 0;
+
+    // The size the surface was created (or imported) with.
+    virtual bool get_surface_size(SurfaceId surface, uint32_t &width, uint32_t &height) const = 0;
+
+    // Part of the allocation the surface's pixels occupy, as texture
+    // coordinates from the top-left corner. 1, 1 unless it is pooled.
+    virtual void surface_uv_extent(SurfaceId, float &u, float &v) const
+    {
+        u = 1.0f;
+        v = 1.0f;
+    }
+
+    // Counters of the pool behind create_surface(), if there is one.
+    virtual const SurfacePoolStats *surface_pool_stats() const { return nullptr; }
+
+    // Bytes of the allocation behind |surface|; 0 for imported surfaces,
+    // whose memory belongs to CEF.
+    virtual size_t surface_bytes(SurfaceId surface) const
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        return get_surface_size(surface, width, height) ? static_cast<size_t>(width) * height * 4 : 0;
+    }
+    // Memory the backend keeps for itself, e.g. scratch surfaces.
+    virtual size_t scratch_bytes() const { return 0; }
+    // Frees the idle pooled surfaces and the scratch; both come back on
+    // demand.
+    virtual void release_idle_memory() {}
+
+    // Copies |rect| of |pixels| (whose first byte is the rect's top-left pixel)
+    // into the same rect of |surface|.
+    virtual void upload_region(SurfaceId surface, const PixelRect &rect, const void *pixels, size_t bytes_per_row) = 0;
+
+    // Moves the pixels of |source| by |dx|, |dy| inside |surface|; the two
+    // may overlap. Returns false if the backend can't, the caller uploads
+    // instead. Uploads made after it returns land on top of the moved pixels.
+    virtual bool move_region(SurfaceId /*surface*/, const PixelRect & /*source*/, int /*dx*/, int /*dy*/)
+    {
+        return false;
+    }
+
+    // Marks |surface| as the frame shown this display tick. Returns whatever
+    // the UI needs to draw it (an MTL::Texture * for ImGui::Image on Metal,
+    // the pixel memory on the CPU backend), or nullptr.
+    virtual void *present(SurfaceId surface) = 0;
+};
+
+#endif // RENDER_BACKEND_H
@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cpu_render_backend.h"
+#include "unit_test.h"
+
+// The paint -> present path of CpuRenderBackend against a golden image:
+// what it presents for a view painted in full, then in parts, then
+// scrolled, and for a translucent popup, stacked top to bottom. Set
+// SHROME_UPDATE_GOLDEN=1 to rewrite the image after an intended change.
+
+#ifndef SHROME_FIXTURES_DIR
+#define SHROME_FIXTURES_DIR "fixtures"
+#endif
+
+namespace
+{
+
+const int kViewWidth = 48;
+const int kViewHeight = 32;
+const int kPopupWidth = 16;
+const int kPopupHeight = 12;
+const char *kGoldenName = "cpu_backend_golden.pam";
+
+// CEF's buffer: BGRA, tightly packed
+struct Frame
+{
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+
+    Frame(int w, int h) : width(w), height(h), pixels(static_cast<size_t>(w) * h * 4) {}
+    size_t stride() const { return static_cast<size_t>(width) * 4; }
+    uint8_t *at(int x, int y) { return pixels.data() + y * stride() + static_cast<size_t>(x) * 4; }
+};
+
+// Gradients and stripes that differ per |phase|, opaque.
+void paint_view(Frame &frame, const PixelRect &rect, int phase)
+{
+    for (int y = rect.y; y < rect.bottom(); ++y)
+    {
+        for (int x = rect.x; x < rect.right(); ++x)
+        {
+            uint8_t *p = frame.at(x, y);
+            p[0] = static_cast<uint8_t>(x * 5 + phase * 40);
+            p[1] = static_cast<uint8_t>(y * 7 + phase * 13);
+            p[2] = static_cast<uint8_t>(((x / 4 + y / 4 + phase) % 2) ? 220 : 30);
+            p[3] = 255;
+        }
+    }
+}
+
+// Alpha ramps across the popup, from fully transparent to opaque.
+void paint_popup(Frame &frame)
+{
+    for (int y = 0; y < frame.height; ++y)
+    {
+        for (int x = 0; x < frame.width; ++x)
+        {
+            uint8_t *p = frame.at(x, y);
+            p[0] = static_cast<uint8_t>(250 - y * 9);
+            p[1] = static_cast<uint8_t>(x * 16);
+            p[2] = static_cast<uint8_t>(100 + x * y);
+            p[3] = static_cast<uint8_t>(x == 0 ? 0 : x == frame.width - 1 ? 255 : x * 17);
+        }
+    }
+}
+
+// What MyApp::upload_staged_frames() does with a paint.
+void upload(CpuRenderBackend &backend, SurfaceId surface, const DirtyRegion &damage, Frame &frame)
+{
+    UploadPlan plan = plan_upload(damage, frame.width, frame.height);
+    for (const PixelRect &rect : plan.rects)
+    {
+        backend.upload_region(surface, rect, frame.at(rect.x, rect.y), frame.stride());
+    }
+}
+
+bool surface_matches(const CpuRenderBackend &backend, SurfaceId id, Frame &frame)
+{
+    const CpuSurface *surface = backend.surface(id);
+    if (!surface || surface->width != static_cast<uint32_t>(frame.width) ||
+        surface->height != static_cast<uint32_t>(frame.height))
+        return false;
+    for (int y = 0; y < frame.height; ++y)
+    {
+        if (memcmp(surface->pixels + y * surface->stride(), frame.at(0, y), frame.stride()) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Appends what the backend presents for |surface| to |image|, padded to
+// the image's width with transparent black.
+void add_presented(CpuRenderBackend &backend, SurfaceId surface, Frame &image, int &top)
+{
+    const uint8_t *pixels = static_cast<const uint8_t *>(backend.present(surface));
+    const CpuSurface *s = backend.surface(surface);
+    EXPECT(pixels && s);
+    if (!pixels || !s)
+        return;
+    for (uint32_t y = 0; y < s->height; ++y)
+    {
+        memcpy(image.at(0, top + y), pixels + y * s->stride(), static_cast<size_t>(s->width) * 4);
+    }
+    top += s->height;
+}
+
+// Binary PAM with the alpha channel, so the popup's ramp is part of it.
+std::string to_pam(Frame &frame)
+{
+    std::ostringstream out;
+    out << "P7\nWIDTH " << frame.width << "\nHEIGHT " << frame.height
+        << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    for (int y = 0; y < frame.height; ++y)
+    {
+        for (int x = 0; x < frame.width; ++x)
+        {
+            const uint8_t *p = frame.at(x, y);
+            out.put(static_cast<char>(p[2])).put(static_cast<char>(p[1])).put(static_cast<char>(p[0]));
+            out.put(static_cast<char>(p[3]));
+        }
+    }
+    return out.str();
+}
+
+std::string read_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+} // namespace
+
+TEST(cpu_backend_golden)
+{
+    CpuRenderBackend backend;
+    SurfaceId view = backend.create_surface(kViewWidth, kViewHeight, false);
+    SurfaceId popup = backend.create_surface(kPopupWidth, kPopupHeight, false);
+    EXPECT(view != kInvalidSurface && popup != kInvalidSurface);
+    Frame image(kViewWidth, 3 * kViewHeight + kPopupHeight);
+    int top = 0;
+
+    // First paint: everything
+    Frame cef(kViewWidth, kViewHeight);
+    const PixelRect full{0, 0, kViewWidth, kViewHeight};
+    paint_view(cef, full, 0);
+    DirtyRegion damage;
+    damage.add(full);
+    upload(backend, view, damage, cef);
+    EXPECT(surface_matches(backend, view, cef));
+    add_presented(backend, view, image, top);
+
+    // A caret and a banner repaint
+    damage.clear();
+    for (const PixelRect &rect : {PixelRect{2, 2, 3, 9}, PixelRect{6, 3, 2, 2}, PixelRect{28, 18, 20, 10}})
+    {
+        paint_view(cef, rect, 1);
+        damage.add(rect);
+    }
+    upload(backend, view, damage, cef);
+    EXPECT(surface_matches(backend, view, cef));
+    add_presented(backend, view, image, top);
+
+    // Scrolled down by 5 rows: moved on the surface, only the new rows are
+    // uploaded
+    const int scroll = 5;
+    memmove(cef.at(0, 0), cef.at(0, scroll), cef.stride() * (kViewHeight - scroll));
+    const PixelRect exposed{0, kViewHeight - scroll, kViewWidth, scroll};
+    paint_view(cef, exposed, 2);
+    EXPECT(backend.move_region(view, PixelRect{0, scroll, kViewWidth, kViewHeight - scroll}, 0, -scroll));
+    damage.clear();
+    damage.add(exposed);
+    upload(backend, view, damage, cef);
+    EXPECT(surface_matches(backend, view, cef));
+    add_presented(backend, view, image, top);
+
+    // The popup's surface keeps its alpha; the UI blends it, not the backend
+    Frame popup_frame(kPopupWidth, kPopupHeight);
+    paint_popup(popup_frame);
+    damage.clear();
+    damage.add(PixelRect{0, 0, kPopupWidth, kPopupHeight});
+    upload(backend, popup, damage, popup_frame);
+    EXPECT(surface_matches(backend, popup, popup_frame));
+    add_presented(backend, popup, image, top);
+    EXPECT_EQ(top, image.height);
+
+    const std::string golden_path = std::string(SHROME_FIXTURES_DIR) + "/" + kGoldenName;
+    const std::string pam = to_pam(image);
+    const char *update = getenv("SHROME_UPDATE_GOLDEN");
+    if (update && *update == '1')
+    {
+        std::ofstream(golden_path, std::ios::binary) << pam;
+        printf("wrote %s\n", golden_path.c_str());
+        return;
+    }
+    const std::string golden = read_file(golden_path);
+    EXPECT(!golden.empty());
+    if (!golden.empty() && golden != pam)
+    {
+        const std::string actual_path = std::string(kGoldenName) + ".actual.pam";
+        std::ofstream(actual_path, std::ios::binary) << pam;
+        unit_test_fail(__FILE__, __LINE__, "the presented surfaces to match " + golden_path + ", see " + actual_path);
+    }
+}
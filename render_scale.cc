@@ -0,0 +1,109 @@
+#include "render_scale.h"
+
+#include <algorithm>
+
+RenderScalePolicy::RenderScalePolicy(const FrameClock &clock, const RenderScaleConfig &config)
+    : m_clock(clock), m_config(config)
+{
+    if (m_config.steps.empty())
+    {
+        m_config.steps.push_back(1.0f);
+    }
+}
+
+void RenderScalePolicy::set_enabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled)
+    {
+        m_level = 0;
+    }
+}
+
+void RenderScalePolicy::set_native_scale(float scale)
+{
+    if (scale <= 0.0f || scale == m_native_scale)
+        return;
+    m_native_scale = scale;
+    m_level = 0;
+}
+
+float RenderScalePolicy::scale_at(size_t level) const
+{
+    float scale = m_native_scale * m_config.steps[level];
+    return std::min(m_native_scale, std::max(scale, m_config.min_device_scale));
+}
+
+float RenderScalePolicy::device_scale() const
+{
+    return scale_at(m_enabled ? m_level : 0);
+}
+
+bool RenderScalePolicy::set_level(size_t level, int64_t now_us)
+{
+    float before = device_scale();
+    m_level = level;
+    m_last_change_us = now_us;
+    return device_scale() != before;
+}
+
+bool RenderScalePolicy::update(bool painted, bool scrolled, int64_t period_us)
+{
+    int64_t now_us = m_clock.now_us();
+    int64_t interval_us = m_last_frame_us >= 0 ? now_us - m_last_frame_us : period_us;
+    m_last_frame_us = now_us;
+
+    m_stats.frames++;
+    if (reduced())
+        m_stats.reduced_frames++;
+
+    // Smoothed over a few frames: one hitch isn't load
+    m_interval_us = m_interval_us > 0.0 ? m_interval_us * 0.75 + interval_us * 0.25 : interval_us;
+    bool slow = period_us > 0 && interval_us > period_us * m_config.slow_frame_ratio;
+    if (slow)
+        m_stats.slow_frames++;
+    bool missing_frames = period_us > 0 && m_interval_us > period_us * m_config.slow_frame_ratio;
+
+    if (painted)
+        m_paints_us.push_back(now_us);
+    while (!m_paints_us.empty() && now_us - m_paints_us.front() > m_config.rate_window_us)
+    {
+        m_paints_us.pop_front();
+    }
+    double paint_rate = m_paints_us.size() * 1e6 / m_config.rate_window_us;
+
+    if (painted || scrolled)
+        m_last_activity_us = now_us;
+    bool busy = scrolled || paint_rate >= m_config.busy_paint_rate;
+    if (!busy)
+        m_busy_since_us = -1;
+    else if (m_busy_since_us < 0)
+        m_busy_since_us = now_us;
+
+    if (!m_enabled)
+        return false;
+
+    if (m_level > 0 && m_last_activity_us >= 0 && now_us - m_last_activity_us >= m_config.idle_us)
+    {
+        m_stats.restores++;
+        return set_level(0, now_us);
+    }
+
+    if (!busy || now_us - m_busy_since_us < m_config.engage_us || now_us - m_last_change_us < m_config.engage_us)
+        return false;
+
+    // Past the first step only missed frames justify going lower
+    if (m_level > 0 && !missing_frames)
+        return false;
+
+    size_t next = m_level + 1;
+    while (next < m_config.steps.size() && scale_at(next) >= device_scale())
+    {
+        next++;
+    }
+    if (next >= m_config.steps.size())
+        return false;
+
+    m_stats.scale_downs++;
+    return set_level(next, now_us);
+}
@@ -0,0 +1,92 @@
+#ifndef RENDER_SCALE_H
+#define RENDER_SCALE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "frame_scheduler.h"
+
+struct RenderScaleConfig
+{
+    // Fractions of the native density stepped through under load, from
+    // full quality down.
+    std::vector<float> steps = {1.0f, 0.75f, 0.5f};
+    // Never report less than this; a 1x screen keeps full quality.
+    float min_device_scale = 1.0f;
+    // Paints per second, over |rate_window_us|, that count as animating.
+    double busy_paint_rate = 30.0;
+    int64_t rate_window_us = 250000;
+    // A frame interval this many display periods long is a missed frame;
+    // compared against the smoothed interval.
+    double slow_frame_ratio = 1.4;
+    // Load has to last this long before the first step down, and again for
+    // every further step (which also needs missed frames).
+    int64_t engage_us = 300000;
+    // No paint or scroll for this long and it goes back to full quality.
+    int64_t idle_us = 400000;
+};
+
+struct RenderScaleStats
+{
+    uint64_t frames = 0;
+    uint64_t reduced_frames = 0; // frames spent below native
+    uint64_t slow_frames = 0;    // longer than slow_frame_ratio periods
+    uint64_t scale_downs = 0;
+    uint64_t restores = 0;       // back to native after idling
+};
+
+// Adaptive quality: while the content is scrolling or animating the browser
+// is told a lower device scale factor, so it rasterizes fewer pixels, and
+// the frame is stretched to the view when drawn. Once nothing moved for
+// idle_us it goes back to the native scale, so text at rest is sharp.
+//
+// The first step is taken on a high paint rate alone, later ones only while
+// frames are still missed. Going down needs sustained load, going back up
+// sustained idleness, so a single paint never flips it.
+//
+// Single threaded; fed once per display frame.
+class RenderScalePolicy
+{
+public:
+    explicit RenderScalePolicy(const FrameClock &clock, const RenderScaleConfig &config = RenderScaleConfig());
+
+    // Off means always the native scale.
+    void set_enabled(bool enabled);
+    bool enabled() const { return m_enabled; }
+
+    // The screen's own density. Changing it starts over at full quality.
+    void set_native_scale(float scale);
+    float native_scale() const { return m_native_scale; }
+
+    // A display frame at now(): whether the browser painted and whether the
+    // view was scrolled since the last one, and the display period. Returns
+    // true when device_scale() changed.
+    bool update(bool painted, bool scrolled, int64_t period_us);
+
+    float device_scale() const;
+    bool reduced() const { return device_scale() < m_native_scale; }
+
+    const RenderScaleStats &stats() const { return m_stats; }
+    void reset_stats() { m_stats = RenderScaleStats(); }
+
+private:
+    float scale_at(size_t level) const;
+    bool set_level(size_t level, int64_t now_us);
+
+    const FrameClock &m_clock;
+    RenderScaleConfig m_config;
+    bool m_enabled = false;
+    float m_native_scale = 1.0f;
+    size_t m_level = 0;
+
+    int64_t m_last_frame_us = -1;
+    double m_interval_us = 0.0;      // smoothed frame interval
+    std::deque<int64_t> m_paints_us; // inside the rate window
+    int64_t m_busy_since_us = -1;
+    int64_t m_last_activity_us = -1;
+    int64_t m_last_change_us = 0;
+    RenderScaleStats m_stats;
+};
+
+#endif // RENDER_SCALE_H
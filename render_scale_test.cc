@@ -0,0 +1,154 @@
+#include "render_scale.h"
+#include "unit_test.h"
+
+// RenderScalePolicy over synthetic frame time traces on a 2x screen, where
+// the steps are 2, 1.5 and 1.
+
+namespace
+{
+
+const int64_t kPeriod = 16667;
+
+struct Trace
+{
+    VirtualFrameClock clock;
+    RenderScalePolicy policy{clock};
+
+    Trace()
+    {
+        policy.set_enabled(true);
+        policy.set_native_scale(2.0f);
+        // A second at rest first
+        frames(60, kPeriod, false, false);
+    }
+
+    // |count| frames |interval_us| apart; returns how often the scale
+    // changed
+    int frames(int count, int64_t interval_us, bool painted, bool scrolled)
+    {
+        int changes = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            clock.advance_us(interval_us);
+            changes += policy.update(painted, scrolled, kPeriod) ? 1 : 0;
+        }
+        return changes;
+    }
+
+    // Frames until the scale changes, at most |limit|; the time it took
+    int64_t until_change(int limit, int64_t interval_us, bool painted, bool scrolled)
+    {
+        int64_t start = clock.now_us();
+        for (int i = 0; i < limit; ++i)
+        {
+            if (frames(1, interval_us, painted, scrolled))
+                return clock.now_us() - start;
+        }
+        return -1;
+    }
+};
+
+} // namespace
+
+TEST(render_scale_ignores_a_hitch)
+{
+    Trace trace;
+    // A page painting a few times a second, with one 200 ms frame and one
+    // scrolled frame along the way
+    for (int second = 0; second < 3; ++second)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(trace.frames(1, kPeriod, true, false), 0);
+            EXPECT_EQ(trace.frames(5, kPeriod, false, false), 0);
+        }
+        if (second == 1)
+        {
+            EXPECT_EQ(trace.frames(1, 200000, true, true), 0);
+        }
+    }
+    EXPECT_EQ(trace.policy.device_scale(), 2.0f);
+    EXPECT_EQ(trace.policy.stats().scale_downs, 0u);
+    EXPECT_EQ(trace.policy.stats().slow_frames, 1u);
+}
+
+TEST(render_scale_steps_down_under_sustained_load)
+{
+    Trace trace;
+    const RenderScaleConfig config;
+
+    // Smooth scrolling: one step after engage_us, none further while no
+    // frame is missed
+    int64_t engaged = trace.until_change(60, kPeriod, true, true);
+    EXPECT(engaged >= config.engage_us && engaged < config.engage_us + 2 * kPeriod);
+    EXPECT_EQ(trace.policy.device_scale(), 1.5f);
+    EXPECT(trace.policy.reduced());
+    EXPECT_EQ(trace.frames(120, kPeriod, true, true), 0);
+
+    // Frames start taking two periods: another step once engage_us has
+    // passed since the last one
+    int64_t stepped = trace.until_change(60, 2 * kPeriod, true, true);
+    EXPECT(stepped > 0);
+    EXPECT_EQ(trace.policy.device_scale(), 1.0f);
+    EXPECT_EQ(trace.policy.stats().scale_downs, 2u);
+
+    // The bottom step is the last
+    EXPECT_EQ(trace.frames(60, 2 * kPeriod, true, true), 0);
+
+    // Animating without scrolling counts as load too
+    Trace animation;
+    EXPECT(animation.until_change(60, kPeriod, true, false) >= config.engage_us);
+    EXPECT_EQ(animation.policy.device_scale(), 1.5f);
+}
+
+TEST(render_scale_missed_frames_step_only_after_engage)
+{
+    Trace trace;
+    const RenderScaleConfig config;
+    // Slow from the start: the second step still waits engage_us after the
+    // first
+    EXPECT(trace.until_change(60, 2 * kPeriod, true, true) >= config.engage_us);
+    int64_t second = trace.until_change(60, 2 * kPeriod, true, true);
+    EXPECT(second >= config.engage_us && second < config.engage_us + 2 * kPeriod);
+    EXPECT_EQ(trace.policy.device_scale(), 1.0f);
+}
+
+TEST(render_scale_restores_after_idle)
+{
+    Trace trace;
+    trace.until_change(60, kPeriod, true, true);
+    EXPECT(trace.policy.reduced());
+
+    // A paint now and then doesn't keep it reduced, it only pushes the
+    // restore back
+    trace.frames(10, kPeriod, false, false);
+    trace.frames(1, kPeriod, true, false);
+    int64_t idle = trace.until_change(60, kPeriod, false, false);
+    EXPECT(idle >= RenderScaleConfig().idle_us && idle < RenderScaleConfig().idle_us + kPeriod);
+    EXPECT_EQ(trace.policy.device_scale(), 2.0f);
+    EXPECT_EQ(trace.policy.stats().restores, 1u);
+    EXPECT(trace.policy.stats().reduced_frames > 0);
+}
+
+TEST(render_scale_disable_resets)
+{
+    Trace trace;
+    trace.until_change(60, kPeriod, true, true);
+    EXPECT(trace.policy.reduced());
+
+    trace.policy.set_enabled(false);
+    EXPECT_EQ(trace.policy.device_scale(), 2.0f);
+    EXPECT_EQ(trace.frames(120, 2 * kPeriod, true, true), 0);
+    EXPECT_EQ(trace.policy.device_scale(), 2.0f);
+
+    // Back on, it starts over from native
+    trace.policy.set_enabled(true);
+    EXPECT_EQ(trace.policy.device_scale(), 2.0f);
+
+    // So does a new screen density
+    trace.until_change(60, kPeriod, true, true);
+    EXPECT(trace.policy.reduced());
+    trace.policy.set_native_scale(1.0f);
+    EXPECT_EQ(trace.policy.device_scale(), 1.0f);
+    EXPECT(!trace.policy.reduced());
+}
@@ -0,0 +1,113 @@
+#include "resize_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+ResizeController::ResizeController(const FrameClock &clock, const ResizeControllerConfig &config)
+    : m_clock(clock), m_config(config)
+{
+    m_config.snap_step = std::max(1, m_config.snap_step);
+}
+
+ViewSize ResizeController::snap(const ViewSize &size) const
+{
+    auto round = [this](int value)
+    {
+        int step = m_config.snap_step;
+        return std::max(step, (value + step / 2) / step * step);
+    };
+
+    ViewSize snapped = size;
+    snapped.width = round(size.width);
+    snapped.height = round(size.height);
+    return snapped;
+}
+
+bool ResizeController::send(const ViewSize &size, int64_t now_us)
+{
+    m_sent = size;
+    m_has_sent = true;
+    m_last_sent_us = now_us;
+
+    uint64_t sent = m_stats.interim_resizes + m_stats.final_resizes;
+    m_stats.relayouts_saved = m_stats.size_changes > sent ? m_stats.size_changes - sent : 0;
+    return true;
+}
+
+bool ResizeController::update(const ViewSize &view_size)
+{
+    if (view_size.empty())
+        return false;
+
+    int64_t now_us = m_clock.now_us();
+    if (!m_has_sent)
+    {
+        m_view = view_size;
+        return send(view_size, now_us);
+    }
+
+    if (view_size != m_view)
+    {
+        bool density_changed = view_size.pixel_density != m_view.pixel_density;
+        m_view = view_size;
+        m_last_change_us = now_us;
+        m_stats.size_changes++;
+
+        if (density_changed)
+        {
+            // Moved to another screen; snapping buys nothing here
+            m_stats.final_resizes++;
+            return send(m_view, now_us);
+        }
+    }
+
+    if (m_sent == m_view)
+        return false;
+
+    if (now_us - m_last_change_us >= m_config.settle_us)
+    {
+        m_stats.final_resizes++;
+        return send(m_view, now_us);
+    }
+
+    if (now_us - m_last_sent_us >= m_config.min_interval_us)
+    {
+        ViewSize snapped = snap(m_view);
+        if (snapped != m_sent)
+        {
+            m_stats.interim_resizes++;
+            return send(snapped, now_us);
+        }
+    }
+
+    // Not sent (yet); the send() that eventually follows updates the count
+    uint64_t sent = m_stats.interim_resizes + m_stats.final_resizes;
+    m_stats.relayouts_saved = m_stats.size_changes > sent ? m_stats.size_changes - sent : 0;
+    return false;
+}
+
+FramePlacement ResizeController::place_frame(int frame_width, int frame_height, float frame_scale)
+{
+    FramePlacement placement;
+    if (frame_width <= 0 || frame_height <= 0 || frame_scale <= 0.0f || m_view.empty())
+    {
+        placement.width = static_cast<float>(m_view.width);
+        placement.height = static_cast<float>(m_view.height);
+        return placement;
+    }
+
+    float frame_logical_width = frame_width / frame_scale;
+    float frame_logical_height = frame_height / frame_scale;
+    placement.width = std::min(frame_logical_width, static_cast<float>(m_view.width));
+    placement.height = std::min(frame_logical_height, static_cast<float>(m_view.height));
+    placement.uv_u = placement.width / frame_logical_width;
+    placement.uv_v = placement.height / frame_logical_height;
+
+    // CEF rounds fractional sizes up
+    if (frame_width != static_cast<int>(std::ceil(m_view.width * frame_scale)) ||
+        frame_height != static_cast<int>(std::ceil(m_view.height * frame_scale)))
+    {
+        m_stats.scaled_frames++;
+    }
+    return placement;
+}
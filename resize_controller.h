@@ -0,0 +1,98 @@
+#ifndef RESIZE_CONTROLLER_H
+#define RESIZE_CONTROLLER_H
+
+#include <cstdint>
+#include "frame_scheduler.h"
+
+// Size of the browser view in logical pixels, and its device scale.
+struct ViewSize
+{
+    int width = 0;
+    int height = 0;
+    int pixel_density = 1;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+    bool operator==(const ViewSize &other) const
+    {
+        return width == other.width && height == other.height && pixel_density == other.pixel_density;
+    }
+    bool operator!=(const ViewSize &other) const { return !(*this == other); }
+};
+
+struct ResizeControllerConfig
+{
+    // Interim sizes are rounded to multiples of this while the size keeps
+    // changing, so a drag relayouts every |snap_step| pixels at most.
+    int snap_step = 64;
+    // At most one interim resize per this interval.
+    int64_t min_interval_us = 100000;
+    // Without a change for this long the drag is over and the exact size is
+    // sent.
+    int64_t settle_us = 150000;
+};
+
+struct ResizeStats
+{
+    uint64_t size_changes = 0;   // distinct sizes the view went through
+    uint64_t interim_resizes = 0;
+    uint64_t final_resizes = 0;
+    uint64_t relayouts_saved = 0; // size changes that never reached the browser
+    uint64_t scaled_frames = 0;   // frames shown at another size than the view
+};
+
+// Where and how much of the last frame to draw while its size doesn't match
+// the view.
+struct FramePlacement
+{
+    float width = 0.0f; // logical pixels, anchored at the view's top-left
+    float height = 0.0f;
+    float uv_u = 1.0f; // bottom-right texture coordinate
+    float uv_v = 1.0f;
+};
+
+// Throttles browser resizes while the view is being resized live. Instead of
+// one WasResized() (a full relayout and repaint) per intermediate pixel size:
+// - the first size is sent right away, later ones at most every
+//   min_interval_us and snapped to snap_step;
+// - once the size has been stable for settle_us the exact size is sent;
+// - a pixel density change is always sent at once.
+// Until the browser paints at the new size the last frame keeps being shown,
+// see place_frame().
+class ResizeController
+{
+public:
+    explicit ResizeController(const FrameClock &clock, const ResizeControllerConfig &config = ResizeControllerConfig());
+
+    // Call once per display frame with the current view size. Returns true
+    // when the browser should be resized to browser_size() now.
+    bool update(const ViewSize &view_size);
+
+    // The size the browser was last told about.
+    const ViewSize &browser_size() const { return m_sent; }
+    bool settling() const { return m_sent != m_view; }
+
+    // Shows a frame of |frame_width| x |frame_height| device pixels, painted
+    // at |frame_scale| device pixels per logical one, in the current view at
+    // its own logical size: letterboxed when it is smaller and cropped when
+    // it is larger. That keeps text sharp and mouse coordinates unchanged.
+    // A frame painted below the view's density is stretched to the view.
+    FramePlacement place_frame(int frame_width, int frame_height, float frame_scale);
+
+    const ResizeStats &stats() const { return m_stats; }
+
+private:
+    ViewSize snap(const ViewSize &size) const;
+    bool send(const ViewSize &size, int64_t now_us);
+
+    const FrameClock &m_clock;
+    ResizeControllerConfig m_config;
+
+    ViewSize m_view;
+    ViewSize m_sent;
+    bool m_has_sent = false;
+    int64_t m_last_change_us = 0;
+    int64_t m_last_sent_us = 0;
+    ResizeStats m_stats;
+};
+
+#endif // RESIZE_CONTROLLER_H
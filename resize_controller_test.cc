@@ -0,0 +1,150 @@
+#include <vector>
+#include "resize_controller.h"
+#include "unit_test.h"
+
+// ResizeController on a VirtualFrameClock, updated at 60 Hz like the UI does.
+
+namespace
+{
+
+const int64_t kFrameUs = 16667;
+
+struct Resize
+{
+    int64_t at_us;
+    ViewSize size;
+};
+
+// Feeds |size| for one frame; records what the browser would be sent.
+struct Drag
+{
+    VirtualFrameClock clock;
+    ResizeController controller{clock};
+    std::vector<Resize> sent;
+
+    bool frame(const ViewSize &size)
+    {
+        clock.advance_us(kFrameUs);
+        if (!controller.update(size))
+            return false;
+        sent.push_back(Resize{clock.now_us(), controller.browser_size()});
+        return true;
+    }
+};
+
+} // namespace
+
+TEST(resize_first_size_goes_out_at_once)
+{
+    Drag drag;
+    EXPECT(!drag.frame(ViewSize{0, 600, 1}));
+    EXPECT(drag.frame(ViewSize{801, 603, 1}));
+    EXPECT(drag.controller.browser_size() == (ViewSize{801, 603, 1}));
+    EXPECT(!drag.controller.settling());
+    EXPECT(!drag.frame(ViewSize{801, 603, 1}));
+}
+
+TEST(resize_drag_is_throttled_and_snapped)
+{
+    Drag drag;
+    drag.frame(ViewSize{800, 600, 1});
+    drag.sent.clear();
+
+    // A second long drag, 3 px wider and 1 px taller every frame
+    ViewSize size{800, 600, 1};
+    for (int i = 0; i < 60; ++i)
+    {
+        size.width += 3;
+        size.height += 1;
+        drag.frame(size);
+        EXPECT(drag.controller.settling() || drag.controller.browser_size() == size);
+    }
+    EXPECT(!drag.sent.empty());
+    int64_t previous_us = 0;
+    for (const Resize &resize : drag.sent)
+    {
+        EXPECT_EQ(resize.size.width % 64, 0);
+        EXPECT_EQ(resize.size.height % 64, 0);
+        if (previous_us)
+            EXPECT(resize.at_us - previous_us >= ResizeControllerConfig().min_interval_us);
+        previous_us = resize.at_us;
+    }
+    // 180 px wider crosses three 64 px steps; the height one
+    EXPECT(drag.sent.size() <= 4);
+    EXPECT_EQ(drag.controller.stats().interim_resizes, drag.sent.size());
+    EXPECT(drag.controller.settling());
+
+    // Held still: nothing until it has been stable for settle_us, then the
+    // exact size
+    int64_t stopped_us = drag.clock.now_us();
+    size_t interim = drag.sent.size();
+    while (drag.clock.now_us() - stopped_us < 300000 && drag.sent.size() == interim)
+    {
+        drag.frame(size);
+    }
+    EXPECT_EQ(drag.sent.size(), interim + 1);
+    EXPECT(drag.sent.back().size == size);
+    EXPECT(drag.sent.back().at_us - stopped_us >= ResizeControllerConfig().settle_us);
+    EXPECT(drag.sent.back().at_us - stopped_us < ResizeControllerConfig().settle_us + kFrameUs);
+    EXPECT(!drag.controller.settling());
+
+    const ResizeStats &stats = drag.controller.stats();
+    EXPECT_EQ(stats.size_changes, 60u);
+    EXPECT_EQ(stats.final_resizes, 1u);
+    EXPECT_EQ(stats.relayouts_saved, stats.size_changes - stats.interim_resizes - stats.final_resizes);
+}
+
+TEST(resize_density_change_goes_out_at_once)
+{
+    Drag drag;
+    drag.frame(ViewSize{800, 600, 1});
+    drag.frame(ViewSize{900, 600, 1});
+    EXPECT(drag.controller.settling());
+
+    // Moved to a Retina screen mid-drag: sent right away, exact
+    EXPECT(drag.frame(ViewSize{903, 600, 2}));
+    EXPECT(drag.controller.browser_size() == (ViewSize{903, 600, 2}));
+    EXPECT_EQ(drag.controller.stats().final_resizes, 1u);
+    EXPECT(!drag.controller.settling());
+}
+
+TEST(resize_place_frame)
+{
+    VirtualFrameClock clock;
+    ResizeController controller(clock);
+    controller.update(ViewSize{800, 600, 2});
+
+    // The frame matches the view
+    FramePlacement placement = controller.place_frame(1600, 1200, 2.0f);
+    EXPECT_EQ(placement.width, 800.0f);
+    EXPECT_EQ(placement.height, 600.0f);
+    EXPECT_EQ(placement.uv_u, 1.0f);
+    EXPECT_EQ(placement.uv_v, 1.0f);
+    EXPECT_EQ(controller.stats().scaled_frames, 0u);
+
+    // The view grew: the old frame at its own size, letterboxed
+    placement = controller.place_frame(1400, 1000, 2.0f);
+    EXPECT_EQ(placement.width, 700.0f);
+    EXPECT_EQ(placement.height, 500.0f);
+    EXPECT_EQ(placement.uv_u, 1.0f);
+    EXPECT_EQ(placement.uv_v, 1.0f);
+    EXPECT_EQ(controller.stats().scaled_frames, 1u);
+
+    // The view shrank: cropped to the part that fits
+    placement = controller.place_frame(1800, 1400, 2.0f);
+    EXPECT_EQ(placement.width, 800.0f);
+    EXPECT_EQ(placement.height, 600.0f);
+    EXPECT_EQ(placement.uv_u, 800.0f / 900.0f);
+    EXPECT_EQ(placement.uv_v, 600.0f / 700.0f);
+
+    // Painted at a lower scale: stretched over the view
+    placement = controller.place_frame(800, 600, 1.0f);
+    EXPECT_EQ(placement.width, 800.0f);
+    EXPECT_EQ(placement.height, 600.0f);
+    EXPECT_EQ(placement.uv_u, 1.0f);
+
+    // No frame yet: the whole view
+    placement = controller.place_frame(0, 0, 2.0f);
+    EXPECT_EQ(placement.width, 800.0f);
+    EXPECT_EQ(placement.uv_v, 1.0f);
+}
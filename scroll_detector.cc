@@ -0,0 +1,327 @@
+#include "scroll_detector.h"
+
+#include <cstdlib>
+#include <cstring>
+#include "tile_hash.h"
+
+namespace
+{
+
+// Fewer matching rows than this is noise, not a scroll
+constexpr int kMinVotes = 8;
+
+void add_span(DirtyRegion &region, bool rows, int start, int end, int width, int height)
+{
+    if (start >= end)
+        return;
+    region.add(rows ? PixelRect{0, start, width, end - start} : PixelRect{start, 0, end - start, height});
+}
+
+} // namespace
+
+PixelRect scroll_source_rect(int width, int height, const ScrollShift &shift)
+{
+    return intersect_rects(PixelRect{-shift.dx, -shift.dy, width, height}, PixelRect{0, 0, width, height});
+}
+
+void move_pixels(uint8_t *pixels, size_t stride, const PixelRect &source, const ScrollShift &shift)
+{
+    size_t row_bytes = static_cast<size_t>(source.width) * 4;
+    // Rows are copied away from the direction they move in, so no source row
+    // is overwritten before it was read; memmove handles the horizontal case.
+    for (int i = 0; i < source.height; ++i)
+    {
+        int y = shift.dy > 0 ? source.bottom() - 1 - i : source.y + i;
+        memmove(pixels + (y + shift.dy) * stride + static_cast<size_t>(source.x + shift.dx) * 4,
+                pixels + y * stride + static_cast<size_t>(source.x) * 4, row_bytes);
+    }
+}
+
+bool ScrollDetector::detect(const DirtyRegion &damage, const uint8_t *frame, int width, int height,
+                            ScrollShift &shift, DirtyRegion &remaining)
+{
+    m_new_signatures_valid = false;
+    if (!m_valid || width != m_width || height != m_height)
+        return false;
+
+    DirtyRegion dirty = damage;
+    dirty.clip(PixelRect{0, 0, width, height});
+    if (dirty.area() < kMinDamageFraction * width * height)
+        return false;
+
+    m_stats.checked++;
+    remaining.clear();
+    if (detect_rows(frame, shift, remaining))
+        return true;
+    remaining.clear();
+    return detect_columns(frame, shift, remaining);
+}
+
+bool ScrollDetector::dominant_offset(const std::vector<uint64_t> &before, const std::vector<uint64_t> &after, int &offset)
+{
+    int count = static_cast<int>(before.size());
+    m_unique.clear();
+    for (int i = 0; i < count; ++i)
+    {
+        auto inserted = m_unique.emplace(before[i], i);
+        if (!inserted.second)
+            inserted.first->second = -1;
+    }
+
+    // Blank rows repeat and say nothing about where they came from, only
+    // unique ones vote.
+    m_votes.assign(2 * count + 1, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        auto it = m_unique.find(after[i]);
+        if (it != m_unique.end() && it->second >= 0)
+        {
+            m_votes[i - it->second + count]++;
+        }
+    }
+
+    int best = 0;
+    for (int i = 0; i < 2 * count + 1; ++i)
+    {
+        if (i != count && m_votes[i] > m_votes[best + count])
+            best = i - count;
+    }
+    if (best == 0 || m_votes[best + count] < kMinVotes)
+        return false;
+    offset = best;
+    return true;
+}
+
+bool ScrollDetector::detect_rows(const uint8_t *frame, ScrollShift &shift, DirtyRegion &remaining)
+{
+    row_signatures(frame, m_new_signatures);
+    m_new_signatures_valid = true;
+    if (m_rows_stale)
+    {
+        row_signatures(m_pixels.data(), m_row_signatures);
+        m_rows_stale = false;
+    }
+
+    int dy = 0;
+    if (!dominant_offset(m_row_signatures, m_new_signatures, dy))
+        return false;
+    m_stats.detected++;
+
+    // A row can stay where the shift puts it if it is byte for byte the row
+    // it was |dy| rows earlier; everything else is uploaded.
+    const size_t stride = static_cast<size_t>(m_width) * 4;
+    int first = dy > 0 ? dy : 0;
+    int last = dy > 0 ? m_height : m_height + dy;
+    int matched = 0;
+    int run_start = 0;
+    for (int y = first; y < last; ++y)
+    {
+        bool same = m_new_signatures[y] == m_row_signatures[y - dy] &&
+                    memcmp(frame + y * stride, m_pixels.data() + (y - dy) * stride, stride) == 0;
+        if (same)
+        {
+            add_span(remaining, true, run_start, y, m_width, m_height);
+            run_start = y + 1;
+            matched++;
+        }
+    }
+    add_span(remaining, true, run_start, m_height, m_width, m_height);
+
+    if (matched < kMinMatchedFraction * m_height)
+    {
+        m_stats.rejected++;
+        return false;
+    }
+    shift = ScrollShift{0, dy};
+    return true;
+}
+
+bool ScrollDetector::detect_columns(const uint8_t *frame, ScrollShift &shift, DirtyRegion &remaining)
+{
+    column_signatures(m_pixels.data(), m_old_columns);
+    column_signatures(frame, m_new_columns);
+
+    int dx = 0;
+    if (!dominant_offset(m_old_columns, m_new_columns, dx))
+        return false;
+    m_stats.detected++;
+
+    // Runs of columns with matching signatures are checked row by row; a run
+    // with any difference is uploaded as a whole.
+    const size_t stride = static_cast<size_t>(m_width) * 4;
+    int first = dx > 0 ? dx : 0;
+    int last = dx > 0 ? m_width : m_width + dx;
+    int matched = 0;
+    int uploaded_from = 0;
+    for (int x = first; x < last;)
+    {
+        if (m_new_columns[x] != m_old_columns[x - dx])
+        {
+            ++x;
+            continue;
+        }
+        int end = x + 1;
+        while (end < last && m_new_columns[end] == m_old_columns[end - dx])
+            ++end;
+
+        size_t run_bytes = static_cast<size_t>(end - x) * 4;
+        bool same = true;
+        for (int y = 0; y < m_height && same; ++y)
+        {
+            same = memcmp(frame + y * stride + static_cast<size_t>(x) * 4,
+                          m_pixels.data() + y * stride + static_cast<size_t>(x - dx) * 4, run_bytes) == 0;
+        }
+        if (same)
+        {
+            add_span(remaining, false, uploaded_from, x, m_width, m_height);
+            uploaded_from = end;
+            matched += end - x;
+        }
+        x = end;
+    }
+    add_span(remaining, false, uploaded_from, m_width, m_width, m_height);
+
+    if (matched < kMinMatchedFraction * m_width)
+    {
+        m_stats.rejected++;
+        return false;
+    }
+    shift = ScrollShift{dx, 0};
+    return true;
+}
+
+void ScrollDetector::apply_shift(const ScrollShift &shift)
+{
+    PixelRect source = scroll_source_rect(m_width, m_height, shift);
+    move_pixels(m_pixels.data(), static_cast<size_t>(m_width) * 4, source, shift);
+
+    // Every row signature changed or moved; update() takes over the ones
+    // detect() computed for the new frame.
+    m_rows_stale = true;
+
+    m_shifted = true;
+    m_stats.shifted++;
+    m_stats.moved_bytes += source.area() * 4;
+}
+
+void ScrollDetector::reset()
+{
+    m_valid = false;
+    m_shifted = false;
+    m_new_signatures_valid = false;
+}
+
+size_t ScrollDetector::memory_bytes() const
+{
+    size_t bytes = m_pixels.capacity();
+    for (const std::vector<uint64_t> *signatures : {&m_row_signatures, &m_new_signatures, &m_old_columns, &m_new_columns})
+    {
+        bytes += signatures->capacity() * sizeof(uint64_t);
+    }
+    bytes += m_votes.capacity() * sizeof(int);
+    bytes += (m_column_a.capacity() + m_column_b.capacity()) * sizeof(uint32_t);
+    // Roughly: a node per entry and a pointer per bucket
+    bytes += m_unique.size() * (sizeof(uint64_t) + sizeof(int) + sizeof(void *)) +
+             m_unique.bucket_count() * sizeof(void *);
+    return bytes;
+}
+
+void ScrollDetector::update(const DirtyRegion &region, const uint8_t *frame, int width, int height)
+{
+    const PixelRect bounds{0, 0, width, height};
+    DirtyRegion clipped = region;
+    clipped.clip(bounds);
+    bool resized = width != m_width || height != m_height;
+    if (resized)
+    {
+        m_width = width;
+        m_height = height;
+        m_pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+        m_row_signatures.assign(height, 0);
+    }
+    if (resized || !m_valid)
+    {
+        // Only a full upload makes the copy whole again
+        m_valid = clipped.area() == bounds.area();
+        m_rows_stale = true;
+        if (!m_valid)
+        {
+            m_new_signatures_valid = false;
+            return;
+        }
+    }
+    if (m_shifted)
+    {
+        m_stats.patched_bytes += clipped.area() * 4;
+        m_shifted = false;
+    }
+
+    const size_t stride = static_cast<size_t>(width) * 4;
+    for (const PixelRect &rect : clipped.rects())
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            memcpy(m_pixels.data() + y * stride + static_cast<size_t>(rect.x) * 4,
+                   frame + y * stride + static_cast<size_t>(rect.x) * 4, row_bytes);
+        }
+    }
+
+    if (m_new_signatures_valid)
+    {
+        // detect() hashed every row of this frame, which m_pixels now is
+        m_row_signatures.swap(m_new_signatures);
+        m_rows_stale = false;
+        m_new_signatures_valid = false;
+    }
+    else if (!m_rows_stale)
+    {
+        const HashRowFn fn = hash_row();
+        for (const PixelRect &rect : clipped.rects())
+        {
+            for (int y = rect.y; y < rect.bottom(); ++y)
+            {
+                m_row_signatures[y] = hash_rect(m_pixels.data(), stride, PixelRect{0, y, width, 1}, fn);
+            }
+        }
+    }
+}
+
+void ScrollDetector::row_signatures(const uint8_t *pixels, std::vector<uint64_t> &signatures) const
+{
+    const size_t stride = static_cast<size_t>(m_width) * 4;
+    const HashRowFn fn = hash_row();
+    signatures.resize(m_height);
+    for (int y = 0; y < m_height; ++y)
+    {
+        signatures[y] = hash_rect(pixels, stride, PixelRect{0, y, m_width, 1}, fn);
+    }
+}
+
+void ScrollDetector::column_signatures(const uint8_t *pixels, std::vector<uint64_t> &signatures)
+{
+    // Two 32 bit hashes per column, fed a row at a time so the inner loop
+    // runs along memory and vectorizes.
+    m_column_a.assign(m_width, 0x811c9dc5u);
+    m_column_b.assign(m_width, 0x9747b28cu);
+    uint32_t *a = m_column_a.data();
+    uint32_t *b = m_column_b.data();
+    for (int y = 0; y < m_height; ++y)
+    {
+        const uint8_t *row = pixels + static_cast<size_t>(y) * m_width * 4;
+        for (int x = 0; x < m_width; ++x)
+        {
+            uint32_t pixel;
+            memcpy(&pixel, row + x * 4, sizeof(pixel));
+            a[x] = (a[x] ^ pixel) * 0x01000193u;
+            uint32_t mixed = (b[x] + pixel) * 0x85ebca6bu;
+            b[x] = mixed ^ (mixed >> 13);
+        }
+    }
+
+    signatures.resize(m_width);
+    for (int x = 0; x < m_width; ++x)
+    {
+        signatures[x] = (static_cast<uint64_t>(a[x]) << 32) | b[x];
+    }
+}
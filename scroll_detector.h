@@ -0,0 +1,107 @@
+#ifndef SCROLL_DETECTOR_H
+#define SCROLL_DETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "dirty_region.h"
+
+// The content of a frame moved by |dx|, |dy| pixels: what was at (x, y) is
+// now at (x + dx, y + dy). One of them is always 0.
+struct ScrollShift
+{
+    int dx = 0;
+    int dy = 0;
+};
+
+// The part of a |width| x |height| frame that is still on it after |shift|,
+// where it was before the shift.
+PixelRect scroll_source_rect(int width, int height, const ScrollShift &shift);
+
+// Moves |source| of a BGRA image by |shift|; source and destination may
+// overlap.
+void move_pixels(uint8_t *pixels, size_t stride, const PixelRect &source, const ScrollShift &shift);
+
+struct ScrollDetectorStats
+{
+    uint64_t checked = 0;   // frames damaged enough to look for a shift
+    uint64_t detected = 0;  // a dominant offset was found
+    uint64_t rejected = 0;  // ... but too little of the frame actually matched
+    uint64_t shifted = 0;   // the surface was moved instead of re-uploaded
+    uint64_t moved_bytes = 0;   // pixels moved on the surface
+    uint64_t patched_bytes = 0; // exposed and changed pixels uploaded on shifted frames
+};
+
+// Finds scrolls in the view's paints. CEF reports a scrolled frame as
+// (almost) fully dirty although most of it is the previous frame moved up or
+// down; when that is the case the surface can be moved in place and only the
+// newly exposed strip and the rows that really changed (fixed headers, a
+// caret) uploaded.
+//
+// It keeps a CPU copy of what the surface holds. Candidate offsets come from
+// votes of matching row (or column) signatures; every row that is then
+// claimed to have moved is compared byte for byte against that copy, so a
+// frame is never patched from pixels that don't match.
+class ScrollDetector
+{
+public:
+    // Frames with less damage than this fraction aren't looked at
+    static constexpr double kMinDamageFraction = 0.5;
+    // A shift must leave at least this fraction of the frame in place
+    static constexpr double kMinMatchedFraction = 0.5;
+
+    // The surface's contents are unknown, e.g. it was recreated.
+    void reset();
+
+    // Looks for a shift that turns the surface into |frame| (|width| * 4
+    // bytes per row), which has |damage| since the last update(). On
+    // success |remaining| is what has to be uploaded after moving the
+    // surface by |shift|.
+    bool detect(const DirtyRegion &damage, const uint8_t *frame, int width, int height,
+                ScrollShift &shift, DirtyRegion &remaining);
+
+    // The surface was moved by |shift| (as found by detect()).
+    void apply_shift(const ScrollShift &shift);
+    // |region| of |frame| was uploaded to the surface.
+    void update(const DirtyRegion &region, const uint8_t *frame, int width, int height);
+
+    const ScrollDetectorStats &stats() const { return m_stats; }
+    void reset_stats() { m_stats = ScrollDetectorStats(); }
+
+    // Bytes held by the surface copy, signatures and scratch.
+    size_t memory_bytes() const;
+
+private:
+    void row_signatures(const uint8_t *pixels, std::vector<uint64_t> &signatures) const;
+    // |offset| with the most votes of rows in |after| matching a unique row
+    // in |before| |offset| rows earlier; false if there is no clear one.
+    bool dominant_offset(const std::vector<uint64_t> &before, const std::vector<uint64_t> &after, int &offset);
+    void column_signatures(const uint8_t *pixels, std::vector<uint64_t> &signatures);
+    bool detect_rows(const uint8_t *frame, ScrollShift &shift, DirtyRegion &remaining);
+    bool detect_columns(const uint8_t *frame, ScrollShift &shift, DirtyRegion &remaining);
+
+    int m_width = 0;
+    int m_height = 0;
+    bool m_valid = false;
+    std::vector<uint8_t> m_pixels;           // what the surface holds
+    std::vector<uint64_t> m_row_signatures;  // of m_pixels
+    bool m_rows_stale = false;               // all of them need rehashing
+    // Rows of the frame detect() last looked at; update() takes them over
+    // instead of hashing the same rows again.
+    std::vector<uint64_t> m_new_signatures;
+    bool m_new_signatures_valid = false;
+    bool m_shifted = false; // the next update() patches a shifted frame
+
+    // Scratch
+    std::vector<uint64_t> m_old_columns;
+    std::vector<uint64_t> m_new_columns;
+    std::vector<int> m_votes;
+    std::unordered_map<uint64_t, int> m_unique; // signature -> index, -1 if repeated
+    std::vector<uint32_t> m_column_a;
+    std::vector<uint32_t> m_column_b;
+
+    ScrollDetectorStats m_stats;
+};
+
+#endif // SCROLL_DETECTOR_H
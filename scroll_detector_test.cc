@@ -0,0 +1,309 @@
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "scroll_detector.h"
+#include "unit_test.h"
+
+// ScrollDetector on synthetic frames: a page whose rows and columns are all
+// different, seen through a view that moves over it.
+
+namespace
+{
+
+const int kWidth = 96;
+const int kHeight = 80;
+
+uint32_t page_pixel(int x, int y)
+{
+    uint64_t z = static_cast<uint64_t>(x) * 0x9e3779b97f4a7c15ull + static_cast<uint64_t>(y) * 0xc2b2ae3d27d4eb4full;
+    z = (z ^ (z >> 31)) * 0xbf58476d1ce4e5b9ull;
+    return static_cast<uint32_t>(z >> 32) | 0xff000000u;
+}
+
+// The view with the page scrolled to |left|, |top|
+std::vector<uint8_t> view_at(int left, int top)
+{
+    std::vector<uint8_t> frame(static_cast<size_t>(kWidth) * kHeight * 4);
+    for (int y = 0; y < kHeight; ++y)
+    {
+        for (int x = 0; x < kWidth; ++x)
+        {
+            uint32_t pixel = page_pixel(left + x, top + y);
+            memcpy(&frame[(static_cast<size_t>(y) * kWidth + x) * 4], &pixel, 4);
+        }
+    }
+    return frame;
+}
+
+void fill_row(std::vector<uint8_t> &frame, int y, uint32_t pixel)
+{
+    for (int x = 0; x < kWidth; ++x)
+    {
+        memcpy(&frame[(static_cast<size_t>(y) * kWidth + x) * 4], &pixel, 4);
+    }
+}
+
+DirtyRegion whole()
+{
+    DirtyRegion region;
+    region.add(PixelRect{0, 0, kWidth, kHeight});
+    return region;
+}
+
+// What the backend does with a detected shift: the surface is moved and
+// |remaining| of |frame| uploaded on top.
+void patch(std::vector<uint8_t> &surface, const ScrollShift &shift, const DirtyRegion &remaining,
+           const std::vector<uint8_t> &frame)
+{
+    const size_t stride = static_cast<size_t>(kWidth) * 4;
+    move_pixels(surface.data(), stride, scroll_source_rect(kWidth, kHeight, shift), shift);
+    for (const PixelRect &rect : remaining.rects())
+    {
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            size_t offset = y * stride + static_cast<size_t>(rect.x) * 4;
+            memcpy(surface.data() + offset, frame.data() + offset, static_cast<size_t>(rect.width) * 4);
+        }
+    }
+}
+
+// A view of the page, its surface and the detector that watches them
+struct View
+{
+    ScrollDetector detector;
+    std::vector<uint8_t> surface;
+
+    explicit View(const std::vector<uint8_t> &first)
+        : surface(first)
+    {
+        detector.update(whole(), first.data(), kWidth, kHeight);
+    }
+
+    // Shows |frame| as MyApp does: moved and patched if a shift is found,
+    // uploaded in full otherwise. Returns whether it was a shift.
+    bool show(const std::vector<uint8_t> &frame, ScrollShift &shift, DirtyRegion &remaining)
+    {
+        if (detector.detect(whole(), frame.data(), kWidth, kHeight, shift, remaining))
+        {
+            patch(surface, shift, remaining, frame);
+            detector.apply_shift(shift);
+            detector.update(remaining, frame.data(), kWidth, kHeight);
+            return true;
+        }
+        surface = frame;
+        detector.update(whole(), frame.data(), kWidth, kHeight);
+        return false;
+    }
+};
+
+} // namespace
+
+TEST(scroll_detects_vertical_shifts)
+{
+    for (int dy : {1, -1, 7, -7, 33, -33})
+    {
+        View view(view_at(0, 100));
+        std::vector<uint8_t> frame = view_at(0, 100 - dy);
+        ScrollShift shift;
+        DirtyRegion remaining;
+        EXPECT(view.show(frame, shift, remaining));
+        EXPECT_EQ(shift.dx, 0);
+        EXPECT_EQ(shift.dy, dy);
+
+        // Only the strip the scroll exposed is left to upload
+        EXPECT_EQ(remaining.area(), static_cast<int64_t>(std::abs(dy)) * kWidth);
+        EXPECT(remaining.bounds().y == (dy > 0 ? 0 : kHeight + dy));
+        EXPECT(view.surface == frame);
+    }
+}
+
+TEST(scroll_detects_horizontal_shifts)
+{
+    for (int dx : {3, -3, 40, -40})
+    {
+        View view(view_at(200, 0));
+        std::vector<uint8_t> frame = view_at(200 - dx, 0);
+        ScrollShift shift;
+        DirtyRegion remaining;
+        EXPECT(view.show(frame, shift, remaining));
+        EXPECT_EQ(shift.dx, dx);
+        EXPECT_EQ(shift.dy, 0);
+        EXPECT_EQ(remaining.area(), static_cast<int64_t>(std::abs(dx)) * kHeight);
+        EXPECT(remaining.bounds().x == (dx > 0 ? 0 : kWidth + dx));
+        EXPECT(view.surface == frame);
+    }
+}
+
+TEST(scroll_ignores_small_damage)
+{
+    View view(view_at(0, 0));
+    std::vector<uint8_t> frame = view_at(0, 10);
+    DirtyRegion damage;
+    damage.add(PixelRect{0, 0, kWidth, kHeight / 2 - 1});
+    ScrollShift shift;
+    DirtyRegion remaining;
+    EXPECT(!view.detector.detect(damage, frame.data(), kWidth, kHeight, shift, remaining));
+    EXPECT_EQ(view.detector.stats().checked, 0u);
+
+    // Half the frame is enough to look
+    damage.add(PixelRect{0, 0, kWidth, kHeight / 2});
+    EXPECT(view.detector.detect(damage, frame.data(), kWidth, kHeight, shift, remaining));
+    EXPECT_EQ(view.detector.stats().checked, 1u);
+}
+
+TEST(scroll_only_unique_rows_vote)
+{
+    // A blank page with a few lines of text: the blank rows match each other
+    // at every offset and mustn't count, so it takes eight text rows.
+    auto page = [](int lines, int top)
+    {
+        std::vector<uint8_t> frame(static_cast<size_t>(kWidth) * kHeight * 4, 0xff);
+        for (int line = 0; line < lines; ++line)
+        {
+            int y = 30 + line - top;
+            if (y >= 0 && y < kHeight)
+                fill_row(frame, y, page_pixel(line, 0));
+        }
+        return frame;
+    };
+
+    for (int lines : {7, 8})
+    {
+        View view(page(lines, 0));
+        ScrollShift shift;
+        DirtyRegion remaining;
+        bool shifted = view.show(page(lines, 5), shift, remaining);
+        EXPECT_EQ(shifted, lines >= 8);
+        EXPECT_EQ(view.detector.stats().detected, lines >= 8 ? 1u : 0u);
+        if (shifted)
+        {
+            EXPECT_EQ(shift.dy, -5);
+            // The blank rows that landed on blank rows stay
+            EXPECT(remaining.area() < kWidth * kHeight / 2);
+        }
+        EXPECT(view.surface == page(lines, 5));
+    }
+}
+
+TEST(scroll_rejects_a_poor_match)
+{
+    // Scrolled, but then most of it repainted: the offset is clear, yet too
+    // few rows are where it says, so the frame is uploaded in full.
+    View view(view_at(0, 0));
+    std::vector<uint8_t> frame = view_at(0, 4);
+    for (int y = 20; y < kHeight; ++y)
+    {
+        fill_row(frame, y, 0xff000000u | static_cast<uint32_t>(y));
+    }
+    ScrollShift shift;
+    DirtyRegion remaining;
+    EXPECT(!view.show(frame, shift, remaining));
+    EXPECT_EQ(view.detector.stats().detected, 1u);
+    EXPECT_EQ(view.detector.stats().rejected, 1u);
+    EXPECT_EQ(view.detector.stats().shifted, 0u);
+
+    // Nothing it looked at is kept: the next scroll starts from the upload
+    std::vector<uint8_t> next = frame;
+    memmove(next.data(), next.data() + 6 * kWidth * 4, static_cast<size_t>(kHeight - 6) * kWidth * 4);
+    for (int y = kHeight - 6; y < kHeight; ++y)
+    {
+        fill_row(next, y, page_pixel(y, 1000));
+    }
+    EXPECT(view.show(next, shift, remaining));
+    EXPECT_EQ(shift.dy, -6);
+    EXPECT(view.surface == next);
+}
+
+TEST(scroll_patches_changes_next_to_the_shift)
+{
+    // A fixed header and a blinking caret over content scrolling underneath
+    auto decorate = [](std::vector<uint8_t> frame, bool caret)
+    {
+        for (int y = 0; y < 6; ++y)
+        {
+            fill_row(frame, y, 0xff203040u + y);
+        }
+        if (caret)
+            memset(&frame[(static_cast<size_t>(50) * kWidth + 10) * 4], 0, 4);
+        return frame;
+    };
+
+    View view(decorate(view_at(0, 0), false));
+    std::vector<uint8_t> frame = decorate(view_at(0, 9), true);
+    ScrollShift shift;
+    DirtyRegion remaining;
+    EXPECT(view.show(frame, shift, remaining));
+    EXPECT_EQ(shift.dy, -9);
+
+    // The header, the caret's row and the exposed strip are uploaded; the
+    // rest stays where the shift puts it
+    int64_t expected_rows = 6 + 1 + 9;
+    EXPECT_EQ(remaining.area(), expected_rows * kWidth);
+    EXPECT(view.surface == frame);
+    EXPECT_EQ(view.detector.stats().shifted, 1u);
+    EXPECT_EQ(view.detector.stats().patched_bytes, static_cast<uint64_t>(expected_rows) * kWidth * 4);
+}
+
+TEST(scroll_signatures_follow_the_shift)
+{
+    // Scrolls in a row, with small paints between them that skip detect():
+    // the row signatures carried over from apply_shift() and update() have
+    // to describe what the surface holds each time.
+    View view(view_at(0, 0));
+    int top = 0;
+    const int steps[] = {-5, -5, 12, -30, 3, 3};
+    for (int dy : steps)
+    {
+        top -= dy;
+        std::vector<uint8_t> frame = view_at(0, top);
+        ScrollShift shift;
+        DirtyRegion remaining;
+        EXPECT(view.show(frame, shift, remaining));
+        EXPECT_EQ(shift.dy, dy);
+        EXPECT(view.surface == frame);
+
+        // A caret blink: too small to look for a shift, uploaded as is
+        std::vector<uint8_t> blink = frame;
+        memset(&blink[(static_cast<size_t>(40) * kWidth + 20) * 4], 0, 4);
+        DirtyRegion caret;
+        caret.add(PixelRect{20, 40, 1, 1});
+        EXPECT(!view.detector.detect(caret, blink.data(), kWidth, kHeight, shift, remaining));
+        view.detector.update(caret, blink.data(), kWidth, kHeight);
+        view.detector.update(caret, frame.data(), kWidth, kHeight);
+    }
+    EXPECT_EQ(view.detector.stats().shifted, 6u);
+
+    // The detector ends up where one that saw only the last frame would be
+    ScrollDetector fresh;
+    std::vector<uint8_t> last = view_at(0, top);
+    fresh.update(whole(), last.data(), kWidth, kHeight);
+    std::vector<uint8_t> next = view_at(0, top + 17);
+    ScrollShift carried;
+    ScrollShift expected;
+    DirtyRegion carried_remaining;
+    DirtyRegion expected_remaining;
+    EXPECT(view.detector.detect(whole(), next.data(), kWidth, kHeight, carried, carried_remaining));
+    EXPECT(fresh.detect(whole(), next.data(), kWidth, kHeight, expected, expected_remaining));
+    EXPECT_EQ(carried.dy, expected.dy);
+    EXPECT(carried_remaining.rects() == expected_remaining.rects());
+}
+
+TEST(scroll_needs_a_whole_frame_first)
+{
+    ScrollDetector detector;
+    std::vector<uint8_t> first = view_at(0, 0);
+    DirtyRegion part;
+    part.add(PixelRect{0, 0, kWidth, kHeight - 1});
+    detector.update(part, first.data(), kWidth, kHeight);
+    std::vector<uint8_t> frame = view_at(0, 3);
+    ScrollShift shift;
+    DirtyRegion remaining;
+    EXPECT(!detector.detect(whole(), frame.data(), kWidth, kHeight, shift, remaining));
+
+    // And again after reset()
+    detector.update(whole(), frame.data(), kWidth, kHeight);
+    detector.reset();
+    std::vector<uint8_t> next = view_at(0, 6);
+    EXPECT(!detector.detect(whole(), next.data(), kWidth, kHeight, shift, remaining));
+    EXPECT_EQ(detector.stats().checked, 0u);
+}
@@ -0,0 +1,101 @@
+#include "surface_pool.h"
+
+#include <algorithm>
+
+SurfacePool::SurfacePool(SurfaceAllocator &allocator, const SurfacePoolConfig &config)
+    : m_allocator(allocator), m_config(config)
+{
+    m_config.granularity = std::max<uint32_t>(1, m_config.granularity);
+}
+
+SurfacePool::~SurfacePool()
+{
+    // Leases still out are their owner's to release.
+    for (const IdleEntry &entry : m_idle)
+    {
+        m_allocator.release(entry.lease.allocation, entry.lease.key);
+    }
+}
+
+SurfaceKey SurfacePool::bucket(uint32_t format, uint32_t width, uint32_t height) const
+{
+    auto round_up = [this](uint32_t value)
+    {
+        uint32_t step = m_config.granularity;
+        return (value + step - 1) / step * step;
+    };
+
+    SurfaceKey key;
+    key.format = format;
+    key.width = round_up(width);
+    key.height = round_up(height);
+    return key;
+}
+
+SurfacePool::Lease SurfacePool::acquire(uint32_t format, uint32_t width, uint32_t height)
+{
+    SurfaceKey key = bucket(format, width, height);
+
+    // Most recently used first, it is the most likely to still be resident
+    auto best = m_idle.end();
+    for (auto it = m_idle.begin(); it != m_idle.end(); ++it)
+    {
+        if (it->lease.key == key && (best == m_idle.end() || it->last_used > best->last_used))
+            best = it;
+    }
+
+    Lease lease;
+    if (best != m_idle.end())
+    {
+        lease = best->lease;
+        m_idle.erase(best);
+        m_stats.hits++;
+        m_stats.idle_bytes -= key.bytes();
+        m_stats.idle_surfaces--;
+    }
+    else
+    {
+        m_stats.misses++;
+        // Make room first so the peak stays under budget where possible
+        trim(m_config.budget_bytes > key.bytes() ? m_config.budget_bytes - key.bytes() : 0);
+        lease.key = key;
+        lease.allocation = m_allocator.allocate(key);
+        if (!lease.allocation)
+            return lease;
+    }
+
+    m_stats.in_use_bytes += key.bytes();
+    return lease;
+}
+
+void SurfacePool::recycle(const Lease &lease)
+{
+    if (!lease.allocation)
+        return;
+
+    m_stats.in_use_bytes -= std::min(m_stats.in_use_bytes, lease.key.bytes());
+    m_idle.push_back(IdleEntry{lease, ++m_clock});
+    m_stats.idle_bytes += lease.key.bytes();
+    m_stats.idle_surfaces++;
+    trim(m_config.budget_bytes);
+}
+
+void SurfacePool::trim(size_t budget_bytes)
+{
+    while (!m_idle.empty() && m_stats.in_use_bytes + m_stats.idle_bytes > budget_bytes)
+    {
+        auto oldest = std::min_element(m_idle.begin(), m_idle.end(), [](const IdleEntry &a, const IdleEntry &b)
+                                       { return a.last_used < b.last_used; });
+        m_allocator.release(oldest->lease.allocation, oldest->lease.key);
+        m_stats.idle_bytes -= oldest->lease.key.bytes();
+        m_stats.idle_surfaces--;
+        m_stats.evictions++;
+        m_idle.erase(oldest);
+    }
+}
+
+void SurfacePool::set_budget(size_t budget_bytes)
+{
+    m_config.budget_bytes = budget_bytes;
+    trim(budget_bytes);
+}
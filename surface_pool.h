@@ -0,0 +1,99 @@
+#ifndef SURFACE_POOL_H
+#define SURFACE_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Size class of a pooled surface. All formats are 4 bytes per pixel; the
+// format only tells apart allocations that can't stand in for each other
+// (on Metal, sampled textures vs render targets).
+struct SurfaceKey
+{
+    uint32_t format = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    size_t bytes() const { return static_cast<size_t>(width) * height * 4; }
+    bool operator==(const SurfaceKey &other) const
+    {
+        return format == other.format && width == other.width && height == other.height;
+    }
+};
+
+// Where the pool gets its memory from; a backend's textures or buffers.
+class SurfaceAllocator
+{
+public:
+    virtual ~SurfaceAllocator() = default;
+    virtual void *allocate(const SurfaceKey &key) = 0;
+    virtual void release(void *allocation, const SurfaceKey &key) = 0;
+};
+
+struct SurfacePoolConfig
+{
+    // Sizes are rounded up to a multiple of this, so a drag resize only
+    // allocates when it crosses a step.
+    uint32_t granularity = 128;
+    // Allocations in use plus idle ones kept for reuse. Idle allocations
+    // are evicted, least recently used first, to stay under it; in-use ones
+    // are never taken away, so the pool can be over budget while they are.
+    size_t budget_bytes = 256u << 20;
+};
+
+struct SurfacePoolStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t in_use_bytes = 0;
+    size_t idle_bytes = 0;
+    size_t idle_surfaces = 0;
+};
+
+// Reuses surface allocations across destroy/create instead of freeing and
+// allocating one at every size change. Not thread safe.
+class SurfacePool
+{
+public:
+    struct Lease
+    {
+        void *allocation = nullptr;
+        SurfaceKey key; // the bucketed size, at least what was asked for
+    };
+
+    explicit SurfacePool(SurfaceAllocator &allocator, const SurfacePoolConfig &config = SurfacePoolConfig());
+    ~SurfacePool();
+
+    SurfacePool(const SurfacePool &) = delete;
+    SurfacePool &operator=(const SurfacePool &) = delete;
+
+    // An allocation of at least |width| x |height|, or one with a null
+    // allocation if the allocator failed.
+    Lease acquire(uint32_t format, uint32_t width, uint32_t height);
+    // Gives a lease back for reuse, evicting idle allocations over budget.
+    void recycle(const Lease &lease);
+
+    // Releases idle allocations until in-use plus idle bytes fit |budget_bytes|.
+    void trim(size_t budget_bytes);
+    void set_budget(size_t budget_bytes);
+
+    SurfaceKey bucket(uint32_t format, uint32_t width, uint32_t height) const;
+    const SurfacePoolConfig &config() const { return m_config; }
+    const SurfacePoolStats &stats() const { return m_stats; }
+
+private:
+    struct IdleEntry
+    {
+        Lease lease;
+        uint64_t last_used;
+    };
+
+    SurfaceAllocator &m_allocator;
+    SurfacePoolConfig m_config;
+    std::vector<IdleEntry> m_idle;
+    uint64_t m_clock = 0;
+    SurfacePoolStats m_stats;
+};
+
+#endif // SURFACE_POOL_H
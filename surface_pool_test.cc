@@ -0,0 +1,210 @@
+#include <cstdint>
+#include <vector>
+#include "cpu_render_backend.h"
+#include "surface_pool.h"
+#include "unit_test.h"
+
+namespace
+{
+
+const size_t kBucketBytes = 128 * 128 * 4;
+
+// Hands out fake addresses and remembers what it was asked for.
+struct FakeAllocator : SurfaceAllocator
+{
+    std::vector<void *> live;
+    std::vector<void *> released;
+    uintptr_t next = 0x1000;
+    int allocations = 0;
+    bool fail = false;
+
+    void *allocate(const SurfaceKey &) override
+    {
+        if (fail)
+            return nullptr;
+        allocations++;
+        void *allocation = reinterpret_cast<void *>(next);
+        next += 0x1000;
+        live.push_back(allocation);
+        return allocation;
+    }
+
+    void release(void *allocation, const SurfaceKey &) override
+    {
+        released.push_back(allocation);
+        std::erase(live, allocation);
+    }
+};
+
+} // namespace
+
+TEST(pool_bucket_reuse)
+{
+    FakeAllocator allocator;
+    SurfacePool pool(allocator);
+    SurfaceKey key = pool.bucket(0, 100, 129);
+    EXPECT_EQ(key.width, 128u);
+    EXPECT_EQ(key.height, 256u);
+
+    SurfacePool::Lease first = pool.acquire(0, 100, 100);
+    EXPECT(first.allocation != nullptr);
+    EXPECT_EQ(first.key.width, 128u);
+    EXPECT_EQ(pool.stats().in_use_bytes, kBucketBytes);
+    pool.recycle(first);
+    EXPECT_EQ(pool.stats().in_use_bytes, 0u);
+    EXPECT_EQ(pool.stats().idle_surfaces, 1u);
+
+    // Anything in the same bucket gets the same allocation back
+    SurfacePool::Lease second = pool.acquire(0, 128, 1);
+    EXPECT(second.allocation == first.allocation);
+    EXPECT_EQ(pool.stats().hits, 1u);
+    EXPECT_EQ(pool.stats().idle_surfaces, 0u);
+
+    // Another size or format doesn't
+    SurfacePool::Lease bigger = pool.acquire(0, 129, 100);
+    SurfacePool::Lease target = pool.acquire(1, 100, 100);
+    EXPECT(bigger.allocation != first.allocation && target.allocation != first.allocation);
+    EXPECT_EQ(pool.stats().misses, 3u);
+    EXPECT_EQ(allocator.allocations, 3);
+
+    pool.recycle(second);
+    pool.recycle(bigger);
+    pool.recycle(target);
+}
+
+TEST(pool_evicts_least_recently_used)
+{
+    FakeAllocator allocator;
+    SurfacePoolConfig config;
+    config.budget_bytes = 3 * kBucketBytes;
+    SurfacePool pool(allocator, config);
+
+    SurfacePool::Lease a = pool.acquire(0, 100, 100);
+    SurfacePool::Lease b = pool.acquire(0, 100, 100);
+    SurfacePool::Lease c = pool.acquire(0, 100, 100);
+    pool.recycle(a);
+    pool.recycle(b);
+    pool.recycle(c);
+    EXPECT_EQ(pool.stats().idle_surfaces, 3u);
+    EXPECT_EQ(pool.stats().evictions, 0u);
+
+    // The most recent one is reused, so |a| and then |b| are the oldest
+    SurfacePool::Lease reused = pool.acquire(0, 100, 100);
+    EXPECT(reused.allocation == c.allocation);
+    pool.recycle(reused);
+
+    // Room for a two bucket surface is made before it is allocated
+    SurfacePool::Lease wide = pool.acquire(0, 256, 100);
+    EXPECT_EQ(pool.stats().evictions, 2u);
+    EXPECT_EQ(allocator.released.size(), 2u);
+    if (allocator.released.size() == 2)
+    {
+        EXPECT(allocator.released[0] == a.allocation);
+        EXPECT(allocator.released[1] == b.allocation);
+    }
+    EXPECT_EQ(pool.stats().in_use_bytes + pool.stats().idle_bytes, config.budget_bytes);
+
+    // In-use surfaces are never taken away, even over budget
+    SurfacePool::Lease extra = pool.acquire(0, 256, 256);
+    EXPECT_EQ(pool.stats().idle_surfaces, 0u);
+    EXPECT(pool.stats().in_use_bytes > config.budget_bytes);
+    EXPECT_EQ(allocator.live.size(), 2u);
+
+    // Returned over budget, they go right away, the oldest first
+    pool.recycle(wide);
+    EXPECT(allocator.released.back() == wide.allocation);
+    pool.recycle(extra);
+    EXPECT_EQ(pool.stats().idle_surfaces, 0u);
+    EXPECT(allocator.live.empty());
+}
+
+TEST(pool_trim_and_destruction_release_idle)
+{
+    FakeAllocator allocator;
+    {
+        SurfacePool pool(allocator);
+        SurfacePool::Lease kept = pool.acquire(0, 100, 100);
+        pool.recycle(pool.acquire(0, 300, 300));
+        pool.recycle(pool.acquire(0, 500, 500));
+        EXPECT_EQ(pool.stats().idle_surfaces, 2u);
+
+        pool.set_budget(0);
+        EXPECT_EQ(pool.stats().idle_surfaces, 0u);
+        EXPECT_EQ(pool.stats().idle_bytes, 0u);
+        EXPECT_EQ(allocator.live.size(), 1u);
+
+        pool.set_budget(256u << 20);
+        pool.recycle(kept);
+        EXPECT_EQ(allocator.live.size(), 1u);
+    }
+    EXPECT(allocator.live.empty());
+}
+
+TEST(pool_failed_allocation)
+{
+    FakeAllocator allocator;
+    SurfacePool pool(allocator);
+    allocator.fail = true;
+    SurfacePool::Lease lease = pool.acquire(0, 100, 100);
+    EXPECT(lease.allocation == nullptr);
+    EXPECT_EQ(pool.stats().in_use_bytes, 0u);
+    pool.recycle(lease);
+    EXPECT_EQ(pool.stats().idle_surfaces, 0u);
+}
+
+TEST(pool_drag_resize)
+{
+    // A window dragged 200 px wider recreates the view at every width; the
+    // pool only allocates when the width crosses a 128 px step, and the way
+    // back costs nothing.
+    FakeAllocator allocator;
+    SurfacePool pool(allocator);
+    SurfacePool::Lease view = pool.acquire(0, 800, 600);
+    for (uint32_t width = 801; width <= 1000; ++width)
+    {
+        pool.recycle(view);
+        view = pool.acquire(0, width, 600);
+    }
+    EXPECT_EQ(allocator.allocations, 2);
+    for (uint32_t width = 999; width >= 800; --width)
+    {
+        pool.recycle(view);
+        view = pool.acquire(0, width, 600);
+    }
+    EXPECT_EQ(allocator.allocations, 2);
+    EXPECT_EQ(pool.stats().misses, 2u);
+    EXPECT_EQ(pool.stats().evictions, 0u);
+    pool.recycle(view);
+}
+
+TEST(cpu_backend_reuses_pooled_surfaces)
+{
+    CpuRenderBackend backend;
+    SurfaceId first = backend.create_surface(100, 50, false);
+    const uint8_t *pixels = backend.surface(first)->pixels;
+    backend.destroy_surface(first);
+
+    // A slightly different size lands in the same bucket and reports its own
+    // size and the part of the allocation it covers
+    SurfaceId second = backend.create_surface(110, 60, false);
+    EXPECT(backend.surface(second)->pixels == pixels);
+    EXPECT_EQ(backend.surface_pool_stats()->hits, 1u);
+    uint32_t width = 0;
+    uint32_t height = 0;
+    EXPECT(backend.get_surface_size(second, width, height));
+    EXPECT_EQ(width, 110u);
+    EXPECT_EQ(height, 60u);
+    float u = 0.0f;
+    float v = 0.0f;
+    backend.surface_uv_extent(second, u, v);
+    EXPECT_EQ(u, 110.0f / 128.0f);
+    EXPECT_EQ(v, 60.0f / 128.0f);
+    EXPECT_EQ(backend.surface_bytes(second), kBucketBytes);
+
+    // A render target doesn't take a sampled surface's allocation
+    backend.destroy_surface(second);
+    SurfaceId target = backend.create_surface(110, 60, true);
+    EXPECT(backend.surface(target)->pixels != pixels);
+    backend.release_idle_memory();
+    EXPECT_EQ(backend.surface_pool_stats()->idle_surfaces, 0u);
+}
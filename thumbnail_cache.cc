@@ -0,0 +1,366 @@
+#include "thumbnail_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// Halvings until |width| x |height| fits into the thumbnail bounds.
+int levels_for(int width, int height, int max_width, int max_height)
+{
+    int levels = 0;
+    while (levels < 16 && ((width >> levels) > max_width || (height >> levels) > max_height))
+    {
+        levels++;
+    }
+    return levels;
+}
+
+} // namespace
+
+ThumbnailCache::ThumbnailCache(const ThumbnailCacheConfig &config)
+    : m_config(config)
+{
+    m_config.max_width = std::max(1, m_config.max_width);
+    m_config.max_height = std::max(1, m_config.max_height);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    stop();
+}
+
+void ThumbnailCache::start()
+{
+    if (active())
+        return;
+
+    m_stopping = false;
+    m_worker = std::thread([this]()
+                           { run_worker(); });
+}
+
+void ThumbnailCache::stop()
+{
+    if (!active())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    reset_source(m_source, 0);
+    reset_source(m_retired, 0);
+    m_source.pixels = std::vector<uint8_t>();
+    m_retired.pixels = std::vector<uint8_t>();
+    m_entries.clear();
+    m_rects = std::vector<PixelRect>();
+    m_block = std::vector<uint8_t>();
+    m_scaled = std::vector<uint8_t>();
+    m_scratch = std::vector<uint8_t>();
+    m_worker_bytes = 0;
+    m_stats.thumbnails = 0;
+    m_stats.thumbnail_bytes = 0;
+    m_stats.staging_bytes = 0;
+}
+
+void ThumbnailCache::reset_source(Source &source, int tab_id)
+{
+    source.tab_id = tab_id;
+    source.pending.clear();
+    source.complete = false;
+    source.due = false;
+}
+
+ThumbnailCache::Entry *ThumbnailCache::find(int tab_id)
+{
+    for (Entry &entry : m_entries)
+    {
+        if (entry.tab_id == tab_id)
+            return &entry;
+    }
+    return nullptr;
+}
+
+const ThumbnailCache::Entry *ThumbnailCache::find(int tab_id) const
+{
+    return const_cast<ThumbnailCache *>(this)->find(tab_id);
+}
+
+void ThumbnailCache::submit(int tab_id, const DirtyRegion &dirty, const void *buffer, size_t stride, int width,
+                            int height, int64_t time_us)
+{
+    if (!active() || width <= 0 || height <= 0)
+        return;
+
+    const PixelRect bounds{0, 0, width, height};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.paints++;
+
+    if (m_source.tab_id != tab_id)
+    {
+        // The frame is about to hold another tab; what the last one painted
+        // since its refresh is picked up from a copy.
+        if (m_source.complete && !m_source.pending.empty())
+        {
+            std::swap(m_source, m_retired);
+            m_retired.due = true;
+            m_retired.due_us = time_us;
+            m_wake.notify_one();
+        }
+        reset_source(m_source, tab_id);
+    }
+    if (width != m_source.width || height != m_source.height)
+    {
+        m_source.width = width;
+        m_source.height = height;
+        m_source.pixels.resize(static_cast<size_t>(width) * height * 4);
+        m_source.pending.clear();
+        m_source.complete = false;
+    }
+
+    DirtyRegion region = dirty;
+    region.clip(bounds);
+    if (region.empty())
+        return;
+    if (region.area() == bounds.area())
+        m_source.complete = true;
+
+    const uint8_t *source = static_cast<const uint8_t *>(buffer);
+    const size_t frame_stride = static_cast<size_t>(width) * 4;
+    for (const PixelRect &rect : region.rects())
+    {
+        for (int y = rect.y; y < rect.bottom(); ++y)
+        {
+            memcpy(m_source.pixels.data() + y * frame_stride + static_cast<size_t>(rect.x) * 4,
+                   source + y * stride + static_cast<size_t>(rect.x) * 4, static_cast<size_t>(rect.width) * 4);
+        }
+    }
+    m_source.pending.add(region);
+    update_staging_bytes();
+
+    bool was_due = m_source.due;
+    schedule(time_us);
+    if (was_due || !m_source.due)
+        m_stats.throttled++;
+}
+
+void ThumbnailCache::tick(int64_t time_us)
+{
+    if (!active())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    schedule(time_us);
+}
+
+bool ThumbnailCache::refresh_due(int tab_id, int64_t time_us) const
+{
+    if (!active())
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Entry *entry = find(tab_id);
+    return !entry || time_us - entry->refreshed_us >= m_config.min_interval_us;
+}
+
+void ThumbnailCache::schedule(int64_t time_us)
+{
+    if (m_source.due || !m_source.complete || m_source.pending.empty())
+        return;
+
+    const Entry *entry = find(m_source.tab_id);
+    if (entry && time_us - entry->refreshed_us < m_config.min_interval_us)
+        return;
+
+    m_source.due = true;
+    m_source.due_us = time_us;
+    m_wake.notify_one();
+}
+
+void ThumbnailCache::remove(int tab_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [tab_id](const Entry &entry)
+                                   { return entry.tab_id == tab_id; }),
+                    m_entries.end());
+    for (Source *source : {&m_source, &m_retired})
+    {
+        if (source->tab_id == tab_id)
+            reset_source(*source, 0);
+    }
+    if (m_refreshing_tab == tab_id)
+        m_refresh_cancelled = true;
+    m_stats.thumbnails = m_entries.size();
+}
+
+bool ThumbnailCache::copy(int tab_id, Thumbnail &thumbnail)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry *entry = find(tab_id);
+    if (!entry || entry->thumbnail.generation == 0)
+        return false;
+
+    entry->last_used = ++m_use_counter;
+    if (thumbnail.generation != entry->thumbnail.generation)
+        thumbnail = entry->thumbnail;
+    return true;
+}
+
+ThumbnailCacheStats ThumbnailCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void ThumbnailCache::run_worker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this]()
+                    { return m_stopping || m_retired.due || m_source.due; });
+        if (m_stopping)
+            return;
+
+        refresh(m_retired.due ? m_retired : m_source, lock);
+    }
+}
+
+void ThumbnailCache::refresh(Source &source, std::unique_lock<std::mutex> &lock)
+{
+    const int tab_id = source.tab_id;
+    const int64_t due_us = source.due_us;
+    const int levels = levels_for(source.width, source.height, m_config.max_width, m_config.max_height);
+    const int block = 1 << levels;
+    const int thumb_width = source.width >> levels;
+    const int thumb_height = source.height >> levels;
+
+    // Grown to whole thumbnail pixels; the partial ones at the right and
+    // bottom edge are left out of the thumbnail.
+    DirtyRegion region;
+    const PixelRect covered{0, 0, thumb_width * block, thumb_height * block};
+    for (const PixelRect &rect : source.pending.rects())
+    {
+        int x0 = rect.x / block * block;
+        int y0 = rect.y / block * block;
+        int x1 = (rect.right() + block - 1) / block * block;
+        int y1 = (rect.bottom() + block - 1) / block * block;
+        region.add(intersect_rects(PixelRect{x0, y0, x1 - x0, y1 - y0}, covered));
+    }
+    source.pending.clear();
+    source.due = false;
+    if (region.empty() || tab_id == 0)
+        return;
+
+    // Only the changed rows are copied under the lock; filtering happens
+    // after it so OnPaint never waits for it.
+    m_rects.assign(region.rects().begin(), region.rects().end());
+    m_block.resize(static_cast<size_t>(region.area()) * 4);
+    const size_t frame_stride = static_cast<size_t>(source.width) * 4;
+    uint8_t *packed = m_block.data();
+    for (const PixelRect &rect : m_rects)
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        for (int y = rect.y; y < rect.bottom(); ++y, packed += row_bytes)
+        {
+            memcpy(packed, source.pixels.data() + y * frame_stride + static_cast<size_t>(rect.x) * 4, row_bytes);
+        }
+    }
+    m_refreshing_tab = tab_id;
+    m_refresh_cancelled = false;
+    lock.unlock();
+
+    m_scaled.resize(m_block.size() / (static_cast<size_t>(block) * block));
+    const uint8_t *in = m_block.data();
+    uint8_t *out = m_scaled.data();
+    for (const PixelRect &rect : m_rects)
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        downscale_rect(in, row_bytes, rect.width, rect.height, levels, out, row_bytes >> levels, m_scratch);
+        in += row_bytes * rect.height;
+        out += (row_bytes >> levels) * (rect.height >> levels);
+    }
+
+    lock.lock();
+    m_refreshing_tab = 0;
+    m_worker_bytes = m_block.capacity() + m_scaled.capacity() + m_scratch.capacity();
+    update_staging_bytes();
+    if (m_stopping || m_refresh_cancelled)
+        return;
+
+    Entry *entry = find(tab_id);
+    if (!entry)
+    {
+        m_entries.emplace_back();
+        entry = &m_entries.back();
+        entry->tab_id = tab_id;
+    }
+    Thumbnail &thumbnail = entry->thumbnail;
+    if (entry->levels != levels || thumbnail.width != thumb_width || thumbnail.height != thumb_height)
+    {
+        entry->levels = levels;
+        thumbnail.width = thumb_width;
+        thumbnail.height = thumb_height;
+        thumbnail.pixels.assign(static_cast<size_t>(thumb_width) * thumb_height * 4, 0);
+    }
+
+    const size_t thumb_stride = static_cast<size_t>(thumb_width) * 4;
+    const uint8_t *scaled = m_scaled.data();
+    for (const PixelRect &rect : m_rects)
+    {
+        size_t row_bytes = static_cast<size_t>(rect.width >> levels) * 4;
+        for (int y = rect.y >> levels; y < rect.bottom() >> levels; ++y, scaled += row_bytes)
+        {
+            memcpy(thumbnail.pixels.data() + y * thumb_stride + static_cast<size_t>(rect.x >> levels) * 4, scaled,
+                   row_bytes);
+        }
+    }
+    thumbnail.generation++;
+    entry->refreshed_us = due_us;
+    entry->last_used = ++m_use_counter;
+    m_stats.refreshes++;
+    m_stats.downscaled_pixels += region.area();
+    evict(tab_id);
+}
+
+void ThumbnailCache::update_staging_bytes()
+{
+    m_stats.staging_bytes = m_source.pixels.capacity() + m_retired.pixels.capacity() + m_worker_bytes;
+}
+
+void ThumbnailCache::evict(int keep_tab_id)
+{
+    auto total_bytes = [this]()
+    {
+        size_t bytes = 0;
+        for (const Entry &entry : m_entries)
+        {
+            bytes += entry.thumbnail.pixels.size();
+        }
+        return bytes;
+    };
+
+    size_t bytes = total_bytes();
+    while (bytes > m_config.memory_cap)
+    {
+        auto victim = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if (it->tab_id != keep_tab_id && (victim == m_entries.end() || it->last_used < victim->last_used))
+                victim = it;
+        }
+        if (victim == m_entries.end())
+            break;
+        m_entries.erase(victim);
+        m_stats.evictions++;
+        bytes = total_bytes();
+    }
+    m_stats.thumbnails = m_entries.size();
+    m_stats.thumbnail_bytes = bytes;
+}
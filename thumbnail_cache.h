@@ -0,0 +1,144 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "dirty_region.h"
+#include "downscale.h"
+
+struct ThumbnailCacheConfig
+{
+    // Thumbnails are the view halved (mip levels) until they fit.
+    int max_width = 320;
+    int max_height = 240;
+    // Least recently used thumbnails are dropped above this.
+    size_t memory_cap = 4 * 1024 * 1024;
+    // A tab's thumbnail is refreshed at most this often; paints in between
+    // are folded into the next refresh.
+    int64_t min_interval_us = 250000;
+};
+
+struct ThumbnailCacheStats
+{
+    uint64_t paints = 0;      // handed to submit()
+    uint64_t refreshes = 0;
+    uint64_t throttled = 0;   // paints folded into a later refresh
+    uint64_t downscaled_pixels = 0; // source pixels filtered
+    uint64_t evictions = 0;
+    uint64_t thumbnails = 0;  // cached now
+    uint64_t thumbnail_bytes = 0;
+    uint64_t staging_bytes = 0; // full size copies of the paints, worker buffers
+};
+
+struct Thumbnail
+{
+    int width = 0;
+    int height = 0;
+    uint64_t generation = 0; // changes whenever the pixels do
+    std::vector<uint8_t> pixels; // BGRA, width * 4 bytes per row
+};
+
+// Small live previews of the tabs, for the tab strip and the overview.
+//
+// submit() takes the view's paints on the paint thread and only copies the
+// dirty rows into a full size staging frame. A worker halves the changed
+// parts of that frame down to thumbnail size with mip_row(), at most once
+// per min_interval_us per tab, so a 60 fps page costs a few small refreshes
+// a second. Only the tab on screen paints; the others keep the thumbnail
+// they had when they were sent to the background.
+class ThumbnailCache
+{
+public:
+    explicit ThumbnailCache(const ThumbnailCacheConfig &config = ThumbnailCacheConfig());
+    ~ThumbnailCache();
+
+    ThumbnailCache(const ThumbnailCache &) = delete;
+    ThumbnailCache &operator=(const ThumbnailCache &) = delete;
+
+    void start();
+    // Drops the thumbnails too.
+    void stop();
+    bool active() const { return m_worker.joinable(); }
+
+    // |buffer| is a BGRA frame of |width| x |height| with |stride| bytes per
+    // row, as OnPaint (or a locked IOSurface) has it.
+    void submit(int tab_id, const DirtyRegion &dirty, const void *buffer, size_t stride, int width, int height,
+                int64_t time_us);
+    // Once per display frame: refreshes throttled paints once their tab's
+    // interval is over, so the last paint of a burst isn't lost.
+    void tick(int64_t time_us);
+    // Whether a paint of |tab_id| submitted now would be refreshed without
+    // waiting for the interval; lets callers for whom reading the frame is
+    // expensive skip the paints that would only be folded.
+    bool refresh_due(int tab_id, int64_t time_us) const;
+    void remove(int tab_id);
+
+    // Copies the tab's thumbnail into |thumbnail| unless it already holds
+    // that generation. Returns false when there is none.
+    bool copy(int tab_id, Thumbnail &thumbnail);
+
+    ThumbnailCacheStats stats() const;
+
+private:
+    struct Entry
+    {
+        int tab_id = 0;
+        int levels = 0;
+        Thumbnail thumbnail;
+        int64_t refreshed_us = 0;
+        uint64_t last_used = 0;
+    };
+
+    // The latest paints of one tab, whole
+    struct Source
+    {
+        int tab_id = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels;
+        DirtyRegion pending;
+        // Only a paint of the whole frame makes a reused frame valid
+        bool complete = false;
+        bool due = false;
+        int64_t due_us = 0;
+    };
+
+    void run_worker();
+    void refresh(Source &source, std::unique_lock<std::mutex> &lock);
+    Entry *find(int tab_id);
+    const Entry *find(int tab_id) const;
+    void schedule(int64_t time_us);
+    void reset_source(Source &source, int tab_id);
+    void evict(int keep_tab_id);
+    void update_staging_bytes();
+
+    ThumbnailCacheConfig m_config;
+    std::thread m_worker;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    Source m_source;
+    // A tab that went to the background with paints not refreshed yet
+    Source m_retired;
+    std::vector<Entry> m_entries;
+    uint64_t m_use_counter = 0;
+    // Tab the worker is filtering for outside the lock, and whether it was
+    // removed meanwhile
+    int m_refreshing_tab = 0;
+    bool m_refresh_cancelled = false;
+    size_t m_worker_bytes = 0; // what the worker only buffers below hold
+    ThumbnailCacheStats m_stats;
+
+    // Worker only
+    std::vector<PixelRect> m_rects;
+    std::vector<uint8_t> m_block;
+    std::vector<uint8_t> m_scaled;
+    std::vector<uint8_t> m_scratch;
+};
+
+#endif // THUMBNAIL_CACHE_H
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "thumbnail_cache.h"
+#include "unit_test.h"
+
+// ThumbnailCache with its worker running: 128x96 paints make 64x48
+// thumbnails of 12 KB.
+
+namespace
+{
+
+const int kWidth = 128;
+const int kHeight = 96;
+const size_t kThumbnailBytes = 64 * 48 * 4;
+
+ThumbnailCacheConfig config(size_t memory_cap)
+{
+    ThumbnailCacheConfig config;
+    config.max_width = 64;
+    config.max_height = 48;
+    config.memory_cap = memory_cap;
+    config.min_interval_us = 0;
+    return config;
+}
+
+// Paints the whole view of |tab_id| in one colour.
+void paint(ThumbnailCache &cache, int tab_id, uint32_t colour, int64_t time_us)
+{
+    std::vector<uint32_t> frame(static_cast<size_t>(kWidth) * kHeight, colour);
+    DirtyRegion dirty;
+    dirty.add(PixelRect{0, 0, kWidth, kHeight});
+    cache.submit(tab_id, dirty, frame.data(), static_cast<size_t>(kWidth) * 4, kWidth, kHeight, time_us);
+}
+
+// Waits for the worker to have refreshed |tab_id| past |generation|.
+bool wait_for(ThumbnailCache &cache, int tab_id, uint64_t generation, Thumbnail &thumbnail)
+{
+    for (int i = 0; i < 2000; ++i)
+    {
+        if (cache.copy(tab_id, thumbnail) && thumbnail.generation > generation)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+uint32_t first_pixel(const Thumbnail &thumbnail)
+{
+    uint32_t pixel = 0;
+    if (!thumbnail.pixels.empty())
+        memcpy(&pixel, thumbnail.pixels.data(), sizeof(pixel));
+    return pixel;
+}
+
+} // namespace
+
+TEST(thumbnail_evicts_least_recently_viewed)
+{
+    ThumbnailCache cache(config(2 * kThumbnailBytes + 100));
+    cache.start();
+
+    Thumbnail one;
+    Thumbnail two;
+    Thumbnail three;
+    paint(cache, 1, 0xff000001u, 0);
+    EXPECT(wait_for(cache, 1, 0, one));
+    EXPECT_EQ(one.width, 64);
+    EXPECT_EQ(one.height, 48);
+    EXPECT_EQ(first_pixel(one), 0xff000001u);
+    paint(cache, 2, 0xff000002u, 1000);
+    EXPECT(wait_for(cache, 2, 0, two));
+
+    // Tab 1 was looked at since tab 2 was painted, so tab 2 is the oldest
+    EXPECT(cache.copy(1, one));
+    paint(cache, 3, 0xff000003u, 2000);
+    EXPECT(wait_for(cache, 3, 0, three));
+    EXPECT_EQ(first_pixel(three), 0xff000003u);
+
+    Thumbnail evicted;
+    EXPECT(!cache.copy(2, evicted));
+    EXPECT(cache.copy(1, one));
+    ThumbnailCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.thumbnails, 2u);
+    EXPECT_EQ(stats.thumbnail_bytes, 2 * kThumbnailBytes);
+
+    // Painted again, it comes back and pushes out the oldest
+    Thumbnail again;
+    paint(cache, 2, 0xff000022u, 3000);
+    EXPECT(wait_for(cache, 2, 0, again));
+    EXPECT_EQ(first_pixel(again), 0xff000022u);
+    EXPECT(!cache.copy(3, three));
+    EXPECT_EQ(cache.stats().evictions, 2u);
+    cache.stop();
+}
+
+TEST(thumbnail_keeps_the_one_just_refreshed)
+{
+    // Too small for even one: the tab just refreshed stays anyway
+    ThumbnailCache cache(config(1));
+    cache.start();
+    Thumbnail one;
+    Thumbnail two;
+    paint(cache, 1, 0xff0000aau, 0);
+    EXPECT(wait_for(cache, 1, 0, one));
+    paint(cache, 2, 0xff0000bbu, 1000);
+    EXPECT(wait_for(cache, 2, 0, two));
+    EXPECT(!cache.copy(1, one));
+    EXPECT_EQ(cache.stats().thumbnails, 1u);
+    EXPECT_EQ(cache.stats().thumbnail_bytes, kThumbnailBytes);
+
+    // Removing the tab drops it for good
+    cache.remove(2);
+    EXPECT(!cache.copy(2, two));
+    EXPECT_EQ(cache.stats().thumbnails, 0u);
+    cache.stop();
+}
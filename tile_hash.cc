@@ -0,0 +1,310 @@
+#include "tile_hash.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHROME_HASH_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__arm__))
+#define SHROME_HASH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+constexpr size_t kStripeBytes = 32;
+
+// Lane keys, and what they advance by per stripe
+constexpr uint64_t kKeys[4] = {0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull,
+                               0x1f67b3b7a4a44072ull};
+constexpr uint64_t kKeyStep = 0x9e3779b97f4a7c15ull;
+
+inline uint64_t load_u64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void accumulate_stripe(uint64_t acc[4], const uint8_t *stripe, uint64_t position)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        uint64_t value = load_u64(stripe + i * 8);
+        uint64_t keyed = value ^ (kKeys[i] + position * kKeyStep);
+        acc[i ^ 1] += value;
+        acc[i] += (keyed & 0xffffffffu) * (keyed >> 32);
+    }
+}
+
+// Hashes what is left of a row after |done| full stripes and updates the
+// counters; shared by all variants so the padding is the same.
+inline void finish_row(TileHashState &state, const uint8_t *row, size_t bytes, size_t done)
+{
+    size_t rest = bytes - done * kStripeBytes;
+    if (rest)
+    {
+        uint8_t padded[kStripeBytes] = {};
+        memcpy(padded, row + done * kStripeBytes, rest);
+        accumulate_stripe(state.acc, padded, state.stripes + done);
+        done++;
+    }
+    state.stripes += done;
+    state.bytes += bytes;
+}
+
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+#if SHROME_HASH_X86
+
+void hash_row_sse2(TileHashState &state, const uint8_t *row, size_t bytes)
+{
+    size_t stripes = bytes / kStripeBytes;
+    __m128i acc01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state.acc));
+    __m128i acc23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state.acc + 2));
+    uint64_t offset = state.stripes * kKeyStep;
+    __m128i key01 = _mm_set_epi64x(static_cast<long long>(kKeys[1] + offset), static_cast<long long>(kKeys[0] + offset));
+    __m128i key23 = _mm_set_epi64x(static_cast<long long>(kKeys[3] + offset), static_cast<long long>(kKeys[2] + offset));
+    const __m128i step = _mm_set1_epi64x(static_cast<long long>(kKeyStep));
+
+    for (size_t s = 0; s < stripes; ++s)
+    {
+        const uint8_t *p = row + s * kStripeBytes;
+        __m128i d01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i d23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+        __m128i k01 = _mm_xor_si128(d01, key01);
+        __m128i k23 = _mm_xor_si128(d23, key23);
+        // lo32 * hi32 of every lane, plus the neighbouring lane's data
+        acc01 = _mm_add_epi64(acc01, _mm_mul_epu32(k01, _mm_srli_epi64(k01, 32)));
+        acc23 = _mm_add_epi64(acc23, _mm_mul_epu32(k23, _mm_srli_epi64(k23, 32)));
+        acc01 = _mm_add_epi64(acc01, _mm_shuffle_epi32(d01, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc23 = _mm_add_epi64(acc23, _mm_shuffle_epi32(d23, _MM_SHUFFLE(1, 0, 3, 2)));
+        key01 = _mm_add_epi64(key01, step);
+        key23 = _mm_add_epi64(key23, step);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state.acc), acc01);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state.acc + 2), acc23);
+    finish_row(state, row, bytes, stripes);
+}
+
+__attribute__((target("avx2"))) void hash_row_avx2(TileHashState &state, const uint8_t *row, size_t bytes)
+{
+    size_t stripes = bytes / kStripeBytes;
+    __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state.acc));
+    uint64_t offset = state.stripes * kKeyStep;
+    __m256i key = _mm256_set_epi64x(static_cast<long long>(kKeys[3] + offset), static_cast<long long>(kKeys[2] + offset),
+                                    static_cast<long long>(kKeys[1] + offset), static_cast<long long>(kKeys[0] + offset));
+    const __m256i step = _mm256_set1_epi64x(static_cast<long long>(kKeyStep));
+
+    for (size_t s = 0; s < stripes; ++s)
+    {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + s * kStripeBytes));
+        __m256i k = _mm256_xor_si256(d, key);
+        acc = _mm256_add_epi64(acc, _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+        // Swaps the lanes of each 128 bit half: 0 <-> 1, 2 <-> 3
+        acc = _mm256_add_epi64(acc, _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+        key = _mm256_add_epi64(key, step);
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state.acc), acc);
+    finish_row(state, row, bytes, stripes);
+}
+
+#endif // SHROME_HASH_X86
+
+#if SHROME_HASH_NEON
+
+inline uint64x2_t accumulate_neon(uint64x2_t acc, uint64x2_t d, uint64x2_t key)
+{
+    uint64x2_t k = veorq_u64(d, key);
+    acc = vaddq_u64(acc, vmull_u32(vmovn_u64(k), vshrn_n_u64(k, 32)));
+    return vaddq_u64(acc, vextq_u64(d, d, 1));
+}
+
+void hash_row_neon(TileHashState &state, const uint8_t *row, size_t bytes)
+{
+    size_t stripes = bytes / kStripeBytes;
+    uint64x2_t acc01 = vld1q_u64(state.acc);
+    uint64x2_t acc23 = vld1q_u64(state.acc + 2);
+    uint64_t offset = state.stripes * kKeyStep;
+    const uint64_t keys[4] = {kKeys[0] + offset, kKeys[1] + offset, kKeys[2] + offset, kKeys[3] + offset};
+    uint64x2_t key01 = vld1q_u64(keys);
+    uint64x2_t key23 = vld1q_u64(keys + 2);
+    const uint64x2_t step = vdupq_n_u64(kKeyStep);
+
+    for (size_t s = 0; s < stripes; ++s)
+    {
+        const uint8_t *p = row + s * kStripeBytes;
+        acc01 = accumulate_neon(acc01, vreinterpretq_u64_u8(vld1q_u8(p)), key01);
+        acc23 = accumulate_neon(acc23, vreinterpretq_u64_u8(vld1q_u8(p + 16)), key23);
+        key01 = vaddq_u64(key01, step);
+        key23 = vaddq_u64(key23, step);
+    }
+
+    vst1q_u64(state.acc, acc01);
+    vst1q_u64(state.acc + 2, acc23);
+    finish_row(state, row, bytes, stripes);
+}
+
+#endif // SHROME_HASH_NEON
+
+} // namespace
+
+void tile_hash_begin(TileHashState &state)
+{
+    state.acc[0] = 0x00000000c2b2ae3dull;
+    state.acc[1] = 0x9e3779b185ebca87ull;
+    state.acc[2] = 0xc2b2ae3d27d4eb4full;
+    state.acc[3] = 0x165667b19e3779f9ull;
+    state.stripes = 0;
+    state.bytes = 0;
+}
+
+uint64_t tile_hash_end(const TileHashState &state)
+{
+    uint64_t hash = state.bytes * 0x9e3779b185ebca87ull;
+    for (uint64_t acc : state.acc)
+    {
+        hash = mix64(hash ^ acc);
+    }
+    return hash;
+}
+
+void hash_row_scalar(TileHashState &state, const uint8_t *row, size_t bytes)
+{
+    size_t stripes = bytes / kStripeBytes;
+    for (size_t s = 0; s < stripes; ++s)
+    {
+        accumulate_stripe(state.acc, row + s * kStripeBytes, state.stripes + s);
+    }
+    finish_row(state, row, bytes, stripes);
+}
+
+HashRowFn hash_row_function(CpuIsa isa)
+{
+    if (!cpu_isa_supported(isa))
+        return nullptr;
+
+    switch (isa)
+    {
+#if SHROME_HASH_X86
+    case CpuIsa::SSE2:
+        return hash_row_sse2;
+    case CpuIsa::AVX2:
+        return hash_row_avx2;
+#endif
+#if SHROME_HASH_NEON
+    case CpuIsa::NEON:
+        return hash_row_neon;
+#endif
+    default:
+        return hash_row_scalar;
+    }
+}
+
+HashRowFn hash_row()
+{
+    static const HashRowFn fn = hash_row_function(best_cpu_isa());
+    return fn;
+}
+
+uint64_t hash_rect(const uint8_t *pixels, size_t stride, const PixelRect &rect, HashRowFn fn)
+{
+    TileHashState state;
+    tile_hash_begin(state);
+    size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+    const uint8_t *row = pixels + rect.y * stride + static_cast<size_t>(rect.x) * 4;
+    for (int y = 0; y < rect.height; ++y, row += stride)
+    {
+        fn(state, row, row_bytes);
+    }
+    return tile_hash_end(state);
+}
+
+void TileHashCache::reset()
+{
+    m_valid.assign(m_valid.size(), 0);
+}
+
+size_t TileHashCache::memory_bytes() const
+{
+    return m_hashes.capacity() * sizeof(uint64_t) + m_valid.capacity() + m_state.capacity();
+}
+
+DirtyRegion TileHashCache::filter(const DirtyRegion &damage, const uint8_t *frame, int width, int height)
+{
+    if (width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_tiles_x = (width + kTileSize - 1) / kTileSize;
+        m_tiles_y = (height + kTileSize - 1) / kTileSize;
+        m_hashes.assign(static_cast<size_t>(m_tiles_x) * m_tiles_y, 0);
+        m_valid.assign(m_hashes.size(), 0);
+    }
+
+    DirtyRegion dirty = damage;
+    const PixelRect bounds{0, 0, width, height};
+    dirty.clip(bounds);
+    m_stats.frames++;
+
+    const size_t stride = static_cast<size_t>(width) * 4;
+    const HashRowFn fn = hash_row();
+    m_state.assign(m_hashes.size(), 0);
+    for (const PixelRect &rect : dirty.rects())
+    {
+        for (int ty = rect.y / kTileSize; ty <= (rect.bottom() - 1) / kTileSize; ++ty)
+        {
+            for (int tx = rect.x / kTileSize; tx <= (rect.right() - 1) / kTileSize; ++tx)
+            {
+                size_t index = static_cast<size_t>(ty) * m_tiles_x + tx;
+                if (m_state[index])
+                    continue;
+
+                PixelRect tile = intersect_rects(PixelRect{tx * kTileSize, ty * kTileSize, kTileSize, kTileSize}, bounds);
+                uint64_t hash = hash_rect(frame, stride, tile, fn);
+                m_stats.tiles_hashed++;
+                if (m_valid[index] && m_hashes[index] == hash)
+                {
+                    m_state[index] = 1;
+                    m_stats.tiles_unchanged++;
+                }
+                else
+                {
+                    m_state[index] = 2;
+                    m_hashes[index] = hash;
+                    m_valid[index] = 1;
+                }
+            }
+        }
+    }
+
+    DirtyRegion changed;
+    for (const PixelRect &rect : dirty.rects())
+    {
+        for (int ty = rect.y / kTileSize; ty <= (rect.bottom() - 1) / kTileSize; ++ty)
+        {
+            for (int tx = rect.x / kTileSize; tx <= (rect.right() - 1) / kTileSize; ++tx)
+            {
+                if (m_state[static_cast<size_t>(ty) * m_tiles_x + tx] == 2)
+                {
+                    changed.add(intersect_rects(rect, PixelRect{tx * kTileSize, ty * kTileSize, kTileSize, kTileSize}));
+                }
+            }
+        }
+    }
+    m_stats.changed_bytes += changed.area() * 4;
+    return changed;
+}
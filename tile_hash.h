@@ -0,0 +1,93 @@
+#ifndef TILE_HASH_H
+#define TILE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cpu_features.h"
+#include "dirty_region.h"
+
+// Content hashes for skipping uploads of pixels that didn't change.
+//
+// A rect is hashed a row at a time into four 64 bit accumulators, 32 byte
+// stripes at once (xxh3's accumulate step: the stripe is added to the
+// neighbouring lane and its 32x32 bit halves, keyed by the stripe's position,
+// are multiplied into its own lane). The key depends on where the stripe is
+// in the rect, so moving content around inside a tile changes the hash too.
+// Rows that aren't a multiple of 32 bytes end in a zero padded stripe. All
+// variants give bit-identical results.
+struct TileHashState
+{
+    uint64_t acc[4];
+    uint64_t stripes = 0; // hashed so far, the next stripe's position
+    uint64_t bytes = 0;
+};
+
+using HashRowFn = void (*)(TileHashState &state, const uint8_t *row, size_t bytes);
+
+void tile_hash_begin(TileHashState &state);
+uint64_t tile_hash_end(const TileHashState &state);
+
+// The reference implementation, always available.
+void hash_row_scalar(TileHashState &state, const uint8_t *row, size_t bytes);
+
+// Kernel for |isa|, or nullptr when it isn't supported.
+HashRowFn hash_row_function(CpuIsa isa);
+// The fastest supported kernel.
+HashRowFn hash_row();
+
+// Hash of |rect| in a BGRA image with |stride| bytes per row.
+uint64_t hash_rect(const uint8_t *pixels, size_t stride, const PixelRect &rect, HashRowFn fn = hash_row());
+
+struct TileUploadStats
+{
+    uint64_t frames = 0;
+    uint64_t tiles_hashed = 0;
+    uint64_t tiles_unchanged = 0;
+    uint64_t dirty_bytes = 0;    // what CEF reported as dirty
+    uint64_t changed_bytes = 0;  // what filter() let through
+    uint64_t uploaded_bytes = 0; // what the upload plan sent for that
+};
+
+// Remembers a hash per tile of a surface's contents so damage can be
+// narrowed to the tiles whose pixels actually changed. CEF often reports the
+// whole view dirty for a caret blink; with this only the caret's tile goes
+// to the GPU.
+class TileHashCache
+{
+public:
+    static constexpr int kTileSize = 128;
+
+    // The surface was recreated or written by someone else: nothing it
+    // holds is known, every tile counts as changed.
+    void reset();
+
+    // |frame| is the complete new contents of the surface (|width| * 4 bytes
+    // per row), |damage| what was reported dirty since the last call. Returns
+    // |damage| clipped to the tiles whose hash changed and remembers the new
+    // hashes.
+    DirtyRegion filter(const DirtyRegion &damage, const uint8_t *frame, int width, int height);
+
+    // Accounting done by the caller, which knows what CEF reported and what
+    // the upload plan made of filter()'s result.
+    void add_dirty_bytes(int64_t bytes) { m_stats.dirty_bytes += bytes; }
+    void add_uploaded_bytes(int64_t bytes) { m_stats.uploaded_bytes += bytes; }
+
+    const TileUploadStats &stats() const { return m_stats; }
+    void reset_stats() { m_stats = TileUploadStats(); }
+
+    size_t memory_bytes() const;
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_tiles_x = 0;
+    int m_tiles_y = 0;
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint8_t> m_valid;
+    // Scratch for filter(): 0 untouched, 1 unchanged, 2 changed
+    std::vector<uint8_t> m_state;
+    TileUploadStats m_stats;
+};
+
+#endif // TILE_HASH_H
@@ -0,0 +1,149 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "tile_hash.h"
+#include "unit_test.h"
+
+// Every hash kernel the CPU runs has to match hash_row_scalar() bit for bit,
+// and TileHashCache has to let through exactly the tiles that changed.
+
+namespace
+{
+
+const CpuIsa kIsas[] = {CpuIsa::SSE2, CpuIsa::AVX2, CpuIsa::NEON};
+
+std::vector<uint8_t> random_bytes(std::mt19937 &rng, size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t &byte : bytes)
+    {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return bytes;
+}
+
+// Hashes |rows| rows of |bytes| starting |offset| bytes into |data| with
+// |fn|, carrying the state from row to row like hash_rect() does.
+TileHashState hash_rows(HashRowFn fn, const std::vector<uint8_t> &data, size_t offset, size_t bytes, int rows)
+{
+    TileHashState state;
+    tile_hash_begin(state);
+    for (int y = 0; y < rows; ++y)
+    {
+        fn(state, data.data() + offset + y * bytes, bytes);
+    }
+    return state;
+}
+
+bool same_state(const TileHashState &a, const TileHashState &b)
+{
+    return memcmp(a.acc, b.acc, sizeof(a.acc)) == 0 && a.stripes == b.stripes && a.bytes == b.bytes &&
+           tile_hash_end(a) == tile_hash_end(b);
+}
+
+void set_pixel(std::vector<uint8_t> &frame, int width, int x, int y, uint32_t pixel)
+{
+    memcpy(&frame[(static_cast<size_t>(y) * width + x) * 4], &pixel, 4);
+}
+
+} // namespace
+
+TEST(hash_kernels_match_scalar)
+{
+    std::mt19937 rng(11);
+    int checked = 0;
+    for (CpuIsa isa : kIsas)
+    {
+        if (!cpu_isa_supported(isa))
+            continue;
+        checked++;
+        HashRowFn fn = hash_row_function(isa);
+        EXPECT(fn != nullptr);
+
+        // Every row length up to four stripes, at an odd start, three rows in
+        // a row so the stripe position carries over a padded tail
+        for (size_t bytes = 0; bytes <= 4 * 32 + 1; ++bytes)
+        {
+            std::vector<uint8_t> data = random_bytes(rng, 3 * bytes + 1);
+            if (!same_state(hash_rows(fn, data, 1, bytes, 3), hash_rows(hash_row_scalar, data, 1, bytes, 3)))
+            {
+                unit_test_fail(__FILE__, __LINE__,
+                               std::string(cpu_isa_name(isa)) + " to match scalar for rows of " + std::to_string(bytes) +
+                                   " bytes");
+                break;
+            }
+        }
+
+        // A whole tile
+        std::vector<uint8_t> tile = random_bytes(rng, 128 * 128 * 4);
+        EXPECT(same_state(hash_rows(fn, tile, 0, 128 * 4, 128), hash_rows(hash_row_scalar, tile, 0, 128 * 4, 128)));
+    }
+    EXPECT(hash_row_function(CpuIsa::Scalar) == hash_row_scalar);
+    EXPECT(hash_row() == hash_row_function(best_cpu_isa()));
+#if defined(__x86_64__) || defined(__aarch64__)
+    // SSE2 and NEON are baseline on these
+    EXPECT(checked > 0);
+#endif
+}
+
+TEST(hash_rect_depends_on_position)
+{
+    // Content moved around inside a tile hashes differently
+    std::vector<uint8_t> frame(64 * 64 * 4, 0);
+    set_pixel(frame, 64, 3, 5, 0xff102030u);
+    uint64_t before = hash_rect(frame.data(), 64 * 4, PixelRect{0, 0, 64, 64});
+    set_pixel(frame, 64, 3, 5, 0);
+    set_pixel(frame, 64, 5, 3, 0xff102030u);
+    EXPECT(hash_rect(frame.data(), 64 * 4, PixelRect{0, 0, 64, 64}) != before);
+
+    // And only the rect's pixels count
+    uint64_t inside = hash_rect(frame.data(), 64 * 4, PixelRect{0, 0, 32, 32});
+    set_pixel(frame, 64, 40, 40, 0xffffffffu);
+    EXPECT_EQ(hash_rect(frame.data(), 64 * 4, PixelRect{0, 0, 32, 32}), inside);
+}
+
+TEST(tile_filter_drops_unchanged_tiles)
+{
+    // 4 x 3 tiles, the last column and row only partly on the frame
+    const int width = 3 * 128 + 50;
+    const int height = 2 * 128 + 30;
+    std::mt19937 rng(13);
+    std::vector<uint8_t> frame = random_bytes(rng, static_cast<size_t>(width) * height * 4);
+    DirtyRegion everything;
+    everything.add(PixelRect{0, 0, width, height});
+
+    TileHashCache cache;
+    EXPECT_EQ(cache.filter(everything, frame.data(), width, height).area(), static_cast<int64_t>(width) * height);
+
+    // Reported dirty but the same: nothing to upload
+    EXPECT(cache.filter(everything, frame.data(), width, height).empty());
+    EXPECT_EQ(cache.stats().tiles_unchanged, 12u);
+
+    // A caret blink in one tile: only that tile goes into the plan
+    set_pixel(frame, width, 300, 140, 0xff000000u);
+    const std::vector<PixelRect> caret_tile = {PixelRect{256, 128, 128, 128}};
+    DirtyRegion changed = cache.filter(everything, frame.data(), width, height);
+    EXPECT(changed.rects() == caret_tile);
+    UploadPlan plan = plan_upload(changed, width, height);
+    EXPECT(plan.strategy != UploadStrategy::FullFrame);
+    EXPECT_EQ(plan.bytes, 128 * 128 * 4);
+    EXPECT(plan.rects == caret_tile);
+
+    // Damage smaller than a tile stays that small; a change in a partial
+    // edge tile is clipped to the frame
+    set_pixel(frame, width, 10, 10, 0xff000000u);
+    set_pixel(frame, width, width - 1, height - 1, 0xff000000u);
+    DirtyRegion damage;
+    damage.add(PixelRect{8, 8, 4, 4});
+    damage.add(PixelRect{0, 200, width, height - 200});
+    changed = cache.filter(damage, frame.data(), width, height);
+    DirtyRegion expected;
+    expected.add(PixelRect{8, 8, 4, 4});
+    expected.add(PixelRect{384, 256, 50, 30});
+    EXPECT(changed.rects() == expected.rects());
+
+    // After reset() nothing is known
+    cache.reset();
+    EXPECT_EQ(cache.filter(everything, frame.data(), width, height).area(), static_cast<int64_t>(width) * height);
+}
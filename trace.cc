@@ -0,0 +1,340 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+    // What one event carries
+    struct TraceEvent
+    {
+        char phase = 0;
+        uint8_t level = 0;
+        uint32_t category = 0;
+        const char *name = nullptr;
+        int64_t ts_us = 0;
+        int64_t value = 0; // duration for 'X', value for 'C'
+        char message[kTraceMessageSize] = {};
+    };
+
+    static_assert(kTraceMessageSize % sizeof(uint64_t) == 0, "messages are copied a word at a time");
+    constexpr int kTraceMessageWords = kTraceMessageSize / sizeof(uint64_t);
+
+    // One slot of a thread's ring. |sequence| is odd while the owner thread
+    // rewrites the slot, so the exporter can skip torn records. The exporter
+    // copies the payload while the owner may be writing it, so every field is
+    // atomic: stored with release after the odd sequence, loaded with acquire
+    // before the sequence is checked again. Seeing any of a new write then
+    // means seeing its sequence change. Plain on x86, and no fences, which
+    // ThreadSanitizer can't follow.
+    struct TraceRecord
+    {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<char> phase{0};
+        std::atomic<uint8_t> level{0};
+        std::atomic<uint32_t> category{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<int64_t> ts_us{0};
+        std::atomic<int64_t> value{0};
+        std::atomic<uint64_t> message[kTraceMessageWords] = {};
+    };
+
+    struct TraceBuffer
+    {
+        uint32_t tid = 0;
+        std::string thread_name; // guarded by the registry mutex
+        std::atomic<uint64_t> next{0};
+        TraceRecord records[kTraceBufferRecords];
+    };
+
+    struct TraceRegistry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TraceBuffer>> buffers;
+        uint32_t next_tid = 1;
+    };
+
+    TraceRegistry &registry()
+    {
+        static TraceRegistry *instance = new TraceRegistry(); // never destroyed, threads may outlive statics
+        return *instance;
+    }
+
+    TraceBuffer *thread_buffer()
+    {
+        thread_local TraceBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            TraceRegistry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.buffers.push_back(std::make_unique<TraceBuffer>());
+            buffer = r.buffers.back().get();
+            buffer->tid = r.next_tid++;
+        }
+        return buffer;
+    }
+
+    // Only ever called by the thread owning |buffer|
+    void append_record(TraceBuffer *buffer, const TraceEvent &event)
+    {
+        uint64_t index = buffer->next.load(std::memory_order_relaxed);
+        TraceRecord &record = buffer->records[index % kTraceBufferRecords];
+        uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+        record.sequence.store(sequence + 1, std::memory_order_relaxed);
+
+        record.phase.store(event.phase, std::memory_order_release);
+        record.level.store(event.level, std::memory_order_release);
+        record.category.store(event.category, std::memory_order_release);
+        record.name.store(event.name, std::memory_order_release);
+        record.ts_us.store(event.ts_us, std::memory_order_release);
+        record.value.store(event.value, std::memory_order_release);
+        for (int i = 0; i < kTraceMessageWords; ++i)
+        {
+            uint64_t word;
+            memcpy(&word, event.message + i * sizeof(word), sizeof(word));
+            record.message[i].store(word, std::memory_order_release);
+        }
+
+        record.sequence.store(sequence + 2, std::memory_order_release);
+        buffer->next.store(index + 1, std::memory_order_release);
+    }
+
+    // False when the owner thread rewrote the slot while it was copied
+    bool read_record(const TraceRecord &record, TraceEvent &event)
+    {
+        uint32_t sequence = record.sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+            return false;
+
+        event.phase = record.phase.load(std::memory_order_acquire);
+        event.level = record.level.load(std::memory_order_acquire);
+        event.category = record.category.load(std::memory_order_acquire);
+        event.name = record.name.load(std::memory_order_acquire);
+        event.ts_us = record.ts_us.load(std::memory_order_acquire);
+        event.value = record.value.load(std::memory_order_acquire);
+        for (int i = 0; i < kTraceMessageWords; ++i)
+        {
+            uint64_t word = record.message[i].load(std::memory_order_acquire);
+            memcpy(event.message + i * sizeof(word), &word, sizeof(word));
+        }
+        event.message[kTraceMessageSize - 1] = '\0';
+
+        return record.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    void append_json_string(std::string &out, const char *text)
+    {
+        out += '"';
+        for (const char *p = text; p && *p; ++p)
+        {
+            unsigned char c = static_cast<unsigned char>(*p);
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else
+                {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+        out += '"';
+    }
+}
+
+const char *trace_category_name(uint32_t category)
+{
+    switch (category)
+    {
+    case TRACE_CAT_INPUT:
+        return "input";
+    case TRACE_CAT_KEY:
+        return "key";
+    case TRACE_CAT_PAINT:
+        return "paint";
+    case TRACE_CAT_COMPOSITE:
+        return "composite";
+    case TRACE_CAT_PUMP:
+        return "pump";
+    case TRACE_CAT_BROWSER:
+        return "browser";
+    case TRACE_CAT_UI:
+        return "ui";
+    default:
+        return "shrome";
+    }
+}
+
+int64_t trace_now_us()
+{
+    // Same clock base as Chromium's TimeTicks on macOS and Linux, so traces
+    // line up when loaded together.
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void trace_instant(int level, uint32_t category, const char *name)
+{
+    trace_instant(level, category, name, "%s", "");
+}
+
+void trace_instant(int level, uint32_t category, const char *name, const char *format, ...)
+{
+    TraceEvent event;
+    event.phase = 'i';
+    event.level = static_cast<uint8_t>(level);
+    event.category = category;
+    event.name = name;
+    event.ts_us = trace_now_us();
+    if (format)
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(event.message, sizeof(event.message), format, args);
+        va_end(args);
+    }
+
+#ifdef SHROME_TRACE_ECHO
+    fprintf(stderr, "[%s] %s %s\n", trace_category_name(category), name, event.message);
+#endif
+
+    append_record(thread_buffer(), event);
+}
+
+void trace_complete(int level, uint32_t category, const char *name, int64_t start_us, int64_t duration_us)
+{
+    TraceEvent event;
+    event.phase = 'X';
+    event.level = static_cast<uint8_t>(level);
+    event.category = category;
+    event.name = name;
+    event.ts_us = start_us;
+    event.value = duration_us;
+    append_record(thread_buffer(), event);
+}
+
+void trace_counter(uint32_t category, const char *name, int64_t value)
+{
+    TraceEvent event;
+    event.phase = 'C';
+    event.level = TRACE_LEVEL_INFO;
+    event.category = category;
+    event.name = name;
+    event.ts_us = trace_now_us();
+    event.value = value;
+    append_record(thread_buffer(), event);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    TraceBuffer *buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer->thread_name = name ? name : "";
+}
+
+std::string trace_chrome_json()
+{
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]()
+    {
+        if (!first)
+            out += ",\n";
+        first = false;
+    };
+
+    const int pid = static_cast<int>(getpid());
+    TraceRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto &buffer : r.buffers)
+    {
+        if (!buffer->thread_name.empty())
+        {
+            separator();
+            out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + std::to_string(pid) +
+                   ",\"tid\":" + std::to_string(buffer->tid) + ",\"args\":{\"name\":";
+            append_json_string(out, buffer->thread_name.c_str());
+            out += "}}";
+        }
+
+        uint64_t end = buffer->next.load(std::memory_order_acquire);
+        uint64_t begin = end > static_cast<uint64_t>(kTraceBufferRecords) ? end - kTraceBufferRecords : 0;
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            TraceEvent event;
+            if (!read_record(buffer->records[i % kTraceBufferRecords], event) || !event.name)
+                continue; // overwritten while we were copying
+            const char phase = event.phase;
+            const char *name = event.name;
+            const char *message = event.message;
+
+            separator();
+            out += "{\"ph\":\"";
+            out += phase;
+            out += "\",\"name\":";
+            append_json_string(out, name);
+            out += ",\"cat\":";
+            append_json_string(out, trace_category_name(event.category));
+            out += ",\"ts\":" + std::to_string(event.ts_us) + ",\"pid\":" + std::to_string(pid) +
+                   ",\"tid\":" + std::to_string(buffer->tid);
+            if (phase == 'X')
+            {
+                out += ",\"dur\":" + std::to_string(event.value);
+            }
+            else if (phase == 'C')
+            {
+                out += ",\"args\":{\"value\":" + std::to_string(event.value) + "}";
+            }
+            else
+            {
+                out += ",\"s\":\"t\"";
+                if (message[0])
+                {
+                    out += ",\"args\":{\"msg\":";
+                    append_json_string(out, message);
+                    out += "}";
+                }
+            }
+            out += "}";
+        }
+    }
+
+    out += "]}\n";
+    return out;
+}
+
+bool trace_write_chrome_json(const std::string &path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << trace_chrome_json();
+    return static_cast<bool>(file);
+}
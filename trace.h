@@ -0,0 +1,127 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Lightweight event tracing for the hot paths that used to print to
+// std::cout.
+//
+// Every call site names a level and a category. Both are filtered at compile
+// time through SHROME_TRACE_LEVEL and SHROME_TRACE_CATEGORIES; a filtered out
+// call compiles to nothing, its arguments aren't evaluated. Enabled events go
+// into a fixed-size ring buffer owned by the calling thread (no locks, no
+// allocation once the thread's buffer exists) and can be exported as Chrome
+// trace-event JSON, which Perfetto and chrome://tracing open directly.
+//
+//   TRACE_EVENT(TRACE_LEVEL_DEBUG, TRACE_CAT_INPUT, "mouse_down", "x=%d y=%d", x, y);
+//   TRACE_EVENT(TRACE_LEVEL_INFO, TRACE_CAT_BROWSER, "browser_created");
+//   TRACE_SCOPE(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "composite");
+//   TRACE_COUNTER(TRACE_CAT_PUMP, "pending_pumps", count);
+
+#define TRACE_LEVEL_ERROR 0
+#define TRACE_LEVEL_WARN 1
+#define TRACE_LEVEL_INFO 2
+#define TRACE_LEVEL_DEBUG 3
+#define TRACE_LEVEL_VERBOSE 4
+
+#define TRACE_CAT_INPUT 0x01u
+#define TRACE_CAT_KEY 0x02u
+#define TRACE_CAT_PAINT 0x04u
+#define TRACE_CAT_COMPOSITE 0x08u
+#define TRACE_CAT_PUMP 0x10u
+#define TRACE_CAT_BROWSER 0x20u
+#define TRACE_CAT_UI 0x40u
+#define TRACE_CAT_ALL 0xffu
+
+#ifndef SHROME_TRACE_LEVEL
+#define SHROME_TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+#ifndef SHROME_TRACE_CATEGORIES
+#define SHROME_TRACE_CATEGORIES TRACE_CAT_ALL
+#endif
+
+#define SHROME_TRACE_ENABLED(level, category) \
+    ((level) <= SHROME_TRACE_LEVEL && ((category) & SHROME_TRACE_CATEGORIES) != 0)
+
+// Records are fixed size; longer messages are cut.
+constexpr int kTraceMessageSize = 96;
+// Per thread; the oldest records are overwritten.
+constexpr int kTraceBufferRecords = 8192;
+
+const char *trace_category_name(uint32_t category);
+
+int64_t trace_now_us();
+
+void trace_instant(int level, uint32_t category, const char *name);
+// |format| is printf-style.
+void trace_instant(int level, uint32_t category, const char *name, const char *format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 4, 5)))
+#endif
+    ;
+void trace_complete(int level, uint32_t category, const char *name, int64_t start_us, int64_t duration_us);
+void trace_counter(uint32_t category, const char *name, int64_t value);
+
+// Names the calling thread in exported traces.
+void trace_set_thread_name(const char *name);
+
+// All buffered events of all threads as Chrome trace-event JSON.
+std::string trace_chrome_json();
+bool trace_write_chrome_json(const std::string &path);
+
+// Emits a complete ("X") event for its lifetime.
+class TraceScope
+{
+public:
+    TraceScope(int level, uint32_t category, const char *name)
+        : m_level(level), m_category(category), m_name(name), m_start_us(trace_now_us())
+    {
+    }
+    ~TraceScope()
+    {
+        trace_complete(m_level, m_category, m_name, m_start_us, trace_now_us() - m_start_us);
+    }
+
+private:
+    int m_level;
+    uint32_t m_category;
+    const char *m_name;
+    int64_t m_start_us;
+};
+
+#define SHROME_TRACE_CONCAT_INNER(a, b) a##b
+#define SHROME_TRACE_CONCAT(a, b) SHROME_TRACE_CONCAT_INNER(a, b)
+
+// The optional message is printf-style.
+#define TRACE_EVENT(level, category, name, ...)                              \
+    do                                                                       \
+    {                                                                        \
+        if constexpr (SHROME_TRACE_ENABLED(level, category))                 \
+        {                                                                    \
+            trace_instant(level, category, name __VA_OPT__(, ) __VA_ARGS__); \
+        }                                                                    \
+    } while (0)
+
+#define TRACE_COUNTER(category, name, value)                          \
+    do                                                                \
+    {                                                                 \
+        if constexpr (SHROME_TRACE_ENABLED(TRACE_LEVEL_INFO, category)) \
+        {                                                             \
+            trace_counter(category, name, value);                     \
+        }                                                             \
+    } while (0)
+
+// Stand-in for TraceScope when filtered out; optimizes away completely.
+struct TraceScopeDisabled
+{
+    TraceScopeDisabled(int, uint32_t, const char *) {}
+};
+
+#define TRACE_SCOPE(level, category, name)                                                     \
+    std::conditional_t<SHROME_TRACE_ENABLED(level, category), TraceScope, TraceScopeDisabled> \
+        SHROME_TRACE_CONCAT(trace_scope_, __LINE__)(level, category, name)
+
+#endif // TRACE_H
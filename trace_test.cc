@@ -0,0 +1,84 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include "trace.h"
+#include "unit_test.h"
+
+// The per-thread trace rings and their Chrome JSON export.
+
+namespace
+{
+
+size_t count_of(const std::string &text, const std::string &needle)
+{
+    size_t count = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + needle.size()))
+    {
+        count++;
+    }
+    return count;
+}
+
+} // namespace
+
+TEST(trace_exports_chrome_json)
+{
+    std::thread([]
+                {
+                    trace_set_thread_name("trace \"test\"");
+                    trace_instant(TRACE_LEVEL_INFO, TRACE_CAT_PAINT, "trace_test_instant", "x=%d\n", 7);
+                    trace_complete(TRACE_LEVEL_INFO, TRACE_CAT_COMPOSITE, "trace_test_complete", 100, 25);
+                    trace_counter(TRACE_CAT_PUMP, "trace_test_counter", -3);
+                })
+        .join();
+
+    std::string json = trace_chrome_json();
+    EXPECT(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    EXPECT(json.find("\"args\":{\"name\":\"trace \\\"test\\\"\"}") != std::string::npos);
+    EXPECT(json.find("\"name\":\"trace_test_instant\",\"cat\":\"paint\"") != std::string::npos);
+    EXPECT(json.find("\"args\":{\"msg\":\"x=7\\n\"}") != std::string::npos);
+    EXPECT(json.find("\"name\":\"trace_test_complete\",\"cat\":\"composite\",\"ts\":100,") != std::string::npos);
+    EXPECT(json.find("\"dur\":25}") != std::string::npos);
+    EXPECT(json.find("\"args\":{\"value\":-3}") != std::string::npos);
+}
+
+TEST(trace_exports_while_the_owner_writes)
+{
+    // Every message is the same length and says what it is, so a record
+    // mixed from two writes would show up as a mismatch
+    std::atomic<bool> done{false};
+    std::thread writer([&]
+                       {
+                           for (int i = 0; i < 4 * kTraceBufferRecords; ++i)
+                           {
+                               trace_instant(TRACE_LEVEL_INFO, TRACE_CAT_UI, "trace_test_torn", "%08d %08d", i % 100000000,
+                                             i % 100000000);
+                           }
+                           done.store(true);
+                       });
+
+    int exports = 0;
+    int torn = 0;
+    bool stop = false;
+    while (!stop)
+    {
+        stop = done.load();
+        std::string json = trace_chrome_json();
+        exports++;
+        const std::string key = "\"msg\":\"";
+        for (size_t at = json.find(key); at != std::string::npos; at = json.find(key, at + 1))
+        {
+            std::string message = json.substr(at + key.size(), 17);
+            if (message[8] == ' ' && message.compare(0, 8, message, 9, 8) != 0)
+                torn++;
+        }
+    }
+    writer.join();
+    EXPECT(exports > 0);
+    EXPECT_EQ(torn, 0);
+
+    // The ring keeps only the newest records
+    std::string json = trace_chrome_json();
+    EXPECT_EQ(count_of(json, "\"trace_test_torn\""), static_cast<size_t>(kTraceBufferRecords));
+    EXPECT(json.find(std::to_string(4 * kTraceBufferRecords - 1)) != std::string::npos);
+}
@@ -0,0 +1,65 @@
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// Just enough of a test harness for the modules that don't need CEF or a
+// GPU. Cases register themselves; unit_test_main.cc runs them.
+//
+//   TEST(region_merges_bands)
+//   {
+//       EXPECT(region.rects().size() == 1);
+//       EXPECT_EQ(region.area(), 100);
+//   }
+//
+// A failed expectation is reported and the case goes on. BENCHMARK() cases
+// only run with --bench and print their own numbers.
+
+using UnitTestFn = void (*)();
+
+struct UnitTestRegistration
+{
+    UnitTestRegistration(const char *name, UnitTestFn fn, bool benchmark);
+};
+
+void unit_test_fail(const char *file, int line, const std::string &message);
+
+#define UNIT_TEST_CASE(name, benchmark)                                                          \
+    static void unit_test_##name();                                                              \
+    static UnitTestRegistration unit_test_registration_##name(#name, unit_test_##name, benchmark); \
+    static void unit_test_##name()
+
+#define TEST(name) UNIT_TEST_CASE(name, false)
+#define BENCHMARK(name) UNIT_TEST_CASE(name, true)
+
+#define EXPECT(condition)                                   \
+    do                                                      \
+    {                                                       \
+        if (!(condition))                                   \
+            unit_test_fail(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+#define EXPECT_EQ(actual, expected)                                                       \
+    do                                                                                    \
+    {                                                                                     \
+        const auto &unit_test_actual = (actual);                                          \
+        const auto &unit_test_expected = (expected);                                      \
+        if (!(unit_test_actual == unit_test_expected))                                    \
+        {                                                                                 \
+            std::ostringstream unit_test_message;                                         \
+            unit_test_message << #actual << " == " << #expected << " (" << unit_test_actual \
+                              << " vs " << unit_test_expected << ")";                      \
+            unit_test_fail(__FILE__, __LINE__, unit_test_message.str());                  \
+        }                                                                                 \
+    } while (0)
+
+// Wall time for benchmarks, in nanoseconds.
+int64_t unit_test_now_ns();
+
+// A path for |name| in the temp directory that no other run uses. Nothing is
+// created there; the case removes what it writes.
+std::string unit_test_temp_path(const std::string &name);
+
+#endif // UNIT_TEST_H
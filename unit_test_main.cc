@@ -0,0 +1,106 @@
+// Runs the TEST() cases linked in, or with --bench the BENCHMARK() ones.
+//
+//   shrome_unit_tests [--bench] [name prefix...]
+//
+// Exits non-zero when an expectation failed.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+#include "unit_test.h"
+
+namespace
+{
+
+struct UnitTestCase
+{
+    const char *name;
+    UnitTestFn fn;
+    bool benchmark;
+};
+
+std::vector<UnitTestCase> &registry()
+{
+    static std::vector<UnitTestCase> cases;
+    return cases;
+}
+
+int g_failures = 0;
+
+bool selected(const char *name, const std::vector<const char *> &prefixes)
+{
+    if (prefixes.empty())
+        return true;
+    for (const char *prefix : prefixes)
+    {
+        if (strncmp(name, prefix, strlen(prefix)) == 0)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+UnitTestRegistration::UnitTestRegistration(const char *name, UnitTestFn fn, bool benchmark)
+{
+    registry().push_back(UnitTestCase{name, fn, benchmark});
+}
+
+void unit_test_fail(const char *file, int line, const std::string &message)
+{
+    fprintf(stderr, "%s:%d: expected %s\n", file, line, message.c_str());
+    g_failures++;
+}
+
+int64_t unit_test_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string unit_test_temp_path(const std::string &name)
+{
+    static const std::string run = std::to_string(std::random_device()());
+    return (std::filesystem::temp_directory_path() / ("shrome_test_" + run + "_" + name)).string();
+}
+
+int main(int argc, char *argv[])
+{
+    bool bench = false;
+    std::vector<const char *> prefixes;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else
+            prefixes.push_back(argv[i]);
+    }
+
+    int run = 0;
+    int failed_cases = 0;
+    for (const UnitTestCase &test : registry())
+    {
+        if (test.benchmark != bench || !selected(test.name, prefixes))
+            continue;
+
+        int failures_before = g_failures;
+        test.fn();
+        run++;
+        if (g_failures != failures_before)
+        {
+            failed_cases++;
+            fprintf(stderr, "FAILED %s\n", test.name);
+        }
+    }
+
+    printf("%d of %d %s passed\n", run - failed_cases, run, bench ? "benchmarks" : "tests");
+    if (run == 0)
+    {
+        fprintf(stderr, "nothing matched\n");
+        return 1;
+    }
+    return failed_cases ? 1 : 0;
+}
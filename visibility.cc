@@ -0,0 +1,90 @@
+#include "visibility.h"
+
+const char *view_visibility_name(ViewVisibility visibility)
+{
+    switch (visibility)
+    {
+    case ViewVisibility::Visible:
+        return "visible";
+    case ViewVisibility::Unfocused:
+        return "unfocused";
+    case ViewVisibility::Offscreen:
+        return "offscreen";
+    case ViewVisibility::Occluded:
+        return "occluded";
+    case ViewVisibility::Minimized:
+        return "minimized";
+    }
+    return "?";
+}
+
+VisibilityPolicy::VisibilityPolicy(const FrameClock &clock, const VisibilityConfig &config)
+    : m_clock(clock), m_config(config)
+{
+}
+
+ViewVisibility VisibilityPolicy::target() const
+{
+    if (m_miniaturized)
+        return ViewVisibility::Minimized;
+    if (m_occluded)
+        return ViewVisibility::Occluded;
+    if (!m_panel_visible)
+        return ViewVisibility::Offscreen;
+    if (!m_key)
+        return ViewVisibility::Unfocused;
+    return ViewVisibility::Visible;
+}
+
+bool VisibilityPolicy::update()
+{
+    int64_t now_us = m_clock.now_us();
+    if (m_last_frame_us >= 0 && paused())
+        m_stats.hidden_us += now_us - m_last_frame_us;
+    m_last_frame_us = now_us;
+
+    m_stats.frames++;
+    if (paused())
+        m_stats.paused_frames++;
+
+    ViewVisibility next = target();
+    if (next == m_state)
+    {
+        if (m_losing_since_us >= 0)
+            m_stats.debounced++;
+        m_losing_since_us = -1;
+        return false;
+    }
+
+    if (next > m_state)
+    {
+        if (m_losing_since_us < 0)
+            m_losing_since_us = now_us;
+        if (now_us - m_losing_since_us < m_config.hide_delay_us)
+            return false;
+    }
+
+    m_state = next;
+    m_losing_since_us = -1;
+    m_stats.changes++;
+    return true;
+}
+
+int VisibilityPolicy::frame_rate() const
+{
+    switch (m_state)
+    {
+    case ViewVisibility::Visible:
+        return m_config.visible_frame_rate;
+    case ViewVisibility::Unfocused:
+        return m_config.unfocused_frame_rate;
+    default:
+        return m_config.hidden_frame_rate;
+    }
+}
+
+int64_t VisibilityPolicy::begin_frame_interval_us() const
+{
+    int rate = frame_rate();
+    return rate > 0 ? 1000000 / rate : 0;
+}
@@ -0,0 +1,99 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <cstdint>
+#include "frame_scheduler.h"
+
+// How much of the view the user can see, from most to least.
+enum class ViewVisibility
+{
+    Visible,
+    Unfocused, // on screen, but another window has the keyboard
+    Offscreen, // the window is up, but the panel holding the view isn't
+    Occluded,  // the window is covered entirely
+    Minimized,
+};
+
+const char *view_visibility_name(ViewVisibility visibility);
+
+struct VisibilityConfig
+{
+    // windowless_frame_rate per state; everything from Offscreen on is
+    // WasHidden() and only paints for the keepalive BeginFrame.
+    int visible_frame_rate = 60;
+    int unfocused_frame_rate = 30;
+    int hidden_frame_rate = 1;
+    // Frames per second the UI itself draws at while the window can't be
+    // seen at all; it still has to notice when it comes back.
+    int hidden_ui_frame_rate = 10;
+    // Losing visibility has to last this long before it is acted on, so a
+    // window dragged across another one or a space switch doesn't flip it.
+    // Getting it back is acted on right away.
+    int64_t hide_delay_us = 250000;
+};
+
+struct VisibilityStats
+{
+    uint64_t frames = 0;
+    uint64_t paused_frames = 0; // no upload or layer build
+    uint64_t changes = 0;
+    uint64_t debounced = 0;     // losses that were over before hide_delay_us
+    int64_t hidden_us = 0;      // time spent paused
+};
+
+// Combines what the platform says about the window (occluded, minimized,
+// key) and what the UI says about the panel into one state, and from it the
+// frame rate the browser should run at and whether the host renders at all.
+//
+// Knows nothing about AppKit or CEF: metal_view.mm feeds the signals,
+// MyApp applies the result.
+//
+// Single threaded; fed once per display frame.
+class VisibilityPolicy
+{
+public:
+    explicit VisibilityPolicy(const FrameClock &clock, const VisibilityConfig &config = VisibilityConfig());
+
+    void set_window_occluded(bool occluded) { m_occluded = occluded; }
+    void set_miniaturized(bool miniaturized) { m_miniaturized = miniaturized; }
+    void set_key_window(bool key) { m_key = key; }
+    void set_panel_visible(bool visible) { m_panel_visible = visible; }
+
+    // What the signals say right now, before any debouncing.
+    ViewVisibility target() const;
+
+    // A display frame at now(). Returns true when state() changed.
+    bool update();
+
+    ViewVisibility state() const { return m_state; }
+    // Nothing of the view can be seen: the browser is hidden and the host
+    // skips uploading and building the layers.
+    bool paused() const { return m_state >= ViewVisibility::Offscreen; }
+    bool window_visible() const { return m_state <= ViewVisibility::Offscreen; }
+
+    int frame_rate() const;
+    // 0 for the display's own rate
+    int ui_frame_rate() const { return window_visible() ? 0 : m_config.hidden_ui_frame_rate; }
+    // Least time between two BeginFrames at frame_rate()
+    int64_t begin_frame_interval_us() const;
+
+    const VisibilityConfig &config() const { return m_config; }
+    const VisibilityStats &stats() const { return m_stats; }
+    void reset_stats() { m_stats = VisibilityStats(); }
+
+private:
+    const FrameClock &m_clock;
+    VisibilityConfig m_config;
+
+    bool m_occluded = false;
+    bool m_miniaturized = false;
+    bool m_key = true;
+    bool m_panel_visible = true;
+
+    ViewVisibility m_state = ViewVisibility::Visible;
+    int64_t m_losing_since_us = -1; // target() less visible than state() since
+    int64_t m_last_frame_us = -1;
+    VisibilityStats m_stats;
+};
+
+#endif // VISIBILITY_H
@@ -0,0 +1,155 @@
+#include "unit_test.h"
+#include "visibility.h"
+
+// VisibilityPolicy on a VirtualFrameClock, updated at 60 Hz.
+
+namespace
+{
+
+const int64_t kFrameUs = 16667;
+
+struct Window
+{
+    VirtualFrameClock clock;
+    VisibilityPolicy policy{clock};
+
+    bool frame()
+    {
+        clock.advance_us(kFrameUs);
+        return policy.update();
+    }
+
+    // Time from now until the state changes, or -1 within |limit_us|
+    int64_t until_change(int64_t limit_us = 1000000)
+    {
+        int64_t start = clock.now_us();
+        while (clock.now_us() - start < limit_us)
+        {
+            if (frame())
+                return clock.now_us() - start;
+        }
+        return -1;
+    }
+};
+
+} // namespace
+
+TEST(visibility_hide_is_debounced)
+{
+    Window window;
+    EXPECT(!window.frame());
+    EXPECT(window.policy.state() == ViewVisibility::Visible);
+
+    // The first frame that sees the loss starts the delay
+    window.policy.set_window_occluded(true);
+    EXPECT(window.policy.target() == ViewVisibility::Occluded);
+    int64_t first_seen = window.clock.now_us() + kFrameUs;
+    int64_t took = window.until_change();
+    int64_t delay = window.policy.config().hide_delay_us;
+    EXPECT(window.clock.now_us() - first_seen >= delay);
+    EXPECT(window.clock.now_us() - first_seen < delay + kFrameUs);
+    EXPECT(took > delay);
+    EXPECT(window.policy.state() == ViewVisibility::Occluded);
+    EXPECT_EQ(window.policy.stats().changes, 1u);
+
+    // Minimized while occluded is another loss, delayed the same way
+    window.policy.set_miniaturized(true);
+    EXPECT(!window.frame());
+    EXPECT(window.until_change() >= delay - kFrameUs);
+    EXPECT(window.policy.state() == ViewVisibility::Minimized);
+}
+
+TEST(visibility_show_is_immediate)
+{
+    Window window;
+    window.policy.set_miniaturized(true);
+    window.until_change();
+    EXPECT(window.policy.state() == ViewVisibility::Minimized);
+
+    // Partly back: straight to what it is now
+    window.policy.set_miniaturized(false);
+    window.policy.set_key_window(false);
+    EXPECT(window.frame());
+    EXPECT(window.policy.state() == ViewVisibility::Unfocused);
+
+    window.policy.set_key_window(true);
+    EXPECT(window.frame());
+    EXPECT(window.policy.state() == ViewVisibility::Visible);
+    EXPECT_EQ(window.policy.stats().debounced, 0u);
+}
+
+TEST(visibility_flap_is_counted_as_debounced)
+{
+    Window window;
+    window.frame();
+
+    // Dragged across another window for 100 ms
+    window.policy.set_window_occluded(true);
+    for (int i = 0; i < 6; ++i)
+    {
+        EXPECT(!window.frame());
+    }
+    window.policy.set_window_occluded(false);
+    EXPECT(!window.frame());
+    EXPECT(window.policy.state() == ViewVisibility::Visible);
+    EXPECT_EQ(window.policy.stats().debounced, 1u);
+    EXPECT_EQ(window.policy.stats().changes, 0u);
+    EXPECT_EQ(window.policy.stats().paused_frames, 0u);
+
+    // A later loss gets the whole delay again
+    window.policy.set_key_window(false);
+    EXPECT(window.until_change() > window.policy.config().hide_delay_us);
+    EXPECT(window.policy.state() == ViewVisibility::Unfocused);
+}
+
+TEST(visibility_states_map_to_frame_rates)
+{
+    struct Expected
+    {
+        ViewVisibility state;
+        int frame_rate;
+        bool paused;
+        bool window_visible;
+    };
+    const VisibilityConfig config;
+    const Expected expected[] = {
+        {ViewVisibility::Visible, config.visible_frame_rate, false, true},
+        {ViewVisibility::Unfocused, config.unfocused_frame_rate, false, true},
+        {ViewVisibility::Offscreen, config.hidden_frame_rate, true, true},
+        {ViewVisibility::Occluded, config.hidden_frame_rate, true, false},
+        {ViewVisibility::Minimized, config.hidden_frame_rate, true, false},
+    };
+
+    // Each step loses a little more
+    Window window;
+    window.frame();
+    for (const Expected &step : expected)
+    {
+        if (step.state == ViewVisibility::Unfocused)
+            window.policy.set_key_window(false);
+        else if (step.state == ViewVisibility::Offscreen)
+            window.policy.set_panel_visible(false);
+        else if (step.state == ViewVisibility::Occluded)
+            window.policy.set_window_occluded(true);
+        else if (step.state == ViewVisibility::Minimized)
+            window.policy.set_miniaturized(true);
+        if (step.state != ViewVisibility::Visible)
+            window.until_change();
+
+        EXPECT(window.policy.state() == step.state);
+        EXPECT_EQ(window.policy.frame_rate(), step.frame_rate);
+        EXPECT_EQ(window.policy.begin_frame_interval_us(), 1000000 / step.frame_rate);
+        EXPECT_EQ(window.policy.paused(), step.paused);
+        EXPECT_EQ(window.policy.window_visible(), step.window_visible);
+        EXPECT_EQ(window.policy.ui_frame_rate(), step.window_visible ? 0 : config.hidden_ui_frame_rate);
+    }
+
+    // Time spent paused is counted
+    window.policy.reset_stats();
+    for (int i = 0; i < 60; ++i)
+    {
+        window.frame();
+    }
+    EXPECT_EQ(window.policy.stats().paused_frames, 60u);
+    EXPECT_EQ(window.policy.stats().hidden_us, 60 * kFrameUs);
+}